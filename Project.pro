@@ -71,6 +71,15 @@ LIBS += \
   -ldl \
   -pthread 
 
+# Transcode KTX2/Basis Universal textures, enable with qmake CONFIG+=basisu.
+# Requires the basis_universal transcoder, built with KTX2 and zstd support,
+# e.g. cloned in to dep/basis_universal
+basisu {
+  message("Building with KTX2 transcoding")
+  DEFINES += QFP_BASISU
+  LIBS += -lbasisu_transcoder -lzstd
+}
+
 # Need this to find metal symbols
 macx:{
     QMAKE_CXXFLAGS += -x objective-c++
@@ -0,0 +1,117 @@
+#ifndef APP_OPTIONS
+#define APP_OPTIONS
+
+#include "upload_budget.h"
+#include <QString>
+#include <QStringList>
+#include <filament/Engine.h>
+
+// Options controlling how the application runs, parsed from the command line
+struct AppOptions
+{
+  // Render offscreen without creating any windows
+  bool headless = false;
+  // Redraw every display refresh, rather than only when something changes
+  bool continuous = false;
+  // The back-end we want filament to use for rendering, from --backend or
+  // --noop, which can't name different ones, or the QFP_BACKEND environment
+  // variable if neither was given
+  filament::Engine::Backend backend = filament::Engine::Backend::OPENGL;
+  // Benchmark the same scene and camera path on every back-end
+  bool backend_compare = false;
+  // Orbit the camera around the scene in headless mode, the same views are
+  // seen in every run
+  bool camera_path = false;
+  // Frame rate the quality governor aims to hold, zero to always render at
+  // full quality. Windows aim for 60 unless told otherwise, headless runs only
+  // govern when given a target, so benchmarks are repeatable.
+  double target_fps = 60.0;
+  // Frames a window accumulates in to a still image once its camera comes to
+  // rest, after which it stops drawing, zero to render every frame the same
+  // way
+  uint32_t refine_frames = 32;
+  // Number of frames to measure in headless mode
+  uint32_t frames = 300;
+  // Number of frames to render before measuring in headless mode
+  uint32_t warmup_frames = 10;
+  // Number of views of the shared scene to render
+  uint32_t views = 1;
+  // Give each view its own top level window, spread across the screens,
+  // rather than a grid within one window
+  bool separate_windows = false;
+  // Benchmark the views sharing one engine against a process per view
+  bool views_compare = false;
+  // Offscreen swap chain dimensions in headless mode
+  uint32_t width = 1280;
+  uint32_t height = 720;
+  // Path to write the JSON benchmark summary to, stdout if empty
+  QString json_path;
+  // Scene manifest to load, the default scene if empty
+  QString scene_path;
+  // Number of instances in a generated grid scene, used if non-zero and no
+  // manifest was provided
+  uint32_t instances = 0;
+  // Number of distinct material looks the generated grid cycles through
+  uint32_t looks = 1;
+  // Benchmark load and frame times at increasing instance counts
+  bool stress = false;
+  // Select mesh levels of detail from their projected size
+  bool lods = true;
+  // Benchmark a dense instanced scene with levels of detail on and off
+  bool lod_compare = false;
+  // Record CPU timings of each frame and startup phase
+  bool profile = false;
+  // Path to write a Chrome trace of the recorded timings to on exit, implies
+  // profiling
+  QString trace_path;
+  // Equirectangular HDR image to bake the image based lighting from,
+  // overriding the scene's environment
+  QString environment_path;
+  // Bytes of texture levels to upload per frame, zero for no limit
+  std::size_t upload_budget = DEFAULT_UPLOAD_BUDGET;
+  // Prefer KTX2 textures transcoded to a compressed format where they exist
+  bool compressed_textures = true;
+  // Name of the local socket to serve render jobs on
+  QString serve_name;
+  // Batch job of thumbnails and turntables to render offscreen
+  QString batch_path;
+  // Path to render a poster of the scene to, a tiled TIFF the size given by
+  // --size
+  QString poster_path;
+  // Width and height of the tiles a poster is rendered in
+  uint32_t tile_size = 2048;
+  // Benchmark the uncompressed textures against the transcoded KTX2 ones
+  bool texture_compare = false;
+  // Number of entities to benchmark creating and destroying through the
+  // resource registry, skipped if zero
+  uint32_t registry_bench = 0;
+  // Animate every instance, updating its transform each frame
+  bool animate = false;
+  // Most threads to update transforms with, zero to use every worker
+  std::size_t transform_threads = 0;
+  // Benchmark animating a dense grid on one thread against every worker
+  bool crowd = false;
+  // Multi mesh scenes to import in to the scene, keeping their hierarchy
+  QStringList import_paths;
+  // Scene to benchmark converting on one thread and every worker, skipped if
+  // empty
+  QString import_bench_path;
+  // Benchmark picking latency at increasing triangle counts
+  bool pick_bench = false;
+  // HDR image to benchmark image based lighting bakes with, skipped if empty
+  QString bake_bench_path;
+};
+
+// Name of a back-end, as accepted by --backend
+const char* backend_name(filament::Engine::Backend i_backend);
+
+// Find the back-end with this name, ignoring case. Returns false if it isn't
+// one we support.
+bool parse_backend(const QString& i_name, filament::Engine::Backend& o_backend);
+
+// Parse our options from the raw command line arguments. This does not
+// require a Qt application to exist, as we need to know whether we're running
+// headless before we create one.
+AppOptions parse_app_options(int argc, char* argv[]);
+
+#endif  // APP_OPTIONS
@@ -2,7 +2,9 @@
 #define APP_WINDOW
 
 #include <memory>
+#include <vector>
 #include <QMainWindow>
+#include <QTimer>
 #include "ui_applayout.h"
 
 // Forward declare our native window widget, could include it instead
@@ -21,17 +23,27 @@ public:
   explicit AppWindow(QWidget *io_parent = nullptr) noexcept;
   // Default destructor
   ~AppWindow() override = default;
-  // Used to initialize the application window with a native window widget, 
-  // placing it as the central widget.
-  void init(std::shared_ptr<NativeWindowWidget> i_window);
+  // Used to initialize the application window with native window widgets,
+  // laid out in a grid as the central widget.
+  void init(std::vector<std::shared_ptr<NativeWindowWidget>> i_windows);
+  // Show the recent timings of each profiled scope in the status bar, this
+  // also enables the profiler while visible
+  void set_stats_visible(bool i_visible);
+  // Where pressing T writes a Chrome trace of the recorded timings
+  void set_trace_path(QString i_path);
 
 private:
   // Used to handle a key press, will get delegated to the scene.
   void keyPressEvent(QKeyEvent * io_event) override;
+  // Refresh the profiler statistics shown in the status bar
+  void update_stats();
   // The Qt UI form.
   Ui::AppLayout m_ui_layout;
-  // A pointer to the native window that should be placed in the central widget.
-  std::shared_ptr<NativeWindowWidget> m_native_window = nullptr;
+  // Pointers to the native windows that are placed in the central widget.
+  std::vector<std::shared_ptr<NativeWindowWidget>> m_native_windows;
+  // Periodically refreshes the statistics readout
+  QTimer m_stats_timer;
+  QString m_trace_path = "trace.json";
 
 };
 
@@ -0,0 +1,130 @@
+#ifndef ASSET_LOADER
+#define ASSET_LOADER
+
+#include "thread_pool.h"
+#include <QJsonArray>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// When each stage of a load ran, in milliseconds since the loader was
+// created. Marks, such as the first frame, have every time equal.
+struct LoadStage
+{
+  // A mark at the given time
+  static LoadStage instant(std::string i_name, double i_ms);
+
+  std::string name;
+  double enqueued_ms = 0.0;
+  double worker_begin_ms = 0.0;
+  double worker_end_ms = 0.0;
+  double finalize_begin_ms = 0.0;
+  double finalize_end_ms = 0.0;
+};
+
+// Loads assets in two stages. The first stage parses files and builds CPU side
+// buffers on worker threads, and produces a finalizer. The finalizer is run on
+// the engine thread, when it calls pump, to create the engine objects. Loads
+// form a dependency graph, every worker stage starts as soon as a thread is
+// free, but a finalizer can be held back until the finalizers of the loads it
+// depends on have run.
+class AssetLoader
+{
+public:
+  // Runs on the engine thread to create engine objects from CPU side data
+  using Finalizer = std::function<void()>;
+  // Runs on a worker thread, returning the finalizer for the loaded data
+  using Loader = std::function<Finalizer()>;
+  // Identifies an enqueued load, so later loads may depend on it
+  using Task = std::size_t;
+
+  explicit AssetLoader(ThreadPool& io_pool = ThreadPool::global());
+  // Copying is disallowed as finalizers are run exactly once
+  AssetLoader(const AssetLoader&) = delete;
+  AssetLoader& operator=(const AssetLoader&) = delete;
+  AssetLoader(AssetLoader&&) = default;
+  // Assigning would abandon our loads without waiting for them
+  AssetLoader& operator=(AssetLoader&&) = delete;
+  // Waits for any worker stages still running, as they may refer to the
+  // objects being loaded in to. Unfinished loads are abandoned, their
+  // finalizers never run.
+  ~AssetLoader();
+
+  // Begin loading an asset on a worker thread, the name is used for reporting.
+  // Its finalizer runs only after those of the given loads, which must already
+  // have been enqueued. If any of them failed, this load fails too without
+  // running its finalizer. Must be called from the engine thread.
+  Task enqueue(std::string i_name,
+               Loader i_loader,
+               std::vector<Task> i_after = {});
+
+  // Run the finalizers for all loads that have finished on a worker. Must be
+  // called from the engine thread. Returns the number of assets finalized.
+  std::size_t pump();
+
+  // Block until all queued loads have been finalized. Must be called from the
+  // engine thread.
+  void wait();
+
+  // Number of assets which have not yet been finalized
+  std::size_t pending() const noexcept;
+
+  // Number of assets whose worker stage failed, or which depended on one
+  // that did
+  std::size_t failed() const noexcept;
+
+  // Record an instant in the timeline, such as the first frame drawn
+  void mark(std::string i_name);
+
+  // Milliseconds since the loader was created, the timeline's clock
+  double elapsed_ms() const noexcept;
+
+  // Every load and mark so far, in the order they were enqueued
+  const std::vector<LoadStage>& timeline() const noexcept;
+
+private:
+  // A load that has finished on a worker
+  struct Completion
+  {
+    Task task;
+    // Empty if the worker stage failed
+    Finalizer finalizer;
+    std::chrono::steady_clock::time_point worker_begin;
+    std::chrono::steady_clock::time_point worker_end;
+  };
+  struct Completions;
+
+  // Whether every load this one depends on has been finalized
+  bool ready(Task i_task) const noexcept;
+
+  void finalize(Completion& io_completion);
+
+  ThreadPool* m_pool;
+  // Shared with the worker tasks so they may outlive the loader
+  std::shared_ptr<Completions> m_completions;
+  std::size_t m_pending = 0;
+  std::size_t m_failed = 0;
+  std::chrono::steady_clock::time_point m_start;
+  // Indexed by task
+  std::vector<LoadStage> m_timeline;
+  std::vector<std::vector<Task>> m_after;
+  std::vector<uint8_t> m_finalized;
+  // Set for failed loads, which count as finalized so their dependents are
+  // released, and fail
+  std::vector<uint8_t> m_failed_tasks;
+  // Loads finished on a worker whose dependencies haven't been finalized
+  std::vector<Completion> m_deferred;
+};
+
+// Draw the timeline as a chart, one row per load, showing the time waiting
+// for a worker, on the worker, waiting to be finalized and being finalized
+void print_timeline(std::ostream& io_os,
+                    const std::vector<LoadStage>& i_stages);
+
+// Machine readable representation of the timeline
+QJsonArray to_json(const std::vector<LoadStage>& i_stages);
+
+#endif  // ASSET_LOADER
@@ -0,0 +1,78 @@
+#ifndef BATCH_JOB
+#define BATCH_JOB
+
+#include "scene_manifest.h"
+#include "trackball_camera.h"
+#include <QJsonObject>
+#include <QString>
+#include <math/vec3.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A list of assets to render thumbnails or turntables of, each from orbits of
+// viewpoints about a target. Jobs are stored as JSON:
+// {
+//   "output": "thumbnails",
+//   "format": "png",
+//   "size": [256, 256],
+//   "assets": [
+//     {
+//       "name": "helmet",
+//       "scene": "assets/scenes/helmet.json",
+//       "import": "assets/models/helmet.gltf",
+//       "orbits": [
+//         {"views": 24, "yaw": 0, "elevation": 20, "distance": 4,
+//          "target": [x, y, z]}
+//       ]
+//     }
+//   ]
+// }
+// Each asset is either a scene manifest or a scene to import, or the default
+// scene if neither is given, and is named after its file if it has no name.
+// An orbit's views are spread evenly around the up axis starting from its
+// yaw, looking down at its target from its elevation, both in degrees. An
+// asset with no orbits is rendered once from the default view point. Images
+// are written to <output>/<name>/<orbit>_<view>.<format>, in any format Qt
+// can write.
+struct BatchJob
+{
+  struct Orbit
+  {
+    uint32_t views = 1;
+    float yaw = 0.f;
+    float elevation = 0.f;
+    float distance = 4.f;
+    filament::math::float3 target{0.f};
+
+    // The camera placed at one of the views
+    TrackballCamera camera(uint32_t i_view = 0) const;
+  };
+
+  struct Asset
+  {
+    std::string name;
+    // The manifest or imported file, empty for the default scene
+    std::string source;
+    SceneManifest manifest;
+    std::vector<Orbit> orbits;
+  };
+
+  // Parse a job from a JSON file, throws on failure
+  static BatchJob load(const QString& i_path);
+
+  // Parse a single asset or orbit, as they appear in a job file
+  static Asset load_asset(const QJsonObject& i_object);
+  static Orbit load_orbit(const QJsonObject& i_object);
+
+  // Total number of images across every asset
+  std::size_t image_count() const noexcept;
+
+  std::string output_directory = "thumbnails";
+  std::string format = "png";
+  uint32_t width = 256;
+  uint32_t height = 256;
+  std::vector<Asset> assets;
+};
+
+#endif  // BATCH_JOB
@@ -0,0 +1,103 @@
+#ifndef BATCH_RENDERER
+#define BATCH_RENDERER
+
+#include "batch_job.h"
+#include "camera_frustum.h"
+#include <QJsonObject>
+#include <filament/Engine.h>
+#include <nonstd/value_ptr.hpp>
+#include <functional>
+#include <memory>
+#include <ostream>
+
+class PbrScene;
+class TrackballCamera;
+
+// Throughput of a batch render
+struct BatchReport
+{
+  std::size_t assets = 0;
+  std::size_t images = 0;
+  // Images which couldn't be written
+  std::size_t failed = 0;
+  // Time spent loading assets, and rendering their views until every image
+  // had been written
+  double load_ms = 0.0;
+  double render_ms = 0.0;
+  // Time the render loop spent waiting for a readback buffer to be free
+  double stall_ms = 0.0;
+  double total_ms = 0.0;
+};
+
+// Renders every view point of a batch job in to an offscreen swap chain,
+// which uses the same scene set-up as the interactive window. Each frame is
+// read back asynchronously in to the next of a ring of buffers, so the
+// readback overlaps drawing the following frames, and the images are encoded
+// and written on the thread pool. Filament calls back from its driver thread
+// once the pixels have arrived, and a buffer is only reused once a worker has
+// copied them out, so a full ring stalls the render loop rather than dropping
+// frames.
+class BatchRenderer
+{
+public:
+  // Told whether an image was written, on the worker which wrote it
+  using WriteCallback = std::function<void(bool i_written)>;
+  // Handed a frame's pixels on a worker, tightly packed RGBA rows from the
+  // bottom up, it copies out whatever it needs while the buffer is held, and
+  // returns the rest of the work, which runs once the buffer is free for
+  // another frame and returns whether the image was written. Neither may
+  // throw.
+  using PixelSink = std::function<std::function<bool()>(
+    const uint8_t* i_rgba, uint32_t i_width, uint32_t i_height)>;
+
+  BatchRenderer(std::shared_ptr<filament::Engine> i_engine,
+                uint32_t i_width,
+                uint32_t i_height,
+                std::size_t i_ring_size = 3);
+  ~BatchRenderer();
+
+  // Load each asset in turn and render all of its views, blocking until
+  // every image has been written. Throws if an asset fails to load.
+  BatchReport render(const BatchJob& i_job);
+
+  // Draw a single view of a scene loaded elsewhere, and write the image
+  // asynchronously. The scene only has to outlive this call.
+  void render_view(PbrScene& io_scene,
+                   const TrackballCamera& i_camera,
+                   const QString& i_path,
+                   const std::string& i_format,
+                   WriteCallback i_on_written = {});
+
+  // Draw a single view of a scene loaded elsewhere, handing the pixels to the
+  // sink once they've been read back
+  void render_view(PbrScene& io_scene,
+                   const TrackballCamera& i_camera,
+                   PixelSink i_sink,
+                   WriteCallback i_on_written = {});
+
+  // Replace the projection of the views drawn from now on, which matches the
+  // interactive window by default
+  void set_frustum(const CameraFrustum& i_frustum);
+
+  // Enable shadows in the views drawn from now on, which they are by default
+  void set_shadows_enabled(bool i_enabled);
+
+  // Wait for every image to be written
+  void wait();
+
+  // Total time spent waiting for a readback buffer to be free
+  double stall_ms() const noexcept;
+
+private:
+  struct BatchRendererImpl;
+  // Value semantics for a smart pointer, automatically deep copies
+  nonstd::value_ptr<BatchRendererImpl> m_impl;
+};
+
+// Human readable representation of a report
+std::ostream& operator<<(std::ostream& io_os, const BatchReport& i_report);
+
+// Machine readable representation of a report
+QJsonObject to_json(const BatchReport& i_report);
+
+#endif  // BATCH_RENDERER
@@ -0,0 +1,28 @@
+#ifndef BENCHMARKS
+#define BENCHMARKS
+
+#include "app_options.h"
+#include "scene_manifest.h"
+#include <QJsonValue>
+#include <filament/Engine.h>
+#include <memory>
+
+// Create a filament engine on the calling thread, using the requested
+// back-end. Throws if the back-end isn't available.
+std::shared_ptr<filament::Engine>
+create_engine(filament::Engine::Backend i_backend);
+
+// The scene requested on the command line, either a manifest file, a grid of
+// instances or the default scene, along with any scenes to import
+SceneManifest load_scene_manifest(const AppOptions& i_options);
+
+// Run the headless benchmarks selected by the options, printing human
+// readable results and a JSON summary. Returns the process exit code.
+int run_benchmarks(const AppOptions& i_options);
+
+// Write the JSON summary to the path given in the options, or stdout if none
+// was given. Returns the process exit code.
+int write_json_summary(const QJsonValue& i_summary,
+                       const AppOptions& i_options);
+
+#endif  // BENCHMARKS
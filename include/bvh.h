@@ -0,0 +1,130 @@
+#ifndef BVH
+#define BVH
+
+#include <math/vec3.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Bounding volume hierarchies over axis aligned boxes, used to find which
+// primitives a ray hits without testing every one of them. The same tree is
+// used over the triangles of a mesh, and over the instances of a scene.
+namespace bvh
+{
+struct Aabb
+{
+  filament::math::float3 min{1e30f};
+  filament::math::float3 max{-1e30f};
+
+  void extend(const filament::math::float3& i_point) noexcept;
+  void extend(const Aabb& i_box) noexcept;
+  filament::math::float3 center() const noexcept;
+  // Half the surface area, enough to compare the cost of splits
+  float half_area() const noexcept;
+};
+
+// A ray with its reciprocal direction precomputed for the slab test
+struct Ray
+{
+  Ray() = default;
+  Ray(const filament::math::float3& i_origin,
+      const filament::math::float3& i_direction) noexcept;
+
+  filament::math::float3 origin;
+  filament::math::float3 direction;
+  filament::math::float3 inverse_direction;
+};
+
+// Interior nodes have no primitives, and their children are stored next to
+// each other at the first index. Leaves hold a range of the primitive order.
+struct Node
+{
+  Aabb bounds;
+  uint32_t first = 0;
+  uint32_t count = 0;
+};
+
+struct Tree
+{
+  std::vector<Node> nodes;
+  // Primitive indices in leaf order
+  std::vector<uint32_t> order;
+};
+
+// Build a tree over the primitives' boxes, choosing each split with the
+// binned surface area heuristic
+Tree build(const std::vector<Aabb>& i_bounds);
+
+// Recompute the nodes' boxes after the primitives moved, keeping the tree's
+// structure. Much cheaper than a rebuild, though the tree degrades as the
+// primitives drift from where it was built.
+void refit(Tree& io_tree, const std::vector<Aabb>& i_bounds);
+
+// Slab test of a ray against a box, giving the distance it enters the box
+inline bool intersect(const Aabb& i_box,
+                      const Ray& i_ray,
+                      float i_t_max,
+                      float& o_t_near) noexcept
+{
+  const auto t0 = (i_box.min - i_ray.origin) * i_ray.inverse_direction;
+  const auto t1 = (i_box.max - i_ray.origin) * i_ray.inverse_direction;
+  const auto near = min(t0, t1);
+  const auto far = max(t0, t1);
+  o_t_near = std::max(std::max(near.x, near.y), std::max(near.z, 0.f));
+  const float t_far =
+    std::min(std::min(far.x, far.y), std::min(far.z, i_t_max));
+  return o_t_near <= t_far;
+}
+
+// Visit the leaves a ray may enter before io_t_max, nearer children first,
+// calling i_leaf(first, count) with their range of the primitive order. The
+// callback lowers io_t_max whenever it finds a closer hit, which culls the
+// rest of the traversal.
+template <typename F>
+void traverse(const Tree& i_tree, const Ray& i_ray, float& io_t_max, F&& i_leaf)
+{
+  float t = 0.f;
+  if (i_tree.nodes.empty() ||
+      !intersect(i_tree.nodes.front().bounds, i_ray, io_t_max, t))
+    return;
+  // Each entry holds a node and the distance the ray enters it
+  thread_local std::vector<std::pair<uint32_t, float>> stack;
+  stack.clear();
+  stack.emplace_back(0, t);
+  while (!stack.empty())
+  {
+    const auto entry = stack.back();
+    stack.pop_back();
+    // Skip nodes beyond a hit found since they were pushed
+    if (entry.second > io_t_max)
+      continue;
+    const auto& node = i_tree.nodes[entry.first];
+    if (node.count)
+    {
+      i_leaf(node.first, node.count);
+      continue;
+    }
+    float t_left = 0.f, t_right = 0.f;
+    const bool left = intersect(
+      i_tree.nodes[node.first].bounds, i_ray, io_t_max, t_left);
+    const bool right = intersect(
+      i_tree.nodes[node.first + 1].bounds, i_ray, io_t_max, t_right);
+    // Push the farther child first, so the nearer one is visited next
+    if (left && right && t_left < t_right)
+    {
+      stack.emplace_back(node.first + 1, t_right);
+      stack.emplace_back(node.first, t_left);
+    }
+    else
+    {
+      if (left)
+        stack.emplace_back(node.first, t_left);
+      if (right)
+        stack.emplace_back(node.first + 1, t_right);
+    }
+  }
+}
+}  // namespace bvh
+
+#endif  // BVH
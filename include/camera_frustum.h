@@ -0,0 +1,36 @@
+#ifndef CAMERA_FRUSTUM
+#define CAMERA_FRUSTUM
+
+#include <filament/Camera.h>
+#include <cstdint>
+
+// The window of the near plane a perspective camera sees through, which can
+// be split in to off-center windows to render an image in tiles
+struct CameraFrustum
+{
+  // The projection every view of our scene uses, a 45 degree vertical field
+  // of view with the given aspect ratio
+  static CameraFrustum perspective(double i_aspect);
+
+  // The part of this frustum seen by a rectangle of pixels within an image of
+  // the given size, rows counted down from the top. The rectangle may extend
+  // past any side of the image, in which case so does the frustum.
+  CameraFrustum tile(int32_t i_x,
+                     int32_t i_y,
+                     uint32_t i_width,
+                     uint32_t i_height,
+                     uint32_t i_image_width,
+                     uint32_t i_image_height) const noexcept;
+
+  // Set the camera's projection to this frustum
+  void apply(filament::Camera& io_camera) const;
+
+  double left;
+  double right;
+  double bottom;
+  double top;
+  double z_near;
+  double z_far;
+};
+
+#endif  // CAMERA_FRUSTUM
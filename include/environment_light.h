@@ -2,14 +2,52 @@
 #define ENVIRONMENT_LIGHT
 
 #include "filament_raii.h"
+#include "ktx_mapping.h"
+#include "ktx2_texture.h"
+#include "texture_streamer.h"
 #include <utils/Path.h>
 #include <math/vec3.h>
 #include <array>
+#include <functional>
+
+// CPU side data for an environment, mapped from disk or transcoded. This does
+// not touch the engine so can be read on any thread. Each texture is either
+// a KTX mapping or a transcoded KTX2 texture.
+struct EnvironmentData
+{
+  std::shared_ptr<KtxMapping> m_ibl_ktx;
+  std::shared_ptr<KtxMapping> m_skybox_ktx;
+  std::shared_ptr<Ktx2Texture> m_ibl_ktx2;
+  std::shared_ptr<Ktx2Texture> m_skybox_ktx2;
+  std::array<filament::math::float3, 9> m_ibl_bands;
+};
 
 struct EnvironmentLight
 {
   EnvironmentLight(const std::shared_ptr<filament::Engine>& i_engine);
 
+  // Map the environment from disk, safe to call from any thread. With KTX2
+  // enabled, a .ktx2 file next to either KTX file is transcoded and used in
+  // its place, falling back to the uncompressed KTX file if it can't be.
+  static std::unique_ptr<EnvironmentData>
+  read_ibl(const utils::Path& i_ibl_path,
+           const utils::Path& i_skybox_path,
+           bool i_ktx2 = false);
+
+  // Create our engine objects from previously read data, must be called from
+  // the engine thread. Given a streamer, the mapped textures start with only
+  // their smallest level, and are replaced as the rest stream in, so the
+  // streamer must not outlive us.
+  void create_ibl(EnvironmentData&& io_data,
+                  TextureStreamer* io_streamer = nullptr);
+
+  // Take ownership of a new reflections texture or skybox texture, and
+  // rebuild the indirect light or skybox that uses it. Without reflections
+  // the light uses only the irradiance harmonics.
+  void set_ibl_texture(filament::Texture* i_texture);
+  void set_skybox_texture(filament::Texture* i_texture);
+
+  // Read and create the environment on the calling thread
   void load_ibl(const utils::Path& i_ibl_path,
                 const utils::Path& i_skybox_path);
 
@@ -19,7 +57,11 @@ struct EnvironmentLight
   FilamentScopedPointer<filament::IndirectLight> m_indirect_light;
   FilamentScopedPointer<filament::Texture> m_skybox_texture;
   FilamentScopedPointer<filament::Skybox> m_skybox;
-  FilamentScopedPointer<filament::Material> m_transparent_material;
+  // Format, memory and upload time of the IBL and skybox textures
+  std::vector<TextureReport> m_texture_reports;
+  // Called whenever the indirect light or skybox is replaced, before the
+  // previous one is destroyed
+  std::function<void()> m_changed;
 };
 
 
@@ -2,34 +2,49 @@
 #define FILAMENT_WINDOW_WIDGET
 
 #include "native_window_widget.h"
-#include "environment_light.h"
-#include <filameshio/MeshReader.h>
+#include "scene_picker.h"
+#include "shared_scene.h"
+#include <filament/Engine.h>
 #include <nonstd/value_ptr.hpp>
 #include <math/vec2.h>
 #include <math/quat.h>
 
-// Our filament rendering window
+// Our filament rendering window. Any number of windows can render the same
+// shared scene, each with its own swap chain, view and camera.
 class FilamentWindowWidget final : public NativeWindowWidget
 {
 public:
   explicit FilamentWindowWidget(QWidget* i_parent,
-                                std::shared_ptr<filament::Engine> i_engine);
+                                std::shared_ptr<SharedScene> i_scene);
   ~FilamentWindowWidget();
 
   virtual void mousePressEvent(QMouseEvent* i_mouse_event) override;
 
   virtual void mouseMoveEvent(QMouseEvent* i_mouse_event) override;
 
+  // Frame rate to hold by stepping down through quality tiers, zero to always
+  // render at full quality
+  void set_target_fps(double i_target_fps);
+
+  // Frames to accumulate in to a still image once the camera comes to rest,
+  // zero to render every frame the same way
+  void set_refine_frames(uint32_t i_frames);
+
+  // Whatever the last click selected, if anything. Picks run on the render
+  // thread, so this updates shortly after the click.
+  const PickResult& selection() const noexcept;
+
 private:
-  void calculate_camera_view();
+  void apply_pending_input();
 
-  void calculate_camera_projection();
+  void camera_idle();
 
-  void init_materials();
+  // Select the instance under a point in the window, on the render thread
+  void pick(filament::math::float2 i_position);
 
-  void init_meshes();
+  void calculate_camera_view();
 
-  void init_lighting();
+  void calculate_camera_projection();
 
   virtual void init_impl(void* io_native_window) override;
 
@@ -40,6 +55,7 @@ private:
   virtual void closeEvent(QCloseEvent* i_event) override;
 
 private:
+  struct RenderState;
   struct FilamentWindowWidgetImpl;
   // Value semantics for a smart pointer, automatically deep copies
   nonstd::value_ptr<FilamentWindowWidgetImpl> m_impl;
@@ -0,0 +1,94 @@
+#ifndef FILAMESH_FILE
+#define FILAMESH_FILE
+
+#include <math/vec3.h>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Mirror of the on disk layout of a filamesh file, as read by
+// filamesh::MeshReader. MeshReader only exposes the renderable it creates, so
+// we parse the file ourselves when we need the individual parts, for example
+// to build further renderables sharing the same buffers.
+namespace filamesh_file
+{
+struct Box
+{
+  filament::math::float3 center;
+  filament::math::float3 half_extent;
+};
+
+struct Header
+{
+  uint32_t version;
+  uint32_t parts;
+  Box aabb;
+  uint32_t flags;
+  uint32_t offset_position;
+  uint32_t stride_position;
+  uint32_t offset_tangents;
+  uint32_t stride_tangents;
+  uint32_t offset_color;
+  uint32_t stride_color;
+  uint32_t offset_uv0;
+  uint32_t stride_uv0;
+  uint32_t offset_uv1;
+  uint32_t stride_uv1;
+  uint32_t vertex_count;
+  uint32_t vertex_size;
+  uint32_t index_type;
+  uint32_t index_count;
+  uint32_t index_size;
+};
+
+struct Part
+{
+  uint32_t offset;
+  uint32_t index_count;
+  uint32_t min_index;
+  uint32_t max_index;
+  uint32_t material_id;
+  Box aabb;
+};
+
+// The file begins with this magic string, without a null terminator
+constexpr char MAGIC[] = "FILAMESH";
+constexpr std::size_t MAGIC_SIZE = sizeof(MAGIC) - 1;
+constexpr uint32_t VERSION = 1;
+// Index types stored in the header
+constexpr uint32_t UI32 = 0;
+constexpr uint32_t UI16 = 1;
+// Attribute offsets for attributes which are not present
+constexpr uint32_t NO_ATTRIBUTE = UINT32_MAX;
+
+// A filamesh file parsed from memory, the vertex and index pointers refer to
+// the buffer it was parsed from
+struct Contents
+{
+  Header header;
+  const uint8_t* vertices;
+  const uint8_t* indices;
+  std::vector<Part> parts;
+  std::vector<std::string> material_names;
+};
+
+// Parse a filamesh file held in memory, throws if it is malformed
+Contents parse(const uint8_t* i_data, std::size_t i_size);
+
+// Point any parts whose material id is out of range at an extra, unnamed
+// material, which no registry knows so falls back to the default material.
+// Returns whether the file was changed, throws if it is malformed.
+bool repair_material_ids(std::vector<uint8_t>& io_data);
+
+// Write a filamesh file, the vertex and index sizes are taken from the header
+// and the part and material counts from the vectors. Throws on failure.
+void write(std::ostream& io_stream,
+           Header i_header,
+           const void* i_vertices,
+           const void* i_indices,
+           const std::vector<Part>& i_parts,
+           const std::vector<std::string>& i_material_names);
+}  // namespace filamesh_file
+
+#endif  // FILAMESH_FILE
@@ -0,0 +1,82 @@
+#ifndef FRAME_SCHEDULER
+#define FRAME_SCHEDULER
+
+#include "frame_stats.h"
+#include <QTimer>
+#include <array>
+#include <chrono>
+#include <functional>
+
+// Decides when frames are drawn. Requests and input received between frames
+// are coalesced so at most one frame is drawn per display refresh. In
+// on-demand mode frames are only drawn when requested, in continuous mode a
+// frame is drawn every refresh. The latency from the first input received
+// before a frame, to that frame being presented, is recorded.
+// When presentation is asynchronous, the next frame is not drawn until the
+// previous one has been reported as presented.
+class FrameScheduler
+{
+public:
+  enum MODE { ON_DEMAND, CONTINUOUS };
+
+  // The draw function is called from the Qt event loop when a frame is due
+  explicit FrameScheduler(std::function<void()> i_draw);
+  // Copying is disallowed as our timer calls back in to this instance
+  FrameScheduler(const FrameScheduler&) = delete;
+  FrameScheduler& operator=(const FrameScheduler&) = delete;
+  ~FrameScheduler() = default;
+
+  void set_mode(MODE i_mode);
+  MODE mode() const noexcept;
+
+  // Frames will not be drawn more frequently than the display refresh rate
+  void set_refresh_rate(double i_hz);
+
+  // By default a frame is presented once the draw function returns. If
+  // presentation is asynchronous the owner must call frame_presented.
+  void set_asynchronous_present(bool i_asynchronous) noexcept;
+
+  // Report that the frame most recently drawn has been presented
+  void frame_presented();
+
+  // Request a frame, multiple requests before the frame is drawn are merged
+  void request_frame();
+
+  // Notify the scheduler that input was received which requires a new frame
+  void input_received();
+
+  // Summary of the input to present latency of recent frames
+  FrameStats latency_stats() const;
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  // Called by our timer when a frame is due
+  void draw_frame();
+
+  void schedule(clock::time_point i_now);
+
+private:
+  std::function<void()> m_draw;
+  QTimer m_timer;
+  MODE m_mode = ON_DEMAND;
+  clock::duration m_frame_interval;
+  // When the next frame is ideally due, advanced by whole intervals so the
+  // timer's millisecond granularity doesn't drift from the refresh rate
+  clock::time_point m_next_frame;
+  // Time the first unprocessed input was received, if any is pending
+  clock::time_point m_first_input;
+  bool m_input_pending = false;
+  // Input time consumed by the frame awaiting presentation, if it had input
+  clock::time_point m_frame_input;
+  bool m_frame_had_input = false;
+  bool m_frame_in_flight = false;
+  bool m_asynchronous_present = false;
+  // Was a frame requested while another was in flight
+  bool m_frame_deferred = false;
+  // Ring of the most recent input latencies in milliseconds
+  std::array<double, 256> m_latencies;
+  std::size_t m_num_latencies = 0;
+};
+
+#endif  // FRAME_SCHEDULER
@@ -0,0 +1,33 @@
+#ifndef FRAME_STATS
+#define FRAME_STATS
+
+#include <QJsonObject>
+#include <ostream>
+#include <vector>
+
+// Summary statistics for a series of measured CPU frame times
+struct FrameStats
+{
+  // Number of frames that were measured
+  uint32_t frames = 0;
+  // Number of frames the renderer asked us to skip
+  uint32_t skipped = 0;
+  double min_ms = 0.0;
+  double median_ms = 0.0;
+  double p99_ms = 0.0;
+  double max_ms = 0.0;
+  double mean_ms = 0.0;
+};
+
+// Computes the summary statistics for the provided frame times, in
+// milliseconds. The times are taken by value as they need to be sorted.
+FrameStats summarize_frame_times(std::vector<double> i_frame_times_ms,
+                                 uint32_t i_skipped = 0);
+
+// Machine readable representation of the frame statistics
+QJsonObject to_json(const FrameStats& i_stats);
+
+// Human readable representation of the frame statistics
+std::ostream& operator<<(std::ostream& io_os, const FrameStats& i_stats);
+
+#endif  // FRAME_STATS
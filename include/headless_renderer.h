@@ -0,0 +1,98 @@
+#ifndef HEADLESS_RENDERER
+#define HEADLESS_RENDERER
+
+#include "asset_loader.h"
+#include "frame_stats.h"
+#include "material_library.h"
+#include "quality_governor.h"
+#include "scene_manifest.h"
+#include "scene_picker.h"
+#include "texture_report.h"
+#include <filament/Engine.h>
+#include <nonstd/value_ptr.hpp>
+#include <memory>
+
+// Renders our PBR scene into a fixed size offscreen swap chain, without any
+// native window. Used to benchmark the renderer on machines with no display.
+class HeadlessRenderer
+{
+public:
+  // Loads the scene described by the manifest, blocking until it's loaded.
+  // Every view shares the scene, but has its own swap chain, view and camera.
+  HeadlessRenderer(
+    std::shared_ptr<filament::Engine> i_engine,
+    uint32_t i_width,
+    uint32_t i_height,
+    const SceneManifest& i_manifest = SceneManifest::default_scene(),
+    uint32_t i_views = 1);
+  ~HeadlessRenderer();
+
+  // Time taken to load the scene until it can be drawn, in milliseconds
+  double load_time_ms() const noexcept;
+
+  // When each stage of loading the scene ran, followed by the first frame
+  // once it has been drawn
+  const std::vector<LoadStage>& startup_timeline() const noexcept;
+
+  // Materials and pooled instances used by the loaded scene
+  MaterialLibrary::Stats material_stats() const noexcept;
+
+  // Format, GPU memory and upload time of the scene's textures
+  std::vector<TextureReport> texture_reports() const;
+
+  // Number of frames drawn before every texture level had streamed in
+  uint32_t stream_frames() const noexcept;
+
+  // Bytes of texture levels uploaded per frame, zero for no limit
+  void set_upload_budget(std::size_t i_bytes) noexcept;
+
+  // Animate every instance, driven by the number of frames drawn
+  void set_animated(bool i_animated) noexcept;
+
+  // Most threads to compute transforms with, zero to use every worker
+  void set_transform_threads(std::size_t i_max_threads) noexcept;
+
+  // Mean time spent updating transforms per frame, in milliseconds
+  double transform_update_ms() const noexcept;
+
+  // Orbit every view's camera about the scene, a full turn every few
+  // seconds at 60Hz, driven by the number of frames drawn so every run sees
+  // the same views
+  void set_camera_path(bool i_enabled) noexcept;
+
+  // Frame rate to hold by stepping every view down through quality tiers,
+  // zero to always render at full quality, which is the default
+  void set_target_fps(double i_target_fps);
+
+  // The current quality tier, and every change made to it
+  const QualityGovernor& governor() const noexcept;
+
+  // Select mesh levels of detail from their projected size, on by default
+  void set_lods_enabled(bool i_enabled) noexcept;
+
+  // Triangles submitted per view in the most recently drawn frame
+  std::size_t triangles_per_frame() const noexcept;
+
+  // Find the nearest instance under a point in normalized device
+  // coordinates, as seen by one of the views
+  PickResult pick(filament::math::float2 i_ndc, uint32_t i_view = 0);
+
+  // The hierarchies used for picking, which are built in the background
+  const ScenePicker& picker() const noexcept;
+
+  // Render the requested number of frames, discarding the timings of the
+  // first few warm-up frames, and summarize the CPU frame times.
+  FrameStats run(uint32_t i_frames, uint32_t i_warmup_frames = 0);
+
+private:
+  // Renders a single frame of every view, returns false if every view was
+  // skipped
+  bool draw();
+
+private:
+  struct HeadlessRendererImpl;
+  // Value semantics for a smart pointer, automatically deep copies
+  nonstd::value_ptr<HeadlessRendererImpl> m_impl;
+};
+
+#endif  // HEADLESS_RENDERER
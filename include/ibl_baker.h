@@ -0,0 +1,113 @@
+#ifndef IBL_BAKER
+#define IBL_BAKER
+
+#include "thread_pool.h"
+#include <math/vec3.h>
+#include <array>
+#include <string>
+#include <vector>
+
+// An equirectangular high dynamic range image, in linear RGB
+struct EquirectImage
+{
+  uint32_t width = 0;
+  uint32_t height = 0;
+  // Stored row by row, from the top of the image
+  std::vector<filament::math::float3> pixels;
+};
+
+// A cubemap with its faces in the order +X, -X, +Y, -Y, +Z, -Z, following
+// the OpenGL conventions. Each face is stored row by row.
+struct CubemapImage
+{
+  uint32_t size = 0;
+  std::array<std::vector<filament::math::float3>, 6> faces;
+};
+
+struct IblBakeSettings
+{
+  // Edge length of the skybox cubemap faces
+  uint32_t skybox_size = 256;
+  // Edge length of the base level of the prefiltered specular cubemap
+  uint32_t specular_size = 256;
+  // GGX samples per texel, for every prefiltered level
+  uint32_t samples = 64;
+  // Most threads to bake with including the caller, zero to use every worker
+  std::size_t max_threads = 0;
+};
+
+// Everything image based lighting needs, baked from a single environment
+struct BakedIbl
+{
+  CubemapImage skybox;
+  // One level per mip, prefiltered for increasing roughness
+  std::vector<CubemapImage> specular;
+  // Irradiance spherical harmonics, pre-convolved with the Lambertian BRDF
+  // and pre-scaled as filament::IndirectLight expects
+  std::array<filament::math::float3, 9> irradiance;
+};
+
+// Timings and results of a cached bake
+struct IblBakeReport
+{
+  std::string source_path;
+  std::string ibl_path;
+  std::string skybox_path;
+  // Were the baked files already in the cache
+  bool cache_hit = false;
+  double bake_ms = 0.0;
+};
+
+// Bakes image based lighting from an equirectangular HDR image, replacing
+// the external cmgen step. The skybox cubemap, the GGX prefiltered specular
+// mip chain and the irradiance spherical harmonics are all computed on the
+// thread pool. Results are written as a pair of RGBM KTX files, with the
+// harmonics in "sh" metadata, to a cache keyed by a hash of the source image
+// and the settings.
+class IblBaker
+{
+public:
+  explicit IblBaker(IblBakeSettings i_settings = {},
+                    std::string i_cache_directory = "cache/ibl",
+                    ThreadPool& io_pool = ThreadPool::global());
+
+  // Returns the paths of the baked KTX files for the image, baking them if
+  // they are not already cached. Safe to call from any thread, including a
+  // pool worker, throws on failure.
+  IblBakeReport bake_cached(const std::string& i_hdr_path) const;
+
+  // Bake the lighting for an image, without touching the cache
+  BakedIbl bake(const EquirectImage& i_image) const;
+
+  // Read a Radiance RGBE (.hdr) image, throws on failure
+  static EquirectImage read_hdr(const std::string& i_path);
+
+  // Write a mip chain of cubemaps as an RGBM encoded KTX file, with optional
+  // "sh" metadata holding the irradiance harmonics
+  static void write_ktx(const std::vector<CubemapImage>& i_levels,
+                        const std::string& i_path,
+                        const std::array<filament::math::float3, 9>* i_sh);
+
+private:
+  // Resample the image on to the faces of a cubemap
+  CubemapImage to_cubemap(const EquirectImage& i_image, uint32_t i_size) const;
+
+  // Halve the resolution of every face with a box filter
+  CubemapImage downsample(const CubemapImage& i_cubemap) const;
+
+  // Prefilter the environment with the GGX distribution, one level per mip
+  // from smooth to rough
+  std::vector<CubemapImage>
+  prefilter_specular(const std::vector<CubemapImage>& i_mips) const;
+
+  // Project the environment on to the first 9 spherical harmonics
+  std::array<filament::math::float3, 9>
+  irradiance_sh(const CubemapImage& i_cubemap) const;
+
+private:
+  IblBakeSettings m_settings;
+  std::string m_cache_directory;
+  ThreadPool* m_pool;
+};
+
+#endif  // IBL_BAKER
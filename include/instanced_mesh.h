@@ -0,0 +1,108 @@
+#ifndef INSTANCED_MESH
+#define INSTANCED_MESH
+
+#include "filament_raii.h"
+#include "filamesh_file.h"
+#include "mesh_lod.h"
+#include "resource_registry.h"
+#include "transform_store.h"
+#include <filameshio/MeshReader.h>
+#include <filament/IndexBuffer.h>
+#include <filament/VertexBuffer.h>
+#include <math/mat4.h>
+#include <math/vec4.h>
+#include <utils/Entity.h>
+#include <memory>
+#include <vector>
+
+// Everything required to choose a level of detail from projected size
+struct LodSelection
+{
+  // World space position of the camera
+  filament::math::float3 eye;
+  // Projected size in pixels of one world unit, at one unit from the camera
+  float pixel_scale = 1.f;
+  // Coarsest allowed simplification error, in pixels
+  float max_pixel_error = 1.f;
+  // Draw every instance at full detail when disabled
+  bool enabled = true;
+};
+
+// A mesh loaded once from a filamesh file, which can be instanced any number
+// of times. Every instance is a separate renderable, but they all share the
+// same vertex and index buffers, including any simplified levels of detail.
+class InstancedMesh
+{
+public:
+  // Create the mesh's buffers from a filamesh file held in memory. The data
+  // must be kept alive until the engine releases it, which is signalled by
+  // the release callback. The buffers and instances are owned by the
+  // registry, which also lends us its engine, and the instances' transforms
+  // by the store, both of which must outlive us. Must be called from the
+  // engine thread.
+  InstancedMesh(ResourceRegistry& io_resources,
+                TransformStore& io_transforms,
+                std::shared_ptr<const std::vector<uint8_t>> i_data,
+                filamesh::MeshReader::MaterialRegistry& io_materials,
+                mesh_lod::Chain i_lods = {});
+  // Copying is disallowed as we own engine registered objects
+  InstancedMesh(const InstancedMesh&) = delete;
+  InstancedMesh& operator=(const InstancedMesh&) = delete;
+  // Queues every instance we created and our buffers for destruction
+  ~InstancedMesh();
+
+  // Create a renderable for each transform, in bulk. If a material instance
+  // is provided it is used for every part, otherwise the materials named by
+  // the mesh file are looked up in the registry. The transforms are added to
+  // the store, relative to the parent node if one is given, and reach
+  // filament in its next update. Returns the new entities, which are not yet
+  // added to any scene.
+  std::vector<utils::Entity>
+  add_instances(const std::vector<filament::math::mat4f>& i_transforms,
+                filament::MaterialInstance* i_material = nullptr,
+                TransformStore::Node i_parent = TransformStore::NONE);
+
+  // All instances of this mesh
+  const std::vector<utils::Entity>& instances() const noexcept;
+
+  // The transform store node of each instance, in the same order
+  const std::vector<TransformStore::Node>& nodes() const noexcept;
+
+  // Number of triangles per instance at full detail
+  std::size_t triangle_count() const noexcept;
+
+  // Number of levels of detail, including the full detail mesh
+  std::size_t lod_count() const noexcept;
+
+  // Choose the level of detail for every instance from its projected size,
+  // only touching the renderables whose level changes. Instances which moved
+  // in the last transform store update have their bounds recomputed.
+  // Instances are shared by every view, so the most detailed level any
+  // selection requires is used. Returns the number of triangles drawn across
+  // all instances. Must be called from the engine thread.
+  std::size_t update_lods(const std::vector<LodSelection>& i_selections);
+
+private:
+  ResourceRegistry* m_resources;
+  TransformStore* m_transforms;
+  filamesh::MeshReader::MaterialRegistry* m_materials;
+  // The renderable created by the mesh reader is used as our first instance
+  utils::Entity m_source;
+  bool m_source_used = false;
+  Handle<filament::VertexBuffer> m_vertex_buffer;
+  Handle<filament::IndexBuffer> m_index_buffer;
+  std::vector<filamesh_file::Part> m_parts;
+  std::vector<std::string> m_material_names;
+  filamesh_file::Box m_aabb;
+  // Every level of detail, the first being the full detail parts
+  mesh_lod::Chain m_lods;
+  std::vector<std::size_t> m_lod_triangles;
+  std::vector<utils::Entity> m_instances;
+  // Each instance's node in the transform store
+  std::vector<TransformStore::Node> m_nodes;
+  // World space bounding sphere of each instance, and its current level
+  std::vector<filament::math::float4> m_bounds;
+  std::vector<uint8_t> m_instance_lods;
+};
+
+#endif  // INSTANCED_MESH
@@ -0,0 +1,59 @@
+#ifndef KTX2_TEXTURE
+#define KTX2_TEXTURE
+
+#include "texture_report.h"
+#include <filament/Engine.h>
+#include <filament/Texture.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A KTX2 texture holding Basis Universal (ETC1S or UASTC) payloads, possibly
+// zstd supercompressed, transcoded on the CPU to a block compressed format
+// the back-end supports. Transcoding is only available when built with
+// CONFIG+=basisu, otherwise available() is false and transcode() throws.
+class Ktx2Texture
+{
+public:
+  using Format = filament::Texture::InternalFormat;
+
+  // Whether KTX2 support was compiled in
+  static bool available() noexcept;
+
+  // Read the file and transcode every level and face to the first of the
+  // target formats it can be transcoded to, spreading the faces over the
+  // thread pool. Safe to call from any thread, throws on failure.
+  static std::shared_ptr<Ktx2Texture>
+  transcode(const std::string& i_path, const std::vector<Format>& i_targets);
+
+  // Look up a value from the key/value metadata, empty if it does not exist
+  std::string metadata(const std::string& i_key) const;
+
+  // Create a texture and upload every transcoded level. Must be called from
+  // the engine thread. The transcoded data is released once the engine has
+  // consumed it, when provided the report is filled in. Throws if RGBM is
+  // requested of a compressed format, which can't represent it faithfully.
+  filament::Texture* create_texture(filament::Engine* io_engine,
+                                    bool i_rgbm,
+                                    TextureReport* o_report = nullptr);
+
+  Format format() const noexcept;
+
+private:
+  struct Level
+  {
+    // Every face, one after another
+    std::vector<uint8_t> data;
+    uint32_t face_size = 0;
+  };
+
+  Format m_format = Format::RGBA8;
+  uint32_t m_width = 0;
+  uint32_t m_height = 0;
+  uint32_t m_faces = 1;
+  double m_transcode_ms = 0.0;
+  std::vector<std::shared_ptr<Level>> m_levels;
+  std::vector<std::pair<std::string, std::string>> m_metadata;
+};
+
+#endif  // KTX2_TEXTURE
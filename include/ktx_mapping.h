@@ -0,0 +1,107 @@
+#ifndef KTX_MAPPING
+#define KTX_MAPPING
+
+#include "texture_report.h"
+#include <image/KtxBundle.h>
+#include <utils/Path.h>
+#include <filament/Engine.h>
+#include <filament/Texture.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Read only memory mapping of a KTX (version 1) file. Unlike image::KtxBundle
+// the file is never copied, mip levels are uploaded directly from the mapping
+// and the pages of each level are released once the engine has consumed them.
+// The file is unmapped once the last upload referencing it has completed.
+class KtxMapping : public std::enable_shared_from_this<KtxMapping>
+{
+public:
+  // Map the file at the given path, throws if it can't be mapped or isn't a
+  // valid KTX file. Safe to call from any thread.
+  static std::shared_ptr<KtxMapping> open(const utils::Path& i_path);
+
+  // Copying is disallowed as we own the mapping
+  KtxMapping(const KtxMapping&) = delete;
+  KtxMapping& operator=(const KtxMapping&) = delete;
+  ~KtxMapping();
+
+  // Format and dimensions of the texture
+  const image::KtxInfo& info() const noexcept;
+  uint32_t num_mip_levels() const noexcept;
+  bool is_cubemap() const noexcept;
+
+  // Pointer to the level's data within the mapping, for cube maps this
+  // contains all six faces, one after another
+  const uint8_t* level_data(uint32_t i_level) const noexcept;
+  // Size of a single face of the level in bytes
+  uint32_t face_size(uint32_t i_level) const noexcept;
+  // Size of all faces of the level in bytes
+  uint32_t level_size(uint32_t i_level) const noexcept;
+
+  // Look up a value from the key/value metadata, empty if it does not exist
+  std::string metadata(const std::string& i_key) const;
+
+  // Total size of the mapped file in bytes
+  std::size_t mapped_size() const noexcept;
+
+  // The format a texture created from this file should use
+  filament::Texture::InternalFormat texture_format(bool i_srgb) const noexcept;
+
+  // Fill in the format and size of a texture created from the whole file
+  void describe(TextureReport& o_report, bool i_srgb) const;
+
+  // Create a texture and upload every level straight from the mapping. Must
+  // be called from the engine thread. When provided, the report is filled in
+  // with the texture's format, size and an upload timer.
+  filament::Texture* create_texture(filament::Engine* io_engine,
+                                    bool i_srgb,
+                                    bool i_rgbm,
+                                    TextureReport* o_report = nullptr);
+
+  // Create a texture holding only the levels from the base level down, so
+  // the base level of the file becomes level zero of the texture, without
+  // uploading anything. Must be called from the engine thread, throws if
+  // RGBM is requested of a compressed file.
+  filament::Texture* create_partial_texture(filament::Engine* io_engine,
+                                            bool i_srgb,
+                                            bool i_rgbm,
+                                            uint32_t i_base_level) const;
+
+  // Upload a single level of an existing texture straight from the mapping,
+  // to the texture's level relative to the base level it was created with.
+  // Must be called from the engine thread. The timer is notified once the
+  // engine has consumed the level.
+  void upload_level(filament::Engine* io_engine,
+                    filament::Texture* io_texture,
+                    uint32_t i_level,
+                    bool i_rgbm,
+                    std::shared_ptr<UploadTimer> i_timer = nullptr,
+                    uint32_t i_base_level = 0);
+
+private:
+  KtxMapping(const uint8_t* i_data, std::size_t i_size);
+
+  // Parse the header, key/value data and level offsets, throws on failure
+  void parse(const std::string& i_path);
+
+  // Tell the kernel it may drop the pages of a level that has been uploaded
+  void release_level(uint32_t i_level) const noexcept;
+
+private:
+  struct Level
+  {
+    std::size_t offset;
+    uint32_t face_size;
+  };
+
+  const uint8_t* m_data;
+  std::size_t m_size;
+  image::KtxInfo m_info;
+  uint32_t m_num_faces = 1;
+  std::size_t m_metadata_offset = 0;
+  std::size_t m_metadata_size = 0;
+  std::vector<Level> m_levels;
+};
+
+#endif  // KTX_MAPPING
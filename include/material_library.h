@@ -0,0 +1,138 @@
+#ifndef MATERIAL_LIBRARY
+#define MATERIAL_LIBRARY
+
+#include "filament_raii.h"
+#include <filament/Material.h>
+#include <filament/MaterialInstance.h>
+#include <math/vec4.h>
+#include <QJsonObject>
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A set of named material parameter values. Two sets with the same values
+// compare equal, and hash the same, regardless of the order they were set in.
+class MaterialParameters
+{
+public:
+  MaterialParameters& set(const std::string& i_name, float i_value);
+  MaterialParameters& set(const std::string& i_name,
+                          const filament::math::float3& i_value);
+  MaterialParameters& set(const std::string& i_name,
+                          const filament::math::float4& i_value);
+
+  bool empty() const noexcept;
+
+  // Set every parameter on the material instance
+  void apply(filament::MaterialInstance& io_instance) const;
+
+  // Approximate size of these parameters within a uniform buffer
+  std::size_t uniform_size() const noexcept;
+
+  std::size_t hash() const noexcept;
+  bool operator==(const MaterialParameters& i_other) const noexcept;
+
+private:
+  struct Value
+  {
+    // Number of components used
+    uint32_t size;
+    filament::math::float4 data;
+  };
+  // Ordered by name so equal sets are stored identically
+  std::map<std::string, Value> m_values;
+};
+
+// Loads compiled material packages once, keyed by name, and hands out
+// material instances from a pool deduplicated by parameter values. Objects
+// which look the same share a single instance. Must only be used from the
+// engine thread, apart from reading packages.
+class MaterialLibrary
+{
+public:
+  // Packages are loaded from <directory>/<name>.filamat
+  explicit MaterialLibrary(std::shared_ptr<filament::Engine> i_engine,
+                           std::string i_directory = "assets/materials");
+  // Copying is disallowed as we own engine registered objects
+  MaterialLibrary(const MaterialLibrary&) = delete;
+  MaterialLibrary& operator=(const MaterialLibrary&) = delete;
+  // Instances are destroyed before the materials they were created from
+  ~MaterialLibrary();
+
+  // Register a package that is already in memory, such as one compiled in to
+  // the binary. The data must outlive the library. Packages found on disk
+  // take priority over registered ones.
+  void add_package(const std::string& i_name,
+                   const void* i_package,
+                   std::size_t i_size);
+
+  // Get the material with this name, loading it on first use. Returns null if
+  // no package with this name exists.
+  filament::Material* material(const std::string& i_name);
+
+  // Read the named package from disk, empty if there is none. Only touches
+  // the file system, so is safe to call from any thread.
+  std::vector<char> read_package(const std::string& i_name) const;
+
+  // Build the named material from a package read ahead of time, or the
+  // registered package if it's empty. Returns the existing material if it
+  // has already been loaded, or null if there is no package.
+  filament::Material* load(const std::string& i_name,
+                           const std::vector<char>& i_package);
+
+  // Get an instance of the named material with these parameters, creating it
+  // only if no instance with identical parameters exists. Returns null if the
+  // material doesn't exist. Instances live as long as the library.
+  filament::MaterialInstance* acquire(const std::string& i_material,
+                                      const MaterialParameters& i_parameters);
+
+  struct Stats
+  {
+    std::size_t materials = 0;
+    std::size_t instances = 0;
+    // Number of acquisitions ever made, served by the instances above.
+    // Instances are never released, so this only grows.
+    std::size_t acquisitions = 0;
+    std::size_t package_bytes = 0;
+    std::size_t approximate_instance_bytes = 0;
+  };
+  Stats stats() const noexcept;
+
+private:
+  struct Key
+  {
+    std::string material;
+    MaterialParameters parameters;
+    bool operator==(const Key& i_other) const noexcept;
+  };
+  struct KeyHash
+  {
+    std::size_t operator()(const Key& i_key) const noexcept;
+  };
+  struct PooledInstance
+  {
+    FilamentScopedPointer<filament::MaterialInstance> instance;
+    // Times this instance has been acquired
+    std::size_t acquisitions;
+    std::size_t uniform_size;
+  };
+
+  std::shared_ptr<filament::Engine> m_engine;
+  std::string m_directory;
+  // Packages registered from memory, keyed by name
+  std::map<std::string, std::pair<const void*, std::size_t>> m_packages;
+  std::map<std::string, FilamentScopedPointer<filament::Material>> m_materials;
+  std::unordered_map<Key, PooledInstance, KeyHash> m_instances;
+  std::size_t m_package_bytes = 0;
+};
+
+// Machine readable representation of the library statistics
+QJsonObject to_json(const MaterialLibrary::Stats& i_stats);
+
+// Human readable representation of the library statistics
+std::ostream& operator<<(std::ostream& io_os,
+                         const MaterialLibrary::Stats& i_stats);
+
+#endif  // MATERIAL_LIBRARY
@@ -0,0 +1,54 @@
+#ifndef MESH_BVH
+#define MESH_BVH
+
+#include "bvh.h"
+#include "filamesh_file.h"
+#include <math/vec3.h>
+#include <cstdint>
+#include <vector>
+
+// A bounding volume hierarchy over the full detail triangles of a filamesh
+// file, in the mesh's own space, used to find which triangle a ray hits.
+// Immutable once built, so it can be shared between threads.
+class MeshBvh
+{
+public:
+  struct Hit
+  {
+    // Index of the triangle's first index in the index buffer, divided by 3
+    uint32_t triangle = 0;
+    // Distance along the ray, in units of its direction's length
+    float distance = 0.f;
+  };
+
+  // Build over the triangles of a parsed filamesh file, whose vertex and
+  // index data must be alive for the duration of the call
+  explicit MeshBvh(const filamesh_file::Contents& i_contents);
+
+  // Find the nearest triangle hit before i_t_max, from either side
+  bool intersect(const bvh::Ray& i_ray, float i_t_max, Hit& o_hit) const;
+
+  // Bounds of every triangle
+  const bvh::Aabb& bounds() const noexcept;
+
+  std::size_t triangle_count() const noexcept;
+  std::size_t node_count() const noexcept;
+  // Time taken to build the tree
+  double build_ms() const noexcept;
+
+private:
+  // A vertex and two edges, in leaf order, ready for intersection
+  struct Triangle
+  {
+    filament::math::float3 v0;
+    filament::math::float3 e1;
+    filament::math::float3 e2;
+    uint32_t index;
+  };
+
+  bvh::Tree m_tree;
+  std::vector<Triangle> m_triangles;
+  double m_build_ms = 0.0;
+};
+
+#endif  // MESH_BVH
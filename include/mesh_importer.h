@@ -0,0 +1,98 @@
+#ifndef MESH_IMPORTER
+#define MESH_IMPORTER
+
+#include "filamesh_file.h"
+#include "mesh_lod.h"
+#include <math/vec2.h>
+#include <math/vec3.h>
+#include <string>
+#include <vector>
+
+struct aiScene;
+
+// A mesh imported through assimp, with all of its sub-meshes merged in to a
+// single vertex and index buffer, one part per sub-mesh. Simplified levels of
+// detail index the same vertices, and follow the full detail indices.
+struct ImportedMesh
+{
+  struct Vertex
+  {
+    filament::math::float3 position;
+    filament::math::float3 normal;
+    filament::math::float2 uv;
+  };
+
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+  std::vector<filamesh_file::Part> parts;
+  std::vector<std::string> material_names;
+  filamesh_file::Box aabb;
+  mesh_lod::Chain lods;
+};
+
+// Timings and optimization results of a single import
+struct MeshImportReport
+{
+  std::string source_path;
+  std::string filamesh_path;
+  // Was the converted mesh already in the cache
+  bool cache_hit = false;
+  double load_ms = 0.0;
+  // Post-transform vertex cache miss ratio (average cache miss per triangle)
+  // before and after optimization, only measured on a cache miss
+  double acmr_before = 0.0;
+  double acmr_after = 0.0;
+  // Triangles in each level of detail, starting with the full mesh, only
+  // measured on a cache miss
+  std::vector<std::size_t> lod_triangles;
+};
+
+// Converts OBJ, and any other format assimp supports, to filamesh files on
+// first load. The converted meshes are optimized for the post-transform
+// vertex cache, overdraw and vertex fetch, and a chain of simplified levels of
+// detail is generated for them. Both are written to a cache keyed by a hash of
+// the source file, so later loads skip conversion entirely.
+class MeshImporter
+{
+public:
+  explicit MeshImporter(std::string i_cache_directory = "cache/meshes");
+
+  // Returns the path of a filamesh file for the mesh, converting it if it is
+  // not already cached. Paths to filamesh files are returned unchanged. Safe
+  // to call from any thread, throws on failure.
+  std::string import(const std::string& i_path,
+                     MeshImportReport* o_report = nullptr) const;
+
+  // Read a mesh through assimp, without any optimization
+  static ImportedMesh read(const std::string& i_path);
+
+  // Merge meshes of a scene already read through assimp, one part per mesh,
+  // without applying any node transforms. Meshes without triangles are
+  // skipped, so the result may have no parts.
+  static ImportedMesh convert(const aiScene& i_scene,
+                              const std::vector<unsigned int>& i_meshes);
+
+  // Reorder the indices for the post-transform vertex cache and overdraw, and
+  // the vertices for fetch locality. Optionally reports the cache miss ratio.
+  static void optimize(ImportedMesh& io_mesh,
+                       double* o_acmr_before = nullptr,
+                       double* o_acmr_after = nullptr);
+
+  // Append progressively simplified levels of detail, each roughly halving
+  // the triangle count, until simplification stops making progress. Must be
+  // called after optimize as the vertex order is relied upon.
+  static void generate_lods(ImportedMesh& io_mesh);
+
+  // Write the mesh as a filamesh file, with packed tangent frames
+  static void write(const ImportedMesh& i_mesh, const std::string& i_path);
+
+  // Write the mesh and its levels of detail in to a cache, through temporary
+  // files renamed in to place so concurrent readers never see partial files
+  static void write_cached(const ImportedMesh& i_mesh,
+                           const std::string& i_path);
+
+private:
+  std::string m_cache_directory;
+};
+
+#endif  // MESH_IMPORTER
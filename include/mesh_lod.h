@@ -0,0 +1,39 @@
+#ifndef MESH_LOD
+#define MESH_LOD
+
+#include "filamesh_file.h"
+#include <string>
+#include <vector>
+
+// Levels of detail for a filamesh file. Every level is drawn from the mesh's
+// own vertex and index buffers, the simplified indices are appended to the
+// index buffer after the full detail parts. The ranges for each level are
+// stored in a small sidecar file next to the mesh, so the filamesh file
+// itself stays readable by filamesh::MeshReader.
+namespace mesh_lod
+{
+struct Level
+{
+  // Largest simplification error achieved by any part, relative to the mesh
+  // extents
+  float error;
+  // One range per part of the mesh
+  std::vector<filamesh_file::Part> parts;
+};
+
+// Levels are ordered from most to least detailed, excluding the full detail
+// parts stored in the filamesh file itself
+using Chain = std::vector<Level>;
+
+// Path of the sidecar file holding the chain for a filamesh file
+std::string sidecar_path(const std::string& i_filamesh_path);
+
+// Read the chain for a filamesh file, empty if it has none. Throws if the
+// sidecar file exists but is malformed.
+Chain read(const std::string& i_filamesh_path);
+
+// Write the chain for a filamesh file, throws on failure
+void write(const std::string& i_filamesh_path, const Chain& i_chain);
+}  // namespace mesh_lod
+
+#endif  // MESH_LOD
@@ -1,6 +1,8 @@
 #ifndef NATIVE_WINDOW_WIDGET
 #define NATIVE_WINDOW_WIDGET
 
+#include "frame_scheduler.h"
+#include <QScreen>
 #include <QWidget>
 #include <memory>
 
@@ -25,6 +27,8 @@ public:
   // Initialization function, to be called after the widget has already been
   // set-up, from here we can access the native window ID
   virtual void init();
+  // Controls when this window is redrawn
+  FrameScheduler& frame_scheduler() noexcept;
 
 protected:
   // For derived classes to draw to this native window
@@ -35,6 +39,13 @@ protected:
   virtual void init_impl(void* io_native_window);
   // Call this function to request a redraw of the window
   void request_draw();
+  // Call this function when input requiring a redraw has been received
+  void input_received();
+  // Call this function when a frame drawn asynchronously has been presented,
+  // optionally requesting another frame
+  Q_INVOKABLE void frame_presented(bool i_redraw = false);
+  // Thread safe version of frame_presented, which is queued on the GUI thread
+  void post_frame_presented(bool i_redraw = false);
 
 private:
   // This event will simply request a draw
@@ -42,16 +53,18 @@ private:
   // This event will simply delegate to resize_impl after boilerplate check,
   // and then request a draw
   virtual void resizeEvent(QResizeEvent* i_resize_event) override final;
-  // We need to intercept the update request, and call draw_impl when received
-  virtual bool event(QEvent* i_event) override final;
+  // Called by the frame scheduler when a frame is due
+  void draw_frame();
+  // Pace frames to this screen, or the primary screen if it's null
+  void update_refresh_rate(QScreen* i_screen);
 
 protected:
   // Has this window been initialized?
   bool m_is_init;
 
 private:
-  // Has a draw been requested?
-  bool m_update_pending;
+  // Coalesces draw requests, and paces them to the display refresh rate
+  FrameScheduler m_frame_scheduler;
 
 };
 
@@ -0,0 +1,199 @@
+#ifndef PBR_SCENE
+#define PBR_SCENE
+
+#include "filament_raii.h"
+#include "environment_light.h"
+#include "asset_loader.h"
+#include "instanced_mesh.h"
+#include "material_library.h"
+#include "mesh_importer.h"
+#include "resource_registry.h"
+#include "scene_importer.h"
+#include "scene_picker.h"
+#include "scene_manifest.h"
+#include "texture_streamer.h"
+#include "transform_store.h"
+#include <map>
+#include <filameshio/MeshReader.h>
+#include <filament/Camera.h>
+#include <filament/Scene.h>
+#include <filament/View.h>
+
+// The contents of our demo scene: materials, the meshes and imported scenes
+// listed in a scene manifest, a sun light and image based lighting. This is
+// kept separate from any window so that the same scene can be rendered on
+// screen, or offscreen in headless mode.
+class PbrScene
+{
+public:
+  explicit PbrScene(std::shared_ptr<filament::Engine> i_engine);
+  // Copying and moving are disallowed as meshes and pending loads refer back
+  // to this scene
+  PbrScene(const PbrScene&) = delete;
+  PbrScene& operator=(const PbrScene&) = delete;
+  ~PbrScene() = default;
+
+  // Load all materials, meshes and lights in to the scene through the same
+  // task graph as init_async, blocking until every asset has been created.
+  // Only the smallest levels of textures are uploaded, the rest stream in as
+  // frames are drawn. Returns when each stage of the load ran, throws if any
+  // asset failed to load.
+  std::vector<LoadStage>
+  init(const SceneManifest& i_manifest = SceneManifest::default_scene());
+  // As above through the given loader, so later marks in its timeline, such
+  // as the first frame, share the load's clock
+  std::vector<LoadStage> init(AssetLoader& io_loader,
+                              const SceneManifest& i_manifest);
+
+  // Create the sun light immediately, and begin reading the material
+  // packages, meshes and image based lighting on worker threads, all at the
+  // same time. Each asset is added to the scene as the loader finalizes it,
+  // meshes only once the materials they refer to have been created, so the
+  // scene can be rendered while loading is still in progress.
+  void init_async(
+    AssetLoader& io_loader,
+    const SceneManifest& i_manifest = SceneManifest::default_scene());
+
+  // Link this scene to the provided view, and apply our screen space effects
+  void configure_view(filament::View& io_view) const;
+
+  // Access to the underlying filament scene
+  filament::Scene* get() const noexcept;
+
+  // Every material and pooled material instance used by the scene
+  const MaterialLibrary& materials() const noexcept;
+
+  // Choose the level of detail of every mesh instance from its size when
+  // projected by each view's camera in to its viewport, using the most
+  // detailed level any view needs. Should be called each frame before
+  // rendering. Returns the number of triangles submitted per view.
+  std::size_t update_lods(const std::vector<const filament::View*>& i_views);
+
+  // Draw everything at full detail when disabled
+  void set_lods_enabled(bool i_enabled) noexcept;
+
+  // Animate every instance, bobbing and spinning in place, as a stress test
+  // of per frame transform updates
+  void set_animated(bool i_animated) noexcept;
+
+  // Most threads to compute transforms with, zero to use every worker
+  void set_transform_threads(std::size_t i_max_threads) noexcept;
+
+  // Apply the animation at the given time, and commit every transform that
+  // changed since the last frame. Should be called once per frame before
+  // selecting levels of detail. Returns the number of transforms committed.
+  std::size_t update_transforms(double i_seconds);
+
+  // Upload the next levels of any textures still streaming in, within the
+  // per frame budget. Should be called once per frame before rendering.
+  // Returns whether any texture is still missing levels.
+  bool stream_textures();
+
+  // Whether any texture is still missing levels
+  bool streaming() const noexcept;
+
+  // Bytes of texture levels uploaded per frame, zero to upload every
+  // remaining level in the next frame
+  void set_upload_budget(std::size_t i_bytes) noexcept;
+
+  // Destroy the resources released in earlier frames which the engine has
+  // finished with. Should be called once per frame after rendering.
+  void end_frame();
+
+  // Find the nearest instance under a world space ray. Meshes which are still
+  // building their hierarchies in the background can't be picked yet.
+  PickResult pick(const bvh::Ray& i_ray);
+
+  // The hierarchies used for picking, and their statistics
+  const ScenePicker& picker() const noexcept;
+
+  // Format, GPU memory and upload time of every texture created so far
+  const std::vector<TextureReport>& texture_reports() const noexcept;
+
+private:
+  // Create the materials from packages read by a worker, keyed by name,
+  // empty if the package wasn't found on disk
+  void init_materials(
+    const std::map<std::string, std::vector<char>>& i_packages);
+
+  void init_sun_light();
+
+  // Create a mesh from a filamesh file already read in to memory, along with
+  // its levels of detail, and add an instance to the scene for every
+  // transform of the entries using it
+  void create_mesh(const std::string& i_path,
+                   std::shared_ptr<std::vector<uint8_t>> i_mesh_data,
+                   mesh_lod::Chain i_lods,
+                   const std::vector<SceneManifest::Entry>& i_entries);
+
+  // Create a mesh without any instances, or return the existing one if the
+  // path has already been loaded
+  InstancedMesh& add_mesh(const std::string& i_path,
+                          std::shared_ptr<std::vector<uint8_t>> i_mesh_data,
+                          mesh_lod::Chain i_lods);
+
+  // An imported scene along with the contents of its converted meshes
+  struct LoadedScene;
+
+  // Import a multi mesh scene and read its meshes in to memory, safe to call
+  // from any thread
+  static std::shared_ptr<LoadedScene>
+  read_scene(const SceneImporter& i_importer, const std::string& i_path);
+
+  // Register an imported scene's materials, create its meshes, and add an
+  // entity to the transform store for every node, with the node's meshes
+  // instanced as its children
+  void create_scene(LoadedScene& io_scene,
+                    const filament::math::mat4f& i_transform);
+
+  // Group the manifest's entries by the mesh they use, so each mesh file is
+  // only loaded once
+  static std::map<std::string, std::vector<SceneManifest::Entry>>
+  group_by_mesh(const SceneManifest& i_manifest);
+
+  // Create the image based lighting and skybox from decoded environment data
+  void create_environment(EnvironmentData&& io_environment);
+
+private:
+  // Store a shared pointer to the engine, all of our entities will also store
+  std::shared_ptr<filament::Engine> m_engine;
+
+  // Scoped unique pointers to all engine registered objects
+  FilamentScopedPointer<filament::Scene> m_scene;
+  // Declared before the meshes so instances outlive the renderables using them
+  MaterialLibrary m_materials;
+  // Transforms of every instance, declared before the registry so it
+  // outlives the registry's final flush of the instances
+  TransformStore m_transforms;
+  // Owns the meshes' buffers and instances, declared between the materials
+  // and meshes so the deferred destruction of the renderables happens before
+  // the materials are destroyed
+  ResourceRegistry m_resources;
+
+  // Scoped entity for our light
+  FilamentScopedEntity m_light;
+  filamesh::MeshReader::MaterialRegistry m_material_registry;
+  // Resting translation and rotation of the animated instances
+  std::vector<std::pair<filament::math::float3, filament::math::quatf>>
+    m_rest_poses;
+  bool m_animated = false;
+  // Every mesh we've loaded keyed by path, each owns all of its instances
+  std::map<std::string, std::unique_ptr<InstancedMesh>> m_meshes;
+  // Refers to the meshes, so is declared after them
+  ScenePicker m_picker;
+  // Converts meshes to cached filamesh files on first load
+  MeshImporter m_importer;
+  // Converts multi mesh scenes, one cached filamesh file per mesh
+  SceneImporter m_scene_importer;
+  // Entities for the nodes of imported scenes
+  std::vector<EntityHandle> m_scene_nodes;
+  bool m_lods_enabled = true;
+
+  // Implements image based lighting and environment map backdrop
+  EnvironmentLight m_ibl_skybox;
+  // Streams in the environment's textures, declared after it as it calls
+  // back in to the environment
+  TextureStreamer m_streamer;
+};
+
+#endif  // PBR_SCENE
@@ -0,0 +1,63 @@
+#ifndef POSTER_RENDERER
+#define POSTER_RENDERER
+
+#include "scene_manifest.h"
+#include <QJsonObject>
+#include <filament/Engine.h>
+#include <memory>
+#include <ostream>
+#include <string>
+
+// Throughput of a poster render
+struct PosterReport
+{
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t tile_size = 0;
+  std::size_t tiles = 0;
+  // Whether every tile was written
+  bool written = false;
+  // Time spent loading the scene, and rendering tiles until every one had
+  // been written
+  double load_ms = 0.0;
+  double render_ms = 0.0;
+  double total_ms = 0.0;
+};
+
+// Renders images too large for a single render target, or for memory, by
+// splitting the camera's frustum in to off-center tiles. Each tile is drawn
+// offscreen and read back through a batch renderer's ring of buffers, then
+// written straight to its place in a tiled TIFF on the thread pool, so memory
+// is bounded by a few tiles whatever the size of the poster. Each tile is
+// drawn with a guard band of extra pixels around it, which is cropped, so
+// screen space effects match across tile edges unless they reach further,
+// as bloom can. Shadows are disabled, as each tile would fit its own
+// cascades.
+class PosterRenderer
+{
+public:
+  // Tiles are square, rounded up to a multiple of 16 pixels. Throws if a
+  // tile and its guard band is larger than the back-end can render.
+  explicit PosterRenderer(std::shared_ptr<filament::Engine> i_engine,
+                          uint32_t i_tile_size = 2048);
+
+  // Render the scene from the default view point to a TIFF of the given
+  // size, blocking until every tile has been written. Throws if the scene
+  // can't be loaded or the file can't be created.
+  PosterReport render(const SceneManifest& i_manifest,
+                      const std::string& i_path,
+                      uint32_t i_width,
+                      uint32_t i_height);
+
+private:
+  std::shared_ptr<filament::Engine> m_engine;
+  uint32_t m_tile_size;
+};
+
+// Human readable representation of a report
+std::ostream& operator<<(std::ostream& io_os, const PosterReport& i_report);
+
+// Machine readable representation of a report
+QJsonObject to_json(const PosterReport& i_report);
+
+#endif  // POSTER_RENDERER
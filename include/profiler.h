@@ -0,0 +1,125 @@
+#ifndef PROFILER
+#define PROFILER
+
+#include "frame_stats.h"
+#include <QString>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Collects CPU timings of named scopes on any thread. Each thread writes to
+// its own fixed size ring buffer without taking any locks, so the oldest
+// events are overwritten once a buffer is full. Recording is disabled by
+// default, when disabled a timer costs a single relaxed atomic load.
+class Profiler
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  // Events retained per thread
+  static constexpr std::size_t CAPACITY = 8192;
+
+  // The process wide profiler
+  static Profiler& global();
+
+  // Copying is disallowed as threads hold pointers in to our buffers
+  Profiler(const Profiler&) = delete;
+  Profiler& operator=(const Profiler&) = delete;
+
+  void set_enabled(bool i_enabled) noexcept;
+  bool enabled() const noexcept;
+
+  // Name the calling thread in exported traces
+  void set_thread_name(std::string i_name);
+
+  // Record a completed scope on the calling thread. The name must have static
+  // storage duration, such as a string literal.
+  void record(const char* i_name,
+              clock::time_point i_begin,
+              clock::time_point i_end) noexcept;
+
+  // Summarize the duration of every named scope over the retained events
+  std::map<std::string, FrameStats> summarize() const;
+
+  // Write every retained event as a Chrome trace_event JSON file, which can be
+  // loaded in to chrome://tracing. Returns false if the file can't be written.
+  bool write_chrome_trace(const QString& i_path) const;
+
+private:
+  Profiler();
+
+  struct Event
+  {
+    // Written by the owning thread only, atomics allow them to be read while
+    // the thread is still recording
+    std::atomic<const char*> name{nullptr};
+    std::atomic<int64_t> begin_ns{0};
+    std::atomic<int64_t> end_ns{0};
+  };
+
+  struct ThreadBuffer
+  {
+    uint32_t id = 0;
+    std::string name;
+    std::array<Event, CAPACITY> events;
+    // Total number of events ever written
+    std::atomic<uint64_t> head{0};
+  };
+
+  struct Record
+  {
+    const char* name;
+    int64_t begin_ns;
+    int64_t end_ns;
+  };
+
+  struct ThreadRecords
+  {
+    uint32_t id;
+    std::string name;
+    std::vector<Record> records;
+  };
+
+  // Find or create the calling thread's buffer
+  ThreadBuffer& thread_buffer();
+
+  // Copy out every event that isn't overwritten while we read it
+  std::vector<ThreadRecords> collect() const;
+
+  std::atomic<bool> m_enabled{false};
+  const clock::time_point m_epoch;
+  mutable std::mutex m_buffers_mutex;
+  std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+};
+
+// Records the time between its construction and destruction with the global
+// profiler, if it was enabled at construction
+class ScopedTimer
+{
+public:
+  // The name must have static storage duration, such as a string literal
+  explicit ScopedTimer(const char* i_name) noexcept
+    : m_name(Profiler::global().enabled() ? i_name : nullptr)
+    , m_begin(m_name ? Profiler::clock::now() : Profiler::clock::time_point{})
+  {
+  }
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+  ~ScopedTimer()
+  {
+    if (m_name)
+      Profiler::global().record(m_name, m_begin, Profiler::clock::now());
+  }
+
+private:
+  const char* m_name;
+  Profiler::clock::time_point m_begin;
+};
+
+#endif  // PROFILER
@@ -0,0 +1,60 @@
+#ifndef PROGRESSIVE_REFINEMENT
+#define PROGRESSIVE_REFINEMENT
+
+#include "quality_governor.h"
+#include <filament/View.h>
+#include <cstdint>
+
+// Renders cheaply while the camera is moving, then once it has come to rest
+// refines a still image by accumulating jittered frames, through temporal
+// anti-aliasing, at full quality. Once enough frames have been accumulated the
+// image has converged and nothing more needs to be drawn until something
+// changes.
+class ProgressiveRefinement
+{
+public:
+  enum PHASE { INTERACTIVE, REFINING, CONVERGED };
+
+  // Accumulate the given number of frames once the camera comes to rest, zero
+  // to render every frame the same way
+  explicit ProgressiveRefinement(uint32_t i_frames = 32);
+
+  // Change the number of frames to accumulate, zero to disable refinement
+  void set_frames(uint32_t i_frames) noexcept;
+
+  bool enabled() const noexcept;
+
+  // The camera has moved, returns true if the view should be configured
+  // again
+  bool camera_moved() noexcept;
+
+  // The camera has come to rest, returns true if the view should be
+  // configured again
+  bool camera_idle() noexcept;
+
+  // Something other than the camera changed the image, so accumulation starts
+  // again from the next frame
+  void restart() noexcept;
+
+  // Weight the next frame so the accumulated image is an even average of every
+  // frame since the camera came to rest, call before each frame is rendered
+  void prepare_frame(filament::View& io_view) const;
+
+  // Count a drawn frame. Returns true while more frames are needed to converge.
+  bool frame_drawn() noexcept;
+
+  PHASE phase() const noexcept;
+
+  // Configure a view for the current phase, starting from the tier chosen by
+  // the quality governor, which still applies while the camera moves. A still
+  // image is always refined at full quality, however long its frames take.
+  void apply(filament::View& io_view,
+             const QualityGovernor::Tier& i_tier) const;
+
+private:
+  uint32_t m_frames = 0;
+  uint32_t m_accumulated = 0;
+  PHASE m_phase = INTERACTIVE;
+};
+
+#endif  // PROGRESSIVE_REFINEMENT
@@ -0,0 +1,102 @@
+#ifndef QUALITY_GOVERNOR
+#define QUALITY_GOVERNOR
+
+#include <filament/View.h>
+#include <QJsonArray>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// Steps a view through tiers of decreasing quality to hold a frame rate.
+// Frame times are averaged over windows of frames, and the quality drops a
+// tier as soon as a window runs over budget, but is only raised after several
+// windows in a row with plenty of headroom. The frames drawn while a change
+// takes effect are ignored, and whenever a raised tier has to be dropped
+// again straight away, it must wait twice as long before it's tried again, so
+// the quality settles rather than oscillating.
+class QualityGovernor
+{
+public:
+  // One step down in quality from the tier before it
+  struct Tier
+  {
+    const char* name;
+    // Fraction of the viewport's resolution rendered, upscaled to fill it
+    float resolution_scale;
+    filament::View::AntiAliasing anti_aliasing;
+    bool shadows;
+    bool post_processing;
+    filament::View::QualityLevel quality;
+  };
+
+  // A change of tier, and the measurement which caused it
+  struct Decision
+  {
+    uint64_t frame;
+    std::size_t from;
+    std::size_t to;
+    double mean_ms;
+    double budget_ms;
+  };
+
+  // Aim for the given frame rate, zero to always render at full quality
+  explicit QualityGovernor(double i_target_fps = 60.0);
+
+  // Every tier, from full quality down
+  static const std::vector<Tier>& tiers();
+
+  // Change the frame rate to aim for, zero to always render at full quality.
+  // Starts again from full quality.
+  void set_target_fps(double i_target_fps);
+
+  // Record the time taken to draw a frame. Returns true if the tier changed,
+  // in which case the views should be configured again.
+  bool add_frame(double i_frame_ms);
+
+  // Index of the current tier in to tiers()
+  std::size_t tier() const noexcept;
+
+  // Configure a view for the current tier, replacing any quality settings it
+  // already had
+  void apply(filament::View& io_view) const;
+
+  // Configure a view for any tier
+  static void apply_tier(const Tier& i_tier, filament::View& io_view);
+
+  // Every change of tier so far
+  const std::vector<Decision>& decisions() const noexcept;
+
+  // Frame time we aim to stay under, zero if we aren't governing
+  double budget_ms() const noexcept;
+
+private:
+  bool change(std::size_t i_tier, double i_mean_ms);
+
+private:
+  double m_budget_ms = 0.0;
+  std::size_t m_tier = 0;
+  uint64_t m_frame = 0;
+  // Frames left to ignore after a change
+  uint32_t m_settling = 0;
+  // Frames measured in the current window
+  uint32_t m_window_frames = 0;
+  double m_window_ms = 0.0;
+  // Windows in a row with enough headroom to raise the quality
+  uint32_t m_headroom_windows = 0;
+  // Windows of headroom needed to raise the quality in to each tier
+  std::vector<uint32_t> m_raise_windows;
+  // When we last raised the quality, zero if we haven't, and the tier we
+  // raised it to
+  uint64_t m_raised_frame = 0;
+  std::size_t m_raised_tier = 0;
+  std::vector<Decision> m_decisions;
+};
+
+// Human readable representation of a decision
+std::ostream& operator<<(std::ostream& io_os,
+                         const QualityGovernor::Decision& i_decision);
+
+// Machine readable representation of the decisions
+QJsonArray to_json(const std::vector<QualityGovernor::Decision>& i_decisions);
+
+#endif  // QUALITY_GOVERNOR
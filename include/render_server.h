@@ -0,0 +1,51 @@
+#ifndef RENDER_SERVER
+#define RENDER_SERVER
+
+#include <QJsonObject>
+#include <QString>
+#include <filament/Engine.h>
+#include <nonstd/value_ptr.hpp>
+#include <memory>
+
+// Keeps an engine and recently used scenes loaded, and renders jobs sent by
+// clients over a local socket, so each job doesn't pay for starting a process
+// and loading its assets. Requests and replies are JSON objects, one per line:
+// {"id": 1, "scene": "assets/scenes/helmet.json", "size": [512, 512],
+//  "camera": {"yaw": 30, "elevation": 20, "distance": 4, "target": [x, y, z]},
+//  "output": "renders/helmet.png"}
+// The scene is a manifest, or an "import", or the default scene if neither is
+// given, and the camera is a view point as in a batch job's orbits. Every job
+// is answered with whether its image was written, the depth of the queue when
+// it arrived and the time it spent in each stage, and {"stats": true} is
+// answered with totals for every job so far.
+//
+// Jobs pass through three stages, and many jobs can be in flight at once.
+// Scenes which aren't cached begin loading on the thread pool, and jobs wait
+// for their scene without holding up jobs whose scene is ready. Those are
+// drawn on the engine thread, in the order they arrived, and read back in to
+// a ring of buffers, and then encoded and written on the thread pool.
+class RenderServer
+{
+public:
+  // Keep up to the given number of scenes loaded, evicting the least
+  // recently used ones which no job is waiting for while no scene is loading
+  explicit RenderServer(std::shared_ptr<filament::Engine> i_engine,
+                        std::size_t i_cache_size = 8);
+  ~RenderServer();
+
+  // Listen for clients on a local socket, replacing any stale socket left by
+  // an earlier server with the same name. Throws if it can't listen. Jobs are
+  // handled by the event loop of the calling thread, which must be the engine
+  // thread.
+  void listen(const QString& i_name);
+
+  // Totals for every job so far, the same as the reply to a stats request
+  QJsonObject stats() const;
+
+private:
+  struct RenderServerImpl;
+  // Value semantics for a smart pointer, automatically deep copies
+  nonstd::value_ptr<RenderServerImpl> m_impl;
+};
+
+#endif  // RENDER_SERVER
@@ -0,0 +1,61 @@
+#ifndef RENDER_THREAD
+#define RENDER_THREAD
+
+#include "spsc_queue.h"
+#include <filament/Engine.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Dedicated thread which makes all filament calls, decoupling rendering from
+// the Qt event loop. The GUI thread sends it commands, such as camera edits
+// and frame requests, through a lock-free single producer queue. Commands are
+// executed in the order they were posted.
+class RenderThread
+{
+public:
+  using Command = std::function<void()>;
+
+  RenderThread();
+  // Copying is disallowed as we own a thread
+  RenderThread(const RenderThread&) = delete;
+  RenderThread& operator=(const RenderThread&) = delete;
+  // Executes all outstanding commands before joining the thread
+  ~RenderThread();
+
+  // Create a filament engine on the render thread, which becomes its main
+  // thread. The engine is also destroyed on the render thread, so the render
+  // thread is kept alive for as long as the engine is. Throws if the
+  // back-end isn't available.
+  static std::shared_ptr<filament::Engine>
+  create_engine(const std::shared_ptr<RenderThread>& i_render_thread,
+                filament::Engine::Backend i_backend);
+
+  // Queue a command for execution on the render thread. Must only be called
+  // from a single producer thread, usually the GUI thread.
+  void post(Command i_command);
+
+  // Execute a command on the render thread and wait for it to complete. If
+  // called from the render thread the command is executed immediately.
+  void run_sync(Command i_command);
+
+  // Are we currently executing on the render thread?
+  bool is_current() const noexcept;
+
+private:
+  void loop();
+
+private:
+  SpscQueue<Command, 1024> m_commands;
+  // Used to put the render thread to sleep while there are no commands
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+  std::atomic<bool> m_sleeping{false};
+  std::atomic<bool> m_stop{false};
+  std::thread m_thread;
+};
+
+#endif  // RENDER_THREAD
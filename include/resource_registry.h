@@ -0,0 +1,170 @@
+#ifndef RESOURCE_REGISTRY
+#define RESOURCE_REGISTRY
+
+#include <filament/Engine.h>
+#include <filament/Fence.h>
+#include <utils/Entity.h>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// A reference to a resource owned by a ResourceRegistry. Handles are plain
+// values which cost nothing to copy. Each slot's generation changes when its
+// resource is destroyed, so a stale handle resolves to nothing rather than to
+// whatever reuses the slot.
+template <typename T>
+struct Handle
+{
+  static constexpr uint32_t INVALID = UINT32_MAX;
+  uint32_t index = INVALID;
+  uint32_t generation = 0;
+
+  explicit operator bool() const noexcept
+  {
+    return index != INVALID;
+  }
+  bool operator==(const Handle& i_other) const noexcept
+  {
+    return index == i_other.index && generation == i_other.generation;
+  }
+  bool operator!=(const Handle& i_other) const noexcept
+  {
+    return !(*this == i_other);
+  }
+};
+using EntityHandle = Handle<utils::Entity>;
+
+// Owns entities and engine registered objects through generational handles,
+// holding the only reference to the engine. Destroying a resource only
+// queues it. At each frame boundary the queued resources are fenced, and
+// destroyed in one batch once the engine has passed that fence, entities
+// first, with their components, and then the objects they may refer to.
+// Must only be used from the engine thread.
+class ResourceRegistry
+{
+public:
+  explicit ResourceRegistry(std::shared_ptr<filament::Engine> i_engine);
+  // Copying is disallowed as we own engine registered objects
+  ResourceRegistry(const ResourceRegistry&) = delete;
+  ResourceRegistry& operator=(const ResourceRegistry&) = delete;
+  // Destroys everything still alive, waiting for the engine to finish first
+  ~ResourceRegistry();
+
+  // Take ownership of an engine registered object
+  template <typename T>
+  Handle<T> adopt(T* i_object);
+  // Take ownership of an entity and its components
+  EntityHandle adopt(utils::Entity i_entity);
+  // Create entities in bulk, writing a handle for each
+  void create(std::size_t i_count, EntityHandle* o_handles);
+
+  // Resolve a handle, null if it is stale or invalid
+  template <typename T>
+  T* get(Handle<T> i_handle) const noexcept;
+  utils::Entity get(EntityHandle i_handle) const noexcept;
+
+  // Queue the resource for destruction, invalidating every handle to it.
+  // Stale handles are ignored.
+  template <typename T>
+  void destroy(Handle<T> i_handle);
+  void destroy(EntityHandle i_handle);
+  // Queue entities we don't hold handles for, such as bulk created
+  // instances, for destruction along with their components
+  void destroy(const std::vector<utils::Entity>& i_entities);
+
+  // Fence everything queued since the last frame, and destroy the batches
+  // whose fence the engine has passed. Should be called once per frame after
+  // rendering. Returns the number of resources destroyed.
+  std::size_t end_frame();
+
+  // Wait for the engine, and destroy everything queued, e.g. before swapping
+  // scenes. Returns the number of resources destroyed.
+  std::size_t flush();
+
+  // The engine our resources belong to, for owners which only borrow it
+  filament::Engine& engine() const noexcept;
+
+  // Number of live resources
+  std::size_t size() const noexcept;
+  // Number of resources waiting to be destroyed
+  std::size_t pending() const noexcept;
+
+private:
+  using Destroy = void (*)(filament::Engine&, void*);
+
+  struct Slot
+  {
+    // Null for entities
+    void* object = nullptr;
+    Destroy destroy = nullptr;
+    utils::Entity entity;
+    uint32_t generation = 0;
+    bool alive = false;
+  };
+
+  struct Batch
+  {
+    filament::Fence* fence = nullptr;
+    std::vector<utils::Entity> entities;
+    std::vector<std::pair<void*, Destroy>> objects;
+  };
+
+  // Claim a free slot, or grow, returning its index
+  uint32_t allocate();
+  // Queue and invalidate a live slot
+  void release(uint32_t i_index);
+  // Destroy a batch's resources in bulk, returning how many there were
+  std::size_t destroy_batch(Batch& io_batch);
+
+  template <typename T>
+  static void destroy_object(filament::Engine& io_engine, void* io_object)
+  {
+    io_engine.destroy(static_cast<T*>(io_object));
+  }
+
+private:
+  std::shared_ptr<filament::Engine> m_engine;
+  std::vector<Slot> m_slots;
+  std::vector<uint32_t> m_free;
+  std::size_t m_live = 0;
+  // Queued this frame, and then fenced batches oldest first
+  Batch m_queued;
+  std::deque<Batch> m_retiring;
+};
+
+template <typename T>
+Handle<T> ResourceRegistry::adopt(T* i_object)
+{
+  static_assert(std::is_base_of<filament::FilamentAPI, T>::value,
+                "Only filament objects can be owned by the registry");
+  if (!i_object)
+    return {};
+  const auto index = allocate();
+  auto& slot = m_slots[index];
+  slot.object = i_object;
+  slot.destroy = &destroy_object<T>;
+  return {index, slot.generation};
+}
+
+template <typename T>
+T* ResourceRegistry::get(Handle<T> i_handle) const noexcept
+{
+  if (i_handle.index >= m_slots.size())
+    return nullptr;
+  const auto& slot = m_slots[i_handle.index];
+  return slot.alive && slot.generation == i_handle.generation
+           ? static_cast<T*>(slot.object)
+           : nullptr;
+}
+
+template <typename T>
+void ResourceRegistry::destroy(Handle<T> i_handle)
+{
+  if (get(i_handle))
+    release(i_handle.index);
+}
+
+#endif  // RESOURCE_REGISTRY
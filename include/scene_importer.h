@@ -0,0 +1,98 @@
+#ifndef SCENE_IMPORTER
+#define SCENE_IMPORTER
+
+#include "material_library.h"
+#include <math/mat4.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A multi mesh scene imported through assimp, such as a glTF, FBX or OBJ
+// file, keeping its node hierarchy. Each mesh has been converted to its own
+// cached filamesh file with levels of detail, whose single part names one of
+// the scene's materials.
+struct ImportedScene
+{
+  struct Mesh
+  {
+    std::string filamesh_path;
+    std::size_t triangles = 0;
+  };
+
+  struct Material
+  {
+    // Unique to the source file, and used as the name in the mesh files
+    std::string name;
+    // Parameters for the aiDefaultMat package
+    MaterialParameters parameters;
+  };
+
+  struct Node
+  {
+    std::string name;
+    // Index of the parent node, which always precedes its children
+    int32_t parent = -1;
+    // Relative to the parent
+    filament::math::mat4f transform;
+    // Indices of the meshes drawn at this node
+    std::vector<uint32_t> meshes;
+  };
+
+  std::string source_path;
+  std::vector<Mesh> meshes;
+  std::vector<Material> materials;
+  std::vector<Node> nodes;
+};
+
+// Timings of a single scene import
+struct SceneImportReport
+{
+  std::string source_path;
+  std::size_t meshes = 0;
+  std::size_t materials = 0;
+  std::size_t nodes = 0;
+  std::size_t triangles = 0;
+  // Meshes which were already in the cache
+  std::size_t cache_hits = 0;
+  // Threads the conversion was spread across, including the caller
+  std::size_t threads = 1;
+  double read_ms = 0.0;
+  double convert_ms = 0.0;
+  double total_ms = 0.0;
+};
+
+// Converts multi mesh scenes to one filamesh file per mesh. Assimp reads the
+// file on the calling thread, then each mesh's vertices and indices are
+// optimized, simplified in to levels of detail and written to the cache, and
+// each material's parameters extracted, spread across the thread pool.
+// Meshes are cached by a hash of the source file and their index in it,
+// along with a description of the hierarchy and materials, so later imports
+// skip assimp entirely. Only the source
+// file itself is hashed, so external buffers should not be edited in place.
+class SceneImporter
+{
+public:
+  explicit SceneImporter(std::string i_cache_directory = "cache/scenes");
+
+  // Most threads to convert with, including the caller, zero to use every
+  // worker
+  void set_max_threads(std::size_t i_max_threads) noexcept;
+
+  // Import a scene, converting any meshes not already cached. Safe to call
+  // from any thread, throws on failure.
+  ImportedScene import(const std::string& i_path,
+                       SceneImportReport* o_report = nullptr) const;
+
+private:
+  // Read the scene through assimp and convert any meshes not already cached,
+  // then cache the scene's description
+  ImportedScene read(const std::string& i_path,
+                     const std::string& i_directory,
+                     SceneImportReport& io_report) const;
+
+private:
+  std::string m_cache_directory;
+  std::size_t m_max_threads = 0;
+};
+
+#endif  // SCENE_IMPORTER
@@ -0,0 +1,79 @@
+#ifndef SCENE_MANIFEST
+#define SCENE_MANIFEST
+
+#include "material_library.h"
+#include <QString>
+#include <math/mat4.h>
+#include <string>
+#include <vector>
+
+// Describes the meshes in a scene, and every transform they are instanced at.
+// Manifests are stored as JSON:
+// {
+//   "environment": "assets/env/studio.hdr",
+//   "meshes": [
+//     {
+//       "mesh": "assets/models/suzanne.obj",
+//       "material": "DefaultMaterial",
+//       "parameters": {"baseColor": [r, g, b], "roughness": 0.5},
+//       "transforms": [
+//         [16 floats, a column major matrix],
+//         {"translation": [x, y, z], "rotation": [x, y, z, w], "scale": s}
+//       ]
+//     }
+//   ],
+//   "imports": [
+//     {"path": "assets/models/scene.gltf", "transform": <as above>}
+//   ]
+// }
+// Meshes may be filamesh files, or any format assimp can import, which are
+// converted and cached on first load. The material is optional, if omitted
+// the materials named in the mesh file are used. When parameters are given
+// the material names a package in the material library, and entries with
+// identical parameters share one material instance. Entries sharing a mesh
+// share its vertex and index buffers. The environment is optional, an
+// equirectangular HDR image the image based lighting is baked from, if
+// omitted the prebaked pillars environment is used. Imports are multi mesh
+// scenes in any format assimp supports, such as glTF or FBX, which keep their
+// node hierarchy and materials, placed by an optional root transform.
+struct SceneManifest
+{
+  struct Entry
+  {
+    std::string mesh;
+    std::string material;
+    MaterialParameters parameters;
+    std::vector<filament::math::mat4f> transforms;
+  };
+
+  struct Import
+  {
+    std::string path;
+    filament::math::mat4f transform;
+  };
+
+  // Parse a manifest from a JSON file, throws on failure
+  static SceneManifest load(const QString& i_path);
+
+  // The default scene, a single suzanne at the origin
+  static SceneManifest default_scene();
+
+  // A square grid of suzannes facing the camera, scaled to fit in view, used
+  // to stress test large instance counts. With more than one look the
+  // instances cycle through that many distinct material parameter sets. A
+  // count of zero gives an empty scene.
+  static SceneManifest grid(uint32_t i_count, uint32_t i_looks = 1);
+
+  // Total number of instances across all entries
+  std::size_t instance_count() const noexcept;
+
+  std::vector<Entry> entries;
+  std::vector<Import> imports;
+  // Relative paths are resolved against the working directory
+  std::string environment;
+  // Use KTX2 textures, transcoded to a compressed format the back-end
+  // supports, where they exist next to the KTX files
+  bool compressed_textures = true;
+};
+
+#endif  // SCENE_MANIFEST
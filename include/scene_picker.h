@@ -0,0 +1,95 @@
+#ifndef SCENE_PICKER
+#define SCENE_PICKER
+
+#include "bvh.h"
+#include "instanced_mesh.h"
+#include "mesh_bvh.h"
+#include "thread_pool.h"
+#include "transform_store.h"
+#include <filament/Camera.h>
+#include <math/mat4.h>
+#include <math/vec2.h>
+#include <utils/Entity.h>
+#include <future>
+#include <memory>
+#include <vector>
+
+// The nearest instance under a ray, and where it was hit
+struct PickResult
+{
+  bool hit = false;
+  utils::Entity entity;
+  // Index of the triangle in the mesh's index buffer, see MeshBvh::Hit
+  uint32_t triangle = 0;
+  // World space position of the hit, and its distance from the ray origin
+  filament::math::float3 position;
+  float distance = 0.f;
+};
+
+// World space ray through a point in normalized device coordinates, from a
+// camera's current view and projection
+bvh::Ray camera_ray(const filament::Camera& i_camera,
+                    filament::math::float2 i_ndc);
+
+// Finds the instance under a ray using a two level hierarchy. Each mesh's
+// triangles get a bounding volume hierarchy of their own, built on the thread
+// pool in the background, and a top level hierarchy over the world bounds of
+// every instance is rebuilt when a pick follows any change to the instances,
+// or refit when only their transforms changed. Meshes whose hierarchy is still building can't be
+// picked yet. Must be used from the engine thread.
+class ScenePicker
+{
+public:
+  explicit ScenePicker(ThreadPool& io_pool = ThreadPool::global());
+
+  // Begin building the hierarchy of a mesh's triangles, from the file
+  // contents it was created from. The mesh must outlive us.
+  void add_mesh(const InstancedMesh& i_mesh,
+                std::shared_ptr<const std::vector<uint8_t>> i_data);
+
+  // Find the nearest instance hit by a world space ray
+  PickResult pick(const bvh::Ray& i_ray, const TransformStore& i_transforms);
+
+  // Block until every mesh's hierarchy has been built
+  void wait() const;
+
+  // Triangles across every pickable instance
+  std::size_t triangle_count() const noexcept;
+
+  // Total time spent building the hierarchies of the meshes
+  double build_ms() const;
+
+private:
+  // Build or refit the top level hierarchy if anything changed since the
+  // last one
+  void update(const TransformStore& i_transforms);
+
+private:
+  struct Mesh
+  {
+    const InstancedMesh* mesh;
+    std::shared_future<std::shared_ptr<const MeshBvh>> bvh;
+    // Set once the future has been seen to be ready
+    std::shared_ptr<const MeshBvh> ready;
+  };
+
+  struct Instance
+  {
+    utils::Entity entity;
+    uint32_t mesh;
+    // Takes world space rays in to the mesh's space
+    filament::math::mat4f world_to_mesh;
+  };
+
+  ThreadPool* m_pool;
+  std::vector<Mesh> m_meshes;
+  std::vector<Instance> m_instances;
+  bvh::Tree m_tree;
+  std::size_t m_triangles = 0;
+  // What the top level hierarchy was built from
+  std::size_t m_built_version = 0;
+  std::size_t m_built_instances = 0;
+  std::size_t m_built_meshes = 0;
+};
+
+#endif  // SCENE_PICKER
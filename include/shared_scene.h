@@ -0,0 +1,92 @@
+#ifndef SHARED_SCENE
+#define SHARED_SCENE
+
+#include "render_thread.h"
+#include "scene_manifest.h"
+#include "scene_picker.h"
+#include <filament/View.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// A scene shared by every window which renders it, so the engine, materials
+// and GPU buffers exist once however many views there are. The scene and its
+// asset loader live on the render thread. Frames requested by any window are
+// batched, so every view drawn in one pass of the Qt event loop is rendered
+// by a single render thread command, which loads assets and selects levels
+// of detail once for all of them.
+class SharedScene : public std::enable_shared_from_this<SharedScene>
+{
+public:
+  // A single view's part of a batched frame
+  struct Target
+  {
+    // Used to select levels of detail, must outlive the frame
+    const filament::View* view;
+    // Renders and presents the view on the render thread, told whether assets
+    // are still loading and whether the scene is animating, in either case
+    // another frame should be requested
+    std::function<void(bool, bool)> draw;
+  };
+
+  // The engine must have been created by the render thread
+  SharedScene(std::shared_ptr<filament::Engine> i_engine,
+              std::shared_ptr<RenderThread> i_render_thread,
+              SceneManifest i_manifest = SceneManifest::default_scene());
+  // Copying is disallowed as views refer to our scene
+  SharedScene(const SharedScene&) = delete;
+  SharedScene& operator=(const SharedScene&) = delete;
+  // Destroys the scene on the render thread
+  ~SharedScene();
+
+  const std::shared_ptr<filament::Engine>& engine() const noexcept;
+  const std::shared_ptr<RenderThread>& render_thread() const noexcept;
+
+  // Link a view to our scene, beginning to load the scene for the first view.
+  // Must be called on the render thread.
+  void attach(filament::View& io_view);
+
+  // Find the nearest instance under a point in normalized device
+  // coordinates, as seen by the camera. Must be called on the render thread.
+  PickResult pick(const filament::Camera& i_camera,
+                  filament::math::float2 i_ndc);
+
+  // Set whether levels of detail are selected, from the GUI thread
+  void set_lods_enabled(bool i_enabled);
+
+  // Bytes of texture levels uploaded per frame, zero for no limit
+  void set_upload_budget(std::size_t i_bytes);
+
+  // Animate every instance, redrawing continuously while enabled
+  void set_animated(bool i_animated);
+
+  // Most threads to compute transforms with, zero to use every worker
+  void set_transform_threads(std::size_t i_max_threads);
+
+  // Queue a view to be drawn in the next batched frame, from the GUI thread.
+  // Submitting the same key again before the batch is rendered replaces the
+  // previous target, so each view is drawn at most once per batch.
+  void submit(const void* i_key, Target i_target);
+
+  // Remove a queued view that has not yet been rendered, from the GUI thread
+  void cancel(const void* i_key);
+
+private:
+  // Post every queued target to the render thread as one command
+  void flush();
+
+  // Render a batch of views, on the render thread
+  void render(const std::vector<Target>& i_targets);
+
+private:
+  struct RenderState;
+  std::shared_ptr<filament::Engine> m_engine;
+  std::shared_ptr<RenderThread> m_render_thread;
+  // Only accessed on the render thread
+  std::unique_ptr<RenderState> m_render_state;
+  // Targets queued on the GUI thread for the next batch
+  std::vector<std::pair<const void*, Target>> m_pending;
+  bool m_flush_scheduled = false;
+};
+
+#endif  // SHARED_SCENE
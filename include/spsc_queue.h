@@ -0,0 +1,55 @@
+#ifndef SPSC_QUEUE
+#define SPSC_QUEUE
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free queue, safe for exactly one producer thread and one
+// consumer thread. The capacity must be a power of two.
+template <typename T, std::size_t N>
+class SpscQueue
+{
+  static_assert(N && (N & (N - 1)) == 0, "Capacity must be a power of two");
+
+public:
+  // Called only from the producer thread, returns false if the queue is full
+  bool try_push(T&& i_value)
+  {
+    const auto tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == N)
+      return false;
+    m_buffer[tail & (N - 1)] = std::move(i_value);
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Called only from the consumer thread, returns false if the queue is empty
+  bool try_pop(T& o_value)
+  {
+    const auto head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire))
+      return false;
+    auto& slot = m_buffer[head & (N - 1)];
+    o_value = std::move(slot);
+    // Release any resources held by the moved from value
+    slot = T{};
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Approximate when called concurrently with a push or pop
+  bool empty() const noexcept
+  {
+    return m_head.load(std::memory_order_acquire) ==
+           m_tail.load(std::memory_order_acquire);
+  }
+
+private:
+  std::array<T, N> m_buffer;
+  // Keep the indices on separate cache lines to avoid false sharing
+  alignas(64) std::atomic<std::size_t> m_head{0};
+  alignas(64) std::atomic<std::size_t> m_tail{0};
+};
+
+#endif  // SPSC_QUEUE
@@ -0,0 +1,70 @@
+#ifndef TEXTURE_REPORT
+#define TEXTURE_REPORT
+
+#include <QJsonObject>
+#include <filament/Texture.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Measures the time from a texture's first level being handed to the engine,
+// until the engine has released the last of them, i.e. until the driver has
+// consumed every upload. Release callbacks may arrive on any thread.
+class UploadTimer
+{
+public:
+  explicit UploadTimer(uint32_t i_uploads);
+
+  // Called as each upload is released by the engine
+  void upload_released() noexcept;
+
+  // Whether every upload has been released
+  bool complete() const noexcept;
+
+  // Milliseconds taken for every upload to be released, zero until complete
+  double elapsed_ms() const noexcept;
+
+private:
+  using clock = std::chrono::steady_clock;
+  const clock::time_point m_start;
+  std::atomic<uint32_t> m_remaining;
+  std::atomic<double> m_elapsed_ms{0.0};
+};
+
+// Describes a texture as it was created on the GPU, so that encodings can be
+// compared for memory use and upload times
+struct TextureReport
+{
+  std::string name;
+  // Name of the GPU format the texture was created with
+  std::string format;
+  bool compressed = false;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t levels = 0;
+  uint32_t faces = 1;
+  // Bytes uploaded across every level and face, which for the formats we use
+  // is the memory the texture occupies on the GPU
+  std::size_t gpu_bytes = 0;
+  // Time spent transcoding on a worker, zero when no transcoding was needed
+  double transcode_ms = 0.0;
+  std::shared_ptr<UploadTimer> upload;
+};
+
+// Name of a texture format, for reporting
+const char* format_name(filament::Texture::InternalFormat i_format) noexcept;
+
+// Whether the format is block compressed
+bool is_compressed(filament::Texture::InternalFormat i_format) noexcept;
+
+// Machine readable representation of the texture
+QJsonObject to_json(const TextureReport& i_report);
+
+// Human readable representation of a texture
+std::ostream& operator<<(std::ostream& io_os, const TextureReport& i_report);
+
+#endif  // TEXTURE_REPORT
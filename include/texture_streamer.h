@@ -0,0 +1,100 @@
+#ifndef TEXTURE_STREAMER
+#define TEXTURE_STREAMER
+
+#include "ktx_mapping.h"
+#include "texture_report.h"
+#include "upload_budget.h"
+#include <filament/Engine.h>
+#include <filament/Texture.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Streams the mip levels of KTX textures in to the engine over many frames,
+// smallest first, so that the first frame never waits for a large upload.
+// Filament can't restrict sampling to a range of levels, so each texture
+// only ever holds the levels that have arrived: when more levels fit in a
+// frame's upload budget, a new texture with the larger base level replaces
+// the previous one. The smaller levels are uploaded again each time, but
+// they add up to at most a third of the full texture. Textures which can't be
+// sampled correctly with levels missing, such as prefiltered reflections
+// whose levels are chosen by roughness, can instead have their levels
+// uploaded in to the complete texture over many frames, and are only passed
+// on once it's whole.
+class TextureStreamer
+{
+public:
+  // Called with each replacement texture, which the callee takes ownership
+  // of. Anything referring to the previous texture must be updated before
+  // returning, and the previous texture destroyed.
+  using Replace = std::function<void(filament::Texture*)>;
+
+  explicit TextureStreamer(std::shared_ptr<filament::Engine> i_engine,
+                           std::size_t i_budget = DEFAULT_UPLOAD_BUDGET);
+  // Copying is disallowed as we may own textures still being uploaded
+  TextureStreamer(const TextureStreamer&) = delete;
+  TextureStreamer& operator=(const TextureStreamer&) = delete;
+  // Destroys any textures which never became whole
+  ~TextureStreamer();
+
+  // Bytes that may be uploaded each frame, zero to upload every remaining
+  // level in the next update
+  void set_budget(std::size_t i_budget) noexcept;
+
+  // Create a texture holding only the smallest level and pass it to the
+  // callback, before returning. The remaining levels stream in during later
+  // updates. If it isn't progressive, the callback is instead only called
+  // once every level has been uploaded. When provided, the report describes
+  // the complete texture, and its upload time runs until the final level has
+  // been consumed. Must be called from the engine thread.
+  void stream(std::shared_ptr<KtxMapping> i_ktx,
+              bool i_srgb,
+              bool i_rgbm,
+              Replace i_replace,
+              TextureReport* o_report = nullptr,
+              bool i_progressive = true);
+
+  // Grow the textures with as many of their next levels as fit in the
+  // budget, at least one level per frame. Should be called once per frame
+  // from the engine thread. Returns the number of bytes uploaded.
+  std::size_t update();
+
+  // Whether any texture is still missing levels
+  bool streaming() const noexcept;
+
+private:
+  struct Stream
+  {
+    std::shared_ptr<KtxMapping> ktx;
+    bool srgb;
+    bool rgbm;
+    Replace replace;
+    // The most detailed level the current texture holds
+    uint32_t base_level;
+    // Notified by the uploads of the complete texture
+    std::shared_ptr<UploadTimer> timer;
+    // The complete texture, when levels are uploaded in to it rather than
+    // replacing it
+    filament::Texture* whole;
+  };
+
+  // Replace the stream's texture with one holding every level from the base
+  // level down, or upload the levels it's missing in to the whole texture.
+  // Returns the bytes uploaded.
+  std::size_t replace(Stream& io_stream, uint32_t i_base_level);
+
+  // Bytes moving the stream's base level up to the given one would upload
+  static std::size_t upload_size(const Stream& i_stream,
+                                 uint32_t i_base_level) noexcept;
+
+  // Bytes a texture holding every level from the base level down uploads
+  static std::size_t resident_size(const KtxMapping& i_ktx,
+                                   uint32_t i_base_level) noexcept;
+
+private:
+  std::shared_ptr<filament::Engine> m_engine;
+  std::size_t m_budget;
+  std::vector<Stream> m_streams;
+};
+
+#endif  // TEXTURE_STREAMER
@@ -0,0 +1,119 @@
+#ifndef THREAD_POOL
+#define THREAD_POOL
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed size pool of worker threads, used to run CPU side work such as file
+// parsing off the Qt GUI thread.
+class ThreadPool
+{
+public:
+  // Spawn the requested number of worker threads, at least one is created
+  explicit ThreadPool(
+    std::size_t i_num_threads = std::thread::hardware_concurrency());
+  // Copying is disallowed as we own threads
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  // Waits for all queued tasks to finish before joining the workers
+  ~ThreadPool();
+
+  // Process wide pool, sized to the hardware concurrency, created on first use
+  static ThreadPool& global();
+
+  // Queue a task for execution, the returned future holds its result, or any
+  // exception it threw
+  template <typename F>
+  auto submit(F&& i_task) -> std::future<decltype(i_task())>
+  {
+    using result_t = decltype(i_task());
+    // std::function requires copyable targets, so share the packaged task
+    auto task =
+      std::make_shared<std::packaged_task<result_t()>>(std::forward<F>(i_task));
+    auto result = task->get_future();
+    enqueue([task] { (*task)(); });
+    return result;
+  }
+
+  // Call i_body(begin, end) over chunks of the range [0, i_count), spread
+  // across at most i_max_threads threads including the caller, or every
+  // worker if zero. The caller works on chunks too, and only waits for chunks
+  // other threads have started, so this is safe to call from a worker. The
+  // body must not throw.
+  template <typename F>
+  void parallel_for(std::size_t i_count,
+                    F&& i_body,
+                    std::size_t i_grain = 1,
+                    std::size_t i_max_threads = 0)
+  {
+    if (!i_count)
+      return;
+    struct Shared
+    {
+      std::atomic<std::size_t> next{0};
+      std::atomic<std::size_t> done{0};
+      std::size_t count;
+      std::size_t grain;
+      std::size_t chunks;
+      std::mutex mutex;
+      std::condition_variable condition;
+      // Only dereferenced after claiming a chunk, which is before we return
+      typename std::remove_reference<F>::type* body;
+    };
+    auto shared = std::make_shared<Shared>();
+    shared->count = i_count;
+    shared->grain = std::max(i_grain, std::size_t{1});
+    shared->chunks = (i_count + shared->grain - 1) / shared->grain;
+    shared->body = &i_body;
+
+    const auto work = [](Shared& io_shared) {
+      for (std::size_t chunk; (chunk = io_shared.next++) < io_shared.chunks;)
+      {
+        const auto begin = chunk * io_shared.grain;
+        (*io_shared.body)(begin,
+                          std::min(begin + io_shared.grain, io_shared.count));
+        if (++io_shared.done == io_shared.chunks)
+        {
+          std::lock_guard<std::mutex> lock(io_shared.mutex);
+          io_shared.condition.notify_all();
+        }
+      }
+    };
+
+    const auto threads = i_max_threads ? i_max_threads : size() + 1;
+    const auto helpers = std::min({threads - 1, size(), shared->chunks - 1});
+    for (std::size_t i = 0; i < helpers; ++i)
+      enqueue([shared, work] { work(*shared); });
+    work(*shared);
+
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    shared->condition.wait(
+      lock, [&shared] { return shared->done == shared->chunks; });
+  }
+
+  // Number of worker threads in this pool
+  std::size_t size() const noexcept;
+
+private:
+  void enqueue(std::function<void()> i_task);
+
+  void worker_loop();
+
+private:
+  std::vector<std::thread> m_workers;
+  std::deque<std::function<void()>> m_tasks;
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+  bool m_stop = false;
+};
+
+#endif  // THREAD_POOL
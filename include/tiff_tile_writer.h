@@ -0,0 +1,50 @@
+#ifndef TIFF_TILE_WRITER
+#define TIFF_TILE_WRITER
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+// Writes an uncompressed 8 bit RGB TIFF a tile at a time, so images too large
+// to hold in memory can be streamed to disk. The layout of the file is fixed
+// when it's created, so tiles can be written in any order and from any
+// thread, each straight to its place. Files over 4GiB are written as BigTIFF.
+class TiffTileWriter
+{
+public:
+  // Create the file, throws if it can't be created. The tile dimensions must
+  // be multiples of 16, and tiles on the right and bottom edges may extend
+  // past the image.
+  TiffTileWriter(const std::string& i_path,
+                 uint32_t i_width,
+                 uint32_t i_height,
+                 uint32_t i_tile_width,
+                 uint32_t i_tile_height);
+
+  uint32_t columns() const noexcept;
+  uint32_t rows() const noexcept;
+
+  // Write a tile of RGBA pixels with its rows from the bottom up, as they're
+  // read back from the GPU, and the given number of pixels from one row to
+  // the next, zero if they're tightly packed. Returns false on failure.
+  bool write_tile(uint32_t i_column,
+                  uint32_t i_row,
+                  const uint8_t* i_rgba,
+                  uint32_t i_row_pixels = 0);
+
+  // Flush the file, returns false if any write failed
+  bool close();
+
+private:
+  std::mutex m_mutex;
+  std::ofstream m_file;
+  uint32_t m_tile_width;
+  uint32_t m_tile_height;
+  uint32_t m_columns;
+  uint32_t m_rows;
+  uint64_t m_data_offset = 0;
+  bool m_failed = false;
+};
+
+#endif  // TIFF_TILE_WRITER
@@ -25,6 +25,15 @@ public:
 
   void act(filament::math::float2 i_mouse_position) noexcept;
 
+  // Place the camera on its orbit directly, by yaw about the up axis and
+  // pitch, in radians, as the mouse would. Positive pitch looks up at the
+  // target from below, and is kept short of the poles.
+  void set_spherical_position(filament::math::float2 i_yaw_pitch) noexcept;
+  // Distance from the camera to its target
+  void set_arm_length(float i_arm_length) noexcept;
+  // The point the camera orbits and looks at
+  void set_target(filament::math::float3 i_target) noexcept;
+
   filament::math::float3 eye() const noexcept;
   filament::math::float3 target() const noexcept;
   filament::math::float3 up() const noexcept;
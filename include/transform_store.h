@@ -0,0 +1,144 @@
+#ifndef TRANSFORM_STORE
+#define TRANSFORM_STORE
+
+#include "thread_pool.h"
+#include <filament/Engine.h>
+#include <filament/TransformManager.h>
+#include <math/mat3.h>
+#include <math/mat4.h>
+#include <math/quat.h>
+#include <math/vec3.h>
+#include <utils/Entity.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Transforms of many entities, stored as structure of arrays, which computes
+// world matrices itself and hands filament only the ones that changed.
+// Each node has a translation, rotation and scale relative to an optional
+// parent node, which must be added before its children. Setting any of them
+// marks the node dirty, and update() propagates that to its descendants,
+// recomputes every dirty world matrix across the thread pool and commits
+// them in a single local transform transaction. The entities' filament
+// transforms have no parents, their local transforms are our world ones.
+// Entities destroyed elsewhere are skipped when committing.
+// Must only be used from the engine thread.
+class TransformStore
+{
+public:
+  using Node = uint32_t;
+  static constexpr Node NONE = UINT32_MAX;
+
+  explicit TransformStore(std::shared_ptr<filament::Engine> i_engine,
+                          ThreadPool& io_pool = ThreadPool::global());
+
+  // Add a node for each entity, decomposing its local matrix. Mirrored
+  // matrices get a negative scale. Matrices with shear or a zero length axis
+  // can't be decomposed, so keep their upper 3x3 as is until the node's
+  // rotation or scale is set. The entities are given transform components if
+  // they don't already have them. The new nodes' world matrices are available
+  // immediately. Returns the index of the first new node, the rest follow it
+  // in order.
+  Node add(const std::vector<utils::Entity>& i_entities,
+           const std::vector<filament::math::mat4f>& i_transforms,
+           Node i_parent = NONE);
+
+  // Number of nodes
+  std::size_t size() const noexcept;
+
+  void set_translation(Node i_node,
+                       const filament::math::float3& i_translation);
+  void set_rotation(Node i_node, const filament::math::quatf& i_rotation);
+  void set_scale(Node i_node, const filament::math::float3& i_scale);
+
+  filament::math::float3 translation(Node i_node) const noexcept;
+  filament::math::quatf rotation(Node i_node) const noexcept;
+  filament::math::float3 scale(Node i_node) const noexcept;
+
+  // The world matrix as of the last update
+  const filament::math::mat4f& world(Node i_node) const noexcept;
+  // Whether the world matrix changed in the last update
+  bool changed(Node i_node) const noexcept;
+  // Incremented by every update which changes any world matrix, so caches
+  // built from them can tell when they are stale
+  std::size_t version() const noexcept;
+
+  // Most threads to update with including the caller, zero to use every
+  // worker. Small updates always run on the calling thread.
+  void set_max_threads(std::size_t i_max_threads) noexcept;
+
+  // Recompute the world matrices of dirty nodes and their descendants, and
+  // commit them to filament in one transaction. Should be called once per
+  // frame before rendering. Returns the number of transforms committed.
+  std::size_t update();
+
+private:
+  // Compute the local matrices of the dirty nodes in a range, in to their
+  // world matrices
+  void compute_local(std::size_t i_begin, std::size_t i_end);
+
+private:
+  std::shared_ptr<filament::Engine> m_engine;
+  ThreadPool* m_pool;
+  std::size_t m_max_threads = 0;
+
+  // Local transform components, one array each
+  std::vector<float> m_tx, m_ty, m_tz;
+  std::vector<float> m_rx, m_ry, m_rz, m_rw;
+  std::vector<float> m_sx, m_sy, m_sz;
+  // Index in to the kept upper 3x3s of nodes which couldn't be decomposed,
+  // NONE for the rest
+  std::vector<uint32_t> m_linear_index;
+  std::vector<filament::math::mat3f> m_linear;
+  std::vector<Node> m_parents;
+  std::vector<uint8_t> m_local_dirty;
+  // Set during update for nodes whose world matrix must be recomputed
+  std::vector<uint8_t> m_world_dirty;
+  std::vector<filament::math::mat4f> m_world;
+  // Filament swaps its components around as others are destroyed, so the
+  // entities are kept and their instances looked up on each commit
+  std::vector<utils::Entity> m_entities;
+  // Nodes with a parent, grouped by depth, so each group only depends on the
+  // ones before it
+  std::vector<std::vector<Node>> m_depths;
+  std::vector<uint32_t> m_depth;
+  bool m_any_dirty = false;
+  std::size_t m_version = 0;
+};
+
+inline void
+TransformStore::set_translation(Node i_node,
+                                const filament::math::float3& i_translation)
+{
+  m_tx[i_node] = i_translation.x;
+  m_ty[i_node] = i_translation.y;
+  m_tz[i_node] = i_translation.z;
+  m_local_dirty[i_node] = 1;
+  m_any_dirty = true;
+}
+
+inline void
+TransformStore::set_rotation(Node i_node,
+                             const filament::math::quatf& i_rotation)
+{
+  m_rx[i_node] = i_rotation.x;
+  m_ry[i_node] = i_rotation.y;
+  m_rz[i_node] = i_rotation.z;
+  m_rw[i_node] = i_rotation.w;
+  m_linear_index[i_node] = NONE;
+  m_local_dirty[i_node] = 1;
+  m_any_dirty = true;
+}
+
+inline void TransformStore::set_scale(Node i_node,
+                                      const filament::math::float3& i_scale)
+{
+  m_sx[i_node] = i_scale.x;
+  m_sy[i_node] = i_scale.y;
+  m_sz[i_node] = i_scale.z;
+  m_linear_index[i_node] = NONE;
+  m_local_dirty[i_node] = 1;
+  m_any_dirty = true;
+}
+
+#endif  // TRANSFORM_STORE
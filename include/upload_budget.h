@@ -0,0 +1,9 @@
+#ifndef UPLOAD_BUDGET
+#define UPLOAD_BUDGET
+
+#include <cstddef>
+
+// Bytes of texture levels streamed in per frame unless told otherwise
+constexpr std::size_t DEFAULT_UPLOAD_BUDGET = 4u << 20u;
+
+#endif  // UPLOAD_BUDGET
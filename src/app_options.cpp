@@ -0,0 +1,301 @@
+#include "app_options.h"
+#include <QCommandLineParser>
+#include <QStringList>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+
+namespace
+{
+// Every back-end we support, and the names they're selected by
+const std::pair<filament::Engine::Backend, const char*> BACKENDS[] = {
+  {filament::Engine::Backend::OPENGL, "opengl"},
+  {filament::Engine::Backend::VULKAN, "vulkan"},
+  {filament::Engine::Backend::NOOP, "noop"}};
+}  // namespace
+
+const char* backend_name(filament::Engine::Backend i_backend)
+{
+  for (const auto& backend : BACKENDS)
+  {
+    if (backend.first == i_backend)
+      return backend.second;
+  }
+  return "default";
+}
+
+bool parse_backend(const QString& i_name, filament::Engine::Backend& o_backend)
+{
+  for (const auto& backend : BACKENDS)
+  {
+    if (i_name.compare(backend.second, Qt::CaseInsensitive) == 0)
+    {
+      o_backend = backend.first;
+      return true;
+    }
+  }
+  return false;
+}
+
+AppOptions parse_app_options(int argc, char* argv[])
+{
+  QStringList arguments;
+  for (int i = 0; i < argc; ++i)
+    arguments << QString::fromLocal8Bit(argv[i]);
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Qt Filament PBR example");
+  const QCommandLineOption help_option({"h", "help"}, "Display this help.");
+  const QCommandLineOption headless_option(
+    "headless", "Render offscreen and print a frame time benchmark.");
+  const QCommandLineOption continuous_option(
+    "continuous", "Redraw the window every display refresh.");
+  const QCommandLineOption backend_option(
+    "backend",
+    "Rendering back-end, opengl, vulkan or noop, overriding QFP_BACKEND.",
+    "name");
+  const QCommandLineOption noop_option(
+    "noop", "Use the NOOP back-end, which requires no GPU.");
+  const QCommandLineOption backend_compare_option(
+    "backend-compare",
+    "Benchmark the same scene and camera path on every back-end.");
+  const QCommandLineOption camera_path_option(
+    "camera-path", "Orbit the camera around the scene in headless mode.");
+  const QCommandLineOption target_fps_option(
+    "target-fps",
+    "Frame rate to hold by lowering the quality, 0 for full quality.",
+    "fps");
+  const QCommandLineOption refine_frames_option(
+    "refine-frames",
+    "Frames to refine a still image over, 0 to render every frame alike.",
+    "count");
+  const QCommandLineOption frames_option(
+    "frames", "Number of frames to measure in headless mode.", "count");
+  const QCommandLineOption warmup_option(
+    "warmup", "Number of unmeasured warm-up frames in headless mode.", "count");
+  const QCommandLineOption size_option(
+    "size", "Offscreen resolution in headless mode.", "WIDTHxHEIGHT");
+  const QCommandLineOption json_option(
+    "json", "Write the JSON benchmark summary to a file.", "path");
+  const QCommandLineOption scene_option(
+    "scene", "Load the scene described by a JSON manifest.", "path");
+  const QCommandLineOption instances_option(
+    "instances", "Render a generated grid of instances.", "count");
+  const QCommandLineOption looks_option(
+    "looks", "Number of distinct materials in a generated grid.", "count");
+  const QCommandLineOption stress_option(
+    "stress", "Benchmark 1k, 10k and 100k instances in headless mode.");
+  const QCommandLineOption no_lod_option(
+    "no-lod", "Always draw meshes at full detail.");
+  const QCommandLineOption lod_compare_option(
+    "lod-compare",
+    "Benchmark a dense grid with levels of detail on and off in headless mode.");
+  const QCommandLineOption profile_option(
+    "profile", "Record CPU timings of each frame and startup phase.");
+  const QCommandLineOption trace_option(
+    "trace", "Write a Chrome trace of the recorded timings on exit.", "path");
+  const QCommandLineOption views_option(
+    "views", "Number of views sharing the scene, e.g. 4 for a quad view.",
+    "count");
+  const QCommandLineOption separate_windows_option(
+    "separate-windows",
+    "Give each view its own window, spread across the screens.");
+  const QCommandLineOption views_compare_option(
+    "views-compare",
+    "Benchmark the views sharing an engine against a process per view.");
+  const QCommandLineOption environment_option(
+    "environment",
+    "Bake image based lighting from an equirectangular HDR image.",
+    "path");
+  const QCommandLineOption bake_bench_option(
+    "bake-bench",
+    "Benchmark baking an HDR image at several sizes and thread counts.",
+    "path");
+  const QCommandLineOption upload_budget_option(
+    "upload-budget",
+    "KiB of texture levels to stream in per frame, 0 for no limit.",
+    "KiB");
+  const QCommandLineOption registry_bench_option(
+    "registry-bench",
+    "Benchmark creating and destroying entities through the RAII wrappers "
+    "against the resource registry.",
+    "count");
+  const QCommandLineOption no_ktx2_option(
+    "no-ktx2", "Always use the uncompressed KTX textures.");
+  const QCommandLineOption texture_compare_option(
+    "texture-compare",
+    "Benchmark uncompressed textures against transcoded KTX2 in headless "
+    "mode.");
+  const QCommandLineOption animate_option(
+    "animate", "Animate every instance, updating its transform each frame.");
+  const QCommandLineOption transform_threads_option(
+    "transform-threads",
+    "Most threads to update transforms with, 0 for every worker.",
+    "count");
+  const QCommandLineOption crowd_option(
+    "crowd",
+    "Benchmark animating a dense grid on one thread and on every worker in "
+    "headless mode.");
+  const QCommandLineOption pick_bench_option(
+    "pick-bench",
+    "Benchmark picking latency at increasing triangle counts in headless "
+    "mode.");
+  const QCommandLineOption import_option(
+    "import",
+    "Import a multi mesh glTF, FBX or OBJ scene, may be repeated.",
+    "path");
+  const QCommandLineOption import_bench_option(
+    "import-bench",
+    "Benchmark converting a scene on one thread and on every worker.",
+    "path");
+  const QCommandLineOption batch_option(
+    "batch",
+    "Render the thumbnails and turntables described by a JSON batch job.",
+    "path");
+  const QCommandLineOption serve_option(
+    "serve",
+    "Keep the engine and scenes loaded, rendering jobs sent to a local socket.",
+    "name");
+  const QCommandLineOption poster_option(
+    "poster",
+    "Render the scene to a TIFF of --size pixels, in tiles, streamed to disk.",
+    "path");
+  const QCommandLineOption tile_option(
+    "tile", "Size of the tiles a poster is rendered in.", "pixels");
+  parser.addOptions({help_option,
+                     headless_option,
+                     continuous_option,
+                     backend_option,
+                     noop_option,
+                     backend_compare_option,
+                     camera_path_option,
+                     target_fps_option,
+                     refine_frames_option,
+                     frames_option,
+                     warmup_option,
+                     size_option,
+                     json_option,
+                     scene_option,
+                     instances_option,
+                     looks_option,
+                     stress_option,
+                     no_lod_option,
+                     lod_compare_option,
+                     profile_option,
+                     trace_option,
+                     views_option,
+                     separate_windows_option,
+                     views_compare_option,
+                     environment_option,
+                     bake_bench_option,
+                     upload_budget_option,
+                     registry_bench_option,
+                     no_ktx2_option,
+                     texture_compare_option,
+                     animate_option,
+                     transform_threads_option,
+                     crowd_option,
+                     pick_bench_option,
+                     import_option,
+                     import_bench_option,
+                     batch_option,
+                     serve_option,
+                     poster_option,
+                     tile_option});
+
+  if (!parser.parse(arguments) || parser.isSet(help_option))
+  {
+    std::cerr << parser.errorText().toStdString() << '\n'
+              << parser.helpText().toStdString();
+    std::exit(parser.isSet(help_option) ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  AppOptions options;
+  options.headless = parser.isSet(headless_option);
+  options.continuous = parser.isSet(continuous_option);
+  // The command line takes priority over the environment
+  const auto backend = parser.isSet(backend_option)
+                         ? parser.value(backend_option)
+                         : QString::fromLocal8Bit(qgetenv("QFP_BACKEND"));
+  if (!backend.isEmpty() && !parse_backend(backend, options.backend))
+  {
+    std::cerr << "Unknown back-end " << backend.toStdString()
+              << ", expected opengl, vulkan or noop\n";
+    std::exit(EXIT_FAILURE);
+  }
+  if (parser.isSet(noop_option))
+  {
+    // --noop is shorthand, so contradicting it is an error rather than
+    // silently picking one of them
+    if (parser.isSet(backend_option) &&
+        options.backend != filament::Engine::Backend::NOOP)
+    {
+      std::cerr << "--noop conflicts with --backend "
+                << backend.toStdString() << '\n';
+      std::exit(EXIT_FAILURE);
+    }
+    options.backend = filament::Engine::Backend::NOOP;
+  }
+  options.backend_compare = parser.isSet(backend_compare_option);
+  options.camera_path = parser.isSet(camera_path_option);
+  if (parser.isSet(target_fps_option))
+    options.target_fps =
+      std::max(parser.value(target_fps_option).toDouble(), 0.0);
+  else if (options.headless)
+    options.target_fps = 0.0;
+  if (parser.isSet(refine_frames_option))
+    options.refine_frames = parser.value(refine_frames_option).toUInt();
+  if (parser.isSet(frames_option))
+    options.frames = parser.value(frames_option).toUInt();
+  if (parser.isSet(warmup_option))
+    options.warmup_frames = parser.value(warmup_option).toUInt();
+  if (parser.isSet(size_option))
+  {
+    const auto dimensions = parser.value(size_option).split('x');
+    if (dimensions.size() == 2)
+    {
+      options.width = std::max(dimensions[0].toUInt(), 1u);
+      options.height = std::max(dimensions[1].toUInt(), 1u);
+    }
+  }
+  options.json_path = parser.value(json_option);
+  options.scene_path = parser.value(scene_option);
+  if (parser.isSet(instances_option))
+    options.instances = parser.value(instances_option).toUInt();
+  if (parser.isSet(looks_option))
+    options.looks = std::max(parser.value(looks_option).toUInt(), 1u);
+  options.stress = parser.isSet(stress_option);
+  options.lods = !parser.isSet(no_lod_option);
+  options.lod_compare = parser.isSet(lod_compare_option);
+  options.trace_path = parser.value(trace_option);
+  if (parser.isSet(views_option))
+    options.views = std::max(parser.value(views_option).toUInt(), 1u);
+  options.separate_windows = parser.isSet(separate_windows_option);
+  options.views_compare = parser.isSet(views_compare_option);
+  options.environment_path = parser.value(environment_option);
+  options.bake_bench_path = parser.value(bake_bench_option);
+  if (parser.isSet(upload_budget_option))
+    options.upload_budget =
+      std::size_t{parser.value(upload_budget_option).toUInt()} * 1024;
+  if (parser.isSet(registry_bench_option))
+    options.registry_bench = parser.value(registry_bench_option).toUInt();
+  options.compressed_textures = !parser.isSet(no_ktx2_option);
+  options.texture_compare = parser.isSet(texture_compare_option);
+  options.batch_path = parser.value(batch_option);
+  options.serve_name = parser.value(serve_option);
+  options.poster_path = parser.value(poster_option);
+  if (parser.isSet(tile_option))
+    options.tile_size = std::max(parser.value(tile_option).toUInt(), 16u);
+  options.animate = parser.isSet(animate_option);
+  if (parser.isSet(transform_threads_option))
+    options.transform_threads =
+      parser.value(transform_threads_option).toUInt();
+  options.crowd = parser.isSet(crowd_option);
+  options.pick_bench = parser.isSet(pick_bench_option);
+  options.import_paths = parser.values(import_option);
+  options.import_bench_path = parser.value(import_bench_option);
+  options.profile =
+    parser.isSet(profile_option) || !options.trace_path.isEmpty();
+  return options;
+}
@@ -1,16 +1,67 @@
 #include "app_window.h"
 #include "native_window_widget.h"
+#include "profiler.h"
 #include <QKeyEvent>
+#include <QStatusBar>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+// How often the statistics readout is refreshed
+constexpr int STATS_INTERVAL_MS = 500;
+}  // namespace
 
 AppWindow::AppWindow(QWidget* io_parent) noexcept : QMainWindow(io_parent)
 {
+  connect(&m_stats_timer, &QTimer::timeout, this, &AppWindow::update_stats);
 }
 
-void AppWindow::init(std::shared_ptr<NativeWindowWidget> i_window)
+void AppWindow::init(std::vector<std::shared_ptr<NativeWindowWidget>> i_windows)
 {
-  m_native_window = std::move(i_window);
+  m_native_windows = std::move(i_windows);
   m_ui_layout.setupUi(this);
-  m_ui_layout.grid_layout->addWidget(m_native_window.get(), 0, 0, 3, 5);
+  // Arrange multiple views in as square a grid as possible, e.g. a quad view
+  const int columns = static_cast<int>(
+    std::ceil(std::sqrt(static_cast<double>(m_native_windows.size()))));
+  for (std::size_t i = 0; i < m_native_windows.size(); ++i)
+  {
+    const int row = static_cast<int>(i) / columns;
+    const int column = static_cast<int>(i) % columns;
+    m_ui_layout.grid_layout->addWidget(
+      m_native_windows[i].get(), row * 3, column * 5, 3, 5);
+  }
+}
+
+void AppWindow::set_stats_visible(bool i_visible)
+{
+  Profiler::global().set_enabled(i_visible);
+  statusBar()->setVisible(i_visible);
+  if (i_visible)
+  {
+    m_stats_timer.start(STATS_INTERVAL_MS);
+    update_stats();
+  }
+  else
+    m_stats_timer.stop();
+}
+
+void AppWindow::set_trace_path(QString i_path)
+{
+  m_trace_path = std::move(i_path);
+}
+
+void AppWindow::update_stats()
+{
+  // Median and 99th percentile of the recent events of every scope
+  std::ostringstream readout;
+  readout << std::fixed << std::setprecision(2);
+  for (const auto& scope : Profiler::global().summarize())
+    readout << scope.first << ' ' << scope.second.median_ms << '/'
+            << scope.second.p99_ms << " ms  ";
+  statusBar()->showMessage(QString::fromStdString(readout.str()));
 }
 
 void AppWindow::keyPressEvent(QKeyEvent* io_event)
@@ -19,6 +70,34 @@ void AppWindow::keyPressEvent(QKeyEvent* io_event)
   {
     // Quit when escape key is hit
   case Qt::Key_Escape: QApplication::exit(EXIT_SUCCESS); break;
+    // Toggle between continuous and on-demand redraws
+  case Qt::Key_Space:
+  {
+    if (m_native_windows.empty())
+      break;
+    const auto mode =
+      m_native_windows.front()->frame_scheduler().mode() ==
+          FrameScheduler::CONTINUOUS
+        ? FrameScheduler::ON_DEMAND
+        : FrameScheduler::CONTINUOUS;
+    for (const auto& window : m_native_windows)
+      window->frame_scheduler().set_mode(mode);
+    break;
+  }
+    // Report the input to present latency of recent frames
+  case Qt::Key_L:
+    for (const auto& window : m_native_windows)
+      std::cout << "Input latency: "
+                << window->frame_scheduler().latency_stats() << std::endl;
+    break;
+    // Toggle the profiler and its statistics readout
+  case Qt::Key_P: set_stats_visible(!m_stats_timer.isActive()); break;
+    // Export the recorded timings for chrome://tracing
+  case Qt::Key_T:
+    if (Profiler::global().write_chrome_trace(m_trace_path))
+      std::cout << "Wrote trace to " << m_trace_path.toStdString()
+                << std::endl;
+    break;
   default: break;
   }
 }
@@ -0,0 +1,308 @@
+#include "asset_loader.h"
+#include "profiler.h"
+#include <QJsonObject>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+
+namespace
+{
+using clock = std::chrono::steady_clock;
+
+double milliseconds(clock::duration i_duration)
+{
+  return std::chrono::duration<double, std::milli>(i_duration).count();
+}
+
+// Columns of the printed timeline chart
+constexpr int CHART_WIDTH = 48;
+// Longer names keep only their end, which holds the file name
+constexpr std::size_t NAME_WIDTH = 28;
+}  // namespace
+
+LoadStage LoadStage::instant(std::string i_name, double i_ms)
+{
+  LoadStage stage;
+  stage.name = std::move(i_name);
+  stage.enqueued_ms = stage.worker_begin_ms = stage.worker_end_ms =
+    stage.finalize_begin_ms = stage.finalize_end_ms = i_ms;
+  return stage;
+}
+
+// Loads that have finished on a worker, waiting for the engine thread
+struct AssetLoader::Completions
+{
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::deque<Completion> queue;
+  // Worker stages which haven't yet finished
+  std::size_t running = 0;
+};
+
+AssetLoader::AssetLoader(ThreadPool& io_pool)
+  : m_pool(&io_pool)
+  , m_completions(std::make_shared<Completions>())
+  , m_start(clock::now())
+{
+}
+
+AssetLoader::~AssetLoader()
+{
+  // Moved from loaders have nothing to wait for
+  if (!m_completions)
+    return;
+  std::unique_lock<std::mutex> lock(m_completions->mutex);
+  m_completions->condition.wait(
+    lock, [this] { return m_completions->running == 0; });
+}
+
+AssetLoader::Task AssetLoader::enqueue(std::string i_name,
+                                      Loader i_loader,
+                                      std::vector<Task> i_after)
+{
+  ++m_pending;
+  const auto task = m_timeline.size();
+  LoadStage stage;
+  stage.name = std::move(i_name);
+  stage.enqueued_ms = milliseconds(clock::now() - m_start);
+  m_timeline.push_back(stage);
+  m_after.push_back(std::move(i_after));
+  m_finalized.push_back(0);
+  m_failed_tasks.push_back(0);
+
+  auto completions = m_completions;
+  {
+    std::lock_guard<std::mutex> lock(completions->mutex);
+    ++completions->running;
+  }
+  m_pool->submit([completions,
+                  task,
+                  name = m_timeline.back().name,
+                  loader = std::move(i_loader)]() mutable {
+    const auto begin = clock::now();
+    Finalizer finalizer;
+    try
+    {
+      ScopedTimer timer("load asset");
+      finalizer = loader();
+    }
+    catch (const std::exception& e)
+    {
+      std::cerr << "Failed to load " << name << ": " << e.what() << std::endl;
+    }
+    {
+      std::lock_guard<std::mutex> lock(completions->mutex);
+      completions->queue.push_back(
+        {task, std::move(finalizer), begin, clock::now()});
+      --completions->running;
+    }
+    completions->condition.notify_all();
+  });
+  return task;
+}
+
+std::size_t AssetLoader::pump()
+{
+  // Take the completed loads so we don't hold the lock while finalizing
+  std::deque<Completion> completed;
+  {
+    std::lock_guard<std::mutex> lock(m_completions->mutex);
+    completed.swap(m_completions->queue);
+  }
+  for (auto& completion : completed)
+    m_deferred.push_back(std::move(completion));
+
+  // Finalizing a load may release the ones depending on it, so keep going
+  // until nothing more is ready
+  std::size_t finalized = 0;
+  for (bool progress = true; progress;)
+  {
+    progress = false;
+    for (auto it = m_deferred.begin(); it != m_deferred.end();)
+    {
+      if (!ready(it->task))
+      {
+        ++it;
+        continue;
+      }
+      finalize(*it);
+      it = m_deferred.erase(it);
+      ++finalized;
+      progress = true;
+    }
+  }
+  m_pending -= finalized;
+  return finalized;
+}
+
+bool AssetLoader::ready(Task i_task) const noexcept
+{
+  const auto& after = m_after[i_task];
+  return std::all_of(after.begin(), after.end(), [this](Task i_dependency) {
+    return m_finalized[i_dependency] != 0;
+  });
+}
+
+void AssetLoader::finalize(Completion& io_completion)
+{
+  const auto begin = clock::now();
+  const auto& after = m_after[io_completion.task];
+  const bool dependency_failed =
+    std::any_of(after.begin(), after.end(), [this](Task i_dependency) {
+      return m_failed_tasks[i_dependency] != 0;
+    });
+  bool failed = !io_completion.finalizer || dependency_failed;
+  if (!failed)
+  {
+    // Creating the engine objects may fail too, e.g. on an unknown material,
+    // which fails the load the same as the worker failing
+    try
+    {
+      ScopedTimer timer("finalize asset");
+      io_completion.finalizer();
+    }
+    catch (const std::exception& e)
+    {
+      std::cerr << "Failed to load " << m_timeline[io_completion.task].name
+                << ": " << e.what() << std::endl;
+      failed = true;
+    }
+  }
+  else if (io_completion.finalizer)
+  {
+    std::cerr << "Failed to load " << m_timeline[io_completion.task].name
+              << ": a load it depends on failed" << std::endl;
+  }
+  if (failed)
+  {
+    m_failed_tasks[io_completion.task] = 1;
+    ++m_failed;
+  }
+  const auto end = clock::now();
+  m_finalized[io_completion.task] = 1;
+
+  auto& stage = m_timeline[io_completion.task];
+  stage.worker_begin_ms = milliseconds(io_completion.worker_begin - m_start);
+  stage.worker_end_ms = milliseconds(io_completion.worker_end - m_start);
+  stage.finalize_begin_ms = milliseconds(begin - m_start);
+  stage.finalize_end_ms = milliseconds(end - m_start);
+  std::cout << std::fixed << std::setprecision(2) << "Loaded " << stage.name
+            << " in " << stage.finalize_end_ms - stage.enqueued_ms
+            << " ms (worker "
+            << milliseconds(io_completion.worker_end -
+                            io_completion.worker_begin)
+            << " ms, engine " << milliseconds(end - begin) << " ms)"
+            << std::endl;
+}
+
+void AssetLoader::wait()
+{
+  while (m_pending)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_completions->mutex);
+      m_completions->condition.wait(
+        lock, [this] { return !m_completions->queue.empty(); });
+    }
+    pump();
+  }
+}
+
+std::size_t AssetLoader::pending() const noexcept
+{
+  return m_pending;
+}
+
+std::size_t AssetLoader::failed() const noexcept
+{
+  return m_failed;
+}
+
+void AssetLoader::mark(std::string i_name)
+{
+  m_timeline.push_back(LoadStage::instant(
+    std::move(i_name), milliseconds(clock::now() - m_start)));
+  // Marks take a task index, so other loads may depend on them
+  m_after.emplace_back();
+  m_finalized.push_back(1);
+  m_failed_tasks.push_back(0);
+}
+
+double AssetLoader::elapsed_ms() const noexcept
+{
+  return milliseconds(clock::now() - m_start);
+}
+
+const std::vector<LoadStage>& AssetLoader::timeline() const noexcept
+{
+  return m_timeline;
+}
+
+void print_timeline(std::ostream& io_os,
+                    const std::vector<LoadStage>& i_stages)
+{
+  double end_ms = 0.0;
+  for (const auto& stage : i_stages)
+    end_ms = std::max(end_ms, stage.finalize_end_ms);
+  const double column_ms = std::max(end_ms, 1e-3) / CHART_WIDTH;
+  const auto column = [column_ms](double i_ms) {
+    return std::min(static_cast<int>(i_ms / column_ms), CHART_WIDTH - 1);
+  };
+
+  io_os << std::fixed << std::setprecision(2) << "Startup timeline, "
+        << end_ms << " ms (- queued, = worker, . waiting, # engine)\n";
+  for (const auto& stage : i_stages)
+  {
+    std::string chart(CHART_WIDTH, ' ');
+    // Later phases are drawn over earlier ones, every phase gets at least one
+    // column so short ones remain visible
+    const auto fill = [&](double i_begin_ms, double i_end_ms, char i_symbol) {
+      const auto last = std::max(column(i_begin_ms), column(i_end_ms) - 1);
+      for (auto c = column(i_begin_ms); c <= last; ++c)
+        chart[c] = i_symbol;
+    };
+    const bool is_mark = stage.enqueued_ms == stage.finalize_end_ms;
+    if (is_mark)
+      chart[column(stage.enqueued_ms)] = '^';
+    else
+    {
+      fill(stage.enqueued_ms, stage.worker_begin_ms, '-');
+      fill(stage.worker_begin_ms, stage.worker_end_ms, '=');
+      fill(stage.worker_end_ms, stage.finalize_begin_ms, '.');
+      fill(stage.finalize_begin_ms, stage.finalize_end_ms, '#');
+    }
+    const auto name = stage.name.size() > NAME_WIDTH
+                        ? stage.name.substr(stage.name.size() - NAME_WIDTH)
+                        : stage.name;
+    io_os << "  " << std::left << std::setw(NAME_WIDTH) << name << std::right
+          << " |" << chart << "| ";
+    if (is_mark)
+      io_os << "at " << stage.enqueued_ms << " ms\n";
+    else
+      io_os << "worker " << stage.worker_begin_ms << '-'
+            << stage.worker_end_ms << " ms, engine "
+            << stage.finalize_begin_ms << '-' << stage.finalize_end_ms
+            << " ms\n";
+  }
+  io_os << std::flush;
+}
+
+QJsonArray to_json(const std::vector<LoadStage>& i_stages)
+{
+  QJsonArray stages;
+  for (const auto& stage : i_stages)
+  {
+    QJsonObject object;
+    object["name"] = QString::fromStdString(stage.name);
+    object["enqueued_ms"] = stage.enqueued_ms;
+    object["worker_begin_ms"] = stage.worker_begin_ms;
+    object["worker_end_ms"] = stage.worker_end_ms;
+    object["finalize_begin_ms"] = stage.finalize_begin_ms;
+    object["finalize_end_ms"] = stage.finalize_end_ms;
+    stages.append(object);
+  }
+  return stages;
+}
@@ -0,0 +1,107 @@
+#include "batch_job.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QImageWriter>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <math/scalar.h>
+#include <algorithm>
+#include <stdexcept>
+
+BatchJob BatchJob::load(const QString& i_path)
+{
+  QFile file(i_path);
+  if (!file.open(QIODevice::ReadOnly))
+    throw std::runtime_error("Failed to open " + i_path.toStdString());
+  QJsonParseError error;
+  const auto document = QJsonDocument::fromJson(file.readAll(), &error);
+  if (document.isNull())
+    throw std::runtime_error("Failed to parse " + i_path.toStdString() + ": " +
+                             error.errorString().toStdString());
+
+  BatchJob job;
+  const auto root = document.object();
+  if (root.contains("output"))
+    job.output_directory = root["output"].toString().toStdString();
+  if (root.contains("format"))
+    job.format = root["format"].toString().toLower().toStdString();
+  if (!QImageWriter::supportedImageFormats().contains(job.format.c_str()))
+    throw std::runtime_error("Unsupported image format " + job.format);
+  const auto size = root["size"].toArray();
+  if (size.size() == 2)
+  {
+    job.width = std::max(size[0].toInt(), 1);
+    job.height = std::max(size[1].toInt(), 1);
+  }
+
+  for (const auto& asset_value : root["assets"].toArray())
+  {
+    auto asset = load_asset(asset_value.toObject());
+    if (asset.name.empty())
+      asset.name = "asset" + std::to_string(job.assets.size());
+    job.assets.push_back(std::move(asset));
+  }
+  return job;
+}
+
+BatchJob::Asset BatchJob::load_asset(const QJsonObject& i_object)
+{
+  Asset asset;
+  const auto scene = i_object["scene"].toString();
+  const auto import = i_object["import"].toString();
+  if (!scene.isEmpty())
+    asset.manifest = SceneManifest::load(scene);
+  else if (!import.isEmpty())
+    asset.manifest.imports.push_back({import.toStdString(), {}});
+  else
+    asset.manifest = SceneManifest::default_scene();
+  const auto source = !scene.isEmpty() ? scene : import;
+  asset.source = source.toStdString();
+  asset.name = i_object.contains("name")
+                 ? i_object["name"].toString().toStdString()
+                 : QFileInfo(source).completeBaseName().toStdString();
+  for (const auto& orbit_value : i_object["orbits"].toArray())
+    asset.orbits.push_back(load_orbit(orbit_value.toObject()));
+  if (asset.orbits.empty())
+    asset.orbits.emplace_back();
+  return asset;
+}
+
+BatchJob::Orbit BatchJob::load_orbit(const QJsonObject& i_object)
+{
+  Orbit orbit;
+  orbit.views = static_cast<uint32_t>(std::max(i_object["views"].toInt(1), 1));
+  orbit.yaw = static_cast<float>(i_object["yaw"].toDouble());
+  orbit.elevation = static_cast<float>(i_object["elevation"].toDouble());
+  orbit.distance =
+    static_cast<float>(i_object["distance"].toDouble(orbit.distance));
+  const auto target = i_object["target"].toArray();
+  if (target.size() == 3)
+    orbit.target = {
+      target[0].toDouble(), target[1].toDouble(), target[2].toDouble()};
+  return orbit;
+}
+
+TrackballCamera BatchJob::Orbit::camera(uint32_t i_view) const
+{
+  // Spread evenly around the orbit, looking down from the elevation
+  const float degrees = filament::math::F_PI / 180.f;
+  TrackballCamera camera;
+  camera.set_target(target);
+  camera.set_arm_length(distance);
+  camera.set_spherical_position(
+    {(yaw + 360.f * i_view / views) * degrees, -elevation * degrees});
+  return camera;
+}
+
+std::size_t BatchJob::image_count() const noexcept
+{
+  std::size_t count = 0;
+  for (const auto& asset : assets)
+  {
+    for (const auto& orbit : asset.orbits)
+      count += orbit.views;
+  }
+  return count;
+}
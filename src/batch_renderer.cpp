@@ -0,0 +1,393 @@
+#include "batch_renderer.h"
+#include "camera_frustum.h"
+#include "filament_raii.h"
+#include "pbr_scene.h"
+#include "profiler.h"
+#include "quality_governor.h"
+#include "thread_pool.h"
+#include "trackball_camera.h"
+#include <QDir>
+#include <QImage>
+#include <filament/Camera.h>
+#include <filament/Fence.h>
+#include <filament/Renderer.h>
+#include <filament/SwapChain.h>
+#include <filament/Texture.h>
+#include <filament/View.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <iomanip>
+#include <mutex>
+
+namespace
+{
+// Images still being encoded, and how many of them couldn't be written
+struct Writes
+{
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::size_t pending = 0;
+  std::size_t failed = 0;
+};
+
+// A buffer a frame is read back in to, busy from the readback until its
+// pixels have been copied out by the sink
+struct Readback
+{
+  std::vector<uint8_t> pixels;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  BatchRenderer::PixelSink sink;
+  BatchRenderer::WriteCallback on_written;
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool busy = false;
+  // Shared by every buffer in the ring
+  Writes* writes = nullptr;
+};
+
+// Let the sink copy the pixels out, freeing the buffer for another frame,
+// then finish writing them. Runs on a worker.
+void write_image(Readback& io_readback)
+{
+  ScopedTimer timer("write image");
+  const auto finish = io_readback.sink(
+    io_readback.pixels.data(), io_readback.width, io_readback.height);
+  const auto on_written = std::move(io_readback.on_written);
+  io_readback.sink = nullptr;
+  auto& writes = *io_readback.writes;
+  {
+    std::lock_guard<std::mutex> lock(io_readback.mutex);
+    io_readback.busy = false;
+  }
+  io_readback.condition.notify_all();
+
+  const bool written = finish && finish();
+  if (on_written)
+    on_written(written);
+  // Notify under the lock, as the renderer may be destroyed as soon as the
+  // last write has finished
+  std::lock_guard<std::mutex> lock(writes.mutex);
+  --writes.pending;
+  writes.failed += !written;
+  writes.condition.notify_all();
+}
+
+// Called by filament once the pixels have arrived, the encoding is handed
+// straight to the pool so the driver isn't held up
+void readback_complete(void* /*i_buffer*/, size_t /*i_size*/, void* io_user)
+{
+  const auto readback = static_cast<Readback*>(io_user);
+  ThreadPool::global().submit([readback] { write_image(*readback); });
+}
+
+// <output>/<asset>/<orbit>_<view>.<format>
+QString image_path(const std::string& i_directory,
+                   std::size_t i_orbit,
+                   uint32_t i_view,
+                   const std::string& i_format)
+{
+  char name[64];
+  std::snprintf(name,
+                sizeof(name),
+                "%zu_%03u.",
+                i_orbit,
+                static_cast<unsigned>(i_view));
+  return QString::fromStdString(i_directory + '/' + name + i_format);
+}
+}  // namespace
+
+// Private state of the batch renderer
+struct BatchRenderer::BatchRendererImpl
+{
+  BatchRendererImpl(std::shared_ptr<filament::Engine> i_engine,
+                    uint32_t i_width,
+                    uint32_t i_height,
+                    std::size_t i_ring_size);
+  ~BatchRendererImpl();
+
+  // Wait until the next buffer in the ring is free, and claim it
+  Readback& acquire();
+
+  // Draw the view and read it back in to the buffer
+  void draw(Readback& io_readback);
+
+  // Wait for every readback to arrive, and every image to be written
+  void drain();
+
+  // Store a shared pointer to the engine, all of our entities will also store
+  std::shared_ptr<filament::Engine> engine;
+  uint32_t width;
+  uint32_t height;
+
+  // The asset being rendered, declared before the view which refers to it
+  std::unique_ptr<PbrScene> scene;
+  // Scoped unique pointers to all engine registered objects
+  FilamentScopedPointer<filament::SwapChain> swap_chain;
+  FilamentScopedPointer<filament::Renderer> renderer;
+  FilamentScopedPointer<filament::Camera> camera;
+  FilamentScopedPointer<filament::View> view;
+
+  std::vector<std::unique_ptr<Readback>> ring;
+  std::size_t next = 0;
+  double stall_ms = 0.0;
+  Writes writes;
+};
+
+BatchRenderer::BatchRendererImpl::BatchRendererImpl(
+  std::shared_ptr<filament::Engine> i_engine,
+  uint32_t i_width,
+  uint32_t i_height,
+  std::size_t i_ring_size)
+  : engine(std::move(i_engine))
+  , width(i_width)
+  , height(i_height)
+  , swap_chain(engine->createSwapChain(
+                 i_width, i_height, filament::SwapChain::CONFIG_DEFAULT),
+               {engine})
+  , renderer(engine->createRenderer(), {engine})
+  , camera(engine->createCamera(), {engine})
+  , view(engine->createView(), {engine})
+{
+  view->setCamera(camera.get());
+  view->setViewport({0, 0, i_width, i_height});
+  // Match the projection used by the interactive window
+  CameraFrustum::perspective(double(i_width) / i_height).apply(*camera);
+  // Every image is a single frame, so there's no history to accumulate
+  QualityGovernor::apply_tier(QualityGovernor::tiers().front(), *view);
+
+  for (std::size_t i = 0; i < std::max(i_ring_size, std::size_t{1}); ++i)
+  {
+    ring.push_back(std::make_unique<Readback>());
+    ring.back()->pixels.resize(std::size_t{i_width} * i_height * 4);
+    ring.back()->width = i_width;
+    ring.back()->height = i_height;
+    ring.back()->writes = &writes;
+  }
+}
+
+BatchRenderer::BatchRendererImpl::~BatchRendererImpl()
+{
+  // Outstanding readbacks and writes refer to the ring
+  drain();
+}
+
+Readback& BatchRenderer::BatchRendererImpl::acquire()
+{
+  auto& readback = *ring[next];
+  next = (next + 1) % ring.size();
+  const auto start = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> lock(readback.mutex);
+  readback.condition.wait(lock, [&readback] { return !readback.busy; });
+  stall_ms += std::chrono::duration<double, std::milli>(
+                   std::chrono::steady_clock::now() - start)
+                   .count();
+  readback.busy = true;
+  return readback;
+}
+
+void BatchRenderer::BatchRendererImpl::draw(Readback& io_readback)
+{
+  {
+    // beginFrame() returns false when the GPU falls behind, but every view
+    // point must be captured. Rather than spin, wait for the GPU to finish
+    // the work already queued before trying again.
+    ScopedTimer begin_timer("beginFrame");
+    while (!renderer->beginFrame(swap_chain.get()))
+      filament::Fence::waitAndDestroy(engine->createFence());
+  }
+  {
+    ScopedTimer render_timer("render");
+    renderer->render(view.get());
+  }
+  {
+    std::lock_guard<std::mutex> lock(writes.mutex);
+    ++writes.pending;
+  }
+  renderer->readPixels(
+    0,
+    0,
+    width,
+    height,
+    filament::Texture::PixelBufferDescriptor(
+      io_readback.pixels.data(),
+      io_readback.pixels.size(),
+      filament::Texture::Format::RGBA,
+      filament::Texture::Type::UBYTE,
+      readback_complete,
+      &io_readback));
+  ScopedTimer end_timer("endFrame");
+  renderer->endFrame();
+}
+
+void BatchRenderer::BatchRendererImpl::drain()
+{
+  filament::Fence::waitAndDestroy(engine->createFence());
+  std::unique_lock<std::mutex> lock(writes.mutex);
+  writes.condition.wait(lock, [this] { return writes.pending == 0; });
+}
+
+BatchRenderer::BatchRenderer(std::shared_ptr<filament::Engine> i_engine,
+                             uint32_t i_width,
+                             uint32_t i_height,
+                             std::size_t i_ring_size)
+  // The ring can't be moved so construct our state in place
+  : m_impl(nonstd::in_place,
+           std::move(i_engine),
+           i_width,
+           i_height,
+           i_ring_size)
+{
+}
+
+BatchRenderer::~BatchRenderer() = default;
+
+BatchReport BatchRenderer::render(const BatchJob& i_job)
+{
+  using clock = std::chrono::steady_clock;
+  const auto elapsed_ms = [](clock::time_point i_start) {
+    return std::chrono::duration<double, std::milli>(clock::now() - i_start)
+      .count();
+  };
+  const auto start = clock::now();
+  auto& impl = *m_impl;
+  BatchReport report;
+  const auto failed_before = impl.writes.failed;
+  const auto stall_before = impl.stall_ms;
+  for (const auto& asset : i_job.assets)
+  {
+    const auto directory = i_job.output_directory + '/' + asset.name;
+    QDir().mkpath(QString::fromStdString(directory));
+    {
+      // Replace the previous asset once the view has moved on to the next
+      ScopedTimer timer("load asset");
+      const auto load_start = clock::now();
+      auto scene = std::make_unique<PbrScene>(impl.engine);
+      scene->configure_view(*impl.view);
+      // Upload every texture level up front, as each view is drawn only once
+      scene->set_upload_budget(0);
+      scene->init(asset.manifest);
+      scene->stream_textures();
+      scene->update_transforms(0.0);
+      impl.scene = std::move(scene);
+      report.load_ms += elapsed_ms(load_start);
+    }
+
+    const auto render_start = clock::now();
+    for (std::size_t o = 0; o < asset.orbits.size(); ++o)
+    {
+      const auto& orbit = asset.orbits[o];
+      for (uint32_t v = 0; v < orbit.views; ++v)
+      {
+        render_view(*impl.scene,
+                    orbit.camera(v),
+                    image_path(directory, o, v, i_job.format),
+                    i_job.format);
+        ++report.images;
+      }
+    }
+    report.render_ms += elapsed_ms(render_start);
+    ++report.assets;
+  }
+  // The last images are still being read back and written
+  const auto drain_start = clock::now();
+  wait();
+  report.render_ms += elapsed_ms(drain_start);
+  report.failed = impl.writes.failed - failed_before;
+  report.stall_ms = impl.stall_ms - stall_before;
+  report.total_ms = elapsed_ms(start);
+  return report;
+}
+
+void BatchRenderer::render_view(PbrScene& io_scene,
+                                const TrackballCamera& i_camera,
+                                const QString& i_path,
+                                const std::string& i_format,
+                                WriteCallback i_on_written)
+{
+  // Copy the image the right way up, and encode it once the buffer is free
+  auto sink = [i_path, i_format](
+                const uint8_t* i_rgba, uint32_t i_width, uint32_t i_height) {
+    const auto image = QImage(i_rgba,
+                              static_cast<int>(i_width),
+                              static_cast<int>(i_height),
+                              QImage::Format_RGBA8888)
+                         .mirrored();
+    return std::function<bool()>([image, i_path, i_format] {
+      return image.save(i_path, i_format.c_str());
+    });
+  };
+  render_view(io_scene, i_camera, std::move(sink), std::move(i_on_written));
+}
+
+void BatchRenderer::render_view(PbrScene& io_scene,
+                                const TrackballCamera& i_camera,
+                                PixelSink i_sink,
+                                WriteCallback i_on_written)
+{
+  ScopedTimer timer("frame");
+  auto& impl = *m_impl;
+  io_scene.configure_view(*impl.view);
+  impl.camera->lookAt(i_camera.eye(), i_camera.target(), i_camera.up());
+  io_scene.update_lods({impl.view.get()});
+
+  auto& readback = impl.acquire();
+  readback.sink = std::move(i_sink);
+  readback.on_written = std::move(i_on_written);
+  impl.draw(readback);
+  io_scene.end_frame();
+}
+
+void BatchRenderer::set_frustum(const CameraFrustum& i_frustum)
+{
+  i_frustum.apply(*m_impl->camera);
+}
+
+void BatchRenderer::set_shadows_enabled(bool i_enabled)
+{
+  m_impl->view->setShadowingEnabled(i_enabled);
+}
+
+void BatchRenderer::wait()
+{
+  m_impl->drain();
+}
+
+double BatchRenderer::stall_ms() const noexcept
+{
+  return m_impl->stall_ms;
+}
+
+std::ostream& operator<<(std::ostream& io_os, const BatchReport& i_report)
+{
+  const auto per_second = [&i_report](double i_ms) {
+    return i_ms > 0.0 ? i_report.images * 1000.0 / i_ms : 0.0;
+  };
+  return io_os << std::fixed << std::setprecision(2) << i_report.images
+               << " images of " << i_report.assets << " assets in "
+               << i_report.total_ms << " ms, "
+               << per_second(i_report.total_ms) << " images per second, "
+               << per_second(i_report.render_ms)
+               << " excluding loads. Loading took " << i_report.load_ms
+               << " ms, waiting for readback buffers " << i_report.stall_ms
+               << " ms, " << i_report.failed << " images failed to write";
+}
+
+QJsonObject to_json(const BatchReport& i_report)
+{
+  const auto per_second = [&i_report](double i_ms) {
+    return i_ms > 0.0 ? i_report.images * 1000.0 / i_ms : 0.0;
+  };
+  QJsonObject report;
+  report["assets"] = static_cast<double>(i_report.assets);
+  report["images"] = static_cast<double>(i_report.images);
+  report["failed"] = static_cast<double>(i_report.failed);
+  report["load_ms"] = i_report.load_ms;
+  report["render_ms"] = i_report.render_ms;
+  report["stall_ms"] = i_report.stall_ms;
+  report["total_ms"] = i_report.total_ms;
+  report["images_per_second"] = per_second(i_report.total_ms);
+  report["render_images_per_second"] = per_second(i_report.render_ms);
+  return report;
+}
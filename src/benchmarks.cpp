@@ -0,0 +1,800 @@
+#include "benchmarks.h"
+#include "batch_renderer.h"
+#include "headless_renderer.h"
+#include "ibl_baker.h"
+#include "ktx2_texture.h"
+#include "poster_renderer.h"
+#include "render_server.h"
+#include "filament_raii.h"
+#include "resource_registry.h"
+#include "scene_importer.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <filament/Camera.h>
+#include <filament/TransformManager.h>
+#include <utils/EntityManager.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+// Peak resident memory of this process in KiB, zero where unavailable
+double peak_resident_kib()
+{
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line))
+  {
+    if (line.compare(0, 6, "VmHWM:") == 0)
+      return std::stod(line.substr(6));
+  }
+  return 0.0;
+}
+
+// Render the scene offscreen and report CPU frame times
+QJsonObject run_headless(const std::shared_ptr<filament::Engine>& i_engine,
+                         const SceneManifest& i_manifest,
+                         const AppOptions& i_options)
+{
+  HeadlessRenderer renderer(
+    i_engine, i_options.width, i_options.height, i_manifest, i_options.views);
+  renderer.set_lods_enabled(i_options.lods);
+  renderer.set_upload_budget(i_options.upload_budget);
+  renderer.set_animated(i_options.animate);
+  renderer.set_transform_threads(i_options.transform_threads);
+  renderer.set_camera_path(i_options.camera_path);
+  renderer.set_target_fps(i_options.target_fps);
+  const auto stats = renderer.run(i_options.frames, i_options.warmup_frames);
+  const auto triangles = static_cast<double>(renderer.triangles_per_frame());
+  // Triangles submitted per second of CPU frame time
+  const double throughput =
+    stats.mean_ms > 0.0 ? triangles * 1000.0 / stats.mean_ms : 0.0;
+  std::cout << std::fixed << std::setprecision(3) << "Headless "
+            << i_options.width << 'x' << i_options.height << ", "
+            << i_options.views << (i_options.views > 1 ? " views, " : " view, ")
+            << i_manifest.instance_count() << " instances, LODs "
+            << (i_options.lods ? "on" : "off") << ", loaded in "
+            << renderer.load_time_ms() << " ms: " << stats << '\n'
+            << "Triangles: " << triangles << " per frame, " << throughput
+            << " per second\n"
+            << "Materials: " << renderer.material_stats() << '\n'
+            << "Textures streamed in over " << renderer.stream_frames()
+            << " frames\n";
+  if (i_options.animate)
+    std::cout << "Transforms updated in " << renderer.transform_update_ms()
+              << " ms per frame\n";
+  const auto& governor = renderer.governor();
+  for (const auto& decision : governor.decisions())
+    std::cout << "Quality " << decision << '\n';
+  QJsonArray textures;
+  for (const auto& texture : renderer.texture_reports())
+  {
+    std::cout << "Texture " << texture << '\n';
+    textures.append(to_json(texture));
+  }
+  print_timeline(std::cout, renderer.startup_timeline());
+  std::cout << "Peak resident memory: " << peak_resident_kib() / 1024.0
+            << " MiB" << std::endl;
+
+  auto summary = to_json(stats);
+  summary["width"] = static_cast<int>(i_options.width);
+  summary["height"] = static_cast<int>(i_options.height);
+  summary["views"] = static_cast<int>(i_options.views);
+  summary["backend"] = backend_name(i_options.backend);
+  summary["camera_path"] = i_options.camera_path;
+  summary["target_fps"] = i_options.target_fps;
+  summary["quality_tier"] = QualityGovernor::tiers()[governor.tier()].name;
+  summary["quality_decisions"] = to_json(governor.decisions());
+  summary["instances"] = static_cast<double>(i_manifest.instance_count());
+  summary["load_ms"] = renderer.load_time_ms();
+  summary["startup"] = to_json(renderer.startup_timeline());
+  summary["lods"] = i_options.lods;
+  summary["triangles_per_frame"] = triangles;
+  summary["triangles_per_second"] = throughput;
+  summary["materials"] = to_json(renderer.material_stats());
+  summary["compressed_textures"] = i_manifest.compressed_textures;
+  summary["textures"] = textures;
+  summary["upload_budget"] = static_cast<double>(i_options.upload_budget);
+  summary["stream_frames"] = static_cast<int>(renderer.stream_frames());
+  summary["animated"] = i_options.animate;
+  summary["transform_threads"] = static_cast<int>(i_options.transform_threads);
+  summary["transform_update_ms"] = renderer.transform_update_ms();
+  summary["peak_rss_kib"] = peak_resident_kib();
+  return summary;
+}
+
+// Measure load and frame times for increasing numbers of instances
+QJsonArray run_stress(const std::shared_ptr<filament::Engine>& i_engine,
+                      const AppOptions& i_options)
+{
+  QJsonArray results;
+  for (const uint32_t count : {1000u, 10000u, 100000u})
+    results.append(run_headless(
+      i_engine, SceneManifest::grid(count, i_options.looks), i_options));
+  return results;
+}
+
+// Measure the same dense scene with levels of detail on and off
+QJsonArray run_lod_compare(const std::shared_ptr<filament::Engine>& i_engine,
+                           const AppOptions& i_options)
+{
+  const auto manifest =
+    !i_options.scene_path.isEmpty() || i_options.instances
+      ? load_scene_manifest(i_options)
+      : SceneManifest::grid(10000, i_options.looks);
+  QJsonArray results;
+  for (const bool lods : {false, true})
+  {
+    auto options = i_options;
+    options.lods = lods;
+    results.append(run_headless(i_engine, manifest, options));
+  }
+  return results;
+}
+
+// Measure the same scene with the uncompressed KTX textures, and then with
+// the textures transcoded from KTX2. Warns if no KTX2 files were found, as
+// both runs then measure the same textures.
+QJsonArray run_texture_compare(
+  const std::shared_ptr<filament::Engine>& i_engine,
+  const AppOptions& i_options)
+{
+  auto manifest = load_scene_manifest(i_options);
+  QJsonArray results;
+  for (const bool compressed : {false, true})
+  {
+    manifest.compressed_textures = compressed;
+    results.append(run_headless(i_engine, manifest, i_options));
+  }
+  const auto textures = results.last().toObject()["textures"].toArray();
+  if (std::none_of(
+        textures.begin(), textures.end(), [](const QJsonValue& i_texture) {
+          return i_texture.toObject()["transcode_ms"].toDouble() > 0.0;
+        }))
+    std::cerr << "Warning: no .ktx2 files were found next to the scene's "
+                 "textures, both runs used the uncompressed KTX files"
+              << std::endl;
+  return results;
+}
+
+// Animate the same dense scene with transforms computed on one thread, and
+// then on every worker
+QJsonArray run_crowd(const std::shared_ptr<filament::Engine>& i_engine,
+                     const AppOptions& i_options)
+{
+  const auto manifest =
+    !i_options.scene_path.isEmpty() || i_options.instances
+      ? load_scene_manifest(i_options)
+      : SceneManifest::grid(10000, i_options.looks);
+  QJsonArray results;
+  for (const std::size_t threads : {std::size_t{1}, std::size_t{0}})
+  {
+    auto options = i_options;
+    options.animate = true;
+    options.transform_threads = threads;
+    results.append(run_headless(i_engine, manifest, options));
+  }
+  return results;
+}
+
+// Measure the latency of picking through a grid of points across the view,
+// at increasing triangle counts
+QJsonArray run_pick_bench(const std::shared_ptr<filament::Engine>& i_engine,
+                          const AppOptions& i_options)
+{
+  using clock = std::chrono::steady_clock;
+  const auto elapsed_ms = [](clock::time_point i_start) {
+    return std::chrono::duration<double, std::milli>(clock::now() - i_start)
+      .count();
+  };
+  std::vector<SceneManifest> manifests;
+  if (!i_options.scene_path.isEmpty() || i_options.instances)
+    manifests.push_back(load_scene_manifest(i_options));
+  else
+  {
+    for (const uint32_t count : {1000u, 10000u, 100000u})
+      manifests.push_back(SceneManifest::grid(count, i_options.looks));
+  }
+
+  QJsonArray results;
+  for (const auto& manifest : manifests)
+  {
+    HeadlessRenderer renderer(
+      i_engine, i_options.width, i_options.height, manifest);
+    // Only measure picks once the meshes' hierarchies are built
+    auto start = clock::now();
+    renderer.picker().wait();
+    const double wait_ms = elapsed_ms(start);
+
+    // The first pick also builds the top level hierarchy
+    start = clock::now();
+    renderer.pick({0.f, 0.f});
+    const double first_pick_ms = elapsed_ms(start);
+
+    constexpr uint32_t GRID = 32;
+    std::vector<double> latencies;
+    latencies.reserve(GRID * GRID);
+    uint32_t hits = 0;
+    for (uint32_t y = 0; y < GRID; ++y)
+    {
+      for (uint32_t x = 0; x < GRID; ++x)
+      {
+        const filament::math::float2 ndc{(x + 0.5f) / GRID * 2.f - 1.f,
+                                         (y + 0.5f) / GRID * 2.f - 1.f};
+        start = clock::now();
+        hits += renderer.pick(ndc).hit;
+        latencies.push_back(elapsed_ms(start));
+      }
+    }
+    const auto stats = summarize_frame_times(std::move(latencies));
+    const auto triangles =
+      static_cast<double>(renderer.picker().triangle_count());
+    std::cout << std::fixed << std::setprecision(3) << "Pick bench, "
+              << manifest.instance_count() << " instances, " << triangles
+              << " triangles\n"
+              << "  Mesh hierarchies built in " << renderer.picker().build_ms()
+              << " ms, ready " << wait_ms << " ms after loading\n"
+              << "  First pick " << first_pick_ms << " ms, " << hits << " of "
+              << GRID * GRID << " rays hit, median " << stats.median_ms
+              << " ms, p99 " << stats.p99_ms << " ms, max " << stats.max_ms
+              << " ms" << std::endl;
+
+    auto summary = to_json(stats);
+    summary["instances"] = static_cast<double>(manifest.instance_count());
+    summary["triangles"] = triangles;
+    summary["mesh_bvh_build_ms"] = renderer.picker().build_ms();
+    summary["bvh_wait_ms"] = wait_ms;
+    summary["first_pick_ms"] = first_pick_ms;
+    summary["rays"] = static_cast<int>(GRID * GRID);
+    summary["hits"] = static_cast<int>(hits);
+    results.append(summary);
+  }
+  return results;
+}
+
+// Create and destroy entities with transform components, and a camera per
+// hundred entities, owned by the RAII wrappers and then by the registry
+QJsonObject run_registry_bench(
+  const std::shared_ptr<filament::Engine>& i_engine,
+  const AppOptions& i_options)
+{
+  using clock = std::chrono::steady_clock;
+  const auto elapsed_ms = [](clock::time_point i_start) {
+    return std::chrono::duration<double, std::milli>(clock::now() - i_start)
+      .count();
+  };
+  const std::size_t count = i_options.registry_bench;
+  const std::size_t cameras = std::max<std::size_t>(count / 100, 1);
+  auto& entity_manager = utils::EntityManager::get();
+  auto& transform_manager = i_engine->getTransformManager();
+
+  // Both owners create their entities in one call to the entity manager, so
+  // only the ownership differs. Every wrapper holds its own reference to the
+  // engine, and destroys its resource as soon as it goes out of scope.
+  auto start = clock::now();
+  std::vector<utils::Entity> raw_entities(count);
+  entity_manager.create(count, raw_entities.data());
+  std::vector<FilamentScopedEntity> scoped_entities;
+  scoped_entities.reserve(count);
+  for (auto& entity : raw_entities)
+  {
+    transform_manager.create(entity);
+    scoped_entities.emplace_back(std::move(entity), i_engine);
+  }
+  std::vector<FilamentScopedPointer<filament::Camera>> scoped_cameras;
+  scoped_cameras.reserve(cameras);
+  for (std::size_t i = 0; i < cameras; ++i)
+    scoped_cameras.emplace_back(
+      i_engine->createCamera(),
+      FilamentEngineDeleter<filament::Camera>{i_engine});
+  const double raii_create_ms = elapsed_ms(start);
+  start = clock::now();
+  scoped_entities.clear();
+  scoped_cameras.clear();
+  const double raii_destroy_ms = elapsed_ms(start);
+
+  // Handles are plain values, destruction is queued and then done in bulk
+  ResourceRegistry registry(i_engine);
+  start = clock::now();
+  std::vector<EntityHandle> entities(count);
+  registry.create(count, entities.data());
+  for (const auto entity : entities)
+    transform_manager.create(registry.get(entity));
+  std::vector<Handle<filament::Camera>> camera_handles;
+  camera_handles.reserve(cameras);
+  for (std::size_t i = 0; i < cameras; ++i)
+    camera_handles.push_back(registry.adopt(i_engine->createCamera()));
+  const double registry_create_ms = elapsed_ms(start);
+  start = clock::now();
+  for (const auto entity : entities)
+    registry.destroy(entity);
+  for (const auto camera : camera_handles)
+    registry.destroy(camera);
+  const double registry_queue_ms = elapsed_ms(start);
+  registry.flush();
+  const double registry_destroy_ms = elapsed_ms(start);
+
+  const auto per_second = [count, cameras](double i_ms) {
+    return i_ms > 0.0 ? (count + cameras) * 1000.0 / i_ms : 0.0;
+  };
+  std::cout << std::fixed << std::setprecision(3) << "Registry bench, "
+            << count << " entities and " << cameras << " cameras\n"
+            << "  RAII wrappers: created in " << raii_create_ms
+            << " ms, destroyed in " << raii_destroy_ms << " ms, "
+            << sizeof(FilamentScopedEntity) << " bytes per entity\n"
+            << "  Registry: created in " << registry_create_ms
+            << " ms, queued in " << registry_queue_ms
+            << " ms, destroyed after a fence in " << registry_destroy_ms
+            << " ms, " << sizeof(EntityHandle) << " bytes per handle"
+            << std::endl;
+
+  QJsonObject results;
+  results["entities"] = static_cast<double>(count);
+  results["cameras"] = static_cast<double>(cameras);
+  QJsonObject raii;
+  raii["create_ms"] = raii_create_ms;
+  raii["destroy_ms"] = raii_destroy_ms;
+  raii["creates_per_second"] = per_second(raii_create_ms);
+  raii["destroys_per_second"] = per_second(raii_destroy_ms);
+  raii["entity_owner_bytes"] = static_cast<int>(sizeof(FilamentScopedEntity));
+  raii["object_owner_bytes"] =
+    static_cast<int>(sizeof(FilamentScopedPointer<filament::Camera>));
+  results["raii"] = raii;
+  QJsonObject handles;
+  handles["create_ms"] = registry_create_ms;
+  handles["queue_ms"] = registry_queue_ms;
+  handles["destroy_ms"] = registry_destroy_ms;
+  handles["creates_per_second"] = per_second(registry_create_ms);
+  handles["destroys_per_second"] = per_second(registry_destroy_ms);
+  handles["entity_owner_bytes"] = static_cast<int>(sizeof(EntityHandle));
+  handles["object_owner_bytes"] =
+    static_cast<int>(sizeof(Handle<filament::Camera>));
+  results["registry"] = handles;
+  return results;
+}
+
+// Arguments which make a child process render the same scene as us
+QStringList child_arguments(const AppOptions& i_options)
+{
+  QStringList arguments{"--headless",
+                        "--frames",
+                        QString::number(i_options.frames),
+                        "--warmup",
+                        QString::number(i_options.warmup_frames),
+                        "--size",
+                        QString("%1x%2").arg(i_options.width).arg(
+                          i_options.height),
+                        "--looks",
+                        QString::number(i_options.looks)};
+  arguments << "--backend" << backend_name(i_options.backend);
+  if (i_options.camera_path)
+    arguments << "--camera-path";
+  arguments << "--target-fps" << QString::number(i_options.target_fps);
+  if (!i_options.lods)
+    arguments << "--no-lod";
+  if (!i_options.scene_path.isEmpty())
+    arguments << "--scene" << i_options.scene_path;
+  if (i_options.instances)
+    arguments << "--instances" << QString::number(i_options.instances);
+  if (!i_options.environment_path.isEmpty())
+    arguments << "--environment" << i_options.environment_path;
+  for (const auto& path : i_options.import_paths)
+    arguments << "--import" << path;
+  if (!i_options.compressed_textures)
+    arguments << "--no-ktx2";
+  arguments << "--upload-budget"
+            << QString::number(i_options.upload_budget / 1024);
+  if (i_options.animate)
+    arguments << "--animate" << "--transform-threads"
+              << QString::number(i_options.transform_threads);
+  return arguments;
+}
+
+// Compare N views sharing one engine in this process, against N processes
+// rendering a single view each, for memory and frame time
+QJsonObject run_views_compare(const std::shared_ptr<filament::Engine>& i_engine,
+                              const AppOptions& i_options)
+{
+  QJsonObject results;
+  results["shared"] =
+    run_headless(i_engine, load_scene_manifest(i_options), i_options);
+
+  // Run the processes concurrently, as the views would be in practice
+  QTemporaryDir directory;
+  std::vector<std::unique_ptr<QProcess>> processes;
+  for (uint32_t i = 0; i < i_options.views; ++i)
+  {
+    processes.push_back(std::make_unique<QProcess>());
+    auto& process = *processes.back();
+    process.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    process.setStandardOutputFile(QProcess::nullDevice());
+    process.start(QCoreApplication::applicationFilePath(),
+                  child_arguments(i_options)
+                    << "--json" << directory.filePath(QString::number(i)));
+  }
+
+  QJsonArray separate;
+  double total_rss_kib = 0.0;
+  double worst_mean_ms = 0.0;
+  for (uint32_t i = 0; i < i_options.views; ++i)
+  {
+    processes[i]->waitForFinished(-1);
+    QFile file(directory.filePath(QString::number(i)));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+      std::cerr << "View process " << i << " failed" << std::endl;
+      continue;
+    }
+    const auto summary = QJsonDocument::fromJson(file.readAll()).object();
+    total_rss_kib += summary["peak_rss_kib"].toDouble();
+    worst_mean_ms = std::max(worst_mean_ms, summary["mean_ms"].toDouble());
+    separate.append(summary);
+  }
+  results["separate"] = separate;
+
+  const auto shared = results["shared"].toObject();
+  std::cout << std::fixed << std::setprecision(3) << i_options.views
+            << " views, shared engine: "
+            << shared["peak_rss_kib"].toDouble() / 1024.0 << " MiB, "
+            << shared["mean_ms"].toDouble() << " ms per frame\n"
+            << i_options.views << " separate processes: "
+            << total_rss_kib / 1024.0 << " MiB, " << worst_mean_ms
+            << " ms per frame (slowest)" << std::endl;
+  results["separate_total_rss_kib"] = total_rss_kib;
+  results["separate_worst_mean_ms"] = worst_mean_ms;
+  return results;
+}
+
+// Render the same scene and camera path on every back-end, one after another
+// in a process each, so a back-end which can't start doesn't take us with it.
+// The NOOP back-end measures our own CPU side cost, the difference from it is
+// the cost of the driver.
+QJsonArray run_backend_compare(const AppOptions& i_options)
+{
+  using Backend = filament::Engine::Backend;
+  QTemporaryDir directory;
+  std::vector<QJsonObject> summaries;
+  for (const auto backend : {Backend::OPENGL, Backend::VULKAN, Backend::NOOP})
+  {
+    auto options = i_options;
+    options.backend = backend;
+    options.camera_path = true;
+    const auto json_path = directory.filePath(backend_name(backend));
+    QProcess process;
+    process.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    process.setStandardOutputFile(QProcess::nullDevice());
+    process.start(QCoreApplication::applicationFilePath(),
+                  child_arguments(options) << "--json" << json_path);
+    process.waitForFinished(-1);
+
+    QJsonObject summary;
+    QFile file(json_path);
+    if (process.exitStatus() == QProcess::NormalExit &&
+        process.exitCode() == EXIT_SUCCESS && file.open(QIODevice::ReadOnly))
+      summary = QJsonDocument::fromJson(file.readAll()).object();
+    summary["backend"] = backend_name(backend);
+    summary["available"] = summary.contains("mean_ms");
+    summaries.push_back(summary);
+  }
+
+  const auto& noop = summaries.back();
+  const auto column = [](const char* i_heading) {
+    return std::setw(static_cast<int>(std::strlen(i_heading)));
+  };
+  std::cout << "| Back-end | Load ms | Mean ms | Median ms | P99 ms | "
+               "Peak MiB | Over NOOP ms |\n"
+            << "|----------|---------|---------|-----------|--------|"
+               "----------|--------------|\n"
+            << std::fixed << std::setprecision(3);
+  QJsonArray results;
+  for (auto& summary : summaries)
+  {
+    std::cout << "| " << std::left << column("Back-end")
+              << summary["backend"].toString().toStdString() << std::right
+              << " | ";
+    if (!summary["available"].toBool())
+    {
+      std::cout << "unavailable |\n";
+      results.append(summary);
+      continue;
+    }
+    const double over_noop =
+      noop["available"].toBool()
+        ? summary["mean_ms"].toDouble() - noop["mean_ms"].toDouble()
+        : 0.0;
+    summary["over_noop_ms"] = over_noop;
+    std::cout << column("Load ms") << summary["load_ms"].toDouble() << " | "
+              << column("Mean ms") << summary["mean_ms"].toDouble() << " | "
+              << column("Median ms") << summary["median_ms"].toDouble()
+              << " | " << column("P99 ms") << summary["p99_ms"].toDouble()
+              << " | " << column("Peak MiB")
+              << summary["peak_rss_kib"].toDouble() / 1024.0 << " | "
+              << column("Over NOOP ms") << over_noop << " |\n";
+    results.append(summary);
+  }
+  std::cout << std::flush;
+  return results;
+}
+}  // namespace
+
+std::shared_ptr<filament::Engine>
+create_engine(const filament::Engine::Backend i_backend)
+{
+  const auto engine = filament::Engine::create(i_backend);
+  if (!engine)
+    throw std::runtime_error(std::string("Failed to create the ") +
+                             backend_name(i_backend) + " back-end");
+  return std::shared_ptr<filament::Engine>(
+    engine,
+    [](filament::Engine* i_engine) { i_engine->destroy(&i_engine); });
+}
+
+SceneManifest load_scene_manifest(const AppOptions& i_options)
+{
+  // Imported scenes replace the default suzanne
+  auto manifest =
+    !i_options.scene_path.isEmpty()
+      ? SceneManifest::load(i_options.scene_path)
+      : i_options.instances
+          ? SceneManifest::grid(i_options.instances, i_options.looks)
+          : i_options.import_paths.isEmpty() ? SceneManifest::default_scene()
+                                             : SceneManifest();
+  for (const auto& path : i_options.import_paths)
+    manifest.imports.push_back({path.toStdString(), {}});
+  if (!i_options.environment_path.isEmpty())
+    manifest.environment = i_options.environment_path.toStdString();
+  manifest.compressed_textures = i_options.compressed_textures;
+  return manifest;
+}
+
+// Render every view point of a batch job, reporting images per second
+QJsonObject run_batch(const std::shared_ptr<filament::Engine>& i_engine,
+                      const AppOptions& i_options)
+{
+  const auto job = BatchJob::load(i_options.batch_path);
+  std::cout << "Rendering " << job.image_count() << ' ' << job.width << 'x'
+            << job.height << " images of " << job.assets.size()
+            << " assets to " << job.output_directory << std::endl;
+  BatchRenderer renderer(i_engine, job.width, job.height);
+  const auto report = renderer.render(job);
+  std::cout << "Batch " << report << std::endl;
+  auto summary = to_json(report);
+  summary["backend"] = backend_name(i_options.backend);
+  summary["width"] = static_cast<int>(job.width);
+  summary["height"] = static_cast<int>(job.height);
+  summary["output"] = QString::fromStdString(job.output_directory);
+  return summary;
+}
+
+// Render the scene to a poster in tiles, reporting megapixels per second
+QJsonObject run_poster(const std::shared_ptr<filament::Engine>& i_engine,
+                       const AppOptions& i_options)
+{
+  std::cout << "Rendering a " << i_options.width << 'x' << i_options.height
+            << " poster to " << i_options.poster_path.toStdString()
+            << std::endl;
+  PosterRenderer renderer(i_engine, i_options.tile_size);
+  const auto report = renderer.render(load_scene_manifest(i_options),
+                                      i_options.poster_path.toStdString(),
+                                      i_options.width,
+                                      i_options.height);
+  std::cout << "Poster " << report << std::endl;
+  auto summary = to_json(report);
+  summary["backend"] = backend_name(i_options.backend);
+  summary["output"] = i_options.poster_path;
+  return summary;
+}
+
+// Render jobs sent to a local socket, until the process is stopped
+int run_server(const std::shared_ptr<filament::Engine>& i_engine,
+               const AppOptions& i_options)
+{
+  RenderServer server(i_engine);
+  try
+  {
+    server.listen(i_options.serve_name);
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return QCoreApplication::exec();
+}
+
+// Time image based lighting bakes of an HDR image at several cubemap sizes,
+// with increasing numbers of threads, bypassing the cache
+QJsonArray run_bake_bench(const AppOptions& i_options)
+{
+  using clock = std::chrono::steady_clock;
+  const auto image =
+    IblBaker::read_hdr(i_options.bake_bench_path.toStdString());
+  std::cout << "Baking " << i_options.bake_bench_path.toStdString() << ", "
+            << image.width << 'x' << image.height << std::endl;
+
+  QJsonArray results;
+  const auto max_threads = ThreadPool::global().size() + 1;
+  for (const uint32_t size : {64u, 128u, 256u})
+  {
+    double single_thread_ms = 0.0;
+    for (std::size_t threads = 1; threads <= max_threads;
+         threads = threads < max_threads ? std::min(threads * 2, max_threads)
+                                         : threads + 1)
+    {
+      IblBakeSettings settings;
+      settings.skybox_size = size;
+      settings.specular_size = size;
+      settings.max_threads = threads;
+      const auto start = clock::now();
+      IblBaker(settings).bake(image);
+      const double ms =
+        std::chrono::duration<double, std::milli>(clock::now() - start).count();
+      if (threads == 1)
+        single_thread_ms = ms;
+      const double speedup = ms > 0.0 ? single_thread_ms / ms : 0.0;
+      std::cout << std::fixed << std::setprecision(2) << "  " << size << "px, "
+                << threads << (threads > 1 ? " threads: " : " thread: ") << ms
+                << " ms, " << speedup << "x" << std::endl;
+
+      QJsonObject result;
+      result["size"] = static_cast<int>(size);
+      result["threads"] = static_cast<int>(threads);
+      result["samples"] = static_cast<int>(settings.samples);
+      result["bake_ms"] = ms;
+      result["speedup"] = speedup;
+      results.append(result);
+    }
+  }
+  return results;
+}
+
+// Convert a scene with a cold cache on one thread and then on every worker,
+// reporting the throughput in triangles per second
+QJsonArray run_import_bench(const AppOptions& i_options)
+{
+  const auto path = i_options.import_bench_path.toStdString();
+  QJsonArray results;
+  double single_thread_ms = 0.0;
+  for (const std::size_t threads : {std::size_t{1}, std::size_t{0}})
+  {
+    // A fresh cache directory, so every mesh is converted
+    QTemporaryDir cache;
+    SceneImporter importer(cache.path().toStdString());
+    importer.set_max_threads(threads);
+    SceneImportReport report;
+    importer.import(path, &report);
+    if (threads == 1)
+      single_thread_ms = report.convert_ms;
+    const auto per_second = [&report](double i_ms) {
+      return i_ms > 0.0 ? report.triangles * 1000.0 / i_ms : 0.0;
+    };
+    const double speedup =
+      report.convert_ms > 0.0 ? single_thread_ms / report.convert_ms : 0.0;
+    std::cout << std::fixed << std::setprecision(2) << "Import bench, "
+              << report.threads << (report.threads > 1 ? " threads" : " thread")
+              << ": read in " << report.read_ms << " ms, converted in "
+              << report.convert_ms << " ms, "
+              << per_second(report.convert_ms) << " triangles per second ("
+              << speedup << "x), " << per_second(report.total_ms)
+              << " including the read" << std::endl;
+
+    QJsonObject result;
+    result["path"] = i_options.import_bench_path;
+    result["threads"] = static_cast<int>(report.threads);
+    result["meshes"] = static_cast<double>(report.meshes);
+    result["materials"] = static_cast<double>(report.materials);
+    result["nodes"] = static_cast<double>(report.nodes);
+    result["triangles"] = static_cast<double>(report.triangles);
+    result["read_ms"] = report.read_ms;
+    result["convert_ms"] = report.convert_ms;
+    result["total_ms"] = report.total_ms;
+    result["triangles_per_second"] = per_second(report.convert_ms);
+    result["total_triangles_per_second"] = per_second(report.total_ms);
+    result["speedup"] = speedup;
+    results.append(result);
+  }
+  return results;
+}
+
+namespace
+{
+// Run the benchmark or mode selected by the options
+int run_mode(const AppOptions& i_options)
+{
+  // Baking and importing need no engine
+  if (!i_options.bake_bench_path.isEmpty())
+    return write_json_summary(run_bake_bench(i_options), i_options);
+  if (!i_options.import_bench_path.isEmpty())
+    return write_json_summary(run_import_bench(i_options), i_options);
+  // Each back-end is run in a child process
+  if (i_options.backend_compare)
+    return write_json_summary(run_backend_compare(i_options), i_options);
+  const auto filament_engine = create_engine(i_options.backend);
+  if (!i_options.serve_name.isEmpty())
+    return run_server(filament_engine, i_options);
+  if (!i_options.batch_path.isEmpty())
+    return write_json_summary(run_batch(filament_engine, i_options),
+                              i_options);
+  if (!i_options.poster_path.isEmpty())
+    return write_json_summary(run_poster(filament_engine, i_options),
+                              i_options);
+  if (i_options.views_compare)
+    return write_json_summary(run_views_compare(filament_engine, i_options),
+                              i_options);
+  if (i_options.lod_compare)
+    return write_json_summary(run_lod_compare(filament_engine, i_options),
+                              i_options);
+  if (i_options.pick_bench)
+    return write_json_summary(run_pick_bench(filament_engine, i_options),
+                              i_options);
+  if (i_options.crowd)
+    return write_json_summary(run_crowd(filament_engine, i_options), i_options);
+  if (i_options.registry_bench)
+    return write_json_summary(run_registry_bench(filament_engine, i_options),
+                              i_options);
+  if (i_options.texture_compare && !Ktx2Texture::available())
+  {
+    std::cerr << "--texture-compare needs KTX2 support, build with "
+                 "CONFIG+=basisu"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (i_options.texture_compare)
+    return write_json_summary(run_texture_compare(filament_engine, i_options),
+                              i_options);
+  if (i_options.stress)
+    return write_json_summary(run_stress(filament_engine, i_options),
+                              i_options);
+  return write_json_summary(
+    run_headless(filament_engine, load_scene_manifest(i_options), i_options),
+    i_options);
+}
+}  // namespace
+
+int run_benchmarks(const AppOptions& i_options)
+{
+  // Such as a scene which fails to load, a bad manifest, a back-end we can't
+  // create or an unwritable path, which fail the run rather than abort it
+  try
+  {
+    return run_mode(i_options);
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
+
+int write_json_summary(const QJsonValue& i_summary, const AppOptions& i_options)
+{
+  const auto document = i_summary.isArray()
+                          ? QJsonDocument(i_summary.toArray())
+                          : QJsonDocument(i_summary.toObject());
+  const auto json = document.toJson(QJsonDocument::Compact);
+  if (i_options.json_path.isEmpty())
+  {
+    std::cout << json.toStdString() << std::endl;
+    return EXIT_SUCCESS;
+  }
+  QFile file(i_options.json_path);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+  {
+    std::cerr << "Failed to write " << i_options.json_path.toStdString()
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  file.write(json);
+  return EXIT_SUCCESS;
+}
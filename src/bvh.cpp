@@ -0,0 +1,213 @@
+#include "bvh.h"
+#include <array>
+#include <limits>
+#include <numeric>
+
+namespace bvh
+{
+namespace
+{
+namespace flm = filament::math;
+
+// Candidate split planes per axis are the boundaries between these bins
+constexpr std::size_t BINS = 16;
+// Nodes this small are never split, and nodes larger than the maximum are
+// always split, between the two the surface area heuristic decides
+constexpr uint32_t MIN_LEAF = 2;
+constexpr uint32_t MAX_LEAF = 8;
+// Relative cost of visiting a node against testing one primitive
+constexpr float TRAVERSAL_COST = 1.f;
+
+// The vector functions are only found by argument dependent lookup, which
+// the members of a box named min and max would hide
+flm::float3 lower(const flm::float3& i_a, const flm::float3& i_b) noexcept
+{
+  return min(i_a, i_b);
+}
+
+flm::float3 upper(const flm::float3& i_a, const flm::float3& i_b) noexcept
+{
+  return max(i_a, i_b);
+}
+
+float component(const flm::float3& i_vector, std::size_t i_axis) noexcept
+{
+  return i_axis == 0 ? i_vector.x : i_axis == 1 ? i_vector.y : i_vector.z;
+}
+}  // namespace
+
+void Aabb::extend(const filament::math::float3& i_point) noexcept
+{
+  min = lower(min, i_point);
+  max = upper(max, i_point);
+}
+
+void Aabb::extend(const Aabb& i_box) noexcept
+{
+  min = lower(min, i_box.min);
+  max = upper(max, i_box.max);
+}
+
+filament::math::float3 Aabb::center() const noexcept
+{
+  return (min + max) * 0.5f;
+}
+
+float Aabb::half_area() const noexcept
+{
+  const auto extent = upper(max - min, flm::float3(0.f));
+  return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+Ray::Ray(const filament::math::float3& i_origin,
+         const filament::math::float3& i_direction) noexcept
+  : origin(i_origin), direction(i_direction)
+{
+  // Avoid infinities, which fast math doesn't respect, for axis aligned rays
+  const auto safe = [](float i_d) {
+    return 1.f / (std::abs(i_d) > 1e-20f ? i_d : std::copysign(1e-20f, i_d));
+  };
+  inverse_direction = {
+    safe(i_direction.x), safe(i_direction.y), safe(i_direction.z)};
+}
+
+Tree build(const std::vector<Aabb>& i_bounds)
+{
+  Tree tree;
+  const auto count = static_cast<uint32_t>(i_bounds.size());
+  if (!count)
+    return tree;
+  tree.order.resize(count);
+  std::iota(tree.order.begin(), tree.order.end(), 0u);
+  std::vector<flm::float3> centers(count);
+  for (uint32_t i = 0; i < count; ++i)
+    centers[i] = i_bounds[i].center();
+
+  // A binary tree with a leaf per primitive has fewer than twice as many
+  // nodes, so reserving up front keeps references stable
+  tree.nodes.reserve(2 * count);
+  tree.nodes.push_back({{}, 0, count});
+  std::vector<uint32_t> pending{0};
+  while (!pending.empty())
+  {
+    const auto index = pending.back();
+    pending.pop_back();
+    auto& node = tree.nodes[index];
+    const auto begin = tree.order.begin() + node.first;
+    const auto end = begin + node.count;
+    Aabb center_bounds;
+    for (auto i = begin; i != end; ++i)
+    {
+      node.bounds.extend(i_bounds[*i]);
+      center_bounds.extend(centers[*i]);
+    }
+    if (node.count <= MIN_LEAF)
+      continue;
+
+    // Bin the centers along every axis, and find the split with the lowest
+    // surface area cost
+    float best_cost = std::numeric_limits<float>::max();
+    std::size_t best_axis = 0, best_split = 0;
+    for (std::size_t axis = 0; axis < 3; ++axis)
+    {
+      const float low = component(center_bounds.min, axis);
+      const float extent = component(center_bounds.max, axis) - low;
+      if (extent <= 0.f)
+        continue;
+      std::array<Aabb, BINS> bins;
+      std::array<uint32_t, BINS> bin_counts{};
+      const float scale = BINS / extent;
+      for (auto i = begin; i != end; ++i)
+      {
+        const float offset = component(centers[*i], axis) - low;
+        const auto bin =
+          std::min(static_cast<std::size_t>(offset * scale), BINS - 1);
+        bins[bin].extend(i_bounds[*i]);
+        ++bin_counts[bin];
+      }
+      // Sweep from the right to find the cost of everything above each split
+      std::array<float, BINS> right_costs{};
+      Aabb right;
+      uint32_t right_count = 0;
+      for (std::size_t split = BINS - 1; split > 0; --split)
+      {
+        right.extend(bins[split]);
+        right_count += bin_counts[split];
+        right_costs[split] = right_count * right.half_area();
+      }
+      Aabb left;
+      uint32_t left_count = 0;
+      for (std::size_t split = 1; split < BINS; ++split)
+      {
+        left.extend(bins[split - 1]);
+        left_count += bin_counts[split - 1];
+        const float cost = left_count * left.half_area() + right_costs[split];
+        if (left_count && left_count < node.count && cost < best_cost)
+        {
+          best_cost = cost;
+          best_axis = axis;
+          best_split = split;
+        }
+      }
+    }
+
+    // Keep small nodes as leaves when splitting wouldn't be cheaper
+    const float leaf_cost = node.count * node.bounds.half_area();
+    const float split_cost =
+      TRAVERSAL_COST * node.bounds.half_area() + best_cost;
+    if (node.count <= MAX_LEAF && (!best_split || leaf_cost <= split_cost))
+      continue;
+
+    auto middle = begin;
+    if (best_split)
+    {
+      const float low = component(center_bounds.min, best_axis);
+      const float scale =
+        BINS / (component(center_bounds.max, best_axis) - low);
+      middle = std::partition(begin, end, [&](uint32_t i_primitive) {
+        const auto bin = std::min(
+          static_cast<std::size_t>(
+            (component(centers[i_primitive], best_axis) - low) * scale),
+          BINS - 1);
+        return bin < best_split;
+      });
+    }
+    // Every center coincides, so split the range in half
+    if (middle == begin || middle == end)
+      middle = begin + node.count / 2;
+
+    const auto first = node.first;
+    const auto left_count = static_cast<uint32_t>(middle - begin);
+    const auto right_count = node.count - left_count;
+    node.first = static_cast<uint32_t>(tree.nodes.size());
+    node.count = 0;
+    const auto left = static_cast<uint32_t>(tree.nodes.size());
+    tree.nodes.push_back({{}, first, left_count});
+    tree.nodes.push_back({{}, first + left_count, right_count});
+    pending.push_back(left + 1);
+    pending.push_back(left);
+  }
+  tree.nodes.shrink_to_fit();
+  return tree;
+}
+
+void refit(Tree& io_tree, const std::vector<Aabb>& i_bounds)
+{
+  // Children always follow their parents, so one pass in reverse order sees
+  // every child before its parent
+  for (auto node = io_tree.nodes.rbegin(); node != io_tree.nodes.rend(); ++node)
+  {
+    node->bounds = {};
+    if (node->count)
+    {
+      for (uint32_t i = node->first; i < node->first + node->count; ++i)
+        node->bounds.extend(i_bounds[io_tree.order[i]]);
+    }
+    else
+    {
+      node->bounds.extend(io_tree.nodes[node->first].bounds);
+      node->bounds.extend(io_tree.nodes[node->first + 1].bounds);
+    }
+  }
+}
+}  // namespace bvh
@@ -0,0 +1,43 @@
+#include "camera_frustum.h"
+#include <math/scalar.h>
+#include <cmath>
+
+CameraFrustum CameraFrustum::perspective(double i_aspect)
+{
+  constexpr double fov_degrees = 45.0;
+  constexpr double z_near = 0.1;
+  constexpr double z_far = 50.0;
+  const double top =
+    z_near * std::tan(fov_degrees * filament::math::F_PI / 360.0);
+  const double right = top * i_aspect;
+  return {-right, right, -top, top, z_near, z_far};
+}
+
+CameraFrustum CameraFrustum::tile(int32_t i_x,
+                                  int32_t i_y,
+                                  uint32_t i_width,
+                                  uint32_t i_height,
+                                  uint32_t i_image_width,
+                                  uint32_t i_image_height) const noexcept
+{
+  // Interpolate across the near plane, y flipped as rows count down
+  const double dx = (right - left) / i_image_width;
+  const double dy = (top - bottom) / i_image_height;
+  CameraFrustum frustum = *this;
+  frustum.left = left + dx * i_x;
+  frustum.right = left + dx * (double(i_x) + i_width);
+  frustum.top = top - dy * i_y;
+  frustum.bottom = top - dy * (double(i_y) + i_height);
+  return frustum;
+}
+
+void CameraFrustum::apply(filament::Camera& io_camera) const
+{
+  io_camera.setProjection(filament::Camera::Projection::PERSPECTIVE,
+                          left,
+                          right,
+                          bottom,
+                          top,
+                          z_near,
+                          z_far);
+}
@@ -1,61 +1,163 @@
 #include "environment_light.h"
-#include <image/KtxBundle.h>
-#include <image/KtxUtility.h>
-#include <fstream>
 #include <array>
+#include <iostream>
 #include <sstream>
 #include <filament/IndirectLight.h>
 #include <filament/Skybox.h>
-#include <filament/Material.h>
 
 
-filament::Texture* load_ktx(filament::Engine* io_engine,
-                            const utils::Path& i_texture_path,
-                            image::KtxBundle** io_ktx_image = nullptr)
-{
-  if (i_texture_path.isEmpty() || !i_texture_path.exists())
-    return nullptr;
-
-  std::ifstream file(i_texture_path.getPath(), std::ios::binary);
-  std::vector<uint8_t> contents((std::istreambuf_iterator<char>(file)), {});
-  auto ktx_image = new image::KtxBundle(contents.data(), contents.size());
-  if (io_ktx_image)
-    *io_ktx_image = ktx_image;
-  return image::KtxUtility::createTexture(io_engine, ktx_image, false, true);
-}
-
 EnvironmentLight::EnvironmentLight(const std::shared_ptr<filament::Engine>& i_engine)
   : m_engine(i_engine)
   , m_ibl_texture(nullptr, {i_engine})
   , m_indirect_light(nullptr, {i_engine})
   , m_skybox_texture(nullptr, {i_engine})
   , m_skybox(nullptr, {i_engine})
-  , m_transparent_material(nullptr, {i_engine})
 {
 }
 
-void EnvironmentLight::load_ibl(const utils::Path& i_ibl_path,
-                   const utils::Path& i_skybox_path)
+namespace
+{
+// Transcode the KTX2 version of a KTX file if there is one we can use
+std::shared_ptr<Ktx2Texture> read_ktx2(const utils::Path& i_ktx_path)
+{
+  const utils::Path path(i_ktx_path.getPath() + '2');
+  if (!Ktx2Texture::available() || !path.exists())
+    return nullptr;
+  try
+  {
+    // Environments are RGBM, whose multiplier in alpha scales every channel,
+    // so block compression errors in it would corrupt the encoded range.
+    // They're only ever transcoded to uncompressed RGBA8, the same as the
+    // KTX file, so KTX2 saves disk space and reads but no GPU memory.
+    return Ktx2Texture::transcode(path.getPath(), {Ktx2Texture::Format::RGBA8});
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << ", using " << i_ktx_path.getPath() << std::endl;
+    return nullptr;
+  }
+}
+}  // namespace
+
+std::unique_ptr<EnvironmentData>
+EnvironmentLight::read_ibl(
+  const utils::Path& i_ibl_path,
+  const utils::Path& i_skybox_path,
+  bool i_ktx2)
 {
-  image::KtxBundle* ibl_ktx = nullptr;
-  m_ibl_texture.reset(load_ktx(m_engine.get(), i_ibl_path, &ibl_ktx));
-  m_skybox_texture.reset(load_ktx(m_engine.get(), i_skybox_path));
+  auto data = std::make_unique<EnvironmentData>();
+  if (i_ktx2)
+  {
+    data->m_ibl_ktx2 = read_ktx2(i_ibl_path);
+    data->m_skybox_ktx2 = read_ktx2(i_skybox_path);
+  }
+  // Mapping only reads the headers, the levels are paged in during upload
+  if (!data->m_skybox_ktx2)
+    data->m_skybox_ktx = KtxMapping::open(i_skybox_path);
+  // The harmonics may only be stored in the original KTX file
+  auto sh = data->m_ibl_ktx2 ? data->m_ibl_ktx2->metadata("sh") : "";
+  if (sh.empty())
+  {
+    data->m_ibl_ktx = KtxMapping::open(i_ibl_path);
+    sh = data->m_ibl_ktx->metadata("sh");
+  }
 
-  std::istringstream shstring(ibl_ktx->getMetadata("sh"));
-  for (auto& band : m_ibl_bands)
+  std::istringstream shstring(sh);
+  for (auto& band : data->m_ibl_bands)
   {
     shstring >> band.x >> band.y >> band.z;
   }
+  return data;
+}
+
+void EnvironmentLight::create_ibl(EnvironmentData&& io_data,
+                                  TextureStreamer* io_streamer)
+{
+  m_ibl_bands = io_data.m_ibl_bands;
+  m_texture_reports.assign(2, {});
+  m_texture_reports[0].name = "ibl";
+  m_texture_reports[1].name = "skybox";
+  // Transcoded textures are already in memory so are uploaded whole. Levels
+  // are uploaded straight from the mappings, which are unmapped once the
+  // engine has released the last level, streaming in if we have a streamer.
+  if (io_data.m_ibl_ktx2)
+    set_ibl_texture(io_data.m_ibl_ktx2->create_texture(
+      m_engine.get(), true, &m_texture_reports[0]));
+  else if (io_streamer)
+  {
+    // Filament picks reflection levels by roughness across however many the
+    // texture has, so a texture missing its largest levels would blur every
+    // reflection. The light uses only the harmonics until every level is in.
+    set_ibl_texture(nullptr);
+    io_streamer->stream(io_data.m_ibl_ktx,
+                        false,
+                        true,
+                        [this](filament::Texture* i_texture) {
+                          set_ibl_texture(i_texture);
+                        },
+                        &m_texture_reports[0],
+                        false);
+  }
+  else
+    set_ibl_texture(io_data.m_ibl_ktx->create_texture(
+      m_engine.get(), false, true, &m_texture_reports[0]));
+
+  if (io_data.m_skybox_ktx2)
+    set_skybox_texture(io_data.m_skybox_ktx2->create_texture(
+      m_engine.get(), true, &m_texture_reports[1]));
+  else if (io_streamer)
+    io_streamer->stream(io_data.m_skybox_ktx,
+                        false,
+                        true,
+                        [this](filament::Texture* i_texture) {
+                          set_skybox_texture(i_texture);
+                        },
+                        &m_texture_reports[1]);
+  else
+    set_skybox_texture(io_data.m_skybox_ktx->create_texture(
+      m_engine.get(), false, true, &m_texture_reports[1]));
 
-  m_indirect_light.reset(filament::IndirectLight::Builder()
-                           .reflections(m_ibl_texture.get())
-                           .irradiance(3, m_ibl_bands.data())
-                           .intensity(30000.0f)
-                           .build(*m_engine));
+  io_data.m_ibl_ktx.reset();
+  io_data.m_skybox_ktx.reset();
+  io_data.m_ibl_ktx2.reset();
+  io_data.m_skybox_ktx2.reset();
+}
 
-  m_skybox.reset(filament::Skybox::Builder()
-                   .environment(m_skybox_texture.get())
-                   .showSun(true)
-                   .build(*m_engine));
+void EnvironmentLight::set_ibl_texture(filament::Texture* i_texture)
+{
+  // The previous light and texture are only destroyed once the new ones
+  // have replaced them in the scene
+  FilamentScopedPointer<filament::Texture> texture(i_texture, {m_engine});
+  FilamentScopedPointer<filament::IndirectLight> light(
+    filament::IndirectLight::Builder()
+      .reflections(texture.get())
+      .irradiance(3, m_ibl_bands.data())
+      .intensity(30000.0f)
+      .build(*m_engine),
+    {m_engine});
+  std::swap(texture, m_ibl_texture);
+  std::swap(light, m_indirect_light);
+  if (m_changed)
+    m_changed();
+}
+
+void EnvironmentLight::set_skybox_texture(filament::Texture* i_texture)
+{
+  FilamentScopedPointer<filament::Texture> texture(i_texture, {m_engine});
+  FilamentScopedPointer<filament::Skybox> skybox(
+    filament::Skybox::Builder()
+      .environment(texture.get())
+      .showSun(true)
+      .build(*m_engine),
+    {m_engine});
+  std::swap(texture, m_skybox_texture);
+  std::swap(skybox, m_skybox);
+  if (m_changed)
+    m_changed();
 }
 
+void EnvironmentLight::load_ibl(const utils::Path& i_ibl_path,
+                   const utils::Path& i_skybox_path)
+{
+  create_ibl(std::move(*read_ibl(i_ibl_path, i_skybox_path)));
+}
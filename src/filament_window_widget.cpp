@@ -1,23 +1,36 @@
 #include "filament_window_widget.h"
+#include "camera_frustum.h"
 #include "filament_raii.h"
+#include "progressive_refinement.h"
+#include "quality_governor.h"
 #include "trackball_camera.h"
+#include "profiler.h"
 #include <QMouseEvent>
-#include <array>
-#include <filament/Material.h>
-#include <filament/MaterialInstance.h>
-#include <filament/RenderableManager.h>
-#include <filament/Scene.h>
+#include <QTimer>
+#include <filament/Camera.h>
+#include <filament/Fence.h>
+#include <filament/Renderer.h>
 #include <filament/View.h>
-#include <filament/LightManager.h>
-#include <filament/TransformManager.h>
-#include <filament/IndirectLight.h>
-#include <filament/Skybox.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
 
+namespace
+{
+// How long the camera must be still before we start refining the image
+constexpr int IDLE_MS = 150;
+}  // namespace
 
-// Private state of the filament window widget
-struct FilamentWindowWidget::FilamentWindowWidgetImpl
+// State used for rendering our view of the shared scene, this is created,
+// accessed and destroyed only on the render thread
+struct FilamentWindowWidget::RenderState
 {
-  FilamentWindowWidgetImpl(std::shared_ptr<filament::Engine> i_engine);
+  RenderState(std::shared_ptr<filament::Engine> i_engine);
+  // Configure the view for the governor's tier and the refinement phase
+  void configure_view();
+  // Render cheaply while the camera or the scene moves, and refine once both
+  // are still
+  void update_motion();
   // Store a shared pointer to the engine, all of our entities will also store
   std::shared_ptr<filament::Engine> engine;
 
@@ -26,64 +39,115 @@ struct FilamentWindowWidget::FilamentWindowWidgetImpl
   FilamentScopedPointer<filament::Renderer> renderer;
   FilamentScopedPointer<filament::Camera> camera;
   FilamentScopedPointer<filament::View> view;
-  FilamentScopedPointer<filament::Scene> scene;
-  FilamentScopedPointer<filament::Material> material;
-  FilamentScopedPointer<filament::MaterialInstance> material_instance;
-
-  // Scoped entity for our light
-  FilamentScopedEntity light;
-  FilamentScopedEntity mesh;
-  filamesh::MeshReader::MaterialRegistry material_registry;
-
-  // Implements the trackball camera state
-  TrackballCamera camera_manager;
-  // Implements image based lighting and environment map backdrop
-  EnvironmentLight ibl_skybox;
+  // Lowers the view's quality when frames take too long
+  QualityGovernor governor;
+  // Renders cheaply while the camera moves, and refines still images
+  ProgressiveRefinement refinement;
+  bool camera_moving = false;
+  bool animating = false;
+  // When we first tried to draw the frame being presented, so frames
+  // skipped on the way count towards its time. Empty once it's presented.
+  std::chrono::steady_clock::time_point frame_start;
 };
 
-// Construct our private state using the supplied filament engine
-FilamentWindowWidget::FilamentWindowWidgetImpl::FilamentWindowWidgetImpl(
+// Construct our render state using the supplied filament engine
+FilamentWindowWidget::RenderState::RenderState(
   std::shared_ptr<filament::Engine> i_engine)
   : engine(std::move(i_engine))
   , swap_chain(nullptr, {engine})
   , renderer(engine->createRenderer(), {engine})
   , camera(engine->createCamera(), {engine})
   , view(engine->createView(), {engine})
-  , scene(engine->createScene(), {engine})
-  , material(nullptr, {engine})
-  , material_instance(nullptr, {engine})
-  , light(utils::EntityManager::get().create(), engine)
-  , mesh(engine)
-  , ibl_skybox(engine)
 {
 }
 
-// This needs to be generated from the sample bakedColor.mat
-// $>  matc -o bakedColor.inc -f header bakedColor.mat
-static constexpr uint8_t AIDEFAULTMAT_PACKAGE[] = {
-#include "assets/materials/aiDefaultMat.inc"
+void FilamentWindowWidget::RenderState::configure_view()
+{
+  refinement.apply(*view, QualityGovernor::tiers()[governor.tier()]);
+}
+
+void FilamentWindowWidget::RenderState::update_motion()
+{
+  // An animating scene changes every frame, so is drawn like a moving camera
+  // rather than refined from scratch each time
+  const bool changed = camera_moving || animating
+                         ? refinement.camera_moved()
+                         : refinement.camera_idle();
+  if (changed)
+    configure_view();
+}
+
+// Private state of the filament window widget
+struct FilamentWindowWidget::FilamentWindowWidgetImpl
+{
+  FilamentWindowWidgetImpl(std::shared_ptr<SharedScene> i_scene);
+  // The scene we render, shared with any other windows
+  std::shared_ptr<SharedScene> scene;
+  // All filament calls are made from this thread
+  std::shared_ptr<RenderThread> render_thread;
+  // Only accessed through commands posted to the render thread
+  std::unique_ptr<RenderState> render_state;
+
+  // Implements the trackball camera state
+  TrackballCamera camera_manager;
+  // Latest mouse position received since the last frame, mouse movement is
+  // coalesced and applied to the camera once per frame
+  filament::math::float2 pending_mouse_position;
+  bool mouse_moved = false;
+  // Fires once the camera has stopped moving, owned by the widget
+  QTimer* idle_timer = nullptr;
+  // Whatever the last click selected, copied from the render thread
+  PickResult selection;
 };
 
+// Construct our private state, creating the render state on the render thread
+FilamentWindowWidget::FilamentWindowWidgetImpl::FilamentWindowWidgetImpl(
+  std::shared_ptr<SharedScene> i_scene)
+  : scene(std::move(i_scene)), render_thread(scene->render_thread())
+{
+  render_thread->run_sync([this] {
+    render_state = std::make_unique<RenderState>(scene->engine());
+  });
+}
+
 // Call the parent constructor, and construct the private state
-FilamentWindowWidget::FilamentWindowWidget(
-  QWidget* i_parent, std::shared_ptr<filament::Engine> i_engine)
-  : NativeWindowWidget(i_parent), m_impl(std::move(i_engine))
+FilamentWindowWidget::FilamentWindowWidget(QWidget* i_parent,
+                                           std::shared_ptr<SharedScene> i_scene)
+  : NativeWindowWidget(i_parent)
+  , m_impl(FilamentWindowWidgetImpl(std::move(i_scene)))
 {
+  // Frames are presented by the render thread, after draw_impl has returned
+  frame_scheduler().set_asynchronous_present(true);
+  m_impl->idle_timer = new QTimer(this);
+  m_impl->idle_timer->setSingleShot(true);
+  m_impl->idle_timer->setInterval(IDLE_MS);
+  connect(
+    m_impl->idle_timer, &QTimer::timeout, this, [this] { camera_idle(); });
 }
 
-// Define the destructor once the definition of FilamentWindowWidgetImpl is 
-// visible
-FilamentWindowWidget::~FilamentWindowWidget() = default;
+// Engine registered objects must be destroyed on the render thread, after any
+// outstanding commands which reference them
+FilamentWindowWidget::~FilamentWindowWidget()
+{
+  // A batch which hasn't been posted yet must not draw us
+  m_impl->scene->cancel(this);
+  auto& render_state = m_impl->render_state;
+  m_impl->render_thread->run_sync([&render_state] { render_state.reset(); });
+}
 
 // Handle user mouse presses by setting the state of our camera
 void FilamentWindowWidget::mousePressEvent(QMouseEvent* i_mouse_event)
 {
   QWidget::mousePressEvent(i_mouse_event);
+  // Movement from before the press must be applied using the previous action
+  apply_pending_input();
   // Could replace this with command pattern to allow re-mapping of controls
   switch (i_mouse_event->button())
   {
   case Qt::LeftButton:
     m_impl->camera_manager.set_action(TrackballCamera::ORBIT);
+    // Clicking also selects whatever is under the cursor
+    pick({i_mouse_event->x(), i_mouse_event->y()});
     break;
   case Qt::RightButton:
     m_impl->camera_manager.set_action(TrackballCamera::ZOOM);
@@ -99,113 +163,140 @@ void FilamentWindowWidget::mousePressEvent(QMouseEvent* i_mouse_event)
 void FilamentWindowWidget::mouseMoveEvent(QMouseEvent* i_mouse_event)
 {
   QWidget::mouseMoveEvent(i_mouse_event);
-  // Get the new mouse position
-  filament::math::float2 new_mouse_position(i_mouse_event->x(),
-                                            i_mouse_event->y());
-  // Let the camera respond to mouse movement
-  m_impl->camera_manager.act(std::move(new_mouse_position));
+  // Store the new mouse position, the camera will respond to it once, when the
+  // next frame is drawn, however many move events we receive before then
+  m_impl->pending_mouse_position = {i_mouse_event->x(), i_mouse_event->y()};
+  m_impl->mouse_moved = true;
+  // Redraw the scene once we've moved the camera
+  input_received();
+}
+
+// Apply all mouse movement received since the last frame to the camera
+void FilamentWindowWidget::apply_pending_input()
+{
+  if (!m_impl->mouse_moved)
+    return;
+  ScopedTimer timer("input");
+  m_impl->mouse_moved = false;
+  // The camera responds to the total displacement since the last position it
+  // saw, so acting on only the latest position is equivalent to acting on
+  // every intermediate one
+  m_impl->camera_manager.act(m_impl->pending_mouse_position);
   // Recalculate the camera view matrix
   calculate_camera_view();
-  // Redraw the scene now that we've moved the camera
+  // Render cheaply until the camera has been still for a moment
+  auto state = m_impl->render_state.get();
+  m_impl->render_thread->post([state] {
+    state->camera_moving = true;
+    state->update_motion();
+  });
+  m_impl->idle_timer->start();
+}
+
+// Begin refining the image now the camera has come to rest
+void FilamentWindowWidget::camera_idle()
+{
+  auto state = m_impl->render_state.get();
+  m_impl->render_thread->post([state] {
+    state->camera_moving = false;
+    state->update_motion();
+  });
   request_draw();
 }
 
-// Load and link our materials here
-void FilamentWindowWidget::init_materials()
-{
-  // Load the material for our mesh
-  m_impl->material.reset(
-    filament::Material::Builder()
-      .package((void*)AIDEFAULTMAT_PACKAGE, sizeof(AIDEFAULTMAT_PACKAGE))
-      .build(*m_impl->engine));
-  // Create an instance of the material to set params
-  m_impl->material_instance.reset(m_impl->material->createInstance());
-  // Set material parameters
-  m_impl->material_instance->setParameter(
-    "baseColor",
-    filament::RgbType::LINEAR,
-    {0.1f, 0.4f, 0.9f});
-  m_impl->material_instance->setParameter("metallic", 1.0f);
-  m_impl->material_instance->setParameter("roughness", 0.3f);
-  m_impl->material_instance->setParameter("reflectance", 0.5f);
-  m_impl->material_registry["DefaultMaterial"] =
-    m_impl->material_instance.get();
-}
-
-// Load and link our meshes here
-void FilamentWindowWidget::init_meshes()
-{
-  // Load the Suzanne mesh from a file
-  m_impl->mesh =
-    filamesh::MeshReader::loadMeshFromFile(m_impl->engine.get(),
-                                           "assets/models/suzanne.filamesh",
-                                           m_impl->material_registry)
-      .renderable;
-  // Allow the mesh to cast shadows in the scene
-  auto& renderable_manager = m_impl->engine->getRenderableManager();
-  auto renderable_instance = renderable_manager.getInstance(m_impl->mesh);
-  renderable_manager.setCastShadows(renderable_instance, true);
-  m_impl->scene->addEntity(m_impl->mesh);
-}
-
-// Set-up the scene's lighting here
-void FilamentWindowWidget::init_lighting()
-{
-  // Load the skybox and setup image based lighting
-  m_impl->ibl_skybox.load_ibl("assets/env/pillars/pillars_ibl.ktx",
-                              "assets/env/pillars/pillars_skybox.ktx");
-  // Link the skybox as our backdrop, and set the image texture as a light
-  m_impl->scene->setSkybox(m_impl->ibl_skybox.m_skybox.get());
-  m_impl->scene->setIndirectLight(m_impl->ibl_skybox.m_indirect_light.get());
-
-  // Create a simple sun light to compliment the image based lighting
-  filament::LightManager::Builder(filament::LightManager::Type::SUN)
-    .color(filament::Color::toLinear<filament::ACCURATE>(
-      filament::sRGBColor(0.98f, 0.92f, 0.89f)))
-    .intensity(110000)
-    .direction({0.7, -1, -0.8})
-    .sunAngularRadius(1.9f)
-    .castShadows(false)
-    .build(*m_impl->engine, m_impl->light);
-  // Add the light to the scene
-  m_impl->scene->addEntity(m_impl->light);
+// Cast a ray through the cursor from the camera, as of the latest frame
+void FilamentWindowWidget::pick(filament::math::float2 i_position)
+{
+  // Sample the center of the pixel, with y pointing up in device coordinates
+  const filament::math::float2 ndc{
+    2.f * (i_position.x + 0.5f) / std::max(width(), 1) - 1.f,
+    1.f - 2.f * (i_position.y + 0.5f) / std::max(height(), 1)};
+  auto state = m_impl->render_state.get();
+  auto scene = m_impl->scene.get();
+  m_impl->render_thread->post([this, state, scene, ndc] {
+    PickResult selection;
+    {
+      // Timed by the profiler rather than reported on every click
+      ScopedTimer timer("pick");
+      selection = scene->pick(*state->camera, ndc);
+    }
+    // Dropped if we're destroyed before it's delivered
+    QMetaObject::invokeMethod(
+      this,
+      [this, selection] { m_impl->selection = selection; },
+      Qt::QueuedConnection);
+  });
+}
+
+const PickResult& FilamentWindowWidget::selection() const noexcept
+{
+  return m_impl->selection;
+}
+
+void FilamentWindowWidget::set_target_fps(double i_target_fps)
+{
+  auto state = m_impl->render_state.get();
+  m_impl->render_thread->post([state, i_target_fps] {
+    state->governor.set_target_fps(i_target_fps);
+    state->configure_view();
+  });
+}
+
+void FilamentWindowWidget::set_refine_frames(uint32_t i_frames)
+{
+  auto state = m_impl->render_state.get();
+  m_impl->render_thread->post([state, i_frames] {
+    state->refinement.set_frames(i_frames);
+    state->configure_view();
+    // Refinement restarts as if everything were still
+    state->update_motion();
+  });
+  request_draw();
 }
 
 // Scene set-up, linking of filament components, creation of materials etc.
 void FilamentWindowWidget::init_impl(void* io_native_window)
 {
+  ScopedTimer timer("init");
   NativeWindowWidget::init_impl(io_native_window);
-  // Create our swap chain for displaying rendered frames
-  m_impl->swap_chain.reset(m_impl->engine->createSwapChain(io_native_window));
-
-  // Link the camera and scene to our view point
-  m_impl->view->setCamera(m_impl->camera.get());
-  m_impl->view->setScene(m_impl->scene.get());
+  auto state = m_impl->render_state.get();
+  auto scene = m_impl->scene.get();
+  m_impl->render_thread->post([state, scene, io_native_window] {
+    {
+      // Create our swap chain for displaying rendered frames
+      ScopedTimer swap_chain_timer("create swap chain");
+      state->swap_chain.reset(
+        state->engine->createSwapChain(io_native_window));
+    }
+    {
+      // Link the camera and scene to our view point, and apply screen space
+      // effects
+      ScopedTimer view_timer("configure view");
+      state->view->setCamera(state->camera.get());
+    }
+    // The first view to attach begins loading the scene
+    scene->attach(*state->view);
+  });
 
   // Calculate the camera's view matrix
   calculate_camera_view();
   // Set up the render view point
   calculate_camera_projection();
-
-  // Screen space effects
-  m_impl->view->setClearColor({0.3f, 0.3f, 0.3f, 1.0f});
-  m_impl->view->setPostProcessingEnabled(true);
-  m_impl->view->setDepthPrepass(filament::View::DepthPrepass::ENABLED);
-  m_impl->view->setAntiAliasing(filament::View::AntiAliasing::FXAA);
-  m_impl->view->setRenderQuality({filament::View::QualityLevel::ULTRA});
-
-  init_materials();
-  init_meshes();
-  init_lighting();
 }
-//
+
 // Update the camera view matrix using the camera manager
 void FilamentWindowWidget::calculate_camera_view()
 {
-  // Recalculate the view matrix
-  m_impl->camera->lookAt(m_impl->camera_manager.eye(),
-                         m_impl->camera_manager.target(),
-                         m_impl->camera_manager.up());
+  // Take a snapshot of the camera state to send to the render thread
+  auto state = m_impl->render_state.get();
+  m_impl->render_thread->post([state,
+                               eye = m_impl->camera_manager.eye(),
+                               target = m_impl->camera_manager.target(),
+                               up = m_impl->camera_manager.up()] {
+    // Recalculate the view matrix
+    ScopedTimer timer("camera update");
+    state->camera->lookAt(eye, target, up);
+  });
 }
 
 // Update the camera projection matrix using the window size
@@ -216,15 +307,17 @@ void FilamentWindowWidget::calculate_camera_projection()
   const uint32_t w = static_cast<uint32_t>(width() * pixel_ratio);
   const uint32_t h = static_cast<uint32_t>(height() * pixel_ratio);
 
-  // Set our view-port size
-  m_impl->view->setViewport({0, 0, w, h});
+  auto state = m_impl->render_state.get();
+  m_impl->render_thread->post([state, w, h] {
+    ScopedTimer timer("camera projection");
+    // A still image has to be refined again at the new size
+    state->refinement.restart();
+    // Set our view-port size
+    state->view->setViewport({0, 0, w, h});
 
-  // setup projection matrix
-  const float far = 50.f;
-  const float near = 0.1f;
-  const float aspect = float(w) / h;
-  m_impl->camera->setProjection(
-    45.0f, aspect, near, far, filament::Camera::Fov::VERTICAL);
+    // setup projection matrix
+    CameraFrustum::perspective(double(w) / h).apply(*state->camera);
+  });
 }
 
 void FilamentWindowWidget::resize_impl()
@@ -237,12 +330,68 @@ void FilamentWindowWidget::resize_impl()
 void FilamentWindowWidget::draw_impl()
 {
   NativeWindowWidget::draw_impl();
-  // beginFrame() returns false if we need to skip a frame
-  if (m_impl->renderer->beginFrame(m_impl->swap_chain.get()))
-  {
-    m_impl->renderer->render(m_impl->view.get());
-    m_impl->renderer->endFrame();
-  }
+  // Respond to input received since the last frame
+  apply_pending_input();
+
+  // Our frame is rendered alongside any other views of the scene
+  auto state = m_impl->render_state.get();
+  SharedScene::Target target;
+  target.view = state->view.get();
+  target.draw = [this, state](bool i_loading, bool i_animating) {
+    if (i_animating != state->animating)
+    {
+      state->animating = i_animating;
+      state->update_motion();
+    }
+    if (state->frame_start == std::chrono::steady_clock::time_point())
+      state->frame_start = std::chrono::steady_clock::now();
+    state->refinement.prepare_frame(*state->view);
+    bool refining =
+      state->refinement.phase() == ProgressiveRefinement::REFINING;
+    bool begun = false;
+    {
+      // beginFrame() returns false to skip the frame when the GPU falls
+      // behind, rather than waiting for it
+      ScopedTimer begin_timer("beginFrame");
+      begun = state->renderer->beginFrame(state->swap_chain.get());
+    }
+    if (begun)
+    {
+      {
+        ScopedTimer render_timer("render");
+        state->renderer->render(state->view.get());
+      }
+      {
+        ScopedTimer end_timer("endFrame");
+        state->renderer->endFrame();
+      }
+      // Timed from the first attempt at this frame, so skipped frames count
+      // against the frame rate the user sees
+      const auto frame_ms = std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() -
+                              state->frame_start)
+                              .count();
+      state->frame_start = {};
+      // Only frames drawn while the camera moves need to keep up, a still
+      // image takes as long as it needs to refine
+      if (state->refinement.phase() == ProgressiveRefinement::INTERACTIVE &&
+          state->governor.add_frame(frame_ms))
+      {
+        state->configure_view();
+        std::cout << "Quality " << state->governor.decisions().back()
+                  << std::endl;
+      }
+      refining = state->refinement.frame_drawn();
+    }
+    // Assets still being added will change the image, so refine from scratch
+    if (i_loading)
+      state->refinement.restart();
+    // Keep drawing until all of our assets have been added to the scene, and
+    // the still image has converged, or forever while animating, then stop
+    // drawing altogether. A skipped frame is always tried again.
+    post_frame_presented(i_loading || i_animating || refining || !begun);
+  };
+  m_impl->scene->submit(this, std::move(target));
 }
 
 void FilamentWindowWidget::closeEvent(QCloseEvent* i_event)
@@ -251,5 +400,8 @@ void FilamentWindowWidget::closeEvent(QCloseEvent* i_event)
   // We need to ensure all rendering operations have completed before we
   // destroy our engine registered objects.
   // Safe to assume we won't be issuing anymore render calls after this
-  filament::Fence::waitAndDestroy(m_impl->engine->createFence());
+  auto state = m_impl->render_state.get();
+  m_impl->render_thread->run_sync([state] {
+    filament::Fence::waitAndDestroy(state->engine->createFence());
+  });
 }
@@ -0,0 +1,134 @@
+#include "filamesh_file.h"
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+namespace filamesh_file
+{
+namespace
+{
+// Bounds checked sequential reads from a buffer
+class Reader
+{
+public:
+  Reader(const uint8_t* i_data, std::size_t i_size)
+    : m_data(i_data), m_end(i_data + i_size)
+  {
+  }
+
+  const uint8_t* skip(std::size_t i_size)
+  {
+    if (static_cast<std::size_t>(m_end - m_data) < i_size)
+      throw std::runtime_error("Truncated filamesh file");
+    const auto data = m_data;
+    m_data += i_size;
+    return data;
+  }
+
+  template <typename T>
+  T read()
+  {
+    T value;
+    std::memcpy(&value, skip(sizeof(T)), sizeof(T));
+    return value;
+  }
+
+private:
+  const uint8_t* m_data;
+  const uint8_t* const m_end;
+};
+}  // namespace
+
+Contents parse(const uint8_t* i_data, std::size_t i_size)
+{
+  Reader reader(i_data, i_size);
+  if (std::memcmp(reader.skip(MAGIC_SIZE), MAGIC, MAGIC_SIZE) != 0)
+    throw std::runtime_error("Not a filamesh file");
+
+  Contents contents;
+  contents.header = reader.read<Header>();
+  contents.vertices = reader.skip(contents.header.vertex_size);
+  contents.indices = reader.skip(contents.header.index_size);
+
+  contents.parts.resize(contents.header.parts);
+  for (auto& part : contents.parts)
+    part = reader.read<Part>();
+
+  const auto material_count = reader.read<uint32_t>();
+  contents.material_names.reserve(material_count);
+  for (uint32_t i = 0; i < material_count; ++i)
+  {
+    // Names are stored with their length, followed by a null terminator
+    const auto length = reader.read<uint32_t>();
+    const auto name = reinterpret_cast<const char*>(reader.skip(length + 1));
+    contents.material_names.emplace_back(name, length);
+  }
+  return contents;
+}
+
+bool repair_material_ids(std::vector<uint8_t>& io_data)
+{
+  const auto contents = parse(io_data.data(), io_data.size());
+  const auto material_count =
+    static_cast<uint32_t>(contents.material_names.size());
+  const auto parts_offset =
+    static_cast<std::size_t>(contents.indices - io_data.data()) +
+    contents.header.index_size;
+  bool repaired = false;
+  for (std::size_t i = 0; i < contents.parts.size(); ++i)
+  {
+    if (contents.parts[i].material_id < material_count)
+      continue;
+    std::memcpy(io_data.data() + parts_offset + i * sizeof(Part) +
+                  offsetof(Part, material_id),
+                &material_count,
+                sizeof(material_count));
+    repaired = true;
+  }
+  if (!repaired)
+    return false;
+
+  // The names are the last thing in the file, so append an empty one
+  const uint32_t new_count = material_count + 1;
+  std::memcpy(io_data.data() + parts_offset +
+                contents.parts.size() * sizeof(Part),
+              &new_count,
+              sizeof(new_count));
+  io_data.resize(io_data.size() + sizeof(uint32_t) + 1, 0);
+  return true;
+}
+
+void write(std::ostream& io_stream,
+           Header i_header,
+           const void* i_vertices,
+           const void* i_indices,
+           const std::vector<Part>& i_parts,
+           const std::vector<std::string>& i_material_names)
+{
+  const auto write_bytes = [&io_stream](const void* i_data,
+                                        std::size_t i_size) {
+    io_stream.write(static_cast<const char*>(i_data), i_size);
+  };
+  const auto write_uint = [&write_bytes](uint32_t i_value) {
+    write_bytes(&i_value, sizeof(i_value));
+  };
+
+  i_header.version = VERSION;
+  i_header.parts = static_cast<uint32_t>(i_parts.size());
+  write_bytes(MAGIC, MAGIC_SIZE);
+  write_bytes(&i_header, sizeof(i_header));
+  write_bytes(i_vertices, i_header.vertex_size);
+  write_bytes(i_indices, i_header.index_size);
+  write_bytes(i_parts.data(), i_parts.size() * sizeof(Part));
+
+  write_uint(static_cast<uint32_t>(i_material_names.size()));
+  for (const auto& name : i_material_names)
+  {
+    // Names are stored with their length, followed by a null terminator
+    write_uint(static_cast<uint32_t>(name.size()));
+    write_bytes(name.c_str(), name.size() + 1);
+  }
+  if (!io_stream)
+    throw std::runtime_error("Failed to write filamesh file");
+}
+}  // namespace filamesh_file
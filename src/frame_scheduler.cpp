@@ -0,0 +1,122 @@
+#include "frame_scheduler.h"
+#include <algorithm>
+
+FrameScheduler::FrameScheduler(std::function<void()> i_draw)
+  : m_draw(std::move(i_draw))
+{
+  // We reuse a single timer rather than posting a new event for each request
+  m_timer.setSingleShot(true);
+  m_timer.setTimerType(Qt::PreciseTimer);
+  QObject::connect(&m_timer, &QTimer::timeout, [this] { draw_frame(); });
+  set_refresh_rate(60.0);
+}
+
+void FrameScheduler::set_mode(MODE i_mode)
+{
+  m_mode = i_mode;
+  if (m_mode == CONTINUOUS)
+    request_frame();
+}
+
+FrameScheduler::MODE FrameScheduler::mode() const noexcept
+{
+  return m_mode;
+}
+
+void FrameScheduler::set_refresh_rate(double i_hz)
+{
+  // Some platforms report a zero refresh rate
+  if (i_hz <= 0.0)
+    i_hz = 60.0;
+  m_frame_interval = std::chrono::duration_cast<clock::duration>(
+    std::chrono::duration<double>(1.0 / i_hz));
+}
+
+void FrameScheduler::set_asynchronous_present(bool i_asynchronous) noexcept
+{
+  m_asynchronous_present = i_asynchronous;
+}
+
+void FrameScheduler::frame_presented()
+{
+  // Nothing is awaiting presentation
+  if (!m_frame_in_flight)
+    return;
+  m_frame_in_flight = false;
+
+  if (m_frame_had_input)
+  {
+    const auto latency = std::chrono::duration<double, std::milli>(
+                           clock::now() - m_frame_input)
+                           .count();
+    m_latencies[m_num_latencies++ % m_latencies.size()] = latency;
+  }
+  // Draw any frames that were requested while we were waiting
+  if (m_mode == CONTINUOUS || m_frame_deferred || m_input_pending)
+  {
+    m_frame_deferred = false;
+    request_frame();
+  }
+}
+
+void FrameScheduler::request_frame()
+{
+  // A frame is already due, this request will be satisfied by it
+  if (m_timer.isActive())
+    return;
+  schedule(clock::now());
+}
+
+void FrameScheduler::input_received()
+{
+  // Latency is measured from the oldest input the next frame will consume
+  if (!m_input_pending)
+  {
+    m_input_pending = true;
+    m_first_input = clock::now();
+  }
+  request_frame();
+}
+
+FrameStats FrameScheduler::latency_stats() const
+{
+  const auto count = std::min(m_num_latencies, m_latencies.size());
+  return summarize_frame_times(
+    std::vector<double>(m_latencies.begin(), m_latencies.begin() + count));
+}
+
+void FrameScheduler::draw_frame()
+{
+  // Wait for the previous frame to be presented, we'll draw once it has been
+  if (m_frame_in_flight)
+  {
+    m_frame_deferred = true;
+    return;
+  }
+  m_frame_in_flight = true;
+  // Keep to the refresh cadence while frames are back to back, but start a
+  // new one if we've been idle for longer than an interval
+  const auto now = clock::now();
+  m_next_frame = now - m_next_frame < m_frame_interval
+                   ? m_next_frame + m_frame_interval
+                   : now + m_frame_interval;
+  // Any input received while drawing belongs to the next frame
+  m_frame_had_input = m_input_pending;
+  m_frame_input = m_first_input;
+  m_input_pending = false;
+
+  m_draw();
+
+  if (!m_asynchronous_present)
+    frame_presented();
+}
+
+void FrameScheduler::schedule(clock::time_point i_now)
+{
+  // Wait until the next frame is due, rounded to the nearest millisecond the
+  // timer accepts, if it's already due then draw as soon as possible
+  const auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(
+    m_next_frame - i_now + std::chrono::microseconds{500});
+  m_timer.start(static_cast<int>(
+    std::max(delay, std::chrono::milliseconds{0}).count()));
+}
@@ -0,0 +1,60 @@
+#include "frame_stats.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+
+namespace
+{
+// Nearest rank percentile of an already sorted series
+double percentile(const std::vector<double>& i_sorted, const double i_p)
+{
+  const auto rank = static_cast<std::size_t>(
+    std::ceil(i_p * static_cast<double>(i_sorted.size())));
+  return i_sorted[std::min(std::max(rank, std::size_t{1}), i_sorted.size()) -
+                  1];
+}
+}  // namespace
+
+FrameStats summarize_frame_times(std::vector<double> i_frame_times_ms,
+                                 uint32_t i_skipped)
+{
+  FrameStats stats;
+  stats.frames = static_cast<uint32_t>(i_frame_times_ms.size());
+  stats.skipped = i_skipped;
+  // Nothing to summarize
+  if (i_frame_times_ms.empty())
+    return stats;
+
+  std::sort(i_frame_times_ms.begin(), i_frame_times_ms.end());
+  stats.min_ms = i_frame_times_ms.front();
+  stats.max_ms = i_frame_times_ms.back();
+  stats.median_ms = percentile(i_frame_times_ms, 0.5);
+  stats.p99_ms = percentile(i_frame_times_ms, 0.99);
+  stats.mean_ms =
+    std::accumulate(i_frame_times_ms.begin(), i_frame_times_ms.end(), 0.0) /
+    i_frame_times_ms.size();
+  return stats;
+}
+
+QJsonObject to_json(const FrameStats& i_stats)
+{
+  return {{"frames", static_cast<int>(i_stats.frames)},
+          {"skipped", static_cast<int>(i_stats.skipped)},
+          {"min_ms", i_stats.min_ms},
+          {"median_ms", i_stats.median_ms},
+          {"p99_ms", i_stats.p99_ms},
+          {"max_ms", i_stats.max_ms},
+          {"mean_ms", i_stats.mean_ms}};
+}
+
+std::ostream& operator<<(std::ostream& io_os, const FrameStats& i_stats)
+{
+  const auto flags = io_os.flags();
+  io_os << std::fixed << std::setprecision(3) << i_stats.frames << " frames ("
+        << i_stats.skipped << " skipped), min " << i_stats.min_ms
+        << " ms, median " << i_stats.median_ms << " ms, p99 " << i_stats.p99_ms
+        << " ms, max " << i_stats.max_ms << " ms";
+  io_os.flags(flags);
+  return io_os;
+}
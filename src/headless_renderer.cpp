@@ -0,0 +1,333 @@
+#include "headless_renderer.h"
+#include "camera_frustum.h"
+#include "filament_raii.h"
+#include "pbr_scene.h"
+#include "profiler.h"
+#include "trackball_camera.h"
+#include <math/quat.h>
+#include <math/scalar.h>
+#include <algorithm>
+#include <chrono>
+#include <filament/Camera.h>
+#include <filament/Fence.h>
+#include <filament/Renderer.h>
+#include <filament/SwapChain.h>
+#include <filament/View.h>
+
+// A single offscreen view of the scene, with its own swap chain and camera
+struct HeadlessView
+{
+  HeadlessView(const std::shared_ptr<filament::Engine>& i_engine,
+               uint32_t i_width,
+               uint32_t i_height);
+  // Scoped unique pointers to all engine registered objects
+  FilamentScopedPointer<filament::SwapChain> swap_chain;
+  FilamentScopedPointer<filament::Renderer> renderer;
+  FilamentScopedPointer<filament::Camera> camera;
+  FilamentScopedPointer<filament::View> view;
+};
+
+HeadlessView::HeadlessView(const std::shared_ptr<filament::Engine>& i_engine,
+                           uint32_t i_width,
+                           uint32_t i_height)
+  : swap_chain(i_engine->createSwapChain(
+                 i_width, i_height, filament::SwapChain::CONFIG_DEFAULT),
+               {i_engine})
+  , renderer(i_engine->createRenderer(), {i_engine})
+  , camera(i_engine->createCamera(), {i_engine})
+  , view(i_engine->createView(), {i_engine})
+{
+}
+
+// Private state of the headless renderer
+struct HeadlessRenderer::HeadlessRendererImpl
+{
+  HeadlessRendererImpl(std::shared_ptr<filament::Engine> i_engine,
+                       uint32_t i_width,
+                       uint32_t i_height,
+                       const SceneManifest& i_manifest,
+                       uint32_t i_views);
+  // Store a shared pointer to the engine, all of our entities will also store
+  std::shared_ptr<filament::Engine> engine;
+
+  // The materials, meshes and lights we render, shared by every view
+  PbrScene scene;
+  std::vector<std::unique_ptr<HeadlessView>> views;
+  // Every view's filament view, used to select levels of detail
+  std::vector<const filament::View*> lod_views;
+
+  // Use the same default view point as the interactive window
+  TrackballCamera camera_manager;
+  // Time taken to load the scene
+  double load_time_ms = 0.0;
+  // Loaded the scene, and marks the first frame on the same clock
+  AssetLoader loader;
+  bool first_frame_drawn = false;
+  std::size_t triangles_per_frame = 0;
+  // Frames drawn before every texture level had streamed in
+  uint32_t stream_frames = 0;
+  // Frames drawn so far, which drive the animation at a fixed 60Hz and the
+  // camera path so runs are repeatable. Skipped frames don't count, so every
+  // run draws the same sequence of images.
+  uint32_t frame_index = 0;
+  // Total time spent updating transforms, and the frames it was measured over
+  double transform_ms = 0.0;
+  uint32_t transform_frames = 0;
+  bool camera_path = false;
+  // When we first tried to draw the next frame, so frames skipped on the way
+  // count towards its time, as in the window. Empty once it's drawn.
+  std::chrono::steady_clock::time_point frame_start;
+  // Off unless given a target, every view shares the same tier
+  QualityGovernor governor{0.0};
+};
+
+HeadlessRenderer::HeadlessRendererImpl::HeadlessRendererImpl(
+  std::shared_ptr<filament::Engine> i_engine,
+  uint32_t i_width,
+  uint32_t i_height,
+  const SceneManifest& i_manifest,
+  uint32_t i_views)
+  : engine(std::move(i_engine)), scene(engine)
+{
+  for (uint32_t i = 0; i < std::max(i_views, 1u); ++i)
+  {
+    views.push_back(std::make_unique<HeadlessView>(engine, i_width, i_height));
+    auto& view = *views.back();
+    // Link the camera and scene to our view point
+    view.view->setCamera(view.camera.get());
+    scene.configure_view(*view.view);
+    view.view->setViewport({0, 0, i_width, i_height});
+
+    // Match the projection used by the interactive window
+    CameraFrustum::perspective(double(i_width) / i_height)
+      .apply(*view.camera);
+    view.camera->lookAt(
+      camera_manager.eye(), camera_manager.target(), camera_manager.up());
+    lod_views.push_back(view.view.get());
+  }
+
+  // Include the time for the engine to consume our uploads, which only
+  // includes the smallest texture levels
+  scene.init(loader, i_manifest);
+  filament::Fence::waitAndDestroy(engine->createFence());
+  load_time_ms = loader.elapsed_ms();
+}
+
+HeadlessRenderer::HeadlessRenderer(std::shared_ptr<filament::Engine> i_engine,
+                                   uint32_t i_width,
+                                   uint32_t i_height,
+                                   const SceneManifest& i_manifest,
+                                   uint32_t i_views)
+  // The scene can't be moved so construct our state in place
+  : m_impl(nonstd::in_place,
+           std::move(i_engine),
+           i_width,
+           i_height,
+           i_manifest,
+           i_views)
+{
+}
+
+double HeadlessRenderer::load_time_ms() const noexcept
+{
+  return m_impl->load_time_ms;
+}
+
+const std::vector<LoadStage>& HeadlessRenderer::startup_timeline() const
+  noexcept
+{
+  return m_impl->loader.timeline();
+}
+
+MaterialLibrary::Stats HeadlessRenderer::material_stats() const noexcept
+{
+  return m_impl->scene.materials().stats();
+}
+
+std::vector<TextureReport> HeadlessRenderer::texture_reports() const
+{
+  return m_impl->scene.texture_reports();
+}
+
+uint32_t HeadlessRenderer::stream_frames() const noexcept
+{
+  return m_impl->stream_frames;
+}
+
+void HeadlessRenderer::set_upload_budget(std::size_t i_bytes) noexcept
+{
+  m_impl->scene.set_upload_budget(i_bytes);
+}
+
+void HeadlessRenderer::set_animated(bool i_animated) noexcept
+{
+  m_impl->scene.set_animated(i_animated);
+}
+
+void HeadlessRenderer::set_transform_threads(
+  std::size_t i_max_threads) noexcept
+{
+  m_impl->scene.set_transform_threads(i_max_threads);
+}
+
+double HeadlessRenderer::transform_update_ms() const noexcept
+{
+  return m_impl->transform_frames == 0
+           ? 0.0
+           : m_impl->transform_ms / m_impl->transform_frames;
+}
+
+void HeadlessRenderer::set_camera_path(bool i_enabled) noexcept
+{
+  m_impl->camera_path = i_enabled;
+}
+
+void HeadlessRenderer::set_target_fps(double i_target_fps)
+{
+  m_impl->governor.set_target_fps(i_target_fps);
+  for (auto& view : m_impl->views)
+    m_impl->governor.apply(*view->view);
+}
+
+const QualityGovernor& HeadlessRenderer::governor() const noexcept
+{
+  return m_impl->governor;
+}
+
+void HeadlessRenderer::set_lods_enabled(bool i_enabled) noexcept
+{
+  m_impl->scene.set_lods_enabled(i_enabled);
+}
+
+PickResult HeadlessRenderer::pick(filament::math::float2 i_ndc,
+                                  uint32_t i_view)
+{
+  return m_impl->scene.pick(
+    camera_ray(*m_impl->views.at(i_view)->camera, i_ndc));
+}
+
+const ScenePicker& HeadlessRenderer::picker() const noexcept
+{
+  return m_impl->scene.picker();
+}
+
+std::size_t HeadlessRenderer::triangles_per_frame() const noexcept
+{
+  return m_impl->triangles_per_frame;
+}
+
+HeadlessRenderer::~HeadlessRenderer()
+{
+  // Ensure all rendering operations have completed before we destroy our
+  // engine registered objects
+  filament::Fence::waitAndDestroy(m_impl->engine->createFence());
+}
+
+bool HeadlessRenderer::draw()
+{
+  ScopedTimer timer("frame");
+  // Texture streaming is part of the frame's CPU cost
+  if (m_impl->scene.streaming())
+  {
+    m_impl->scene.stream_textures();
+    ++m_impl->stream_frames;
+  }
+  {
+    // So is applying the animation and committing the changed transforms
+    const auto start = std::chrono::steady_clock::now();
+    m_impl->scene.update_transforms(m_impl->frame_index / 60.0);
+    m_impl->transform_ms += std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - start)
+                              .count();
+    ++m_impl->transform_frames;
+  }
+  if (m_impl->camera_path)
+  {
+    // A full turn about the vertical axis through the target
+    constexpr uint32_t frames_per_turn = 240;
+    const auto& camera_manager = m_impl->camera_manager;
+    const float angle = 2.f * filament::math::F_PI *
+                        (m_impl->frame_index % frames_per_turn) /
+                        frames_per_turn;
+    const auto rotation =
+      filament::math::quatf::fromAxisAngle(camera_manager.up(), angle);
+    const auto eye =
+      camera_manager.target() +
+      rotation * (camera_manager.eye() - camera_manager.target());
+    for (auto& view : m_impl->views)
+      view->camera->lookAt(eye, camera_manager.target(), camera_manager.up());
+  }
+  // Level selection is part of the frame's CPU cost
+  m_impl->triangles_per_frame = m_impl->scene.update_lods(m_impl->lod_views);
+  // Every view is rendered in the same batch, as the window does
+  if (m_impl->frame_start == std::chrono::steady_clock::time_point())
+    m_impl->frame_start = std::chrono::steady_clock::now();
+  bool drawn = false;
+  for (auto& view : m_impl->views)
+  {
+    {
+      // beginFrame() returns false if we need to skip a frame
+      ScopedTimer begin_timer("beginFrame");
+      if (!view->renderer->beginFrame(view->swap_chain.get()))
+        continue;
+    }
+    {
+      ScopedTimer render_timer("render");
+      view->renderer->render(view->view.get());
+    }
+    ScopedTimer end_timer("endFrame");
+    view->renderer->endFrame();
+    drawn = true;
+  }
+  if (drawn)
+  {
+    const auto frame_ms = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() -
+                            m_impl->frame_start)
+                            .count();
+    m_impl->frame_start = {};
+    if (m_impl->governor.add_frame(frame_ms))
+    {
+      for (auto& view : m_impl->views)
+        m_impl->governor.apply(*view->view);
+    }
+  }
+  m_impl->scene.end_frame();
+  if (drawn)
+    ++m_impl->frame_index;
+  if (drawn && !m_impl->first_frame_drawn)
+  {
+    m_impl->first_frame_drawn = true;
+    m_impl->loader.mark("first frame");
+  }
+  return drawn;
+}
+
+FrameStats HeadlessRenderer::run(uint32_t i_frames, uint32_t i_warmup_frames)
+{
+  using clock = std::chrono::steady_clock;
+  // Warm up the caches and pipelines before we start measuring
+  for (uint32_t i = 0; i < i_warmup_frames; ++i)
+    draw();
+
+  std::vector<double> frame_times;
+  frame_times.reserve(i_frames);
+  uint32_t skipped = 0;
+  for (uint32_t i = 0; i < i_frames; ++i)
+  {
+    const auto start = clock::now();
+    const bool drawn = draw();
+    const auto end = clock::now();
+    // Skipped frames did no work, so they would skew our timings
+    if (!drawn)
+    {
+      ++skipped;
+      continue;
+    }
+    frame_times.push_back(
+      std::chrono::duration<double, std::milli>(end - start).count());
+  }
+  // Wait for the GPU to catch up before reporting
+  filament::Fence::waitAndDestroy(m_impl->engine->createFence());
+  return summarize_frame_times(std::move(frame_times), skipped);
+}
@@ -0,0 +1,724 @@
+#include "ibl_baker.h"
+#include "profiler.h"
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <math/vec4.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace
+{
+namespace flm = filament::math;
+
+// Bump this whenever the bake changes, to invalidate cached results
+constexpr const char* BAKE_VERSION = "qfp-ibl-bake-2";
+constexpr float PI = 3.14159265358979f;
+
+// Direction through a point on a cube face, where s and t are in [-1, 1]
+inline flm::float3 face_direction(uint32_t i_face, float i_s, float i_t)
+{
+  switch (i_face)
+  {
+  case 0: return {1.f, -i_t, -i_s};
+  case 1: return {-1.f, -i_t, i_s};
+  case 2: return {i_s, 1.f, i_t};
+  case 3: return {i_s, -1.f, -i_t};
+  case 4: return {i_s, -i_t, 1.f};
+  default: return {-i_s, -i_t, -1.f};
+  }
+}
+
+// Faces, and coordinates in [0, 1] on them, of the texels a row of
+// directions pass through. Every branch is a select, so the loop vectorizes.
+inline void direction_faces(const float* i_x,
+                            const float* i_y,
+                            const float* i_z,
+                            uint32_t i_count,
+                            uint32_t* o_face,
+                            float* o_u,
+                            float* o_v)
+{
+  for (uint32_t i = 0; i < i_count; ++i)
+  {
+    const float x = i_x[i];
+    const float y = i_y[i];
+    const float z = i_z[i];
+    const float ax = std::abs(x);
+    const float ay = std::abs(y);
+    const float az = std::abs(z);
+    const bool x_major = ax >= ay && ax >= az;
+    const bool y_major = !x_major && ay >= az;
+    const float major = x_major ? ax : y_major ? ay : az;
+    const float positive = x_major ? x : y_major ? y : z;
+    const float s =
+      x_major ? (x > 0.f ? -z : z) : y_major ? x : (z > 0.f ? x : -x);
+    const float t = y_major ? (y > 0.f ? z : -z) : -y;
+    o_face[i] = (x_major ? 0u : y_major ? 2u : 4u) + (positive > 0.f ? 0u : 1u);
+    const float scale = 0.5f / major;
+    o_u[i] = s * scale + 0.5f;
+    o_v[i] = t * scale + 0.5f;
+  }
+}
+
+// Bilinear lookups for a row of coordinates in [0, 1]. The texels and
+// weights are found for the whole row up front, so that arithmetic
+// vectorizes, leaving only the fetches themselves scalar.
+class BilinearRow
+{
+public:
+  explicit BilinearRow(std::size_t i_size)
+    : m_x0(i_size), m_x1(i_size), m_y0(i_size), m_y1(i_size), m_fx(i_size)
+    , m_fy(i_size)
+  {
+  }
+
+  // Clamp at every edge, as within a cube face
+  void clamp(const float* i_u,
+             const float* i_v,
+             uint32_t i_width,
+             uint32_t i_height) noexcept
+  {
+    for (std::size_t i = 0; i < m_fx.size(); ++i)
+    {
+      const float x =
+        std::min(std::max(i_u[i] * i_width - 0.5f, 0.f), i_width - 1.f);
+      const auto x0 = static_cast<uint32_t>(x);
+      m_x0[i] = x0;
+      m_x1[i] = std::min(x0 + 1, i_width - 1);
+      m_fx[i] = x - x0;
+    }
+    clamp_rows(i_v, i_height);
+  }
+
+  // Wrap around horizontally and clamp vertically, as in an equirectangular
+  // image whose left and right edges meet
+  void wrap(const float* i_u,
+            const float* i_v,
+            uint32_t i_width,
+            uint32_t i_height) noexcept
+  {
+    const auto width = static_cast<int32_t>(i_width);
+    for (std::size_t i = 0; i < m_fx.size(); ++i)
+    {
+      const float x =
+        std::min(std::max(i_u[i] * i_width - 0.5f, -0.5f), i_width - 0.5f);
+      const float floor_x = std::floor(x);
+      const auto xi = static_cast<int32_t>(floor_x);
+      const auto x0 = static_cast<uint32_t>(xi < 0 ? xi + width : xi);
+      m_x0[i] = x0;
+      m_x1[i] = x0 + 1 < i_width ? x0 + 1 : 0u;
+      m_fx[i] = x - floor_x;
+    }
+    clamp_rows(i_v, i_height);
+  }
+
+  // Blend the four texels around a coordinate
+  flm::float3 sample(const flm::float3* i_pixels,
+                     uint32_t i_width,
+                     std::size_t i) const noexcept
+  {
+    const auto row0 = i_pixels + std::size_t{m_y0[i]} * i_width;
+    const auto row1 = i_pixels + std::size_t{m_y1[i]} * i_width;
+    const auto top = mix(row0[m_x0[i]], row0[m_x1[i]], m_fx[i]);
+    const auto bottom = mix(row1[m_x0[i]], row1[m_x1[i]], m_fx[i]);
+    return mix(top, bottom, m_fy[i]);
+  }
+
+private:
+  void clamp_rows(const float* i_v, uint32_t i_height) noexcept
+  {
+    for (std::size_t i = 0; i < m_fy.size(); ++i)
+    {
+      const float y =
+        std::min(std::max(i_v[i] * i_height - 0.5f, 0.f), i_height - 1.f);
+      const auto y0 = static_cast<uint32_t>(y);
+      m_y0[i] = y0;
+      m_y1[i] = std::min(y0 + 1, i_height - 1);
+      m_fy[i] = y - y0;
+    }
+  }
+
+  std::vector<uint32_t> m_x0;
+  std::vector<uint32_t> m_x1;
+  std::vector<uint32_t> m_y0;
+  std::vector<uint32_t> m_y1;
+  std::vector<float> m_fx;
+  std::vector<float> m_fy;
+};
+
+// Solid angle of the area between the centre of a face and a point on it
+inline float area_element(float i_x, float i_y)
+{
+  return std::atan2(i_x * i_y, std::sqrt(i_x * i_x + i_y * i_y + 1.f));
+}
+
+// Low discrepancy sample points over the unit square
+inline flm::float2 hammersley(uint32_t i_index, uint32_t i_count)
+{
+  uint32_t bits = i_index;
+  bits = (bits << 16u) | (bits >> 16u);
+  bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+  bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+  bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+  bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+  return {static_cast<float>(i_index) / i_count,
+          bits * 2.3283064365386963e-10f};
+}
+
+// Encode as filament decodes RGBM, in gamma 2.0 space with a range of 16
+inline flm::ubyte4 to_rgbm(const flm::float3& i_color)
+{
+  const flm::float3 c = sqrt(max(i_color, flm::float3{0.f})) / 16.f;
+  float m = std::max({c.x, c.y, c.z});
+  m = std::min(std::max(m, 1.f / 255.f), 1.f);
+  m = std::ceil(m * 255.f) / 255.f;
+  const flm::float4 rgbm = min(flm::float4{c / m, m}, flm::float4{1.f});
+  return flm::ubyte4(rgbm * 255.f + 0.5f);
+}
+
+// A single prefilter sample in tangent space, around a normal of +Z
+struct GgxSample
+{
+  flm::float3 direction;
+  float weight;
+  float lod;
+};
+
+std::vector<GgxSample> ggx_samples(float i_roughness,
+                                   uint32_t i_count,
+                                   uint32_t i_source_size)
+{
+  const float a2 = i_roughness * i_roughness;
+  // Solid angle of a texel of the base level
+  const float texel_solid_angle =
+    4.f * PI / (6.f * i_source_size * i_source_size);
+  std::vector<GgxSample> samples;
+  samples.reserve(i_count);
+  for (uint32_t i = 0; i < i_count; ++i)
+  {
+    const auto u = hammersley(i, i_count);
+    const float phi = 2.f * PI * u.x;
+    const float cos_theta = std::sqrt((1.f - u.y) / (1.f + (a2 - 1.f) * u.y));
+    const float sin_theta = std::sqrt(1.f - cos_theta * cos_theta);
+    // Reflect the view direction, which equals the normal, about the half
+    // vector
+    const flm::float3 l{2.f * cos_theta * sin_theta * std::cos(phi),
+                        2.f * cos_theta * sin_theta * std::sin(phi),
+                        2.f * cos_theta * cos_theta - 1.f};
+    if (l.z <= 0.f)
+      continue;
+    // Filtered importance sampling, read from the mip whose texels cover the
+    // solid angle this sample represents
+    const float d =
+      a2 / (PI * std::pow(cos_theta * cos_theta * (a2 - 1.f) + 1.f, 2.f));
+    const float pdf = d / 4.f;
+    const float sample_solid_angle = 1.f / (i_count * pdf);
+    const float lod =
+      0.5f * std::log2(sample_solid_angle / texel_solid_angle) + 1.f;
+    samples.push_back({l, l.z, lod});
+  }
+  return samples;
+}
+
+std::string file_hash(const std::string& i_path,
+                      const IblBakeSettings& i_settings)
+{
+  QFile source(QString::fromStdString(i_path));
+  if (!source.open(QIODevice::ReadOnly))
+    throw std::runtime_error("Failed to open " + i_path);
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  hash.addData(QByteArray(BAKE_VERSION));
+  const uint32_t settings[] = {
+    i_settings.skybox_size, i_settings.specular_size, i_settings.samples};
+  hash.addData(reinterpret_cast<const char*>(settings), sizeof(settings));
+  hash.addData(&source);
+  return hash.result().toHex().toStdString();
+}
+}  // namespace
+
+IblBaker::IblBaker(IblBakeSettings i_settings,
+                   std::string i_cache_directory,
+                   ThreadPool& io_pool)
+  : m_settings(i_settings)
+  , m_cache_directory(std::move(i_cache_directory))
+  , m_pool(&io_pool)
+{
+}
+
+IblBakeReport IblBaker::bake_cached(const std::string& i_hdr_path) const
+{
+  using clock = std::chrono::steady_clock;
+  const auto start = clock::now();
+  IblBakeReport report;
+  report.source_path = i_hdr_path;
+  const auto prefix =
+    m_cache_directory + '/' + file_hash(i_hdr_path, m_settings);
+  report.ibl_path = prefix + "_ibl.ktx";
+  report.skybox_path = prefix + "_skybox.ktx";
+  // The IBL is written last, so its presence marks a complete entry
+  report.cache_hit = QFile::exists(QString::fromStdString(report.ibl_path));
+
+  if (!report.cache_hit)
+  {
+    const auto baked = bake(read_hdr(i_hdr_path));
+    QDir().mkpath(QString::fromStdString(m_cache_directory));
+    // Write to unique temporary files and rename them in to place, so
+    // concurrent bakes never see a partial file
+    const auto suffix =
+      ".tmp" + std::to_string(QCoreApplication::applicationPid()) + '_' +
+      std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    write_ktx({baked.skybox}, report.skybox_path + suffix, nullptr);
+    write_ktx(baked.specular, report.ibl_path + suffix, &baked.irradiance);
+    if (std::rename((report.skybox_path + suffix).c_str(),
+                    report.skybox_path.c_str()) ||
+        std::rename((report.ibl_path + suffix).c_str(),
+                    report.ibl_path.c_str()))
+      throw std::runtime_error("Failed to write " + report.ibl_path);
+  }
+  report.bake_ms =
+    std::chrono::duration<double, std::milli>(clock::now() - start).count();
+  std::cout << std::fixed << std::setprecision(2) << "Baked " << i_hdr_path
+            << (report.cache_hit ? " (warm) in " : " (cold) in ")
+            << report.bake_ms << " ms" << std::endl;
+  return report;
+}
+
+BakedIbl IblBaker::bake(const EquirectImage& i_image) const
+{
+  ScopedTimer timer("bake ibl");
+  BakedIbl baked;
+  baked.skybox = to_cubemap(i_image, m_settings.skybox_size);
+
+  // Prefiltering reads from a full mip chain of the environment
+  std::vector<CubemapImage> mips;
+  mips.push_back(m_settings.specular_size == m_settings.skybox_size
+                   ? baked.skybox
+                   : to_cubemap(i_image, m_settings.specular_size));
+  while (mips.back().size > 1)
+    mips.push_back(downsample(mips.back()));
+
+  baked.specular = prefilter_specular(mips);
+  // The smallest level is plenty for the low frequency harmonics
+  baked.irradiance =
+    irradiance_sh(mips[std::min<std::size_t>(mips.size() - 1, 5)]);
+  return baked;
+}
+
+CubemapImage IblBaker::to_cubemap(const EquirectImage& i_image,
+                                  uint32_t i_size) const
+{
+  CubemapImage cubemap;
+  cubemap.size = i_size;
+  for (auto& face : cubemap.faces)
+    face.resize(i_size * i_size);
+
+  // Rows of every face are independent
+  m_pool->parallel_for(
+    6 * i_size,
+    [&](std::size_t i_begin, std::size_t i_end) {
+      std::vector<float> x(i_size), y(i_size), z(i_size), u(i_size), v(i_size);
+      BilinearRow texels(i_size);
+      for (auto row = i_begin; row < i_end; ++row)
+      {
+        const auto face = static_cast<uint32_t>(row / i_size);
+        const auto j = static_cast<uint32_t>(row % i_size);
+        const float t = 2.f * (j + 0.5f) / i_size - 1.f;
+        // Directions, and then their equirectangular coordinates, are
+        // computed for the whole row at once so the loops vectorize
+        for (uint32_t i = 0; i < i_size; ++i)
+        {
+          const auto d =
+            normalize(face_direction(face, 2.f * (i + 0.5f) / i_size - 1.f, t));
+          x[i] = d.x;
+          y[i] = d.y;
+          z[i] = d.z;
+        }
+        for (uint32_t i = 0; i < i_size; ++i)
+        {
+          u[i] = std::atan2(x[i], -z[i]) / (2.f * PI) + 0.5f;
+          v[i] = std::acos(std::min(std::max(y[i], -1.f), 1.f)) / PI;
+        }
+        texels.wrap(u.data(), v.data(), i_image.width, i_image.height);
+        auto out = cubemap.faces[face].data() + j * i_size;
+        for (uint32_t i = 0; i < i_size; ++i)
+          out[i] = texels.sample(i_image.pixels.data(), i_image.width, i);
+      }
+    },
+    1,
+    m_settings.max_threads);
+  return cubemap;
+}
+
+CubemapImage IblBaker::downsample(const CubemapImage& i_cubemap) const
+{
+  CubemapImage half;
+  half.size = std::max(i_cubemap.size / 2, 1u);
+  const auto source_size = i_cubemap.size;
+  for (uint32_t face = 0; face < 6; ++face)
+  {
+    const auto& source = i_cubemap.faces[face];
+    auto& out = half.faces[face];
+    out.resize(half.size * half.size);
+    for (uint32_t j = 0; j < half.size; ++j)
+    {
+      const auto row0 =
+        source.data() + std::min(2 * j, source_size - 1) * source_size;
+      const auto row1 =
+        source.data() + std::min(2 * j + 1, source_size - 1) * source_size;
+      for (uint32_t i = 0; i < half.size; ++i)
+      {
+        const auto i0 = std::min(2 * i, source_size - 1);
+        const auto i1 = std::min(2 * i + 1, source_size - 1);
+        out[j * half.size + i] =
+          (row0[i0] + row0[i1] + row1[i0] + row1[i1]) * 0.25f;
+      }
+    }
+  }
+  return half;
+}
+
+std::vector<CubemapImage>
+IblBaker::prefilter_specular(const std::vector<CubemapImage>& i_mips) const
+{
+  ScopedTimer timer("prefilter specular");
+  const auto levels = i_mips.size();
+  std::vector<CubemapImage> prefiltered(levels);
+  // A perfect mirror needs no filtering
+  prefiltered[0] = i_mips[0];
+
+  for (std::size_t level = 1; level < levels; ++level)
+  {
+    // Perceptual roughness increases linearly with the mip level
+    const float perceptual = static_cast<float>(level) / (levels - 1);
+    const auto samples =
+      ggx_samples(perceptual * perceptual, m_settings.samples, i_mips[0].size);
+    auto& out = prefiltered[level];
+    out.size = i_mips[level].size;
+    const auto size = out.size;
+    for (auto& face : out.faces)
+      face.resize(size * size);
+
+    m_pool->parallel_for(
+      6 * size,
+      [&](std::size_t i_begin, std::size_t i_end) {
+        std::vector<float> nx(size), ny(size), nz(size);
+        std::vector<float> tx(size), ty(size), tz(size);
+        std::vector<float> bx(size), by(size), bz(size);
+        std::vector<float> dx(size), dy(size), dz(size);
+        std::vector<uint32_t> faces(size);
+        std::vector<float> u(size), v(size);
+        BilinearRow texels(size);
+        std::vector<flm::float3> sum(size);
+        for (auto row = i_begin; row < i_end; ++row)
+        {
+          const auto face = static_cast<uint32_t>(row / size);
+          const auto j = static_cast<uint32_t>(row % size);
+          const float t = 2.f * (j + 0.5f) / size - 1.f;
+          // Tangent frame of every texel in the row
+          for (uint32_t i = 0; i < size; ++i)
+          {
+            const auto n =
+              normalize(face_direction(face, 2.f * (i + 0.5f) / size - 1.f, t));
+            const flm::float3 up =
+              std::abs(n.z) < 0.999f ? flm::float3{0.f, 0.f, 1.f}
+                                     : flm::float3{1.f, 0.f, 0.f};
+            const auto tangent = normalize(cross(up, n));
+            const auto bitangent = cross(n, tangent);
+            nx[i] = n.x;
+            ny[i] = n.y;
+            nz[i] = n.z;
+            tx[i] = tangent.x;
+            ty[i] = tangent.y;
+            tz[i] = tangent.z;
+            bx[i] = bitangent.x;
+            by[i] = bitangent.y;
+            bz[i] = bitangent.z;
+            sum[i] = flm::float3{0.f};
+          }
+          float weight = 0.f;
+          for (const auto& sample : samples)
+          {
+            // Rotate the sample in to every texel's frame at once, this
+            // loop is plain arithmetic over arrays so it vectorizes
+            const auto l = sample.direction;
+            for (uint32_t i = 0; i < size; ++i)
+            {
+              dx[i] = tx[i] * l.x + bx[i] * l.y + nx[i] * l.z;
+              dy[i] = ty[i] * l.x + by[i] * l.y + ny[i] * l.z;
+              dz[i] = tz[i] * l.x + bz[i] * l.y + nz[i] * l.z;
+            }
+            direction_faces(dx.data(),
+                            dy.data(),
+                            dz.data(),
+                            size,
+                            faces.data(),
+                            u.data(),
+                            v.data());
+            // Blend the two mips either side of the sample's level
+            const float lod =
+              std::min(std::max(sample.lod, 0.f), i_mips.size() - 1.f);
+            const auto level = static_cast<std::size_t>(lod);
+            const float fraction = lod - level;
+            const std::pair<std::size_t, float> lookups[] = {
+              {level, (1.f - fraction) * sample.weight},
+              {std::min(level + 1, i_mips.size() - 1),
+               fraction * sample.weight}};
+            for (const auto& lookup : lookups)
+            {
+              if (lookup.second <= 0.f)
+                continue;
+              const auto& mip = i_mips[lookup.first];
+              texels.clamp(u.data(), v.data(), mip.size, mip.size);
+              for (uint32_t i = 0; i < size; ++i)
+                sum[i] +=
+                  texels.sample(mip.faces[faces[i]].data(), mip.size, i) *
+                  lookup.second;
+            }
+            weight += sample.weight;
+          }
+          auto prefiltered_row = out.faces[face].data() + j * size;
+          for (uint32_t i = 0; i < size; ++i)
+            prefiltered_row[i] = weight > 0.f ? sum[i] / weight : sum[i];
+        }
+      },
+      1,
+      m_settings.max_threads);
+  }
+  return prefiltered;
+}
+
+std::array<flm::float3, 9>
+IblBaker::irradiance_sh(const CubemapImage& i_cubemap) const
+{
+  const auto size = i_cubemap.size;
+  std::array<flm::float3, 9> total{};
+  std::mutex total_mutex;
+  m_pool->parallel_for(
+    6 * size,
+    [&](std::size_t i_begin, std::size_t i_end) {
+      std::array<flm::float3, 9> local{};
+      const float inv = 1.f / size;
+      for (auto row = i_begin; row < i_end; ++row)
+      {
+        const auto face = static_cast<uint32_t>(row / size);
+        const auto j = static_cast<uint32_t>(row % size);
+        const float t = 2.f * (j + 0.5f) / size - 1.f;
+        const auto texels = i_cubemap.faces[face].data() + j * size;
+        for (uint32_t i = 0; i < size; ++i)
+        {
+          const float s = 2.f * (i + 0.5f) / size - 1.f;
+          const float solid_angle =
+            area_element(s - inv, t - inv) - area_element(s - inv, t + inv) -
+            area_element(s + inv, t - inv) + area_element(s + inv, t + inv);
+          const auto d = normalize(face_direction(face, s, t));
+          const auto radiance = texels[i] * solid_angle;
+          // Unnormalized real spherical harmonic basis, in the order filament
+          // evaluates them
+          local[0] += radiance;
+          local[1] += radiance * d.y;
+          local[2] += radiance * d.z;
+          local[3] += radiance * d.x;
+          local[4] += radiance * (d.y * d.x);
+          local[5] += radiance * (d.y * d.z);
+          local[6] += radiance * (3.f * d.z * d.z - 1.f);
+          local[7] += radiance * (d.z * d.x);
+          local[8] += radiance * (d.x * d.x - d.y * d.y);
+        }
+      }
+      std::lock_guard<std::mutex> lock(total_mutex);
+      for (std::size_t k = 0; k < 9; ++k)
+        total[k] += local[k];
+    },
+    1,
+    m_settings.max_threads);
+
+  // Normalization of each basis function, projection multiplies by it once
+  // and evaluation in the shader needs it again
+  constexpr float K[9] = {0.282095f,
+                          0.488603f,
+                          0.488603f,
+                          0.488603f,
+                          1.092548f,
+                          1.092548f,
+                          0.315392f,
+                          1.092548f,
+                          0.546274f};
+  // Convolution with the clamped cosine lobe, per band
+  constexpr float A[9] = {PI,
+                          2.f * PI / 3.f,
+                          2.f * PI / 3.f,
+                          2.f * PI / 3.f,
+                          PI / 4.f,
+                          PI / 4.f,
+                          PI / 4.f,
+                          PI / 4.f,
+                          PI / 4.f};
+  // Filament expects irradiance divided by pi, the Lambertian BRDF
+  for (std::size_t k = 0; k < 9; ++k)
+    total[k] *= K[k] * K[k] * A[k] / PI;
+  return total;
+}
+
+EquirectImage IblBaker::read_hdr(const std::string& i_path)
+{
+  std::ifstream file(i_path, std::ios::binary);
+  if (!file)
+    throw std::runtime_error("Failed to open " + i_path);
+
+  // The header is a list of lines ending with a blank line, followed by the
+  // resolution
+  std::string line;
+  std::getline(file, line);
+  if (line.compare(0, 2, "#?") != 0)
+    throw std::runtime_error(i_path + " is not a Radiance HDR image");
+  while (std::getline(file, line) && !line.empty())
+  {
+    if (line.compare(0, 7, "FORMAT=") == 0 &&
+        line != "FORMAT=32-bit_rle_rgbe")
+      throw std::runtime_error(i_path + " has unsupported format " + line);
+  }
+  std::getline(file, line);
+  char y_axis[3] = {}, x_axis[3] = {};
+  int height = 0, width = 0;
+  if (std::sscanf(
+        line.c_str(), "%2s %d %2s %d", y_axis, &height, x_axis, &width) !=
+        4 ||
+      std::strcmp(y_axis, "-Y") || std::strcmp(x_axis, "+X") || width <= 0 ||
+      height <= 0)
+    throw std::runtime_error(i_path + " has an unsupported orientation");
+
+  EquirectImage image;
+  image.width = static_cast<uint32_t>(width);
+  image.height = static_cast<uint32_t>(height);
+  image.pixels.resize(image.width * image.height);
+  std::vector<uint8_t> scanline(image.width * 4);
+  for (uint32_t y = 0; y < image.height; ++y)
+  {
+    uint8_t start[4];
+    file.read(reinterpret_cast<char*>(start), 4);
+    const bool rle = image.width >= 8 && image.width < 32768 &&
+                     start[0] == 2 && start[1] == 2 &&
+                     ((start[2] << 8) | start[3]) == width;
+    if (rle)
+    {
+      // Each channel is run length encoded separately
+      for (uint32_t channel = 0; channel < 4; ++channel)
+      {
+        for (uint32_t x = 0; x < image.width;)
+        {
+          uint8_t count = 0;
+          file.read(reinterpret_cast<char*>(&count), 1);
+          if (count > 128)
+          {
+            count -= 128;
+            const auto value = static_cast<uint8_t>(file.get());
+            for (uint8_t i = 0; i < count && x < image.width; ++i)
+              scanline[4 * x++ + channel] = value;
+          }
+          else
+          {
+            for (uint8_t i = 0; i < count && x < image.width; ++i)
+              scanline[4 * x++ + channel] = static_cast<uint8_t>(file.get());
+          }
+          if (!file || !count)
+            throw std::runtime_error("Corrupt scanline in " + i_path);
+        }
+      }
+    }
+    else
+    {
+      // Flat pixels
+      std::memcpy(scanline.data(), start, 4);
+      file.read(reinterpret_cast<char*>(scanline.data() + 4),
+                scanline.size() - 4);
+    }
+    if (!file)
+      throw std::runtime_error("Truncated image " + i_path);
+
+    auto out = image.pixels.data() + y * image.width;
+    for (uint32_t x = 0; x < image.width; ++x)
+    {
+      const auto rgbe = scanline.data() + 4 * x;
+      const float scale = rgbe[3] ? std::ldexp(1.f, rgbe[3] - 136) : 0.f;
+      out[x] = flm::float3(rgbe[0], rgbe[1], rgbe[2]) * scale;
+    }
+  }
+  return image;
+}
+
+void IblBaker::write_ktx(const std::vector<CubemapImage>& i_levels,
+                         const std::string& i_path,
+                         const std::array<flm::float3, 9>* i_sh)
+{
+  std::ofstream file(i_path, std::ios::binary | std::ios::trunc);
+  const auto write_uint = [&file](uint32_t i_value) {
+    file.write(reinterpret_cast<const char*>(&i_value), sizeof(i_value));
+  };
+
+  // Harmonics are stored as text, three floats per line, as cmgen does
+  std::string metadata;
+  if (i_sh)
+  {
+    std::ostringstream sh;
+    sh << std::setprecision(9);
+    for (const auto& band : *i_sh)
+      sh << band.x << ' ' << band.y << ' ' << band.z << '\n';
+    const std::string value = sh.str();
+    const auto entry_size = static_cast<uint32_t>(3 + value.size() + 1);
+    metadata.append(reinterpret_cast<const char*>(&entry_size), 4);
+    metadata.append("sh", 3);
+    metadata.append(value.c_str(), value.size() + 1);
+    metadata.resize((metadata.size() + 3) & ~std::size_t{3}, '\0');
+  }
+
+  constexpr uint8_t IDENTIFIER[12] = {
+    0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+  constexpr uint32_t GL_UNSIGNED_BYTE = 0x1401;
+  constexpr uint32_t GL_RGBA = 0x1908;
+  constexpr uint32_t GL_RGBA8 = 0x8058;
+  file.write(reinterpret_cast<const char*>(IDENTIFIER), sizeof(IDENTIFIER));
+  write_uint(0x04030201);
+  write_uint(GL_UNSIGNED_BYTE);
+  write_uint(1);
+  write_uint(GL_RGBA);
+  write_uint(GL_RGBA8);
+  write_uint(GL_RGBA);
+  write_uint(i_levels.front().size);
+  write_uint(i_levels.front().size);
+  write_uint(0);
+  write_uint(0);
+  write_uint(6);
+  write_uint(static_cast<uint32_t>(i_levels.size()));
+  write_uint(static_cast<uint32_t>(metadata.size()));
+  file.write(metadata.data(), metadata.size());
+
+  // Rows of RGBA8 texels are always 4 byte aligned so no padding is needed
+  std::vector<flm::ubyte4> texels;
+  for (const auto& level : i_levels)
+  {
+    write_uint(static_cast<uint32_t>(level.size * level.size * 4));
+    for (const auto& face : level.faces)
+    {
+      texels.resize(face.size());
+      std::transform(face.begin(), face.end(), texels.begin(), to_rgbm);
+      file.write(reinterpret_cast<const char*>(texels.data()),
+                 texels.size() * sizeof(flm::ubyte4));
+    }
+  }
+  if (!file)
+    throw std::runtime_error("Failed to write " + i_path);
+}
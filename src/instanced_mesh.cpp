@@ -0,0 +1,252 @@
+#include "instanced_mesh.h"
+#include <filament/Box.h>
+#include <filament/RenderableManager.h>
+#include <filament/TransformManager.h>
+#include <utils/EntityManager.h>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+std::size_t triangle_count(const std::vector<filamesh_file::Part>& i_parts)
+{
+  std::size_t count = 0;
+  for (const auto& part : i_parts)
+    count += part.index_count / 3;
+  return count;
+}
+
+// Bounding sphere of a box after it has been transformed
+filament::math::float4 bounding_sphere(const filamesh_file::Box& i_box,
+                                       const filament::math::mat4f& i_transform)
+{
+  namespace flm = filament::math;
+  const auto center = (i_transform * flm::float4(i_box.center, 1.f)).xyz;
+  const float scale = std::max({length(i_transform[0].xyz),
+                                length(i_transform[1].xyz),
+                                length(i_transform[2].xyz)});
+  return {center, length(i_box.half_extent) * scale};
+}
+}  // namespace
+
+InstancedMesh::InstancedMesh(
+  ResourceRegistry& io_resources,
+  TransformStore& io_transforms,
+  std::shared_ptr<const std::vector<uint8_t>> i_data,
+  filamesh::MeshReader::MaterialRegistry& io_materials,
+  mesh_lod::Chain i_lods)
+  : m_resources(&io_resources)
+  , m_transforms(&io_transforms)
+  , m_materials(&io_materials)
+{
+  // We need the parts to build further renderables from the same buffers
+  auto contents = filamesh_file::parse(i_data->data(), i_data->size());
+  // Parts with a material id past the file's names would be read out of
+  // bounds, here and by the mesh reader, so give them the default material
+  if (std::any_of(contents.parts.begin(),
+                  contents.parts.end(),
+                  [&contents](const filamesh_file::Part& i_part) {
+                    return i_part.material_id >= contents.material_names.size();
+                  }))
+  {
+    auto repaired = std::make_shared<std::vector<uint8_t>>(*i_data);
+    filamesh_file::repair_material_ids(*repaired);
+    i_data = std::move(repaired);
+    contents = filamesh_file::parse(i_data->data(), i_data->size());
+  }
+  m_parts = std::move(contents.parts);
+  m_material_names = std::move(contents.material_names);
+  m_aabb = contents.header.aabb;
+
+  // The full detail parts are our first level
+  m_lods.push_back({0.f, m_parts});
+  for (auto& lod : i_lods)
+  {
+    // Ignore levels which don't match this mesh, e.g. from a stale cache
+    if (lod.parts.size() == m_parts.size())
+      m_lods.push_back(std::move(lod));
+  }
+  for (const auto& lod : m_lods)
+    m_lod_triangles.push_back(::triangle_count(lod.parts));
+
+  // Keep the file contents alive until the engine has uploaded them
+  const auto data = i_data->data();
+  auto mesh = filamesh::MeshReader::loadMeshFromBuffer(
+    &m_resources->engine(),
+    data,
+    [](void*, size_t, void* io_user) {
+      delete static_cast<std::shared_ptr<const std::vector<uint8_t>>*>(
+        io_user);
+    },
+    new std::shared_ptr<const std::vector<uint8_t>>(std::move(i_data)),
+    io_materials);
+  m_source = mesh.renderable;
+  m_vertex_buffer = m_resources->adopt(mesh.vertexBuffer);
+  m_index_buffer = m_resources->adopt(mesh.indexBuffer);
+}
+
+InstancedMesh::~InstancedMesh()
+{
+  // Our instances are destroyed in bulk at the end of the frame, before the
+  // buffers they refer to
+  if (!m_source_used)
+    m_instances.push_back(m_source);
+  m_resources->destroy(m_instances);
+  m_resources->destroy(m_vertex_buffer);
+  m_resources->destroy(m_index_buffer);
+}
+
+std::vector<utils::Entity>
+InstancedMesh::add_instances(
+  const std::vector<filament::math::mat4f>& i_transforms,
+  filament::MaterialInstance* i_material,
+  TransformStore::Node i_parent)
+{
+  if (i_transforms.empty())
+    return {};
+
+  std::vector<utils::Entity> instances(i_transforms.size());
+  auto first = instances.begin();
+  // The reader's renderable is our first instance, as long as it would use
+  // the materials it was built with
+  if (!m_source_used && !i_material)
+  {
+    instances.front() = m_source;
+    m_source_used = true;
+    ++first;
+  }
+  if (first != instances.end())
+    utils::EntityManager::get().create(
+      std::distance(first, instances.end()), &*first);
+
+  // Resolve the materials for each part once, rather than per instance
+  std::vector<filament::MaterialInstance*> materials(m_parts.size(),
+                                                     i_material);
+  if (!i_material)
+  {
+    for (std::size_t i = 0; i < m_parts.size(); ++i)
+    {
+      const auto& name = m_material_names[m_parts[i].material_id];
+      const auto found = m_materials->find(utils::CString(name.c_str()));
+      if (found != m_materials->end())
+        materials[i] = found->second;
+    }
+  }
+
+  const filament::Box bounds{m_aabb.center, m_aabb.half_extent};
+  const auto vertex_buffer = m_resources->get(m_vertex_buffer);
+  const auto index_buffer = m_resources->get(m_index_buffer);
+  for (auto instance = first; instance != instances.end(); ++instance)
+  {
+    filament::RenderableManager::Builder builder(m_parts.size());
+    builder.boundingBox(bounds).castShadows(true).receiveShadows(true);
+    for (std::size_t i = 0; i < m_parts.size(); ++i)
+    {
+      const auto& part = m_parts[i];
+      builder.geometry(i,
+                       filament::RenderableManager::PrimitiveType::TRIANGLES,
+                       vertex_buffer,
+                       index_buffer,
+                       part.offset,
+                       part.min_index,
+                       part.max_index,
+                       part.index_count);
+      if (materials[i])
+        builder.material(i, materials[i]);
+    }
+    builder.build(m_resources->engine(), *instance);
+  }
+
+  // The store commits every new transform in its next update, within a
+  // single transaction
+  const auto first_node =
+    m_transforms->add(instances, i_transforms, i_parent);
+  for (std::size_t i = 0; i < instances.size(); ++i)
+    m_nodes.push_back(static_cast<TransformStore::Node>(first_node + i));
+
+  // The reader's renderable casts shadows like the others
+  if (instances.front() == m_source)
+  {
+    auto& renderable_manager = m_resources->engine().getRenderableManager();
+    renderable_manager.setCastShadows(
+      renderable_manager.getInstance(m_source), true);
+  }
+
+  // Instances begin at full detail
+  m_bounds.reserve(m_bounds.size() + instances.size());
+  for (std::size_t i = 0; i < instances.size(); ++i)
+    m_bounds.push_back(bounding_sphere(
+      m_aabb,
+      m_transforms->world(static_cast<TransformStore::Node>(first_node + i))));
+  m_instance_lods.resize(m_instance_lods.size() + instances.size(), 0);
+
+  m_instances.insert(m_instances.end(), instances.begin(), instances.end());
+  return instances;
+}
+
+const std::vector<utils::Entity>& InstancedMesh::instances() const noexcept
+{
+  return m_instances;
+}
+
+const std::vector<TransformStore::Node>& InstancedMesh::nodes() const noexcept
+{
+  return m_nodes;
+}
+
+std::size_t InstancedMesh::triangle_count() const noexcept
+{
+  return m_lod_triangles.front();
+}
+
+std::size_t InstancedMesh::lod_count() const noexcept
+{
+  return m_lods.size();
+}
+
+std::size_t
+InstancedMesh::update_lods(const std::vector<LodSelection>& i_selections)
+{
+  auto& renderable_manager = m_resources->engine().getRenderableManager();
+  const auto coarsest = static_cast<uint8_t>(m_lods.size() - 1);
+  std::size_t triangles = 0;
+  for (std::size_t i = 0; i < m_instances.size(); ++i)
+  {
+    // Follow instances that have moved since the last frame
+    if (m_transforms->changed(m_nodes[i]))
+      m_bounds[i] = bounding_sphere(m_aabb, m_transforms->world(m_nodes[i]));
+    uint8_t level = i_selections.empty() ? 0 : coarsest;
+    for (const auto& selection : i_selections)
+    {
+      if (!selection.enabled)
+      {
+        level = 0;
+        break;
+      }
+      // Project the diameter of the bounding sphere, from its nearest point
+      const auto& bounds = m_bounds[i];
+      const float distance =
+        std::max(length(bounds.xyz - selection.eye) - bounds.w, 1e-3f);
+      const float pixels = 2.f * bounds.w * selection.pixel_scale / distance;
+      // Use the coarsest level whose error stays within the allowed pixels,
+      // level errors are relative to the mesh extents
+      while (level && m_lods[level].error * pixels > selection.max_pixel_error)
+        --level;
+    }
+    triangles += m_lod_triangles[level];
+
+    if (level == m_instance_lods[i])
+      continue;
+    m_instance_lods[i] = level;
+    const auto renderable = renderable_manager.getInstance(m_instances[i]);
+    const auto& parts = m_lods[level].parts;
+    for (std::size_t p = 0; p < parts.size(); ++p)
+      renderable_manager.setGeometryAt(
+        renderable,
+        p,
+        filament::RenderableManager::PrimitiveType::TRIANGLES,
+        parts[p].offset,
+        parts[p].index_count);
+  }
+  return triangles;
+}
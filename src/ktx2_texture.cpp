@@ -0,0 +1,274 @@
+#include "ktx2_texture.h"
+#include "profiler.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#ifdef QFP_BASISU
+#include <transcoder/basisu_transcoder.h>
+#include <mutex>
+#endif
+
+namespace
+{
+// Keeps a transcoded level alive until the engine has consumed it
+struct LevelUpload
+{
+  std::shared_ptr<const void> level;
+  std::shared_ptr<UploadTimer> timer;
+};
+
+filament::Texture::CompressedType
+compressed_type(filament::Texture::InternalFormat i_format)
+{
+  using Format = filament::Texture::InternalFormat;
+  using Type = filament::Texture::CompressedType;
+  switch (i_format)
+  {
+  case Format::RGBA_ASTC_4x4: return Type::RGBA_ASTC_4x4;
+  case Format::ETC2_EAC_RGBA8: return Type::ETC2_EAC_RGBA8;
+  case Format::DXT5_RGBA: return Type::DXT5_RGBA;
+  default: throw std::runtime_error("Unsupported compressed format");
+  }
+}
+
+#ifdef QFP_BASISU
+// Basis Universal equivalents of the formats we can upload
+bool to_basis_format(filament::Texture::InternalFormat i_format,
+                     basist::transcoder_texture_format& o_format)
+{
+  using Format = filament::Texture::InternalFormat;
+  using basist::transcoder_texture_format;
+  switch (i_format)
+  {
+  case Format::RGBA_ASTC_4x4:
+    o_format = transcoder_texture_format::cTFASTC_4x4_RGBA;
+    return true;
+  case Format::ETC2_EAC_RGBA8:
+    o_format = transcoder_texture_format::cTFETC2_RGBA;
+    return true;
+  case Format::DXT5_RGBA:
+    o_format = transcoder_texture_format::cTFBC3_RGBA;
+    return true;
+  case Format::RGBA8:
+    o_format = transcoder_texture_format::cTFRGBA32;
+    return true;
+  default: return false;
+  }
+}
+#endif
+}  // namespace
+
+bool Ktx2Texture::available() noexcept
+{
+#ifdef QFP_BASISU
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::shared_ptr<Ktx2Texture>
+Ktx2Texture::transcode(const std::string& i_path,
+                       const std::vector<Format>& i_targets)
+{
+#ifdef QFP_BASISU
+  ScopedTimer timer("transcode ktx2");
+  using clock = std::chrono::steady_clock;
+  const auto start = clock::now();
+  static std::once_flag init_flag;
+  std::call_once(init_flag, [] { basist::basisu_transcoder_init(); });
+
+  std::ifstream file(i_path, std::ios::binary | std::ios::ate);
+  if (!file)
+    throw std::runtime_error("Failed to open " + i_path);
+  std::vector<uint8_t> contents(static_cast<std::size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(contents.data()), contents.size());
+
+  basist::ktx2_transcoder transcoder;
+  const auto size = static_cast<uint32_t>(contents.size());
+  if (!transcoder.init(contents.data(), size) ||
+      !transcoder.start_transcoding())
+    throw std::runtime_error(i_path + " is not a Basis Universal KTX2 file");
+  if (transcoder.get_layers() > 1)
+    throw std::runtime_error(i_path + " is not a 2D or cube map texture");
+
+  // Use the first target this file's encoding can be transcoded to
+  auto texture = std::make_shared<Ktx2Texture>();
+  basist::transcoder_texture_format target{};
+  const auto found =
+    std::find_if(i_targets.begin(), i_targets.end(), [&](Format i_format) {
+      return to_basis_format(i_format, target) &&
+             basist::basis_is_format_supported(target, transcoder.get_format());
+    });
+  if (found == i_targets.end())
+    throw std::runtime_error("No supported format to transcode " + i_path);
+  texture->m_format = *found;
+  texture->m_width = transcoder.get_width();
+  texture->m_height = transcoder.get_height();
+  texture->m_faces = transcoder.get_faces();
+
+  for (const auto& entry : transcoder.get_key_values())
+  {
+    // Keys and values are stored null terminated
+    std::string key(entry.m_key.begin(), entry.m_key.end());
+    std::string value(entry.m_value.begin(), entry.m_value.end());
+    key.erase(std::find(key.begin(), key.end(), '\0'), key.end());
+    value.erase(std::find(value.begin(), value.end(), '\0'), value.end());
+    texture->m_metadata.emplace_back(std::move(key), std::move(value));
+  }
+
+  const bool uncompressed =
+    basist::basis_transcoder_format_is_uncompressed(target);
+  const uint32_t unit_size =
+    basist::basis_get_bytes_per_block_or_pixel(target);
+  std::vector<uint32_t> units(transcoder.get_levels());
+  for (uint32_t level = 0; level < transcoder.get_levels(); ++level)
+  {
+    basist::ktx2_image_level_info info;
+    if (!transcoder.get_image_level_info(info, level, 0, 0))
+      throw std::runtime_error(i_path + " has an invalid level");
+    units[level] = uncompressed ? info.m_orig_width * info.m_orig_height
+                                : info.m_num_blocks_x * info.m_num_blocks_y;
+    auto data = std::make_shared<Level>();
+    data->face_size = units[level] * unit_size;
+    data->data.resize(std::size_t{data->face_size} * texture->m_faces);
+    texture->m_levels.push_back(std::move(data));
+  }
+
+  // Every face of every level transcodes independently, each thread needs
+  // its own transcoder state
+  std::atomic<bool> failed{false};
+  const auto faces = texture->m_faces;
+  ThreadPool::global().parallel_for(
+    units.size() * faces, [&](std::size_t i_begin, std::size_t i_end) {
+      basist::ktx2_transcoder_state state;
+      for (auto i = i_begin; i < i_end; ++i)
+      {
+        const auto level = static_cast<uint32_t>(i / faces);
+        const auto face = static_cast<uint32_t>(i % faces);
+        auto& data = *texture->m_levels[level];
+        if (!transcoder.transcode_image_level(
+              level,
+              0,
+              face,
+              data.data.data() + std::size_t{face} * data.face_size,
+              units[level],
+              target,
+              0,
+              0,
+              0,
+              -1,
+              -1,
+              &state))
+          failed = true;
+      }
+    });
+  if (failed)
+    throw std::runtime_error("Failed to transcode " + i_path);
+
+  texture->m_transcode_ms =
+    std::chrono::duration<double, std::milli>(clock::now() - start).count();
+  return texture;
+#else
+  (void)i_targets;
+  throw std::runtime_error("Can't transcode " + i_path +
+                           ", build with CONFIG+=basisu for KTX2 support");
+#endif
+}
+
+std::string Ktx2Texture::metadata(const std::string& i_key) const
+{
+  for (const auto& entry : m_metadata)
+  {
+    if (entry.first == i_key)
+      return entry.second;
+  }
+  return {};
+}
+
+filament::Texture* Ktx2Texture::create_texture(filament::Engine* io_engine,
+                                               bool i_rgbm,
+                                               TextureReport* o_report)
+{
+  using Sampler = filament::Texture::Sampler;
+  using PixelBufferDescriptor = filament::Texture::PixelBufferDescriptor;
+  if (i_rgbm && is_compressed(m_format))
+    throw std::invalid_argument("RGBM textures must not be block compressed");
+  auto texture =
+    filament::Texture::Builder()
+      .width(m_width)
+      .height(m_height)
+      .levels(static_cast<uint8_t>(m_levels.size()))
+      .sampler(m_faces == 6 ? Sampler::SAMPLER_CUBEMAP : Sampler::SAMPLER_2D)
+      .format(m_format)
+      .rgbm(i_rgbm)
+      .build(*io_engine);
+
+  std::shared_ptr<UploadTimer> timer;
+  if (o_report)
+  {
+    timer =
+      std::make_shared<UploadTimer>(static_cast<uint32_t>(m_levels.size()));
+    o_report->format = format_name(m_format);
+    o_report->compressed = is_compressed(m_format);
+    o_report->width = m_width;
+    o_report->height = m_height;
+    o_report->levels = static_cast<uint32_t>(m_levels.size());
+    o_report->faces = m_faces;
+    o_report->gpu_bytes = 0;
+    for (const auto& level : m_levels)
+      o_report->gpu_bytes += level->data.size();
+    o_report->transcode_ms = m_transcode_ms;
+    o_report->upload = timer;
+  }
+
+  const auto release = [](void*, size_t, void* io_user) {
+    auto upload = static_cast<LevelUpload*>(io_user);
+    if (upload->timer)
+      upload->timer->upload_released();
+    delete upload;
+  };
+  for (uint32_t i = 0; i < m_levels.size(); ++i)
+  {
+    auto& level = m_levels[i];
+    // The descriptor holds the only reference to the level once we're done
+    auto upload = new LevelUpload{level, timer};
+    auto buffer =
+      is_compressed(m_format)
+        ? PixelBufferDescriptor(level->data.data(),
+                                level->data.size(),
+                                compressed_type(m_format),
+                                level->face_size,
+                                release,
+                                upload)
+        : PixelBufferDescriptor(level->data.data(),
+                                level->data.size(),
+                                i_rgbm ? filament::Texture::Format::RGBM
+                                       : filament::Texture::Format::RGBA,
+                                filament::Texture::Type::UBYTE,
+                                release,
+                                upload);
+    if (m_faces == 6)
+    {
+      filament::Texture::FaceOffsets offsets;
+      for (uint32_t face = 0; face < m_faces; ++face)
+        offsets[face] = face * level->face_size;
+      texture->setImage(*io_engine, i, std::move(buffer), offsets);
+    }
+    else
+    {
+      texture->setImage(*io_engine, i, std::move(buffer));
+    }
+  }
+  m_levels.clear();
+  return texture;
+}
+
+Ktx2Texture::Format Ktx2Texture::format() const noexcept
+{
+  return m_format;
+}
@@ -0,0 +1,340 @@
+#include "ktx_mapping.h"
+#include <image/KtxUtility.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+constexpr uint8_t KTX_IDENTIFIER[12] = {
+  0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+constexpr uint32_t KTX_ENDIANNESS = 0x04030201;
+constexpr std::size_t KTX_HEADER_SIZE = 64;
+
+// Layout of the fields following the identifier in a KTX header
+struct KtxHeader
+{
+  uint32_t endianness;
+  uint32_t gl_type;
+  uint32_t gl_type_size;
+  uint32_t gl_format;
+  uint32_t gl_internal_format;
+  uint32_t gl_base_internal_format;
+  uint32_t pixel_width;
+  uint32_t pixel_height;
+  uint32_t pixel_depth;
+  uint32_t number_of_array_elements;
+  uint32_t number_of_faces;
+  uint32_t number_of_mipmap_levels;
+  uint32_t bytes_of_key_value_data;
+};
+
+// All KTX sections are padded to four bytes
+constexpr std::size_t pad4(std::size_t i_size) noexcept
+{
+  return (i_size + 3) & ~std::size_t{3};
+}
+
+// Keeps the mapping alive until the engine has consumed a level
+struct LevelUpload
+{
+  std::shared_ptr<const KtxMapping> mapping;
+  uint32_t level;
+  std::shared_ptr<UploadTimer> timer;
+};
+}  // namespace
+
+std::shared_ptr<KtxMapping> KtxMapping::open(const utils::Path& i_path)
+{
+  const auto path = i_path.getPath();
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Failed to open " + path);
+
+  struct stat file_stat;
+  if (::fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0)
+  {
+    ::close(fd);
+    throw std::runtime_error("Failed to stat " + path);
+  }
+  const auto size = static_cast<std::size_t>(file_stat.st_size);
+  void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping holds its own reference to the file
+  ::close(fd);
+  if (data == MAP_FAILED)
+    throw std::runtime_error("Failed to map " + path);
+  // Levels are uploaded in order so let the kernel read ahead
+  ::madvise(data, size, MADV_SEQUENTIAL);
+
+  // Can't use make_shared with a private constructor
+  std::shared_ptr<KtxMapping> mapping(
+    new KtxMapping(static_cast<const uint8_t*>(data), size));
+  mapping->parse(path);
+  return mapping;
+}
+
+KtxMapping::KtxMapping(const uint8_t* i_data, std::size_t i_size)
+  : m_data(i_data), m_size(i_size)
+{
+}
+
+KtxMapping::~KtxMapping()
+{
+  ::munmap(const_cast<uint8_t*>(m_data), m_size);
+}
+
+void KtxMapping::parse(const std::string& i_path)
+{
+  if (m_size < KTX_HEADER_SIZE ||
+      std::memcmp(m_data, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0)
+    throw std::runtime_error(i_path + " is not a KTX file");
+
+  KtxHeader header;
+  std::memcpy(&header, m_data + sizeof(KTX_IDENTIFIER), sizeof(header));
+  if (header.endianness != KTX_ENDIANNESS)
+    throw std::runtime_error(i_path + " has unsupported endianness");
+  if (header.number_of_array_elements > 1 || header.pixel_depth > 1)
+    throw std::runtime_error(i_path + " is not a 2D or cube map texture");
+
+  m_info.endianness = header.endianness;
+  m_info.glType = header.gl_type;
+  m_info.glTypeSize = header.gl_type_size;
+  m_info.glFormat = header.gl_format;
+  m_info.glInternalFormat = header.gl_internal_format;
+  m_info.glBaseInternalFormat = header.gl_base_internal_format;
+  m_info.pixelWidth = header.pixel_width;
+  m_info.pixelHeight = header.pixel_height;
+  m_info.pixelDepth = header.pixel_depth;
+  m_num_faces = std::max(header.number_of_faces, 1u);
+
+  m_metadata_offset = KTX_HEADER_SIZE;
+  m_metadata_size = header.bytes_of_key_value_data;
+
+  // Walk the levels recording where each one lives in the file
+  std::size_t offset = m_metadata_offset + m_metadata_size;
+  const uint32_t num_levels = std::max(header.number_of_mipmap_levels, 1u);
+  m_levels.reserve(num_levels);
+  for (uint32_t level = 0; level < num_levels; ++level)
+  {
+    if (offset + sizeof(uint32_t) > m_size)
+      throw std::runtime_error(i_path + " is truncated");
+    uint32_t image_size;
+    std::memcpy(&image_size, m_data + offset, sizeof(image_size));
+    offset += sizeof(image_size);
+    // For cube maps the image size refers to a single face
+    if (m_num_faces == 1)
+    {
+      m_levels.push_back({offset, image_size});
+      offset += pad4(image_size);
+    }
+    else
+    {
+      // Faces must be tightly packed to be uploaded in one descriptor
+      if (pad4(image_size) != image_size)
+        throw std::runtime_error(i_path + " has padded cube map faces");
+      m_levels.push_back({offset, image_size});
+      offset += std::size_t{image_size} * m_num_faces;
+    }
+    if (offset > m_size)
+      throw std::runtime_error(i_path + " is truncated");
+  }
+}
+
+const image::KtxInfo& KtxMapping::info() const noexcept
+{
+  return m_info;
+}
+
+uint32_t KtxMapping::num_mip_levels() const noexcept
+{
+  return static_cast<uint32_t>(m_levels.size());
+}
+
+bool KtxMapping::is_cubemap() const noexcept
+{
+  return m_num_faces == 6;
+}
+
+const uint8_t* KtxMapping::level_data(uint32_t i_level) const noexcept
+{
+  return m_data + m_levels[i_level].offset;
+}
+
+uint32_t KtxMapping::face_size(uint32_t i_level) const noexcept
+{
+  return m_levels[i_level].face_size;
+}
+
+uint32_t KtxMapping::level_size(uint32_t i_level) const noexcept
+{
+  return m_levels[i_level].face_size * m_num_faces;
+}
+
+std::string KtxMapping::metadata(const std::string& i_key) const
+{
+  // Each entry is a size, followed by a null terminated key and the value
+  const uint8_t* entry = m_data + m_metadata_offset;
+  const uint8_t* const end = entry + m_metadata_size;
+  while (entry + sizeof(uint32_t) <= end)
+  {
+    uint32_t entry_size;
+    std::memcpy(&entry_size, entry, sizeof(entry_size));
+    const char* key = reinterpret_cast<const char*>(entry + sizeof(uint32_t));
+    const char* entry_end = key + std::min<std::size_t>(
+                                    entry_size, end - entry - sizeof(uint32_t));
+    const char* key_end = std::find(key, entry_end, '\0');
+    if (key_end != entry_end &&
+        i_key.compare(0, i_key.npos, key, key_end - key) == 0)
+    {
+      // Values are usually null terminated strings, strip the terminator
+      std::string value(key_end + 1, entry_end);
+      value.erase(std::find(value.begin(), value.end(), '\0'), value.end());
+      return value;
+    }
+    entry += sizeof(uint32_t) + pad4(entry_size);
+  }
+  return {};
+}
+
+std::size_t KtxMapping::mapped_size() const noexcept
+{
+  return m_size;
+}
+
+filament::Texture::InternalFormat
+KtxMapping::texture_format(bool i_srgb) const noexcept
+{
+  using Format = filament::Texture::InternalFormat;
+  auto format = image::KtxUtility::toTextureFormat(m_info);
+  if (i_srgb && format == Format::RGB8)
+    format = Format::SRGB8;
+  else if (i_srgb && format == Format::RGBA8)
+    format = Format::SRGB8_A8;
+  return format;
+}
+
+void KtxMapping::describe(TextureReport& o_report, bool i_srgb) const
+{
+  o_report.format = format_name(texture_format(i_srgb));
+  o_report.compressed = image::KtxUtility::isCompressed(m_info);
+  o_report.width = m_info.pixelWidth;
+  o_report.height = m_info.pixelHeight;
+  o_report.levels = num_mip_levels();
+  o_report.faces = m_num_faces;
+  o_report.gpu_bytes = 0;
+  for (uint32_t level = 0; level < num_mip_levels(); ++level)
+    o_report.gpu_bytes += level_size(level);
+}
+
+filament::Texture* KtxMapping::create_texture(filament::Engine* io_engine,
+                                              bool i_srgb,
+                                              bool i_rgbm,
+                                              TextureReport* o_report)
+{
+  auto texture = create_partial_texture(io_engine, i_srgb, i_rgbm, 0);
+  std::shared_ptr<UploadTimer> timer;
+  if (o_report)
+  {
+    timer = std::make_shared<UploadTimer>(num_mip_levels());
+    describe(*o_report, i_srgb);
+    o_report->upload = timer;
+  }
+
+  for (uint32_t level = 0; level < num_mip_levels(); ++level)
+    upload_level(io_engine, texture, level, i_rgbm, timer);
+  return texture;
+}
+
+filament::Texture*
+KtxMapping::create_partial_texture(filament::Engine* io_engine,
+                                   bool i_srgb,
+                                   bool i_rgbm,
+                                   uint32_t i_base_level) const
+{
+  using Sampler = filament::Texture::Sampler;
+  if (i_rgbm && image::KtxUtility::isCompressed(m_info))
+    throw std::invalid_argument("RGBM textures must not be block compressed");
+  return filament::Texture::Builder()
+    .width(std::max(m_info.pixelWidth >> i_base_level, 1u))
+    .height(std::max(m_info.pixelHeight >> i_base_level, 1u))
+    .levels(static_cast<uint8_t>(num_mip_levels() - i_base_level))
+    .sampler(is_cubemap() ? Sampler::SAMPLER_CUBEMAP : Sampler::SAMPLER_2D)
+    .format(texture_format(i_srgb))
+    .rgbm(i_rgbm)
+    .build(*io_engine);
+}
+
+void KtxMapping::upload_level(filament::Engine* io_engine,
+                              filament::Texture* io_texture,
+                              uint32_t i_level,
+                              bool i_rgbm,
+                              std::shared_ptr<UploadTimer> i_timer,
+                              uint32_t i_base_level)
+{
+  using PixelBufferDescriptor = filament::Texture::PixelBufferDescriptor;
+  // The descriptor holds a reference to this mapping until it is released
+  auto upload =
+    new LevelUpload{shared_from_this(), i_level, std::move(i_timer)};
+  const auto release = [](void*, size_t, void* io_user) {
+    auto upload = static_cast<LevelUpload*>(io_user);
+    upload->mapping->release_level(upload->level);
+    if (upload->timer)
+      upload->timer->upload_released();
+    delete upload;
+  };
+
+  // Point the descriptor straight at the mapped level, no copies are made
+  void* data = const_cast<uint8_t*>(level_data(i_level));
+  const auto size = level_size(i_level);
+  auto buffer =
+    image::KtxUtility::isCompressed(m_info)
+      ? PixelBufferDescriptor(
+          data,
+          size,
+          image::KtxUtility::toCompressedPixelDataType(m_info),
+          face_size(i_level),
+          release,
+          upload)
+      : PixelBufferDescriptor(
+          data,
+          size,
+          i_rgbm ? filament::Texture::Format::RGBM
+                 : image::KtxUtility::toPixelDataFormat(m_info),
+          image::KtxUtility::toPixelDataType(m_info),
+          release,
+          upload);
+
+  if (is_cubemap())
+  {
+    // Faces are stored one after another
+    filament::Texture::FaceOffsets offsets;
+    for (uint32_t face = 0; face < m_num_faces; ++face)
+      offsets[face] = face * face_size(i_level);
+    io_texture->setImage(
+      *io_engine, i_level - i_base_level, std::move(buffer), offsets);
+  }
+  else
+  {
+    io_texture->setImage(*io_engine, i_level - i_base_level, std::move(buffer));
+  }
+}
+
+void KtxMapping::release_level(uint32_t i_level) const noexcept
+{
+  // Only whole pages within the level can be released
+  static const std::size_t page_size =
+    static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  const auto begin = reinterpret_cast<std::uintptr_t>(level_data(i_level));
+  const auto end = begin + level_size(i_level);
+  const auto page_begin = (begin + page_size - 1) & ~(page_size - 1);
+  const auto page_end = end & ~(page_size - 1);
+  if (page_begin < page_end)
+    ::madvise(reinterpret_cast<void*>(page_begin),
+              page_end - page_begin,
+              MADV_DONTNEED);
+}
@@ -1,6 +1,17 @@
 #include <QApplication>
+#include "app_options.h"
 #include "app_window.h"
+#include "benchmarks.h"
 #include "filament_window_widget.h"
+#include "profiler.h"
+#include "render_thread.h"
+#include "shared_scene.h"
+#include <QScreen>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <vector>
 
 // filament::Texture* load_texture(filament::Engine* io_engine, const
 // utils::Path& i_texture_path)
@@ -51,26 +62,87 @@
 
 int main(int argc, char* argv[])
 {
+  // We need to know if we're headless before creating the application
+  const auto options = parse_app_options(argc, argv);
+  Profiler::global().set_enabled(options.profile);
+  Profiler::global().set_thread_name("gui");
+  if (options.headless || !options.bake_bench_path.isEmpty() ||
+      !options.import_bench_path.isEmpty() || !options.batch_path.isEmpty() ||
+      !options.serve_name.isEmpty() || !options.poster_path.isEmpty())
+  {
+    // A core application does not require a display
+    QCoreApplication app(argc, argv);
+    const int result = run_benchmarks(options);
+    if (!options.trace_path.isEmpty())
+      Profiler::global().write_chrome_trace(options.trace_path);
+    return result;
+  }
+
   // Create the application
   QApplication app(argc, argv);
-  // Create a new main window
-  AppWindow window;
-  // Set the back-end we want filament to use for rendering
-  auto filament_backend = filament::Engine::Backend::OPENGL;
-  // Create our filament engine
-  std::shared_ptr<filament::Engine> filament_engine(
-    filament::Engine::create(filament_backend),
-    [](filament::Engine* i_engine) { i_engine->destroy(&i_engine); });
-  // Create our filament window
-  auto filament_widget =
-    std::make_shared<FilamentWindowWidget>(&window, filament_engine);
-  // Initialize the filament entities and set-up cameras
-  filament_widget->init();
-  // Initialize the main window using our filament scene
-  window.init(filament_widget);
-  // Show it
-  window.show();
+  // All rendering happens on a dedicated thread, which must outlive the window
+  auto render_thread = std::make_shared<RenderThread>();
+  // Create our main windows, one per view if requested, otherwise every view
+  // shares a single window
+  std::vector<std::unique_ptr<AppWindow>> windows;
+  const uint32_t window_count = options.separate_windows ? options.views : 1;
+  for (uint32_t i = 0; i < window_count; ++i)
+    windows.push_back(std::make_unique<AppWindow>());
+  // Create our filament engine on the render thread
+  std::shared_ptr<filament::Engine> filament_engine;
+  try
+  {
+    filament_engine =
+      RenderThread::create_engine(render_thread, options.backend);
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  // Every view renders the same scene, sharing its materials and buffers
+  auto scene = std::make_shared<SharedScene>(
+    filament_engine, render_thread, load_scene_manifest(options));
+  scene->set_lods_enabled(options.lods);
+  scene->set_upload_budget(options.upload_budget);
+  scene->set_animated(options.animate);
+  scene->set_transform_threads(options.transform_threads);
+
+  std::vector<std::vector<std::shared_ptr<NativeWindowWidget>>> window_views(
+    window_count);
+  for (uint32_t i = 0; i < options.views; ++i)
+  {
+    const auto window = i % window_count;
+    // Create our filament window, rendering the shared scene
+    auto filament_widget =
+      std::make_shared<FilamentWindowWidget>(windows[window].get(), scene);
+    // Initialize the filament entities and set-up cameras
+    filament_widget->init();
+    filament_widget->set_target_fps(options.target_fps);
+    filament_widget->set_refine_frames(options.refine_frames);
+    if (options.continuous)
+      filament_widget->frame_scheduler().set_mode(FrameScheduler::CONTINUOUS);
+    window_views[window].push_back(std::move(filament_widget));
+  }
+
+  const auto screens = QGuiApplication::screens();
+  for (uint32_t i = 0; i < window_count; ++i)
+  {
+    auto& window = *windows[i];
+    // Initialize the main window using our filament views
+    window.init(std::move(window_views[i]));
+    if (!options.trace_path.isEmpty())
+      window.set_trace_path(options.trace_path);
+    window.set_stats_visible(options.profile);
+    // Spread separate windows over the available screens
+    if (window_count > 1 && !screens.isEmpty())
+      window.move(screens[i % screens.size()]->availableGeometry().topLeft());
+    // Show it
+    window.show();
+  }
   // Hand control over to Qt framework
-  return app.exec();
+  const int result = app.exec();
+  if (!options.trace_path.isEmpty())
+    Profiler::global().write_chrome_trace(options.trace_path);
+  return result;
 }
-
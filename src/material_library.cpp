@@ -0,0 +1,248 @@
+#include "material_library.h"
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+namespace
+{
+// Combine a value's hash in to an existing seed
+template <typename T>
+void hash_combine(std::size_t& io_seed, const T& i_value) noexcept
+{
+  io_seed ^=
+    std::hash<T>{}(i_value) + 0x9e3779b9 + (io_seed << 6) + (io_seed >> 2);
+}
+
+// Uniforms are packed in to 16 byte slots
+constexpr std::size_t UNIFORM_SLOT_SIZE = 16;
+// Rough engine side cost of an instance beyond its parameters, the engine
+// doesn't expose the real figure
+constexpr std::size_t INSTANCE_OVERHEAD = 512;
+}  // namespace
+
+MaterialParameters& MaterialParameters::set(const std::string& i_name,
+                                            float i_value)
+{
+  m_values[i_name] = {1, {i_value, 0.f, 0.f, 0.f}};
+  return *this;
+}
+
+MaterialParameters&
+MaterialParameters::set(const std::string& i_name,
+                        const filament::math::float3& i_value)
+{
+  m_values[i_name] = {3, {i_value, 0.f}};
+  return *this;
+}
+
+MaterialParameters&
+MaterialParameters::set(const std::string& i_name,
+                        const filament::math::float4& i_value)
+{
+  m_values[i_name] = {4, i_value};
+  return *this;
+}
+
+bool MaterialParameters::empty() const noexcept
+{
+  return m_values.empty();
+}
+
+void MaterialParameters::apply(filament::MaterialInstance& io_instance) const
+{
+  for (const auto& value : m_values)
+  {
+    const char* name = value.first.c_str();
+    const auto& data = value.second.data;
+    switch (value.second.size)
+    {
+    case 1: io_instance.setParameter(name, data.x); break;
+    case 3: io_instance.setParameter(name, data.xyz); break;
+    default: io_instance.setParameter(name, data); break;
+    }
+  }
+}
+
+std::size_t MaterialParameters::uniform_size() const noexcept
+{
+  return m_values.size() * UNIFORM_SLOT_SIZE;
+}
+
+std::size_t MaterialParameters::hash() const noexcept
+{
+  std::size_t seed = m_values.size();
+  for (const auto& value : m_values)
+  {
+    hash_combine(seed, value.first);
+    for (uint32_t i = 0; i < value.second.size; ++i)
+      hash_combine(seed, value.second.data[i]);
+  }
+  return seed;
+}
+
+bool MaterialParameters::operator==(const MaterialParameters& i_other) const
+  noexcept
+{
+  if (m_values.size() != i_other.m_values.size())
+    return false;
+  auto other = i_other.m_values.begin();
+  for (const auto& value : m_values)
+  {
+    if (value.first != other->first ||
+        value.second.size != other->second.size ||
+        value.second.data != other->second.data)
+      return false;
+    ++other;
+  }
+  return true;
+}
+
+bool MaterialLibrary::Key::operator==(const Key& i_other) const noexcept
+{
+  return material == i_other.material && parameters == i_other.parameters;
+}
+
+std::size_t MaterialLibrary::KeyHash::operator()(const Key& i_key) const
+  noexcept
+{
+  std::size_t seed = i_key.parameters.hash();
+  hash_combine(seed, i_key.material);
+  return seed;
+}
+
+MaterialLibrary::MaterialLibrary(std::shared_ptr<filament::Engine> i_engine,
+                                 std::string i_directory)
+  : m_engine(std::move(i_engine)), m_directory(std::move(i_directory))
+{
+}
+
+MaterialLibrary::~MaterialLibrary()
+{
+  // Instances must be destroyed before their materials
+  m_instances.clear();
+  m_materials.clear();
+}
+
+void MaterialLibrary::add_package(const std::string& i_name,
+                                  const void* i_package,
+                                  std::size_t i_size)
+{
+  m_packages[i_name] = {i_package, i_size};
+}
+
+filament::Material* MaterialLibrary::material(const std::string& i_name)
+{
+  const auto found = m_materials.find(i_name);
+  if (found != m_materials.end())
+    return found->second.get();
+  return load(i_name, read_package(i_name));
+}
+
+std::vector<char> MaterialLibrary::read_package(const std::string& i_name) const
+{
+  // Prefer a package on disk, so materials can be recompiled without
+  // rebuilding the application
+  std::vector<char> package;
+  std::ifstream file(m_directory + '/' + i_name + ".filamat",
+                     std::ios::binary);
+  if (file)
+    package.assign(std::istreambuf_iterator<char>(file),
+                   std::istreambuf_iterator<char>());
+  return package;
+}
+
+filament::Material* MaterialLibrary::load(const std::string& i_name,
+                                          const std::vector<char>& i_package)
+{
+  const auto found = m_materials.find(i_name);
+  if (found != m_materials.end())
+    return found->second.get();
+
+  const void* data = i_package.data();
+  std::size_t size = i_package.size();
+  if (i_package.empty())
+  {
+    const auto registered = m_packages.find(i_name);
+    if (registered == m_packages.end())
+    {
+      std::cerr << "No material package named " << i_name << '\n';
+      return nullptr;
+    }
+    data = registered->second.first;
+    size = registered->second.second;
+  }
+
+  // The engine copies what it needs from the package during the build
+  auto& material = m_materials[i_name];
+  material = FilamentScopedPointer<filament::Material>(
+    filament::Material::Builder().package(data, size).build(*m_engine),
+    {m_engine});
+  m_package_bytes += size;
+  return material.get();
+}
+
+filament::MaterialInstance*
+MaterialLibrary::acquire(const std::string& i_material,
+                         const MaterialParameters& i_parameters)
+{
+  Key key{i_material, i_parameters};
+  const auto found = m_instances.find(key);
+  if (found != m_instances.end())
+  {
+    ++found->second.acquisitions;
+    return found->second.instance.get();
+  }
+
+  auto source = material(i_material);
+  if (!source)
+    return nullptr;
+  FilamentScopedPointer<filament::MaterialInstance> instance(
+    source->createInstance(), {m_engine});
+  i_parameters.apply(*instance);
+  auto& pooled = m_instances[std::move(key)];
+  pooled.instance = std::move(instance);
+  pooled.acquisitions = 1;
+  pooled.uniform_size = i_parameters.uniform_size();
+  return pooled.instance.get();
+}
+
+MaterialLibrary::Stats MaterialLibrary::stats() const noexcept
+{
+  Stats stats;
+  stats.materials = m_materials.size();
+  stats.instances = m_instances.size();
+  stats.package_bytes = m_package_bytes;
+  for (const auto& instance : m_instances)
+  {
+    stats.acquisitions += instance.second.acquisitions;
+    // Each instance owns a uniform buffer for its parameters, along with the
+    // instance object itself
+    stats.approximate_instance_bytes +=
+      instance.second.uniform_size + INSTANCE_OVERHEAD;
+  }
+  return stats;
+}
+
+std::ostream& operator<<(std::ostream& io_os,
+                         const MaterialLibrary::Stats& i_stats)
+{
+  return io_os << i_stats.materials << " materials ("
+               << i_stats.package_bytes / 1024 << " KiB), "
+               << i_stats.instances << " instances serving "
+               << i_stats.acquisitions << " uses (~"
+               << i_stats.approximate_instance_bytes / 1024 << " KiB)";
+}
+
+QJsonObject to_json(const MaterialLibrary::Stats& i_stats)
+{
+  QJsonObject json;
+  json["materials"] = static_cast<double>(i_stats.materials);
+  json["instances"] = static_cast<double>(i_stats.instances);
+  json["acquisitions"] = static_cast<double>(i_stats.acquisitions);
+  json["package_bytes"] = static_cast<double>(i_stats.package_bytes);
+  json["instance_bytes"] =
+    static_cast<double>(i_stats.approximate_instance_bytes);
+  return json;
+}
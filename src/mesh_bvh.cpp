@@ -0,0 +1,150 @@
+#include "mesh_bvh.h"
+#include <math/half.h>
+#include <math/vec4.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace
+{
+namespace flm = filament::math;
+
+// Filamesh positions are always stored as half floats
+flm::float3 read_position(const filamesh_file::Contents& i_contents,
+                          uint32_t i_vertex)
+{
+  const auto& header = i_contents.header;
+  flm::half4 position;
+  std::memcpy(&position,
+              i_contents.vertices + header.offset_position +
+                std::size_t{i_vertex} * header.stride_position,
+              sizeof(position));
+  return flm::float4(position).xyz;
+}
+
+uint32_t read_index(const filamesh_file::Contents& i_contents, uint32_t i_index)
+{
+  if (i_contents.header.index_type == filamesh_file::UI16)
+  {
+    uint16_t index;
+    std::memcpy(&index, i_contents.indices + i_index * sizeof(index), 2);
+    return index;
+  }
+  uint32_t index;
+  std::memcpy(&index, i_contents.indices + i_index * sizeof(index), 4);
+  return index;
+}
+}  // namespace
+
+MeshBvh::MeshBvh(const filamesh_file::Contents& i_contents)
+{
+  const auto start = std::chrono::steady_clock::now();
+  // Only the full detail parts are tested, as they are what the simplified
+  // levels approximate
+  std::vector<Triangle> triangles;
+  std::vector<bvh::Aabb> bounds;
+  // Ignore anything outside of the buffers, as the file may be malformed
+  const auto& header = i_contents.header;
+  const std::size_t index_size =
+    header.index_type == filamesh_file::UI16 ? 2 : 4;
+  const auto index_count = static_cast<uint32_t>(std::min<std::size_t>(
+    header.index_count, header.index_size / index_size));
+  const std::size_t position_end =
+    std::size_t{header.offset_position} + sizeof(flm::half4);
+  const auto vertex_count =
+    header.vertex_size < position_end || !header.stride_position
+      ? 0u
+      : static_cast<uint32_t>(std::min<std::size_t>(
+          header.vertex_count,
+          (header.vertex_size - position_end) / header.stride_position + 1));
+  for (const auto& part : i_contents.parts)
+  {
+    if (part.offset > index_count ||
+        part.index_count > index_count - part.offset)
+      continue;
+    for (uint32_t i = 0; i + 2 < part.index_count; i += 3)
+    {
+      const auto first = part.offset + i;
+      const uint32_t indices[] = {read_index(i_contents, first),
+                                  read_index(i_contents, first + 1),
+                                  read_index(i_contents, first + 2)};
+      if (std::max({indices[0], indices[1], indices[2]}) >= vertex_count)
+        continue;
+      const auto v0 = read_position(i_contents, indices[0]);
+      const auto v1 = read_position(i_contents, indices[1]);
+      const auto v2 = read_position(i_contents, indices[2]);
+      triangles.push_back({v0, v1 - v0, v2 - v0, first / 3});
+      bvh::Aabb box;
+      box.extend(v0);
+      box.extend(v1);
+      box.extend(v2);
+      bounds.push_back(box);
+    }
+  }
+  m_tree = bvh::build(bounds);
+
+  // Store the triangles in leaf order, so each leaf reads contiguous memory
+  m_triangles.reserve(triangles.size());
+  for (const auto i : m_tree.order)
+    m_triangles.push_back(triangles[i]);
+  m_build_ms = std::chrono::duration<double, std::milli>(
+                 std::chrono::steady_clock::now() - start)
+                 .count();
+}
+
+bool MeshBvh::intersect(const bvh::Ray& i_ray,
+                        float i_t_max,
+                        Hit& o_hit) const
+{
+  bool hit = false;
+  const auto test_leaf = [&](uint32_t i_first, uint32_t i_count) {
+    for (auto i = i_first; i < i_first + i_count; ++i)
+    {
+      // Moller-Trumbore, accepting hits on either face
+      const auto& triangle = m_triangles[i];
+      const auto p = cross(i_ray.direction, triangle.e2);
+      const float determinant = dot(triangle.e1, p);
+      if (std::abs(determinant) < 1e-12f)
+        continue;
+      const float inverse = 1.f / determinant;
+      const auto s = i_ray.origin - triangle.v0;
+      const float u = dot(s, p) * inverse;
+      if (u < 0.f || u > 1.f)
+        continue;
+      const auto q = cross(s, triangle.e1);
+      const float v = dot(i_ray.direction, q) * inverse;
+      if (v < 0.f || u + v > 1.f)
+        continue;
+      const float t = dot(triangle.e2, q) * inverse;
+      if (t <= 0.f || t >= i_t_max)
+        continue;
+      i_t_max = t;
+      o_hit.triangle = triangle.index;
+      o_hit.distance = t;
+      hit = true;
+    }
+  };
+  bvh::traverse(m_tree, i_ray, i_t_max, test_leaf);
+  return hit;
+}
+
+const bvh::Aabb& MeshBvh::bounds() const noexcept
+{
+  static const bvh::Aabb empty;
+  return m_tree.nodes.empty() ? empty : m_tree.nodes.front().bounds;
+}
+
+std::size_t MeshBvh::triangle_count() const noexcept
+{
+  return m_triangles.size();
+}
+
+std::size_t MeshBvh::node_count() const noexcept
+{
+  return m_tree.nodes.size();
+}
+
+double MeshBvh::build_ms() const noexcept
+{
+  return m_build_ms;
+}
@@ -0,0 +1,442 @@
+#include "mesh_importer.h"
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+#include <geometry/SurfaceOrientation.h>
+#include <math/half.h>
+#include <math/vec4.h>
+#include <meshoptimizer.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+// Bump this whenever the conversion changes, to invalidate cached meshes
+constexpr const char* IMPORT_VERSION = "qfp-mesh-import-3";
+// Typical post-transform cache size used for analysis
+constexpr unsigned int VERTEX_CACHE_SIZE = 16;
+// Allow the vertex cache efficiency to degrade by up to 5% to reduce overdraw
+constexpr float OVERDRAW_THRESHOLD = 1.05f;
+// Most simplified levels generated beyond the full detail mesh
+constexpr std::size_t MAX_LODS = 4;
+// Simplification error allowed for the first level, relative to the mesh
+// extents, which grows by LOD_ERROR_GROWTH for each further level
+constexpr float LOD_BASE_ERROR = 0.005f;
+constexpr float LOD_ERROR_GROWTH = 4.f;
+// Levels which don't remove at least 10% of the previous level's triangles
+// aren't worth switching to
+constexpr float LOD_MIN_REDUCTION = 0.9f;
+
+// Layout of each vertex in the filamesh files we write, matching the formats
+// filamesh::MeshReader expects
+struct PackedVertex
+{
+  filament::math::half4 position;
+  filament::math::short4 tangents;
+  filament::math::half2 uv0;
+};
+
+bool is_filamesh(const std::string& i_path)
+{
+  return QFileInfo(QString::fromStdString(i_path))
+           .suffix()
+           .compare("filamesh", Qt::CaseInsensitive) == 0;
+}
+
+filamesh_file::Box to_box(const filament::math::float3& i_min,
+                          const filament::math::float3& i_max)
+{
+  return {(i_max + i_min) * 0.5f, (i_max - i_min) * 0.5f};
+}
+
+std::size_t triangle_count(const std::vector<filamesh_file::Part>& i_parts)
+{
+  std::size_t count = 0;
+  for (const auto& part : i_parts)
+    count += part.index_count / 3;
+  return count;
+}
+
+double vertex_cache_miss_ratio(const ImportedMesh& i_mesh)
+{
+  return meshopt_analyzeVertexCache(i_mesh.indices.data(),
+                                    i_mesh.indices.size(),
+                                    i_mesh.vertices.size(),
+                                    VERTEX_CACHE_SIZE,
+                                    0,
+                                    0)
+    .acmr;
+}
+}  // namespace
+
+MeshImporter::MeshImporter(std::string i_cache_directory)
+  : m_cache_directory(std::move(i_cache_directory))
+{
+}
+
+std::string MeshImporter::import(const std::string& i_path,
+                                 MeshImportReport* o_report) const
+{
+  using clock = std::chrono::steady_clock;
+  const auto start = clock::now();
+  MeshImportReport report;
+  report.source_path = i_path;
+
+  if (is_filamesh(i_path))
+  {
+    report.filamesh_path = i_path;
+    report.cache_hit = true;
+  }
+  else
+  {
+    // Key the cache on the contents of the source, not its path
+    QFile source(QString::fromStdString(i_path));
+    if (!source.open(QIODevice::ReadOnly))
+      throw std::runtime_error("Failed to open " + i_path);
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QByteArray(IMPORT_VERSION));
+    hash.addData(&source);
+    report.filamesh_path = m_cache_directory + '/' +
+                           hash.result().toHex().toStdString() + ".filamesh";
+    report.cache_hit =
+      QFile::exists(QString::fromStdString(report.filamesh_path));
+
+    if (!report.cache_hit)
+    {
+      auto mesh = read(i_path);
+      optimize(mesh, &report.acmr_before, &report.acmr_after);
+      generate_lods(mesh);
+      report.lod_triangles.push_back(triangle_count(mesh.parts));
+      for (const auto& lod : mesh.lods)
+        report.lod_triangles.push_back(triangle_count(lod.parts));
+      QDir().mkpath(QString::fromStdString(m_cache_directory));
+      write_cached(mesh, report.filamesh_path);
+    }
+  }
+  report.load_ms =
+    std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+  std::cout << std::fixed << std::setprecision(2) << "Imported " << i_path
+            << (report.cache_hit ? " (warm) in " : " (cold) in ")
+            << report.load_ms << " ms";
+  if (!report.cache_hit)
+    std::cout << ", vertex cache miss ratio " << report.acmr_before << " -> "
+              << report.acmr_after;
+  if (report.lod_triangles.size() > 1)
+  {
+    std::cout << ", LOD triangles";
+    for (const auto triangles : report.lod_triangles)
+      std::cout << ' ' << triangles;
+  }
+  std::cout << std::endl;
+
+  if (o_report)
+    *o_report = report;
+  return report.filamesh_path;
+}
+
+ImportedMesh MeshImporter::read(const std::string& i_path)
+{
+  Assimp::Importer importer;
+  // Bake the node transforms in to the vertices, we only want the geometry
+  const aiScene* scene = importer.ReadFile(
+    i_path,
+    aiProcess_Triangulate | aiProcess_JoinIdenticalVertices |
+      aiProcess_GenSmoothNormals | aiProcess_PreTransformVertices |
+      aiProcess_SortByPType);
+  if (!scene)
+    throw std::runtime_error("Failed to import " + i_path + ": " +
+                             importer.GetErrorString());
+
+  std::vector<unsigned int> meshes(scene->mNumMeshes);
+  std::iota(meshes.begin(), meshes.end(), 0u);
+  auto mesh = convert(*scene, meshes);
+  if (mesh.parts.empty())
+    throw std::runtime_error(i_path + " contains no triangles");
+  return mesh;
+}
+
+ImportedMesh MeshImporter::convert(const aiScene& i_scene,
+                                   const std::vector<unsigned int>& i_meshes)
+{
+  namespace flm = filament::math;
+  const aiScene* scene = &i_scene;
+  ImportedMesh mesh;
+  flm::float3 mesh_min{std::numeric_limits<float>::max()};
+  flm::float3 mesh_max{std::numeric_limits<float>::lowest()};
+  for (const auto m : i_meshes)
+  {
+    const aiMesh* source = scene->mMeshes[m];
+    // Skip any points and lines
+    if (!(source->mPrimitiveTypes & aiPrimitiveType_TRIANGLE))
+      continue;
+
+    const auto base = static_cast<uint32_t>(mesh.vertices.size());
+    flm::float3 part_min{std::numeric_limits<float>::max()};
+    flm::float3 part_max{std::numeric_limits<float>::lowest()};
+    for (unsigned int v = 0; v < source->mNumVertices; ++v)
+    {
+      const auto& p = source->mVertices[v];
+      const auto& n = source->mNormals[v];
+      ImportedMesh::Vertex vertex{{p.x, p.y, p.z}, {n.x, n.y, n.z}, {0.f}};
+      if (source->HasTextureCoords(0))
+        vertex.uv = {source->mTextureCoords[0][v].x,
+                     source->mTextureCoords[0][v].y};
+      part_min = min(part_min, vertex.position);
+      part_max = max(part_max, vertex.position);
+      mesh.vertices.push_back(vertex);
+    }
+
+    filamesh_file::Part part;
+    part.offset = static_cast<uint32_t>(mesh.indices.size());
+    for (unsigned int f = 0; f < source->mNumFaces; ++f)
+    {
+      const auto& face = source->mFaces[f];
+      if (face.mNumIndices != 3)
+        continue;
+      for (unsigned int i = 0; i < 3; ++i)
+        mesh.indices.push_back(base + face.mIndices[i]);
+    }
+    part.index_count = static_cast<uint32_t>(mesh.indices.size()) - part.offset;
+    part.min_index = base;
+    part.max_index = static_cast<uint32_t>(mesh.vertices.size()) - 1;
+    part.aabb = to_box(part_min, part_max);
+
+    // Parts refer to materials by index in to the material names
+    aiString material_name;
+    scene->mMaterials[source->mMaterialIndex]->Get(AI_MATKEY_NAME,
+                                                   material_name);
+    const std::string name = material_name.C_Str();
+    const auto found =
+      std::find(mesh.material_names.begin(), mesh.material_names.end(), name);
+    part.material_id =
+      static_cast<uint32_t>(std::distance(mesh.material_names.begin(), found));
+    if (found == mesh.material_names.end())
+      mesh.material_names.push_back(name);
+
+    mesh.parts.push_back(part);
+    mesh_min = min(mesh_min, part_min);
+    mesh_max = max(mesh_max, part_max);
+  }
+  if (!mesh.parts.empty())
+    mesh.aabb = to_box(mesh_min, mesh_max);
+  return mesh;
+}
+
+void MeshImporter::optimize(ImportedMesh& io_mesh,
+                            double* o_acmr_before,
+                            double* o_acmr_after)
+{
+  if (o_acmr_before)
+    *o_acmr_before = vertex_cache_miss_ratio(io_mesh);
+
+  // Parts are drawn separately so are optimized independently
+  const auto vertex_count = io_mesh.vertices.size();
+  for (const auto& part : io_mesh.parts)
+  {
+    auto indices = io_mesh.indices.data() + part.offset;
+    meshopt_optimizeVertexCache(
+      indices, indices, part.index_count, vertex_count);
+    meshopt_optimizeOverdraw(indices,
+                             indices,
+                             part.index_count,
+                             &io_mesh.vertices[0].position.x,
+                             vertex_count,
+                             sizeof(ImportedMesh::Vertex),
+                             OVERDRAW_THRESHOLD);
+  }
+  // Reorder the vertices in the order they are first referenced, this also
+  // keeps each part's vertices contiguous as parts don't share vertices
+  std::vector<ImportedMesh::Vertex> vertices(vertex_count);
+  meshopt_optimizeVertexFetch(vertices.data(),
+                              io_mesh.indices.data(),
+                              io_mesh.indices.size(),
+                              io_mesh.vertices.data(),
+                              vertex_count,
+                              sizeof(ImportedMesh::Vertex));
+  io_mesh.vertices = std::move(vertices);
+
+  // Vertex fetch optimization moves vertices so the index ranges must be
+  // recalculated
+  for (auto& part : io_mesh.parts)
+  {
+    const auto begin = io_mesh.indices.begin() + part.offset;
+    const auto range = std::minmax_element(begin, begin + part.index_count);
+    part.min_index = *range.first;
+    part.max_index = *range.second;
+  }
+
+  if (o_acmr_after)
+    *o_acmr_after = vertex_cache_miss_ratio(io_mesh);
+}
+
+void MeshImporter::generate_lods(ImportedMesh& io_mesh)
+{
+  io_mesh.lods.clear();
+  const auto vertex_count = io_mesh.vertices.size();
+  auto previous = io_mesh.parts;
+  float error = LOD_BASE_ERROR;
+  for (std::size_t level = 1; level <= MAX_LODS;
+       ++level, error *= LOD_ERROR_GROWTH)
+  {
+    const auto level_offset = io_mesh.indices.size();
+    // Record the error the simplifier achieved rather than the target, so
+    // levels are selected by how far they really deviate
+    mesh_lod::Level lod{0.f, io_mesh.parts};
+    std::size_t previous_indices = 0;
+    std::size_t level_indices = 0;
+    for (std::size_t p = 0; p < io_mesh.parts.size(); ++p)
+    {
+      // Always simplify from the full detail part, so errors don't compound
+      const auto& source = io_mesh.parts[p];
+      const auto target = static_cast<std::size_t>(
+                            source.index_count / std::pow(2.0, level)) /
+                          3 * 3;
+      std::vector<uint32_t> simplified(source.index_count);
+      float part_error = 0.f;
+      simplified.resize(
+        meshopt_simplify(simplified.data(),
+                         io_mesh.indices.data() + source.offset,
+                         source.index_count,
+                         &io_mesh.vertices[0].position.x,
+                         vertex_count,
+                         sizeof(ImportedMesh::Vertex),
+                         target,
+                         error,
+                         0,
+                         &part_error));
+      lod.error = std::max(lod.error, part_error);
+      meshopt_optimizeVertexCache(
+        simplified.data(), simplified.data(), simplified.size(), vertex_count);
+
+      auto& part = lod.parts[p];
+      part.offset = static_cast<uint32_t>(io_mesh.indices.size());
+      part.index_count = static_cast<uint32_t>(simplified.size());
+      if (!simplified.empty())
+      {
+        const auto range =
+          std::minmax_element(simplified.begin(), simplified.end());
+        part.min_index = *range.first;
+        part.max_index = *range.second;
+      }
+      io_mesh.indices.insert(
+        io_mesh.indices.end(), simplified.begin(), simplified.end());
+      previous_indices += previous[p].index_count;
+      level_indices += part.index_count;
+    }
+
+    // Stop once simplification is no longer making progress
+    if (level_indices > previous_indices * LOD_MIN_REDUCTION)
+    {
+      io_mesh.indices.resize(level_offset);
+      break;
+    }
+    previous = lod.parts;
+    io_mesh.lods.push_back(std::move(lod));
+  }
+}
+
+void MeshImporter::write(const ImportedMesh& i_mesh, const std::string& i_path)
+{
+  namespace flm = filament::math;
+  const auto vertex_count = i_mesh.vertices.size();
+
+  // Filament shades using a quaternion tangent frame per vertex
+  std::vector<flm::float3> normals(vertex_count);
+  std::transform(i_mesh.vertices.begin(),
+                 i_mesh.vertices.end(),
+                 normals.begin(),
+                 [](const ImportedMesh::Vertex& v) { return v.normal; });
+  std::unique_ptr<geometry::SurfaceOrientation> orientation(
+    geometry::SurfaceOrientation::Builder()
+      .vertexCount(vertex_count)
+      .normals(normals.data())
+      .build());
+  std::vector<flm::short4> tangents(vertex_count);
+  orientation->getQuats(tangents.data(), vertex_count);
+
+  std::vector<PackedVertex> vertices(vertex_count);
+  for (std::size_t i = 0; i < vertex_count; ++i)
+  {
+    const auto& vertex = i_mesh.vertices[i];
+    vertices[i].position = flm::half4(flm::float4(vertex.position, 1.f));
+    vertices[i].tangents = tangents[i];
+    vertices[i].uv0 = flm::half2(vertex.uv);
+  }
+
+  filamesh_file::Header header{};
+  header.aabb = i_mesh.aabb;
+  header.offset_position = offsetof(PackedVertex, position);
+  header.stride_position = sizeof(PackedVertex);
+  header.offset_tangents = offsetof(PackedVertex, tangents);
+  header.stride_tangents = sizeof(PackedVertex);
+  header.offset_color = filamesh_file::NO_ATTRIBUTE;
+  header.offset_uv0 = offsetof(PackedVertex, uv0);
+  header.stride_uv0 = sizeof(PackedVertex);
+  header.offset_uv1 = filamesh_file::NO_ATTRIBUTE;
+  header.vertex_count = static_cast<uint32_t>(vertex_count);
+  header.vertex_size =
+    static_cast<uint32_t>(vertex_count * sizeof(PackedVertex));
+  header.index_count = static_cast<uint32_t>(i_mesh.indices.size());
+
+  // Use 16 bit indices whenever they are sufficient
+  std::vector<uint16_t> short_indices;
+  const void* indices = i_mesh.indices.data();
+  if (vertex_count <= std::numeric_limits<uint16_t>::max() + 1u)
+  {
+    short_indices.assign(i_mesh.indices.begin(), i_mesh.indices.end());
+    indices = short_indices.data();
+    header.index_type = filamesh_file::UI16;
+    header.index_size = header.index_count * sizeof(uint16_t);
+  }
+  else
+  {
+    header.index_type = filamesh_file::UI32;
+    header.index_size = header.index_count * sizeof(uint32_t);
+  }
+
+  std::ofstream file(i_path, std::ios::binary | std::ios::trunc);
+  filamesh_file::write(file,
+                       header,
+                       vertices.data(),
+                       indices,
+                       i_mesh.parts,
+                       i_mesh.material_names);
+}
+
+void MeshImporter::write_cached(const ImportedMesh& i_mesh,
+                                const std::string& i_path)
+{
+  // Write to a temporary file unique to this process and thread and rename it
+  // in to place, so concurrent imports of the same mesh never see a partial
+  // file, even from other processes sharing the cache
+  const auto temporary_path =
+    i_path + ".tmp" + std::to_string(QCoreApplication::applicationPid()) +
+    '_' +
+    std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+  write(i_mesh, temporary_path);
+  // The sidecar goes in to place first, as the mesh's presence marks the
+  // cache entry as complete
+  mesh_lod::write(temporary_path, i_mesh.lods);
+  if (std::rename(mesh_lod::sidecar_path(temporary_path).c_str(),
+                  mesh_lod::sidecar_path(i_path).c_str()) ||
+      std::rename(temporary_path.c_str(), i_path.c_str()))
+    throw std::runtime_error("Failed to write " + i_path);
+}
@@ -0,0 +1,81 @@
+#include "mesh_lod.h"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace mesh_lod
+{
+namespace
+{
+// The file begins with this magic string, without a null terminator
+constexpr char MAGIC[] = "QFPLODS1";
+constexpr std::size_t MAGIC_SIZE = sizeof(MAGIC) - 1;
+
+template <typename T>
+void read_value(std::istream& io_stream, T& o_value)
+{
+  io_stream.read(reinterpret_cast<char*>(&o_value), sizeof(T));
+}
+
+template <typename T>
+void write_value(std::ostream& io_stream, const T& i_value)
+{
+  io_stream.write(reinterpret_cast<const char*>(&i_value), sizeof(T));
+}
+}  // namespace
+
+std::string sidecar_path(const std::string& i_filamesh_path)
+{
+  return i_filamesh_path + ".lods";
+}
+
+Chain read(const std::string& i_filamesh_path)
+{
+  std::ifstream file(sidecar_path(i_filamesh_path), std::ios::binary);
+  if (!file)
+    return {};
+
+  char magic[MAGIC_SIZE];
+  file.read(magic, MAGIC_SIZE);
+  uint32_t level_count = 0;
+  uint32_t part_count = 0;
+  read_value(file, level_count);
+  read_value(file, part_count);
+  if (!file || std::memcmp(magic, MAGIC, MAGIC_SIZE) != 0)
+    throw std::runtime_error("Malformed LOD file for " + i_filamesh_path);
+
+  Chain chain(level_count);
+  for (auto& level : chain)
+  {
+    read_value(file, level.error);
+    level.parts.resize(part_count);
+    file.read(reinterpret_cast<char*>(level.parts.data()),
+              part_count * sizeof(filamesh_file::Part));
+  }
+  if (!file)
+    throw std::runtime_error("Truncated LOD file for " + i_filamesh_path);
+  return chain;
+}
+
+void write(const std::string& i_filamesh_path, const Chain& i_chain)
+{
+  std::ofstream file(sidecar_path(i_filamesh_path),
+                     std::ios::binary | std::ios::trunc);
+  const auto part_count =
+    i_chain.empty() ? 0u : static_cast<uint32_t>(i_chain[0].parts.size());
+  file.write(MAGIC, MAGIC_SIZE);
+  write_value(file, static_cast<uint32_t>(i_chain.size()));
+  write_value(file, part_count);
+  for (const auto& level : i_chain)
+  {
+    if (level.parts.size() != part_count)
+      throw std::runtime_error("Every LOD requires the same number of parts");
+    write_value(file, level.error);
+    file.write(reinterpret_cast<const char*>(level.parts.data()),
+               part_count * sizeof(filamesh_file::Part));
+  }
+  if (!file)
+    throw std::runtime_error("Failed to write LOD file for " +
+                             i_filamesh_path);
+}
+}  // namespace mesh_lod
@@ -1,10 +1,14 @@
 #include "native_window_widget.h"
-#include <mutex>
 #include <QApplication>
 #include <QResizeEvent>
+#include <QScreen>
+#include <QWindow>
+#include <cstdint>
 
 NativeWindowWidget::NativeWindowWidget(QWidget* i_parent) noexcept
-  : QWidget(i_parent), m_is_init(false), m_update_pending(false)
+  : QWidget(i_parent)
+  , m_is_init(false)
+  , m_frame_scheduler([this] { draw_frame(); })
 {
   setAttribute(Qt::WA_NativeWindow);
   setAttribute(Qt::WA_PaintOnScreen);
@@ -16,13 +20,32 @@ QPaintEngine* NativeWindowWidget::paintEngine() const
   return nullptr;
 }
 
+FrameScheduler& NativeWindowWidget::frame_scheduler() noexcept
+{
+  return m_frame_scheduler;
+}
+
 void NativeWindowWidget::request_draw()
 {
-  if (m_update_pending == false)
-  {
-    m_update_pending = true;
-    QApplication::postEvent(this, new QEvent{QEvent::UpdateRequest});
-  }
+  m_frame_scheduler.request_frame();
+}
+
+void NativeWindowWidget::input_received()
+{
+  m_frame_scheduler.input_received();
+}
+
+void NativeWindowWidget::frame_presented(bool i_redraw)
+{
+  m_frame_scheduler.frame_presented();
+  if (i_redraw)
+    request_draw();
+}
+
+void NativeWindowWidget::post_frame_presented(bool i_redraw)
+{
+  QMetaObject::invokeMethod(
+    this, "frame_presented", Qt::QueuedConnection, Q_ARG(bool, i_redraw));
 }
 
 void NativeWindowWidget::paintEvent(QPaintEvent* /*i_paint_event*/)
@@ -54,37 +77,40 @@ void NativeWindowWidget::resizeEvent(QResizeEvent* i_resize_event)
   }
 }
 
-bool NativeWindowWidget::event(QEvent* i_event)
+void NativeWindowWidget::draw_frame()
 {
-  switch (i_event->type())
-  {
-  // If an update has been requested, we need to draw
-  case QEvent::UpdateRequest:
-  {
-    // Only draw if the window is visible
-    if (isVisible())
-      draw_impl();
-    // Set this to false now that we've satisfied the request
-    m_update_pending = false;
-    return true;
-  }
-  // All other events should have default behavior
-  default: return QWidget::event(i_event);
-  }
+  // Only draw if the window is visible, otherwise there's nothing to present
+  if (isVisible())
+    draw_impl();
+  else
+    frame_presented();
 }
 
 void NativeWindowWidget::init()
 {
-  // Quick exit to avoid locking
+  // Each window is initialized once, initialization happens on the GUI thread
   if (m_is_init)
     return;
-  // Initialize using the native window id, exactly once in a thread safe manor
-  static std::once_flag is_init;
-  std::call_once(is_init, [this] {
-    m_is_init = true;
-    std::intptr_t native_window_id = winId();
-    init_impl(reinterpret_cast<void*>(native_window_id));
-  });
+  m_is_init = true;
+  std::intptr_t native_window_id = winId();
+  // Pace our frames to the refresh rate of the display we're on, which may
+  // change when the window is placed after initialization, or moved later
+  const auto handle = window()->windowHandle();
+  update_refresh_rate(handle ? handle->screen() : nullptr);
+  if (handle)
+    connect(handle,
+            &QWindow::screenChanged,
+            this,
+            &NativeWindowWidget::update_refresh_rate);
+  init_impl(reinterpret_cast<void*>(native_window_id));
+}
+
+void NativeWindowWidget::update_refresh_rate(QScreen* i_screen)
+{
+  if (!i_screen)
+    i_screen = QGuiApplication::primaryScreen();
+  if (i_screen)
+    m_frame_scheduler.set_refresh_rate(i_screen->refreshRate());
 }
 
 //------------------------------------------------------------------------------
@@ -0,0 +1,470 @@
+#include "pbr_scene.h"
+#include "ibl_baker.h"
+#include "profiler.h"
+#include <filament/Material.h>
+#include <filament/MaterialInstance.h>
+#include <filament/RenderableManager.h>
+#include <filament/LightManager.h>
+#include <filament/TransformManager.h>
+#include <filament/IndirectLight.h>
+#include <filament/Skybox.h>
+#include <utils/EntityManager.h>
+#include <cmath>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+
+// This needs to be generated from the sample bakedColor.mat
+// $>  matc -o bakedColor.inc -f header bakedColor.mat
+static constexpr uint8_t AIDEFAULTMAT_PACKAGE[] = {
+#include "assets/materials/aiDefaultMat.inc"
+};
+// $>  matc -o transparentColor.inc -f header transparentColor.mat
+static constexpr uint8_t TRANSPARENTCOLOR_PACKAGE[] = {
+#include "assets/materials/transparentColor.inc"
+};
+
+namespace
+{
+constexpr const char* IBL_PATH = "assets/env/pillars/pillars_ibl.ktx";
+constexpr const char* SKYBOX_PATH = "assets/env/pillars/pillars_skybox.ktx";
+
+// Read an entire file in to memory, safe to call from any thread
+std::shared_ptr<std::vector<uint8_t>> read_file(const std::string& i_path)
+{
+  std::ifstream file(i_path, std::ios::binary | std::ios::ate);
+  if (!file)
+    throw std::runtime_error("Failed to open " + i_path);
+  auto contents = std::make_shared<std::vector<uint8_t>>(
+    static_cast<std::size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(contents->data()), contents->size());
+  return contents;
+}
+
+// Bake the manifest's environment if it has one, otherwise read the
+// prebaked pillars environment. Safe to call from any thread.
+std::unique_ptr<EnvironmentData>
+read_environment(const std::string& i_hdr_path, bool i_ktx2)
+{
+  if (i_hdr_path.empty())
+    return EnvironmentLight::read_ibl(IBL_PATH, SKYBOX_PATH, i_ktx2);
+  const auto baked = IblBaker().bake_cached(i_hdr_path);
+  return EnvironmentLight::read_ibl(
+    baked.ibl_path, baked.skybox_path, i_ktx2);
+}
+
+// Library materials the manifest may use, which are read ahead of time
+std::set<std::string> material_names(const SceneManifest& i_manifest)
+{
+  // Our default material and imported scenes use aiDefaultMat
+  std::set<std::string> names{"aiDefaultMat"};
+  for (const auto& entry : i_manifest.entries)
+  {
+    if (!entry.material.empty())
+      names.insert(entry.material);
+  }
+  return names;
+}
+}  // namespace
+
+struct PbrScene::LoadedScene
+{
+  ImportedScene scene;
+  // The contents and levels of detail of each of the scene's meshes
+  std::vector<std::shared_ptr<std::vector<uint8_t>>> mesh_data;
+  std::vector<mesh_lod::Chain> lods;
+};
+
+PbrScene::PbrScene(std::shared_ptr<filament::Engine> i_engine)
+  : m_engine(std::move(i_engine))
+  , m_scene(m_engine->createScene(), {m_engine})
+  , m_materials(m_engine)
+  , m_transforms(m_engine)
+  , m_resources(m_engine)
+  , m_light(utils::EntityManager::get().create(), m_engine)
+  , m_ibl_skybox(m_engine)
+  , m_streamer(m_engine)
+{
+}
+
+std::vector<LoadStage> PbrScene::init(const SceneManifest& i_manifest)
+{
+  AssetLoader loader;
+  return init(loader, i_manifest);
+}
+
+std::vector<LoadStage> PbrScene::init(AssetLoader& io_loader,
+                                      const SceneManifest& i_manifest)
+{
+  ScopedTimer timer("init scene");
+  init_async(io_loader, i_manifest);
+  io_loader.wait();
+  // Each failure has already been reported by the loader
+  if (io_loader.failed())
+    throw std::runtime_error("Failed to load the scene");
+  m_transforms.update();
+  return io_loader.timeline();
+}
+
+void PbrScene::init_async(AssetLoader& io_loader,
+                          const SceneManifest& i_manifest)
+{
+  init_sun_light();
+
+  // Only reading the packages can happen off the engine thread, meshes refer
+  // to the materials by name so are finalized after them
+  const auto materials = io_loader.enqueue(
+    "materials",
+    [this, names = material_names(i_manifest)]() -> AssetLoader::Finalizer {
+      auto packages =
+        std::make_shared<std::map<std::string, std::vector<char>>>();
+      for (const auto& name : names)
+        (*packages)[name] = m_materials.read_package(name);
+      return [this, packages] { init_materials(*packages); };
+    });
+
+  for (auto& mesh : group_by_mesh(i_manifest))
+  {
+    io_loader.enqueue(
+      mesh.first,
+      [this, path = mesh.first, entries = std::move(mesh.second)]()
+        -> AssetLoader::Finalizer {
+        // Conversion of uncached meshes also happens on the worker
+        const auto filamesh_path = m_importer.import(path);
+        auto mesh_data = read_file(filamesh_path);
+        auto lods = std::make_shared<mesh_lod::Chain>(
+          mesh_lod::read(filamesh_path));
+        return [this, path, mesh_data, lods, entries] {
+          create_mesh(path, mesh_data, std::move(*lods), entries);
+        };
+      },
+      {materials});
+  }
+  for (const auto& imported : i_manifest.imports)
+  {
+    // The scene's meshes are converted across the rest of the pool
+    io_loader.enqueue(
+      imported.path,
+      [this, imported]() -> AssetLoader::Finalizer {
+        auto scene = read_scene(m_scene_importer, imported.path);
+        return [this, scene, transform = imported.transform] {
+          create_scene(*scene, transform);
+        };
+      },
+      {materials});
+  }
+  // Uncached environments are baked on the worker, spreading the bake across
+  // the rest of the pool
+  const auto environment_path =
+    i_manifest.environment.empty() ? IBL_PATH : i_manifest.environment;
+  io_loader.enqueue(
+    environment_path,
+    [this,
+     hdr_path = i_manifest.environment,
+     ktx2 = i_manifest.compressed_textures]() -> AssetLoader::Finalizer {
+      std::shared_ptr<EnvironmentData> environment =
+        read_environment(hdr_path, ktx2);
+      return [this, environment] {
+        create_environment(std::move(*environment));
+      };
+    });
+}
+
+void PbrScene::configure_view(filament::View& io_view) const
+{
+  // Link the scene to our view point
+  io_view.setScene(m_scene.get());
+
+  // Screen space effects
+  io_view.setClearColor({0.3f, 0.3f, 0.3f, 1.0f});
+  io_view.setPostProcessingEnabled(true);
+  io_view.setDepthPrepass(filament::View::DepthPrepass::ENABLED);
+  io_view.setAntiAliasing(filament::View::AntiAliasing::FXAA);
+  io_view.setRenderQuality({filament::View::QualityLevel::ULTRA});
+}
+
+filament::Scene* PbrScene::get() const noexcept
+{
+  return m_scene.get();
+}
+
+const MaterialLibrary& PbrScene::materials() const noexcept
+{
+  return m_materials;
+}
+
+std::size_t
+PbrScene::update_lods(const std::vector<const filament::View*>& i_views)
+{
+  ScopedTimer timer("select lods");
+  std::vector<LodSelection> selections;
+  selections.reserve(i_views.size());
+  for (const auto view : i_views)
+  {
+    // The vertical scale of the projection is the cotangent of half the
+    // field of view, which maps a unit at unit distance to half the viewport
+    const auto& camera = view->getCamera();
+    LodSelection selection;
+    selection.eye = filament::math::float3(camera.getPosition());
+    selection.pixel_scale =
+      static_cast<float>(camera.getProjectionMatrix()[1][1] *
+                         view->getViewport().height * 0.5);
+    selection.enabled = m_lods_enabled;
+    selections.push_back(selection);
+  }
+
+  std::size_t triangles = 0;
+  for (auto& mesh : m_meshes)
+    triangles += mesh.second->update_lods(selections);
+  return triangles;
+}
+
+void PbrScene::set_lods_enabled(bool i_enabled) noexcept
+{
+  m_lods_enabled = i_enabled;
+}
+
+void PbrScene::set_animated(bool i_animated) noexcept
+{
+  m_animated = i_animated;
+}
+
+void PbrScene::set_transform_threads(std::size_t i_max_threads) noexcept
+{
+  m_transforms.set_max_threads(i_max_threads);
+}
+
+std::size_t PbrScene::update_transforms(double i_seconds)
+{
+  if (m_animated)
+  {
+    // Remember the pose of newly loaded instances
+    for (auto node = m_rest_poses.size(); node < m_transforms.size(); ++node)
+    {
+      const auto i = static_cast<TransformStore::Node>(node);
+      m_rest_poses.push_back(
+        {m_transforms.translation(i), m_transforms.rotation(i)});
+    }
+
+    const auto t = static_cast<float>(i_seconds);
+    const filament::math::float3 up{0.f, 1.f, 0.f};
+    for (std::size_t node = 0; node < m_rest_poses.size(); ++node)
+    {
+      // Offset each instance's phase so they don't move in lock step
+      const auto i = static_cast<TransformStore::Node>(node);
+      const float phase = node * 0.37f;
+      const float bob = 0.05f * std::sin(2.f * t + phase);
+      const auto& pose = m_rest_poses[node];
+      m_transforms.set_translation(i, pose.first + up * bob);
+      m_transforms.set_rotation(
+        i,
+        filament::math::quatf::fromAxisAngle(up, 0.5f * t + phase) *
+          pose.second);
+    }
+  }
+  return m_transforms.update();
+}
+
+bool PbrScene::stream_textures()
+{
+  m_streamer.update();
+  return m_streamer.streaming();
+}
+
+bool PbrScene::streaming() const noexcept
+{
+  return m_streamer.streaming();
+}
+
+void PbrScene::set_upload_budget(std::size_t i_bytes) noexcept
+{
+  m_streamer.set_budget(i_bytes);
+}
+
+void PbrScene::end_frame()
+{
+  m_resources.end_frame();
+}
+
+PickResult PbrScene::pick(const bvh::Ray& i_ray)
+{
+  return m_picker.pick(i_ray, m_transforms);
+}
+
+const ScenePicker& PbrScene::picker() const noexcept
+{
+  return m_picker;
+}
+
+const std::vector<TextureReport>& PbrScene::texture_reports() const noexcept
+{
+  return m_ibl_skybox.m_texture_reports;
+}
+
+// Load and link our materials here
+void PbrScene::init_materials(
+  const std::map<std::string, std::vector<char>>& i_packages)
+{
+  ScopedTimer timer("init materials");
+  // Fall back to the embedded packages if no compiled one is found on disk
+  m_materials.add_package(
+    "aiDefaultMat", AIDEFAULTMAT_PACKAGE, sizeof(AIDEFAULTMAT_PACKAGE));
+  m_materials.add_package("transparentColor",
+                          TRANSPARENTCOLOR_PACKAGE,
+                          sizeof(TRANSPARENTCOLOR_PACKAGE));
+  // Any not found on disk are loaded on first use instead
+  for (const auto& package : i_packages)
+  {
+    if (!package.second.empty())
+      m_materials.load(package.first, package.second);
+  }
+  // Meshes refer to our default material by name
+  m_material_registry["DefaultMaterial"] =
+    m_materials.acquire("aiDefaultMat",
+                        MaterialParameters()
+                          .set("baseColor", {0.1f, 0.4f, 0.9f})
+                          .set("metallic", 1.0f)
+                          .set("roughness", 0.3f)
+                          .set("reflectance", 0.5f));
+}
+
+std::map<std::string, std::vector<SceneManifest::Entry>>
+PbrScene::group_by_mesh(const SceneManifest& i_manifest)
+{
+  std::map<std::string, std::vector<SceneManifest::Entry>> meshes;
+  for (const auto& entry : i_manifest.entries)
+    meshes[entry.mesh].push_back(entry);
+  return meshes;
+}
+
+// Create our mesh and its instances from the file contents
+void PbrScene::create_mesh(const std::string& i_path,
+                           std::shared_ptr<std::vector<uint8_t>> i_mesh_data,
+                           mesh_lod::Chain i_lods,
+                           const std::vector<SceneManifest::Entry>& i_entries)
+{
+  ScopedTimer timer("create mesh");
+  auto& mesh = add_mesh(i_path, std::move(i_mesh_data), std::move(i_lods));
+  for (const auto& entry : i_entries)
+  {
+    // Entries may override the materials named in the mesh file, either with
+    // a registered instance, or a library material and its parameters
+    filament::MaterialInstance* material = nullptr;
+    if (!entry.material.empty())
+    {
+      const auto found =
+        m_material_registry.find(utils::CString(entry.material.c_str()));
+      if (found != m_material_registry.end() && entry.parameters.empty())
+        material = found->second;
+      else
+        material = m_materials.acquire(entry.material, entry.parameters);
+      if (!material)
+        throw std::runtime_error("Unknown material " + entry.material +
+                                 " for " + i_path);
+    }
+    const auto instances = mesh.add_instances(entry.transforms, material);
+    m_scene->addEntities(instances.data(), instances.size());
+  }
+}
+
+InstancedMesh&
+PbrScene::add_mesh(const std::string& i_path,
+                   std::shared_ptr<std::vector<uint8_t>> i_mesh_data,
+                   mesh_lod::Chain i_lods)
+{
+  auto& mesh = m_meshes[i_path];
+  if (mesh)
+    return *mesh;
+  mesh = std::make_unique<InstancedMesh>(m_resources,
+                                         m_transforms,
+                                         i_mesh_data,
+                                         m_material_registry,
+                                         std::move(i_lods));
+  // Picking needs the triangles on the CPU, so build their hierarchy in the
+  // background from the same file contents
+  m_picker.add_mesh(*mesh, std::move(i_mesh_data));
+  return *mesh;
+}
+
+std::shared_ptr<PbrScene::LoadedScene>
+PbrScene::read_scene(const SceneImporter& i_importer, const std::string& i_path)
+{
+  auto loaded = std::make_shared<LoadedScene>();
+  loaded->scene = i_importer.import(i_path);
+  for (const auto& mesh : loaded->scene.meshes)
+  {
+    loaded->mesh_data.push_back(read_file(mesh.filamesh_path));
+    loaded->lods.push_back(mesh_lod::read(mesh.filamesh_path));
+  }
+  return loaded;
+}
+
+void PbrScene::create_scene(LoadedScene& io_scene,
+                            const filament::math::mat4f& i_transform)
+{
+  ScopedTimer timer("create scene");
+  const auto& scene = io_scene.scene;
+  // The meshes refer to their materials by these names
+  for (const auto& material : scene.materials)
+    m_material_registry[utils::CString(material.name.c_str())] =
+      m_materials.acquire("aiDefaultMat", material.parameters);
+
+  std::vector<InstancedMesh*> meshes;
+  meshes.reserve(scene.meshes.size());
+  for (std::size_t i = 0; i < scene.meshes.size(); ++i)
+    meshes.push_back(&add_mesh(scene.meshes[i].filamesh_path,
+                               std::move(io_scene.mesh_data[i]),
+                               std::move(io_scene.lods[i])));
+
+  // Nodes precede their children, so each parent is in the store before any
+  // node refers to it. The root is placed by the manifest's transform.
+  std::vector<EntityHandle> handles(scene.nodes.size());
+  m_resources.create(handles.size(), handles.data());
+  std::vector<TransformStore::Node> nodes;
+  nodes.reserve(scene.nodes.size());
+  for (std::size_t i = 0; i < scene.nodes.size(); ++i)
+  {
+    const auto& node = scene.nodes[i];
+    const bool root = node.parent < 0;
+    nodes.push_back(
+      m_transforms.add({m_resources.get(handles[i])},
+                       {root ? i_transform * node.transform : node.transform},
+                       root ? TransformStore::NONE : nodes[node.parent]));
+    for (const auto mesh : node.meshes)
+    {
+      const auto instances = meshes[mesh]->add_instances(
+        {filament::math::mat4f{}}, nullptr, nodes.back());
+      m_scene->addEntities(instances.data(), instances.size());
+    }
+  }
+  m_scene_nodes.insert(m_scene_nodes.end(), handles.begin(), handles.end());
+}
+
+// Set-up the scene's image based lighting here
+void PbrScene::create_environment(EnvironmentData&& io_environment)
+{
+  ScopedTimer timer("create environment");
+  // Link the skybox as our backdrop, and set the image texture as a light,
+  // again each time more levels of their textures stream in
+  m_ibl_skybox.m_changed = [this] {
+    m_scene->setSkybox(m_ibl_skybox.m_skybox.get());
+    m_scene->setIndirectLight(m_ibl_skybox.m_indirect_light.get());
+  };
+  m_ibl_skybox.create_ibl(std::move(io_environment), &m_streamer);
+}
+
+// Create a simple sun light to compliment the image based lighting
+void PbrScene::init_sun_light()
+{
+  filament::LightManager::Builder(filament::LightManager::Type::SUN)
+    .color(filament::Color::toLinear<filament::ACCURATE>(
+      filament::sRGBColor(0.98f, 0.92f, 0.89f)))
+    .intensity(110000)
+    .direction({0.7, -1, -0.8})
+    .sunAngularRadius(1.9f)
+    .castShadows(false)
+    .build(*m_engine, m_light);
+  // Add the light to the scene
+  m_scene->addEntity(m_light);
+}
@@ -0,0 +1,153 @@
+#include "poster_renderer.h"
+#include "batch_renderer.h"
+#include "camera_frustum.h"
+#include "pbr_scene.h"
+#include "profiler.h"
+#include "tiff_tile_writer.h"
+#include "trackball_camera.h"
+#include <filament/Texture.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+// Pixels drawn around every side of each tile and cropped, so screen space
+// effects such as FXAA and ambient occlusion see the same neighbourhood at
+// the tile's edges as in its middle
+constexpr uint32_t GUARD_BAND = 64;
+
+// Millions of pixels written per second over the given time
+double megapixels_per_second(const PosterReport& i_report, double i_ms)
+{
+  return i_ms > 0.0 ? double(i_report.width) * i_report.height / (i_ms * 1e3)
+                    : 0.0;
+}
+}  // namespace
+
+PosterRenderer::PosterRenderer(std::shared_ptr<filament::Engine> i_engine,
+                               uint32_t i_tile_size)
+  : m_engine(std::move(i_engine))
+  , m_tile_size((std::max(i_tile_size, 1u) + 15) / 16 * 16)
+{
+  const auto max_size = filament::Texture::getMaxTextureSize(
+    *m_engine, filament::Texture::Sampler::SAMPLER_2D);
+  if (m_tile_size + 2 * GUARD_BAND > max_size)
+    throw std::invalid_argument(
+      "Tiles of " + std::to_string(m_tile_size) +
+      " pixels with their guard band exceed the back-end's largest render "
+      "target of " +
+      std::to_string(max_size) + " pixels");
+}
+
+PosterReport PosterRenderer::render(const SceneManifest& i_manifest,
+                                    const std::string& i_path,
+                                    uint32_t i_width,
+                                    uint32_t i_height)
+{
+  using clock = std::chrono::steady_clock;
+  const auto elapsed_ms = [](clock::time_point i_start) {
+    return std::chrono::duration<double, std::milli>(clock::now() - i_start)
+      .count();
+  };
+  ScopedTimer timer("poster");
+  const auto start = clock::now();
+  PosterReport report;
+  report.width = i_width;
+  report.height = i_height;
+  report.tile_size = m_tile_size;
+
+  // The writer must outlive the renderer, which drains its writes on
+  // destruction, and the scene must outlive the renderer's view
+  TiffTileWriter writer(i_path, i_width, i_height, m_tile_size, m_tile_size);
+  PbrScene scene(m_engine);
+  {
+    ScopedTimer load_timer("load scene");
+    // Upload every texture level up front, as each tile is drawn only once
+    scene.set_upload_budget(0);
+    scene.init(i_manifest);
+    scene.stream_textures();
+    scene.update_transforms(0.0);
+  }
+  report.load_ms = elapsed_ms(start);
+
+  const auto render_start = clock::now();
+  const uint32_t render_size = m_tile_size + 2 * GUARD_BAND;
+  BatchRenderer renderer(m_engine, render_size, render_size);
+  // Each tile would fit its shadow cascades to its own frustum, which would
+  // seam, so shadows are pinned off
+  renderer.set_shadows_enabled(false);
+  const auto frustum =
+    CameraFrustum::perspective(double(i_width) / i_height);
+  const TrackballCamera camera;
+  for (uint32_t row = 0; row < writer.rows(); ++row)
+  {
+    for (uint32_t column = 0; column < writer.columns(); ++column)
+    {
+      // Tiles on the right and bottom edges overhang the poster, and the
+      // overhang is cropped by readers of the TIFF
+      const auto guard = static_cast<int32_t>(GUARD_BAND);
+      renderer.set_frustum(
+        frustum.tile(static_cast<int32_t>(column * m_tile_size) - guard,
+                     static_cast<int32_t>(row * m_tile_size) - guard,
+                     render_size,
+                     render_size,
+                     i_width,
+                     i_height));
+      renderer.render_view(
+        scene,
+        camera,
+        [&writer, column, row](
+          const uint8_t* i_rgba, uint32_t i_render_width, uint32_t) {
+          // Written straight from the readback buffer, without the guard
+          // band, whose rows also count from the bottom
+          const auto tile =
+            i_rgba + (uint64_t(GUARD_BAND) * i_render_width + GUARD_BAND) * 4;
+          const bool written =
+            writer.write_tile(column, row, tile, i_render_width);
+          return std::function<bool()>([written] { return written; });
+        });
+      ++report.tiles;
+    }
+  }
+  renderer.wait();
+  report.written = writer.close();
+  report.render_ms = elapsed_ms(render_start);
+  report.total_ms = elapsed_ms(start);
+  return report;
+}
+
+std::ostream& operator<<(std::ostream& io_os, const PosterReport& i_report)
+{
+  return io_os << std::fixed << std::setprecision(2) << i_report.width << 'x'
+               << i_report.height << " in " << i_report.tiles << ' '
+               << i_report.tile_size << "px tiles, "
+               << (i_report.written ? "" : "failed to write, ") << "loaded in "
+               << i_report.load_ms << " ms, rendered in " << i_report.render_ms
+               << " ms, "
+               << megapixels_per_second(i_report, i_report.render_ms)
+               << " megapixels per second, "
+               << megapixels_per_second(i_report, i_report.total_ms)
+               << " including the load";
+}
+
+QJsonObject to_json(const PosterReport& i_report)
+{
+  QJsonObject report;
+  report["width"] = static_cast<double>(i_report.width);
+  report["height"] = static_cast<double>(i_report.height);
+  report["tile_size"] = static_cast<double>(i_report.tile_size);
+  report["tiles"] = static_cast<double>(i_report.tiles);
+  report["written"] = i_report.written;
+  report["load_ms"] = i_report.load_ms;
+  report["render_ms"] = i_report.render_ms;
+  report["total_ms"] = i_report.total_ms;
+  report["megapixels_per_second"] =
+    megapixels_per_second(i_report, i_report.render_ms);
+  report["total_megapixels_per_second"] =
+    megapixels_per_second(i_report, i_report.total_ms);
+  return report;
+}
@@ -0,0 +1,161 @@
+#include "profiler.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+
+namespace
+{
+// Each thread caches a pointer to its buffer, buffers live as long as the
+// profiler so this never dangles
+thread_local void* t_buffer = nullptr;
+}  // namespace
+
+constexpr std::size_t Profiler::CAPACITY;
+
+Profiler::Profiler() : m_epoch(clock::now())
+{
+}
+
+Profiler& Profiler::global()
+{
+  static Profiler profiler;
+  return profiler;
+}
+
+void Profiler::set_enabled(bool i_enabled) noexcept
+{
+  m_enabled.store(i_enabled, std::memory_order_relaxed);
+}
+
+bool Profiler::enabled() const noexcept
+{
+  return m_enabled.load(std::memory_order_relaxed);
+}
+
+void Profiler::set_thread_name(std::string i_name)
+{
+  auto& buffer = thread_buffer();
+  std::lock_guard<std::mutex> lock(m_buffers_mutex);
+  buffer.name = std::move(i_name);
+}
+
+Profiler::ThreadBuffer& Profiler::thread_buffer()
+{
+  if (!t_buffer)
+  {
+    // Only taken once per thread
+    std::lock_guard<std::mutex> lock(m_buffers_mutex);
+    m_buffers.push_back(std::make_unique<ThreadBuffer>());
+    auto& buffer = *m_buffers.back();
+    buffer.id = static_cast<uint32_t>(m_buffers.size());
+    buffer.name = "thread " + std::to_string(buffer.id);
+    t_buffer = &buffer;
+  }
+  return *static_cast<ThreadBuffer*>(t_buffer);
+}
+
+void Profiler::record(const char* i_name,
+                      clock::time_point i_begin,
+                      clock::time_point i_end) noexcept
+{
+  using std::chrono::duration_cast;
+  using std::chrono::nanoseconds;
+  auto& buffer = thread_buffer();
+  const auto head = buffer.head.load(std::memory_order_relaxed);
+  auto& event = buffer.events[head % CAPACITY];
+  event.name.store(i_name, std::memory_order_relaxed);
+  event.begin_ns.store(duration_cast<nanoseconds>(i_begin - m_epoch).count(),
+                       std::memory_order_relaxed);
+  event.end_ns.store(duration_cast<nanoseconds>(i_end - m_epoch).count(),
+                     std::memory_order_relaxed);
+  // Publish the event to readers
+  buffer.head.store(head + 1, std::memory_order_release);
+}
+
+std::vector<Profiler::ThreadRecords> Profiler::collect() const
+{
+  std::lock_guard<std::mutex> lock(m_buffers_mutex);
+  std::vector<ThreadRecords> threads;
+  threads.reserve(m_buffers.size());
+  for (const auto& buffer : m_buffers)
+  {
+    const auto head = buffer->head.load(std::memory_order_acquire);
+    const auto first = head > CAPACITY ? head - CAPACITY : 0;
+    std::vector<Record> records;
+    records.reserve(head - first);
+    for (auto i = first; i < head; ++i)
+    {
+      const auto& event = buffer->events[i % CAPACITY];
+      records.push_back({event.name.load(std::memory_order_relaxed),
+                         event.begin_ns.load(std::memory_order_relaxed),
+                         event.end_ns.load(std::memory_order_relaxed)});
+    }
+    // Discard any events the thread overwrote while we were reading,
+    // including the slot of an event it may be part way through writing
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const auto new_head = buffer->head.load(std::memory_order_relaxed) + 1;
+    const auto overwritten =
+      new_head > CAPACITY ? std::min(new_head - CAPACITY, head) : 0;
+    if (overwritten > first)
+      records.erase(records.begin(), records.begin() + (overwritten - first));
+    threads.push_back({buffer->id, buffer->name, std::move(records)});
+  }
+  return threads;
+}
+
+std::map<std::string, FrameStats> Profiler::summarize() const
+{
+  std::map<std::string, std::vector<double>> durations;
+  for (const auto& thread : collect())
+    for (const auto& record : thread.records)
+      durations[record.name].push_back((record.end_ns - record.begin_ns) *
+                                       1e-6);
+
+  std::map<std::string, FrameStats> stats;
+  for (auto& scope : durations)
+    stats[scope.first] = summarize_frame_times(std::move(scope.second));
+  return stats;
+}
+
+bool Profiler::write_chrome_trace(const QString& i_path) const
+{
+  const auto pid = static_cast<double>(QCoreApplication::applicationPid());
+  QJsonArray events;
+  for (const auto& thread : collect())
+  {
+    // Metadata so the viewer shows our thread names
+    QJsonObject thread_name;
+    thread_name["name"] = "thread_name";
+    thread_name["ph"] = "M";
+    thread_name["pid"] = pid;
+    thread_name["tid"] = static_cast<int>(thread.id);
+    thread_name["args"] =
+      QJsonObject{{"name", QString::fromStdString(thread.name)}};
+    events.append(thread_name);
+
+    for (const auto& record : thread.records)
+    {
+      // Complete events, with times in microseconds
+      QJsonObject event;
+      event["name"] = record.name;
+      event["ph"] = "X";
+      event["pid"] = pid;
+      event["tid"] = static_cast<int>(thread.id);
+      event["ts"] = record.begin_ns * 1e-3;
+      event["dur"] = (record.end_ns - record.begin_ns) * 1e-3;
+      events.append(event);
+    }
+  }
+
+  QFile file(i_path);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    return false;
+  QJsonObject trace;
+  trace["traceEvents"] = events;
+  trace["displayTimeUnit"] = "ms";
+  file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact));
+  return true;
+}
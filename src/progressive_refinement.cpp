@@ -0,0 +1,104 @@
+#include "progressive_refinement.h"
+#include <algorithm>
+
+namespace
+{
+// Fraction of the tier's resolution rendered while the camera moves
+constexpr float MOTION_SCALE = 0.5f;
+// Lowest weight given to a new frame, so the history still follows changes
+// the accumulation isn't told about
+constexpr float MIN_FEEDBACK = 0.02f;
+}  // namespace
+
+ProgressiveRefinement::ProgressiveRefinement(uint32_t i_frames)
+{
+  set_frames(i_frames);
+}
+
+void ProgressiveRefinement::set_frames(uint32_t i_frames) noexcept
+{
+  m_frames = i_frames;
+  m_accumulated = 0;
+  // The camera starts at rest
+  m_phase = enabled() ? REFINING : INTERACTIVE;
+}
+
+bool ProgressiveRefinement::enabled() const noexcept
+{
+  return m_frames > 0;
+}
+
+bool ProgressiveRefinement::camera_moved() noexcept
+{
+  if (!enabled() || m_phase == INTERACTIVE)
+    return false;
+  m_phase = INTERACTIVE;
+  return true;
+}
+
+bool ProgressiveRefinement::camera_idle() noexcept
+{
+  if (!enabled() || m_phase != INTERACTIVE)
+    return false;
+  m_phase = REFINING;
+  m_accumulated = 0;
+  return true;
+}
+
+void ProgressiveRefinement::restart() noexcept
+{
+  if (m_phase == INTERACTIVE)
+    return;
+  m_phase = REFINING;
+  m_accumulated = 0;
+}
+
+void ProgressiveRefinement::prepare_frame(filament::View& io_view) const
+{
+  if (m_phase != REFINING)
+    return;
+  // The first frame replaces the history, which was drawn at motion quality
+  filament::View::TemporalAntiAliasingOptions accumulation;
+  accumulation.enabled = true;
+  accumulation.feedback =
+    std::max(1.f / static_cast<float>(m_accumulated + 1), MIN_FEEDBACK);
+  io_view.setTemporalAntiAliasingOptions(accumulation);
+}
+
+bool ProgressiveRefinement::frame_drawn() noexcept
+{
+  if (m_phase != REFINING)
+    return false;
+  if (++m_accumulated >= m_frames)
+    m_phase = CONVERGED;
+  return m_phase == REFINING;
+}
+
+ProgressiveRefinement::PHASE ProgressiveRefinement::phase() const noexcept
+{
+  return m_phase;
+}
+
+void ProgressiveRefinement::apply(filament::View& io_view,
+                                  const QualityGovernor::Tier& i_tier) const
+{
+  // Still images start from full quality, moving ones from the governed tier
+  auto tier = m_phase == INTERACTIVE ? i_tier : QualityGovernor::tiers()[0];
+  filament::View::TemporalAntiAliasingOptions accumulation;
+  if (enabled() && m_phase == INTERACTIVE)
+  {
+    // Nothing stays on screen long enough to be worth the detail
+    tier.resolution_scale *= MOTION_SCALE;
+    tier.anti_aliasing = filament::View::AntiAliasing::NONE;
+    tier.shadows = false;
+    tier.quality = filament::View::QualityLevel::LOW;
+  }
+  else if (enabled())
+  {
+    // The jittered accumulation anti-aliases far better than FXAA
+    tier.anti_aliasing = filament::View::AntiAliasing::NONE;
+    accumulation.enabled = true;
+  }
+  io_view.setTemporalAntiAliasingOptions(accumulation);
+  QualityGovernor::apply_tier(tier, io_view);
+}
@@ -0,0 +1,193 @@
+#include "quality_governor.h"
+#include <QJsonObject>
+#include <algorithm>
+#include <iomanip>
+
+namespace
+{
+using AntiAliasing = filament::View::AntiAliasing;
+using QualityLevel = filament::View::QualityLevel;
+
+// Frames averaged before each decision
+constexpr uint32_t WINDOW_FRAMES = 30;
+// Frames ignored after a change, while new render targets are allocated
+constexpr uint32_t SETTLING_FRAMES = 30;
+// Drop a tier when the mean is over budget, raise it when there is plenty of
+// headroom, as the next tier up costs more than this one
+constexpr double DROP_RATIO = 1.0;
+constexpr double RAISE_RATIO = 0.7;
+// Windows of headroom needed before raising in to a tier, doubled each time
+// that tier has to be dropped straight after being raised in to
+constexpr uint32_t RAISE_WINDOWS = 4;
+constexpr uint32_t MAX_RAISE_WINDOWS = 256;
+// How soon a drop must follow a raise to count against the raised tier
+constexpr uint64_t PROBATION_FRAMES =
+  SETTLING_FRAMES + 4 * static_cast<uint64_t>(WINDOW_FRAMES);
+}  // namespace
+
+QualityGovernor::QualityGovernor(double i_target_fps)
+  : m_raise_windows(tiers().size(), RAISE_WINDOWS)
+{
+  set_target_fps(i_target_fps);
+}
+
+const std::vector<QualityGovernor::Tier>& QualityGovernor::tiers()
+{
+  // Resolution goes first as it costs the least to look at, post-processing
+  // last as it also takes anti-aliasing and tone mapping with it
+  static const std::vector<Tier> tiers = {
+    {"ultra", 1.f, AntiAliasing::FXAA, true, true, QualityLevel::ULTRA},
+    {"high", 1.f, AntiAliasing::FXAA, true, true, QualityLevel::HIGH},
+    {"85% resolution",
+     .85f,
+     AntiAliasing::FXAA,
+     true,
+     true,
+     QualityLevel::HIGH},
+    {"70% resolution",
+     .7f,
+     AntiAliasing::FXAA,
+     true,
+     true,
+     QualityLevel::HIGH},
+    {"no anti-aliasing",
+     .7f,
+     AntiAliasing::NONE,
+     true,
+     true,
+     QualityLevel::HIGH},
+    {"no shadows", .7f, AntiAliasing::NONE, false, true, QualityLevel::MEDIUM},
+    {"50% resolution", .5f, AntiAliasing::NONE, false, true, QualityLevel::LOW},
+    {"no post-processing",
+     .5f,
+     AntiAliasing::NONE,
+     false,
+     false,
+     QualityLevel::LOW}};
+  return tiers;
+}
+
+void QualityGovernor::set_target_fps(double i_target_fps)
+{
+  m_budget_ms = i_target_fps > 0.0 ? 1000.0 / i_target_fps : 0.0;
+  m_tier = 0;
+  m_settling = 0;
+  m_window_frames = 0;
+  m_window_ms = 0.0;
+  m_headroom_windows = 0;
+  m_raised_frame = 0;
+  std::fill(m_raise_windows.begin(), m_raise_windows.end(), RAISE_WINDOWS);
+}
+
+bool QualityGovernor::add_frame(double i_frame_ms)
+{
+  ++m_frame;
+  if (m_budget_ms <= 0.0)
+    return false;
+  // Frames drawn while a change takes effect aren't representative
+  if (m_settling)
+  {
+    --m_settling;
+    return false;
+  }
+  m_window_ms += i_frame_ms;
+  if (++m_window_frames < WINDOW_FRAMES)
+    return false;
+  const double mean_ms = m_window_ms / m_window_frames;
+  m_window_frames = 0;
+  m_window_ms = 0.0;
+
+  if (mean_ms > m_budget_ms * DROP_RATIO && m_tier + 1 < tiers().size())
+  {
+    // The tier we just raised to was too much, so give it longer next time
+    if (m_raised_frame && m_tier == m_raised_tier &&
+        m_frame - m_raised_frame < PROBATION_FRAMES)
+      m_raise_windows[m_tier] =
+        std::min(m_raise_windows[m_tier] * 2, MAX_RAISE_WINDOWS);
+    return change(m_tier + 1, mean_ms);
+  }
+  if (mean_ms < m_budget_ms * RAISE_RATIO && m_tier > 0)
+  {
+    if (++m_headroom_windows < m_raise_windows[m_tier - 1])
+      return false;
+    m_raised_frame = m_frame;
+    m_raised_tier = m_tier - 1;
+    return change(m_tier - 1, mean_ms);
+  }
+  m_headroom_windows = 0;
+  return false;
+}
+
+std::size_t QualityGovernor::tier() const noexcept
+{
+  return m_tier;
+}
+
+void QualityGovernor::apply(filament::View& io_view) const
+{
+  apply_tier(tiers()[m_tier], io_view);
+}
+
+void QualityGovernor::apply_tier(const Tier& i_tier, filament::View& io_view)
+{
+  // Pin the scale, rather than letting the view choose its own
+  filament::View::DynamicResolutionOptions resolution;
+  resolution.enabled = i_tier.resolution_scale < 1.f;
+  resolution.minScale = i_tier.resolution_scale;
+  resolution.maxScale = i_tier.resolution_scale;
+  io_view.setDynamicResolutionOptions(resolution);
+  io_view.setAntiAliasing(i_tier.anti_aliasing);
+  io_view.setShadowingEnabled(i_tier.shadows);
+  io_view.setPostProcessingEnabled(i_tier.post_processing);
+  io_view.setRenderQuality({i_tier.quality});
+}
+
+const std::vector<QualityGovernor::Decision>&
+QualityGovernor::decisions() const noexcept
+{
+  return m_decisions;
+}
+
+double QualityGovernor::budget_ms() const noexcept
+{
+  return m_budget_ms;
+}
+
+bool QualityGovernor::change(std::size_t i_tier, double i_mean_ms)
+{
+  m_decisions.push_back({m_frame, m_tier, i_tier, i_mean_ms, m_budget_ms});
+  m_tier = i_tier;
+  m_settling = SETTLING_FRAMES;
+  m_headroom_windows = 0;
+  return true;
+}
+
+std::ostream& operator<<(std::ostream& io_os,
+                         const QualityGovernor::Decision& i_decision)
+{
+  const auto& tiers = QualityGovernor::tiers();
+  return io_os << std::fixed << std::setprecision(2) << "tier "
+               << i_decision.from << " (" << tiers[i_decision.from].name
+               << ") to " << i_decision.to << " ("
+               << tiers[i_decision.to].name << ") at frame "
+               << i_decision.frame << ", mean " << i_decision.mean_ms
+               << " ms against a " << i_decision.budget_ms << " ms budget";
+}
+
+QJsonArray to_json(const std::vector<QualityGovernor::Decision>& i_decisions)
+{
+  const auto& tiers = QualityGovernor::tiers();
+  QJsonArray decisions;
+  for (const auto& decision : i_decisions)
+  {
+    QJsonObject object;
+    object["frame"] = static_cast<double>(decision.frame);
+    object["from"] = static_cast<int>(decision.from);
+    object["to"] = static_cast<int>(decision.to);
+    object["tier"] = tiers[decision.to].name;
+    object["mean_ms"] = decision.mean_ms;
+    object["budget_ms"] = decision.budget_ms;
+    decisions.append(object);
+  }
+  return decisions;
+}
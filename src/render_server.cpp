@@ -0,0 +1,530 @@
+#include "render_server.h"
+#include "asset_loader.h"
+#include "batch_job.h"
+#include "batch_renderer.h"
+#include "pbr_scene.h"
+#include "profiler.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QImageWriter>
+#include <QJsonDocument>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QPointer>
+#include <QTimer>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+namespace
+{
+using TimePoint = std::chrono::steady_clock::time_point;
+
+// Most offscreen targets kept, one per image size
+constexpr std::size_t MAX_TARGETS = 4;
+// How often loads and readbacks in flight are checked on. Jobs are also moved
+// on as soon as they arrive, and as soon as their images are written.
+constexpr int PUMP_MS = 5;
+
+double ms_between(TimePoint i_start, TimePoint i_end)
+{
+  return std::chrono::duration<double, std::milli>(i_end - i_start).count();
+}
+
+// A scene kept loaded between jobs
+struct CachedScene
+{
+  std::unique_ptr<PbrScene> scene;
+  // Present until the scene has finished loading
+  std::unique_ptr<AssetLoader> loader;
+  // Why the scene failed to load, empty if it didn't
+  std::string error;
+  TimePoint ready;
+  // Jobs waiting for or drawing this scene
+  std::size_t jobs = 0;
+  uint64_t last_used = 0;
+};
+
+// A job which hasn't been answered yet
+struct Job
+{
+  // Null once the client has disconnected
+  QPointer<QLocalSocket> client;
+  QJsonValue id;
+  std::string scene_key;
+  BatchJob::Orbit camera;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  QString output;
+  std::string format;
+  // Jobs already in flight when this one arrived
+  std::size_t queue_depth = 0;
+  TimePoint received;
+  TimePoint loaded;
+  TimePoint render_begin;
+  TimePoint render_end;
+};
+
+// Images written, or which failed to be, reported by the workers
+struct Writes
+{
+  std::mutex mutex;
+  std::vector<std::pair<uint64_t, bool>> done;
+};
+
+// Running totals of every stage, over every job answered
+struct Totals
+{
+  std::size_t jobs = 0;
+  std::size_t failed = 0;
+  std::size_t cache_hits = 0;
+  std::size_t cache_misses = 0;
+  std::size_t max_queue_depth = 0;
+  double load_ms = 0.0;
+  double wait_ms = 0.0;
+  double render_ms = 0.0;
+  double encode_ms = 0.0;
+  double total_ms = 0.0;
+};
+}  // namespace
+
+// Private state of the render server
+struct RenderServer::RenderServerImpl
+{
+  RenderServerImpl(std::shared_ptr<filament::Engine> i_engine,
+                   std::size_t i_cache_size);
+
+  // Queue every complete line received from a client
+  void read(QLocalSocket& io_client);
+
+  // Parse a job and start loading its scene if it isn't cached
+  void receive(QLocalSocket& io_client, const QJsonObject& i_request);
+
+  // Move every job on as far as it can go, on the engine thread
+  void pump();
+
+  // Pump from the engine thread's event loop as soon as it's free, safe to
+  // call from any thread
+  void wake();
+
+  // Finalize loaded scenes, and upload all of their textures
+  void pump_loads();
+
+  // Draw every job whose scene is ready, in the order they arrived
+  void pump_renders();
+
+  // Answer every job whose image has been written
+  void pump_writes();
+
+  // Drop the least recently used scenes no job needs, beyond the cache size
+  void evict();
+
+  // The offscreen target for an image size, created on first use
+  BatchRenderer& target(uint32_t i_width, uint32_t i_height);
+
+  // Send the result of a job to its client, and forget it
+  void answer(uint64_t i_job, bool i_written, const std::string& i_error);
+
+  QJsonObject stats() const;
+
+  // Store a shared pointer to the engine, all of our entities will also store
+  std::shared_ptr<filament::Engine> engine;
+  std::size_t cache_size;
+  uint64_t next_job = 0;
+  uint64_t use_count = 0;
+
+  std::map<std::string, CachedScene> scenes;
+  std::map<uint64_t, Job> jobs;
+  // Jobs which haven't been drawn yet, in the order they arrived
+  std::deque<uint64_t> waiting;
+  // Declared before the targets, whose writes report in to it and wake the
+  // pump until they're destroyed
+  Writes writes;
+  QTimer pump_timer;
+  std::map<std::pair<uint32_t, uint32_t>, std::unique_ptr<BatchRenderer>>
+    targets;
+  Totals totals;
+
+  std::unique_ptr<QLocalServer> server;
+};
+
+RenderServer::RenderServerImpl::RenderServerImpl(
+  std::shared_ptr<filament::Engine> i_engine, std::size_t i_cache_size)
+  : engine(std::move(i_engine))
+  , cache_size(std::max(i_cache_size, std::size_t{1}))
+  , server(std::make_unique<QLocalServer>())
+{
+  pump_timer.setInterval(PUMP_MS);
+  QObject::connect(&pump_timer, &QTimer::timeout, [this] { pump(); });
+  QObject::connect(server.get(), &QLocalServer::newConnection, [this] {
+    while (auto client = server->nextPendingConnection())
+    {
+      QObject::connect(client, &QLocalSocket::readyRead, client, [=] {
+        read(*client);
+      });
+      QObject::connect(client,
+                       &QLocalSocket::disconnected,
+                       client,
+                       &QObject::deleteLater);
+    }
+  });
+}
+
+void RenderServer::RenderServerImpl::read(QLocalSocket& io_client)
+{
+  while (io_client.canReadLine())
+  {
+    const auto line = io_client.readLine().trimmed();
+    if (line.isEmpty())
+      continue;
+    QJsonParseError error;
+    const auto document = QJsonDocument::fromJson(line, &error);
+    if (!document.isObject())
+    {
+      QJsonObject reply;
+      reply["ok"] = false;
+      reply["error"] = "Failed to parse request: " + error.errorString();
+      io_client.write(QJsonDocument(reply).toJson(QJsonDocument::Compact) +
+                      '\n');
+      continue;
+    }
+    const auto request = document.object();
+    if (request["stats"].toBool())
+    {
+      io_client.write(QJsonDocument(stats()).toJson(QJsonDocument::Compact) +
+                      '\n');
+      continue;
+    }
+    receive(io_client, request);
+  }
+}
+
+void RenderServer::RenderServerImpl::receive(QLocalSocket& io_client,
+                                             const QJsonObject& i_request)
+{
+  const auto id = next_job++;
+  auto& job = jobs[id];
+  job.client = &io_client;
+  job.id = i_request["id"];
+  job.received = std::chrono::steady_clock::now();
+  job.queue_depth = jobs.size() - 1;
+  totals.max_queue_depth = std::max(totals.max_queue_depth, job.queue_depth);
+
+  // Manifests and imports are cached by path
+  const auto scene = i_request["scene"].toString().toStdString();
+  const auto import = i_request["import"].toString().toStdString();
+  job.scene_key = !scene.empty()    ? "scene:" + scene
+                  : !import.empty() ? "import:" + import
+                                    : "default";
+  SceneManifest manifest;
+  const bool cached_scene = scenes.count(job.scene_key) != 0;
+  try
+  {
+    job.output = i_request["output"].toString();
+    if (job.output.isEmpty())
+      throw std::runtime_error("No output path given");
+    job.format = QFileInfo(job.output).suffix().toLower().toStdString();
+    if (job.format.empty())
+      job.format = "png";
+    if (!QImageWriter::supportedImageFormats().contains(job.format.c_str()))
+      throw std::runtime_error("Unsupported image format " + job.format);
+    const auto size = i_request["size"].toArray();
+    job.width = size.size() == 2 ? std::max(size[0].toInt(), 1) : 256;
+    job.height = size.size() == 2 ? std::max(size[1].toInt(), 1) : 256;
+    job.camera = BatchJob::load_orbit(i_request["camera"].toObject());
+    // Only read the manifest when it isn't loaded, throws if it can't be
+    if (!cached_scene)
+      manifest = BatchJob::load_asset(i_request).manifest;
+  }
+  catch (const std::exception& e)
+  {
+    job.scene_key.clear();
+    answer(id, false, e.what());
+    return;
+  }
+
+  auto& cached = scenes[job.scene_key];
+  ++cached.jobs;
+  cached.last_used = ++use_count;
+  if (cached_scene)
+  {
+    ++totals.cache_hits;
+  }
+  else
+  {
+    ++totals.cache_misses;
+    ScopedTimer timer("begin scene load");
+    cached.scene = std::make_unique<PbrScene>(engine);
+    cached.loader = std::make_unique<AssetLoader>();
+    cached.scene->init_async(*cached.loader, manifest);
+  }
+  waiting.push_back(id);
+  if (!pump_timer.isActive())
+    pump_timer.start();
+  wake();
+}
+
+void RenderServer::RenderServerImpl::wake()
+{
+  // Posted events for the timer are dropped along with it
+  QMetaObject::invokeMethod(
+    &pump_timer, [this] { pump(); }, Qt::QueuedConnection);
+}
+
+void RenderServer::RenderServerImpl::pump()
+{
+  pump_loads();
+  pump_renders();
+  pump_writes();
+  evict();
+  if (jobs.empty())
+    pump_timer.stop();
+}
+
+void RenderServer::RenderServerImpl::pump_loads()
+{
+  for (auto& entry : scenes)
+  {
+    auto& cached = entry.second;
+    if (!cached.loader)
+      continue;
+    cached.loader->pump();
+    if (cached.loader->pending())
+      continue;
+    if (cached.loader->failed())
+    {
+      cached.error = "Failed to load " + entry.first;
+    }
+    else
+    {
+      // Upload every texture level up front, as each job draws one frame
+      ScopedTimer timer("upload scene");
+      cached.scene->set_upload_budget(0);
+      cached.scene->stream_textures();
+      cached.scene->update_transforms(0.0);
+    }
+    cached.loader.reset();
+    cached.ready = std::chrono::steady_clock::now();
+  }
+}
+
+void RenderServer::RenderServerImpl::pump_renders()
+{
+  for (auto it = waiting.begin(); it != waiting.end();)
+  {
+    auto& job = jobs.at(*it);
+    auto& cached = scenes.at(job.scene_key);
+    // Later jobs whose scenes are ready aren't held up by this one
+    if (cached.loader)
+    {
+      ++it;
+      continue;
+    }
+    const auto id = *it;
+    it = waiting.erase(it);
+    job.loaded = std::max(job.received, cached.ready);
+    if (!cached.error.empty())
+    {
+      answer(id, false, cached.error);
+      continue;
+    }
+    job.render_begin = std::chrono::steady_clock::now();
+    QDir().mkpath(QFileInfo(job.output).absolutePath());
+    target(job.width, job.height)
+      .render_view(*cached.scene,
+                   job.camera.camera(),
+                   job.output,
+                   job.format,
+                   [this, id](bool i_written) {
+                     {
+                       std::lock_guard<std::mutex> lock(writes.mutex);
+                       writes.done.emplace_back(id, i_written);
+                     }
+                     wake();
+                   });
+    job.render_end = std::chrono::steady_clock::now();
+  }
+}
+
+void RenderServer::RenderServerImpl::pump_writes()
+{
+  std::vector<std::pair<uint64_t, bool>> done;
+  {
+    std::lock_guard<std::mutex> lock(writes.mutex);
+    done.swap(writes.done);
+  }
+  for (const auto& write : done)
+    answer(write.first,
+           write.second,
+           write.second ? "" : "Failed to write the image");
+}
+
+void RenderServer::RenderServerImpl::evict()
+{
+  // Destroying a scene releases engine objects, so wait until nothing is
+  // being created by a load in flight
+  if (std::any_of(scenes.begin(), scenes.end(), [](const auto& i_entry) {
+        return i_entry.second.loader != nullptr;
+      }))
+    return;
+  while (scenes.size() > cache_size ||
+         std::any_of(scenes.begin(), scenes.end(), [](const auto& i_entry) {
+           return !i_entry.second.error.empty() && !i_entry.second.jobs;
+         }))
+  {
+    // Failed scenes go first, so the next job for them tries again
+    auto victim = scenes.end();
+    for (auto it = scenes.begin(); it != scenes.end(); ++it)
+    {
+      const auto& cached = it->second;
+      if (cached.jobs || cached.loader)
+        continue;
+      if (!cached.error.empty())
+      {
+        victim = it;
+        break;
+      }
+      if (victim == scenes.end() ||
+          cached.last_used < victim->second.last_used)
+        victim = it;
+    }
+    if (victim == scenes.end())
+      return;
+    scenes.erase(victim);
+  }
+}
+
+BatchRenderer& RenderServer::RenderServerImpl::target(uint32_t i_width,
+                                                      uint32_t i_height)
+{
+  auto& renderer = targets[{i_width, i_height}];
+  if (!renderer)
+  {
+    // Drop the other sizes rather than growing without bound, which waits
+    // for their images to be written
+    if (targets.size() > MAX_TARGETS)
+    {
+      for (auto it = targets.begin(); it != targets.end();)
+      {
+        if (it->second)
+          it = targets.erase(it);
+        else
+          ++it;
+      }
+    }
+    renderer = std::make_unique<BatchRenderer>(engine, i_width, i_height);
+  }
+  return *renderer;
+}
+
+void RenderServer::RenderServerImpl::answer(uint64_t i_job,
+                                            bool i_written,
+                                            const std::string& i_error)
+{
+  auto it = jobs.find(i_job);
+  if (it == jobs.end())
+    return;
+  const auto& job = it->second;
+  const auto now = std::chrono::steady_clock::now();
+  QJsonObject reply;
+  reply["id"] = job.id;
+  reply["ok"] = i_written;
+  if (!i_error.empty())
+    reply["error"] = QString::fromStdString(i_error);
+  reply["output"] = job.output;
+  reply["queue_depth"] = static_cast<double>(job.queue_depth);
+  // Stages the job never reached are left out
+  const bool loaded = job.loaded != TimePoint{};
+  const bool rendered = job.render_end != TimePoint{};
+  if (loaded)
+    reply["load_ms"] = ms_between(job.received, job.loaded);
+  if (rendered)
+  {
+    reply["wait_ms"] = ms_between(job.loaded, job.render_begin);
+    reply["render_ms"] = ms_between(job.render_begin, job.render_end);
+    reply["encode_ms"] = ms_between(job.render_end, now);
+  }
+  reply["total_ms"] = ms_between(job.received, now);
+
+  ++totals.jobs;
+  totals.failed += !i_written;
+  if (loaded)
+    totals.load_ms += ms_between(job.received, job.loaded);
+  if (rendered)
+  {
+    totals.wait_ms += ms_between(job.loaded, job.render_begin);
+    totals.render_ms += ms_between(job.render_begin, job.render_end);
+    totals.encode_ms += ms_between(job.render_end, now);
+  }
+  totals.total_ms += ms_between(job.received, now);
+
+  std::cout << std::fixed << std::setprecision(2) << "Job "
+            << job.id.toVariant().toString().toStdString() << ' '
+            << (i_written ? "written to " : "failed, ")
+            << (i_written ? job.output.toStdString() : i_error) << " in "
+            << ms_between(job.received, now) << " ms, " << job.queue_depth
+            << " ahead of it" << std::endl;
+  if (job.client)
+    job.client->write(QJsonDocument(reply).toJson(QJsonDocument::Compact) +
+                      '\n');
+  if (!job.scene_key.empty())
+    --scenes.at(job.scene_key).jobs;
+  jobs.erase(it);
+}
+
+QJsonObject RenderServer::RenderServerImpl::stats() const
+{
+  const auto mean = [this](double i_ms) {
+    return totals.jobs ? i_ms / totals.jobs : 0.0;
+  };
+  std::size_t loading = 0;
+  for (const auto& entry : scenes)
+    loading += entry.second.loader != nullptr;
+  QJsonObject stats;
+  stats["jobs"] = static_cast<double>(totals.jobs);
+  stats["failed"] = static_cast<double>(totals.failed);
+  stats["in_flight"] = static_cast<double>(jobs.size());
+  stats["queue_depth"] = static_cast<double>(waiting.size());
+  stats["max_queue_depth"] = static_cast<double>(totals.max_queue_depth);
+  stats["cached_scenes"] = static_cast<double>(scenes.size() - loading);
+  stats["loading_scenes"] = static_cast<double>(loading);
+  stats["cache_hits"] = static_cast<double>(totals.cache_hits);
+  stats["cache_misses"] = static_cast<double>(totals.cache_misses);
+  stats["mean_load_ms"] = mean(totals.load_ms);
+  stats["mean_wait_ms"] = mean(totals.wait_ms);
+  stats["mean_render_ms"] = mean(totals.render_ms);
+  stats["mean_encode_ms"] = mean(totals.encode_ms);
+  stats["mean_total_ms"] = mean(totals.total_ms);
+  return stats;
+}
+
+RenderServer::RenderServer(std::shared_ptr<filament::Engine> i_engine,
+                           std::size_t i_cache_size)
+  // The timer and server can't be moved so construct our state in place
+  : m_impl(nonstd::in_place, std::move(i_engine), i_cache_size)
+{
+}
+
+RenderServer::~RenderServer() = default;
+
+void RenderServer::listen(const QString& i_name)
+{
+  QLocalServer::removeServer(i_name);
+  if (!m_impl->server->listen(i_name))
+    throw std::runtime_error("Failed to listen on " + i_name.toStdString() +
+                             ": " +
+                             m_impl->server->errorString().toStdString());
+  std::cout << "Listening on " << m_impl->server->fullServerName().toStdString()
+            << std::endl;
+}
+
+QJsonObject RenderServer::stats() const
+{
+  return m_impl->stats();
+}
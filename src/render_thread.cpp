@@ -0,0 +1,96 @@
+#include "render_thread.h"
+#include "profiler.h"
+#include <future>
+#include <stdexcept>
+
+RenderThread::RenderThread() : m_thread([this] { loop(); })
+{
+}
+
+RenderThread::~RenderThread()
+{
+  m_stop = true;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+  }
+  m_condition.notify_one();
+  m_thread.join();
+}
+
+std::shared_ptr<filament::Engine>
+RenderThread::create_engine(const std::shared_ptr<RenderThread>& i_render_thread,
+                            filament::Engine::Backend i_backend)
+{
+  filament::Engine* engine = nullptr;
+  i_render_thread->run_sync(
+    [&engine, i_backend] { engine = filament::Engine::create(i_backend); });
+  if (!engine)
+    throw std::runtime_error("Failed to create the rendering engine");
+  // Capture the render thread so it outlives the engine
+  return std::shared_ptr<filament::Engine>(
+    engine, [i_render_thread](filament::Engine* i_engine) {
+      i_render_thread->run_sync(
+        [&i_engine] { filament::Engine::destroy(&i_engine); });
+    });
+}
+
+void RenderThread::post(Command i_command)
+{
+  // The queue is bounded, if the render thread has fallen this far behind we
+  // have no choice but to wait for it
+  while (!m_commands.try_push(std::move(i_command)))
+    std::this_thread::yield();
+  // Only take the lock if the render thread may be asleep, the fence orders
+  // our push before reading the flag
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_sleeping.load())
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+    }
+    m_condition.notify_one();
+  }
+}
+
+void RenderThread::run_sync(Command i_command)
+{
+  if (is_current())
+  {
+    i_command();
+    return;
+  }
+  std::promise<void> done;
+  post([&i_command, &done] {
+    i_command();
+    done.set_value();
+  });
+  done.get_future().wait();
+}
+
+bool RenderThread::is_current() const noexcept
+{
+  return std::this_thread::get_id() == m_thread.get_id();
+}
+
+void RenderThread::loop()
+{
+  Profiler::global().set_thread_name("render");
+  Command command;
+  for (;;)
+  {
+    while (m_commands.try_pop(command))
+    {
+      command();
+      command = nullptr;
+    }
+    // Announce that we're going to sleep, then check again for commands that
+    // were posted before the producer could see the announcement
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_sleeping = true;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    m_condition.wait(lock, [this] { return m_stop || !m_commands.empty(); });
+    m_sleeping = false;
+    if (m_stop && m_commands.empty())
+      return;
+  }
+}
@@ -0,0 +1,161 @@
+#include "resource_registry.h"
+#include "profiler.h"
+#include <utils/EntityManager.h>
+
+ResourceRegistry::ResourceRegistry(std::shared_ptr<filament::Engine> i_engine)
+  : m_engine(std::move(i_engine))
+{
+}
+
+ResourceRegistry::~ResourceRegistry()
+{
+  for (uint32_t i = 0; i < m_slots.size(); ++i)
+  {
+    if (m_slots[i].alive)
+      release(i);
+  }
+  flush();
+}
+
+EntityHandle ResourceRegistry::adopt(utils::Entity i_entity)
+{
+  if (!i_entity)
+    return {};
+  const auto index = allocate();
+  m_slots[index].entity = i_entity;
+  return {index, m_slots[index].generation};
+}
+
+void ResourceRegistry::create(std::size_t i_count, EntityHandle* o_handles)
+{
+  std::vector<utils::Entity> entities(i_count);
+  utils::EntityManager::get().create(i_count, entities.data());
+  for (std::size_t i = 0; i < i_count; ++i)
+    o_handles[i] = adopt(entities[i]);
+}
+
+utils::Entity ResourceRegistry::get(EntityHandle i_handle) const noexcept
+{
+  if (i_handle.index >= m_slots.size())
+    return {};
+  const auto& slot = m_slots[i_handle.index];
+  return slot.alive && slot.generation == i_handle.generation
+           ? slot.entity
+           : utils::Entity{};
+}
+
+void ResourceRegistry::destroy(EntityHandle i_handle)
+{
+  if (get(i_handle))
+    release(i_handle.index);
+}
+
+void ResourceRegistry::destroy(const std::vector<utils::Entity>& i_entities)
+{
+  m_queued.entities.insert(
+    m_queued.entities.end(), i_entities.begin(), i_entities.end());
+}
+
+std::size_t ResourceRegistry::end_frame()
+{
+  if (!m_queued.entities.empty() || !m_queued.objects.empty())
+  {
+    m_queued.fence = m_engine->createFence();
+    m_retiring.push_back(std::move(m_queued));
+    m_queued = {};
+  }
+
+  std::size_t destroyed = 0;
+  // Fences are passed in order, so stop at the first that hasn't been
+  while (!m_retiring.empty() &&
+         m_retiring.front().fence->wait(filament::Fence::Mode::DONT_FLUSH,
+                                        0) ==
+           filament::Fence::FenceStatus::CONDITION_SATISFIED)
+  {
+    destroyed += destroy_batch(m_retiring.front());
+    m_retiring.pop_front();
+  }
+  return destroyed;
+}
+
+std::size_t ResourceRegistry::flush()
+{
+  std::size_t destroyed = 0;
+  if (!m_retiring.empty() || !m_queued.entities.empty() ||
+      !m_queued.objects.empty())
+  {
+    // Once the engine passes a new fence it has finished with everything
+    filament::Fence::waitAndDestroy(m_engine->createFence());
+    for (auto& batch : m_retiring)
+      destroyed += destroy_batch(batch);
+    m_retiring.clear();
+    destroyed += destroy_batch(m_queued);
+    m_queued = {};
+  }
+  return destroyed;
+}
+
+filament::Engine& ResourceRegistry::engine() const noexcept
+{
+  return *m_engine;
+}
+
+std::size_t ResourceRegistry::size() const noexcept
+{
+  return m_live;
+}
+
+std::size_t ResourceRegistry::pending() const noexcept
+{
+  std::size_t count = m_queued.entities.size() + m_queued.objects.size();
+  for (const auto& batch : m_retiring)
+    count += batch.entities.size() + batch.objects.size();
+  return count;
+}
+
+uint32_t ResourceRegistry::allocate()
+{
+  uint32_t index;
+  if (m_free.empty())
+  {
+    index = static_cast<uint32_t>(m_slots.size());
+    m_slots.emplace_back();
+  }
+  else
+  {
+    index = m_free.back();
+    m_free.pop_back();
+  }
+  m_slots[index].alive = true;
+  ++m_live;
+  return index;
+}
+
+void ResourceRegistry::release(uint32_t i_index)
+{
+  auto& slot = m_slots[i_index];
+  if (slot.object)
+    m_queued.objects.emplace_back(slot.object, slot.destroy);
+  else
+    m_queued.entities.push_back(slot.entity);
+  // The slot can be reused straight away, old handles no longer match it
+  slot = Slot{nullptr, nullptr, {}, slot.generation + 1, false};
+  m_free.push_back(i_index);
+  --m_live;
+}
+
+std::size_t ResourceRegistry::destroy_batch(Batch& io_batch)
+{
+  ScopedTimer timer("destroy resources");
+  if (io_batch.fence)
+    m_engine->destroy(io_batch.fence);
+  // Components first, as they may refer to the objects, then the entities in
+  // a single call
+  for (const auto entity : io_batch.entities)
+    m_engine->destroy(entity);
+  utils::EntityManager::get().destroy(io_batch.entities.size(),
+                                      io_batch.entities.data());
+  for (const auto& object : io_batch.objects)
+    object.second(*m_engine, object.first);
+  return io_batch.entities.size() + io_batch.objects.size();
+}
@@ -0,0 +1,483 @@
+#include "scene_importer.h"
+#include "mesh_importer.h"
+#include "profiler.h"
+#include "thread_pool.h"
+#include <QCryptographicHash>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace
+{
+// Bump this whenever the conversion changes, to invalidate cached scenes
+constexpr const char* IMPORT_VERSION = "qfp-scene-import-2";
+// Written to each scene's cache directory once its meshes are converted
+constexpr const char* DESCRIPTION_NAME = "scene.json";
+
+// Assimp matrices are row major, ours are column major
+filament::math::mat4f to_mat4f(const aiMatrix4x4& i_matrix)
+{
+  filament::math::mat4f matrix;
+  for (int column = 0; column < 4; ++column)
+  {
+    for (int row = 0; row < 4; ++row)
+      matrix[column][row] = i_matrix[row][column];
+  }
+  return matrix;
+}
+
+// Try each key in turn, as the metallic-roughness keys were renamed between
+// assimp versions
+bool get_float(const aiMaterial& i_material,
+               std::initializer_list<const char*> i_keys,
+               float& o_value)
+{
+  for (const auto key : i_keys)
+  {
+    if (i_material.Get(key, 0, 0, o_value) == AI_SUCCESS)
+      return true;
+  }
+  return false;
+}
+
+// What we take from a scene's material, which is all that needs caching
+struct Surface
+{
+  filament::math::float3 base_color{0.8f};
+  float metallic = 0.f;
+  float roughness = 0.5f;
+};
+
+// Read the surface of a material, clamped to the ranges our materials take
+Surface to_surface(const aiMaterial& i_material)
+{
+  // glTF's base color, falling back to the diffuse color of older formats
+  aiColor4D color(0.8f, 0.8f, 0.8f, 1.f);
+  if (i_material.Get("$clr.base", 0, 0, color) != AI_SUCCESS &&
+      i_material.Get(
+        "$mat.gltf.pbrMetallicRoughness.baseColorFactor", 0, 0, color) !=
+        AI_SUCCESS)
+    i_material.Get(AI_MATKEY_COLOR_DIFFUSE, color);
+
+  float metallic = 0.f;
+  get_float(i_material,
+            {"$mat.metallicFactor",
+             "$mat.gltf.pbrMetallicRoughness.metallicFactor"},
+            metallic);
+  float roughness = 0.5f;
+  if (!get_float(i_material,
+                 {"$mat.roughnessFactor",
+                  "$mat.gltf.pbrMetallicRoughness.roughnessFactor"},
+                 roughness))
+  {
+    // Approximate the roughness of a Phong specular exponent
+    float shininess = 0.f;
+    if (i_material.Get(AI_MATKEY_SHININESS, shininess) == AI_SUCCESS &&
+        shininess > 0.f)
+      roughness = std::sqrt(2.f / (shininess + 2.f));
+  }
+
+  Surface surface;
+  surface.base_color = {color.r, color.g, color.b};
+  surface.metallic = std::min(std::max(metallic, 0.f), 1.f);
+  surface.roughness = std::min(std::max(roughness, 0.f), 1.f);
+  return surface;
+}
+
+// Map a surface on to the parameters of our default lit material
+MaterialParameters to_parameters(const Surface& i_surface)
+{
+  MaterialParameters parameters;
+  parameters.set("baseColor", i_surface.base_color)
+    .set("metallic", i_surface.metallic)
+    .set("roughness", i_surface.roughness)
+    .set("reflectance", 0.5f);
+  return parameters;
+}
+
+QJsonArray to_json(const float* i_values, std::size_t i_count)
+{
+  QJsonArray array;
+  for (std::size_t i = 0; i < i_count; ++i)
+    array.append(static_cast<double>(i_values[i]));
+  return array;
+}
+
+// Read an array of exactly the given number of values
+bool from_json(const QJsonValue& i_value, float* o_values, std::size_t i_count)
+{
+  const auto array = i_value.toArray();
+  if (static_cast<std::size_t>(array.size()) != i_count)
+    return false;
+  for (std::size_t i = 0; i < i_count; ++i)
+    o_values[i] = static_cast<float>(array[static_cast<int>(i)].toDouble());
+  return true;
+}
+
+// Qualify a material's name with its index, as names within a file aren't
+// unique, and with the file, as they must be unique across scenes
+std::string material_name(const std::string& i_source_path,
+                          std::size_t i_index,
+                          const std::string& i_name)
+{
+  return i_source_path + '#' + std::to_string(i_index) + ':' + i_name;
+}
+
+// Everything about a scene except its meshes, which are cached alongside,
+// so later imports don't need to read the source at all. Paths are relative
+// to the cache directory, and material names unqualified, so the cache
+// still applies if the source moves.
+void write_description(const ImportedScene& i_scene,
+                       const std::vector<std::string>& i_material_names,
+                       const std::vector<Surface>& i_surfaces,
+                       const std::string& i_directory)
+{
+  QJsonArray meshes;
+  for (const auto& mesh : i_scene.meshes)
+  {
+    QJsonObject object;
+    object["path"] = QFileInfo(QString::fromStdString(mesh.filamesh_path))
+                       .fileName();
+    object["triangles"] = static_cast<double>(mesh.triangles);
+    meshes.append(object);
+  }
+  QJsonArray materials;
+  for (std::size_t i = 0; i < i_scene.materials.size(); ++i)
+  {
+    QJsonObject object;
+    object["name"] = QString::fromStdString(i_material_names[i]);
+    object["base_color"] = to_json(&i_surfaces[i].base_color.x, 3);
+    object["metallic"] = i_surfaces[i].metallic;
+    object["roughness"] = i_surfaces[i].roughness;
+    materials.append(object);
+  }
+  QJsonArray nodes;
+  for (const auto& node : i_scene.nodes)
+  {
+    QJsonObject object;
+    object["name"] = QString::fromStdString(node.name);
+    object["parent"] = node.parent;
+    object["transform"] = to_json(&node.transform[0][0], 16);
+    QJsonArray node_meshes;
+    for (const auto mesh : node.meshes)
+      node_meshes.append(static_cast<double>(mesh));
+    object["meshes"] = node_meshes;
+    nodes.append(object);
+  }
+  QJsonObject root;
+  root["meshes"] = meshes;
+  root["materials"] = materials;
+  root["nodes"] = nodes;
+
+  // Renamed in to place, as its presence marks the whole scene as cached
+  const auto path = i_directory + "/" + DESCRIPTION_NAME;
+  const auto temporary_path =
+    path + ".tmp" + std::to_string(QCoreApplication::applicationPid()) +
+    '_' +
+    std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+  QFile file(QString::fromStdString(temporary_path));
+  const auto bytes = QJsonDocument(root).toJson(QJsonDocument::Compact);
+  if (!file.open(QIODevice::WriteOnly) || file.write(bytes) != bytes.size())
+    throw std::runtime_error("Failed to write " + temporary_path);
+  file.close();
+  if (std::rename(temporary_path.c_str(), path.c_str()))
+    throw std::runtime_error("Failed to write " + path);
+}
+
+// Read a description written by an earlier import, returning false if there
+// isn't a complete one, in which case the scene must be imported again
+bool read_description(const std::string& i_directory,
+                      const std::string& i_source_path,
+                      ImportedScene& o_scene)
+{
+  QFile file(
+    QString::fromStdString(i_directory + "/" + DESCRIPTION_NAME));
+  if (!file.open(QIODevice::ReadOnly))
+    return false;
+  QJsonParseError error;
+  const auto root = QJsonDocument::fromJson(file.readAll(), &error).object();
+  if (error.error != QJsonParseError::NoError)
+    return false;
+
+  ImportedScene scene;
+  scene.source_path = i_source_path;
+  for (const auto value : root["meshes"].toArray())
+  {
+    const auto object = value.toObject();
+    ImportedScene::Mesh mesh;
+    mesh.filamesh_path =
+      i_directory + '/' + object["path"].toString().toStdString();
+    mesh.triangles = static_cast<std::size_t>(object["triangles"].toDouble());
+    if (!QFile::exists(QString::fromStdString(mesh.filamesh_path)))
+      return false;
+    scene.meshes.push_back(std::move(mesh));
+  }
+  for (const auto value : root["materials"].toArray())
+  {
+    const auto object = value.toObject();
+    Surface surface;
+    if (!from_json(object["base_color"], &surface.base_color.x, 3))
+      return false;
+    surface.metallic = static_cast<float>(object["metallic"].toDouble());
+    surface.roughness = static_cast<float>(object["roughness"].toDouble());
+    scene.materials.push_back(
+      {material_name(i_source_path,
+                     scene.materials.size(),
+                     object["name"].toString().toStdString()),
+       to_parameters(surface)});
+  }
+  for (const auto value : root["nodes"].toArray())
+  {
+    const auto object = value.toObject();
+    ImportedScene::Node node;
+    node.name = object["name"].toString().toStdString();
+    node.parent = object["parent"].toInt(-1);
+    // Parents always precede their children
+    if (node.parent >= static_cast<int32_t>(scene.nodes.size()) ||
+        !from_json(object["transform"], &node.transform[0][0], 16))
+      return false;
+    for (const auto mesh : object["meshes"].toArray())
+    {
+      const auto index = mesh.toInt(-1);
+      if (index < 0 || static_cast<std::size_t>(index) >= scene.meshes.size())
+        return false;
+      node.meshes.push_back(static_cast<uint32_t>(index));
+    }
+    scene.nodes.push_back(std::move(node));
+  }
+  if (scene.nodes.empty())
+    return false;
+  o_scene = std::move(scene);
+  return true;
+}
+
+std::size_t triangle_count(const aiMesh& i_mesh)
+{
+  std::size_t count = 0;
+  for (unsigned int f = 0; f < i_mesh.mNumFaces; ++f)
+    count += i_mesh.mFaces[f].mNumIndices == 3;
+  return count;
+}
+}  // namespace
+
+SceneImporter::SceneImporter(std::string i_cache_directory)
+  : m_cache_directory(std::move(i_cache_directory))
+{
+}
+
+void SceneImporter::set_max_threads(std::size_t i_max_threads) noexcept
+{
+  m_max_threads = i_max_threads;
+}
+
+ImportedScene SceneImporter::import(const std::string& i_path,
+                                    SceneImportReport* o_report) const
+{
+  ScopedTimer timer("import scene");
+  using clock = std::chrono::steady_clock;
+  const auto elapsed_ms = [](clock::time_point i_start) {
+    return std::chrono::duration<double, std::milli>(clock::now() - i_start)
+      .count();
+  };
+  const auto start = clock::now();
+  SceneImportReport report;
+  report.source_path = i_path;
+
+  // Key the cache on the contents of the source, not its path
+  QFile source(QString::fromStdString(i_path));
+  if (!source.open(QIODevice::ReadOnly))
+    throw std::runtime_error("Failed to open " + i_path);
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  hash.addData(QByteArray(IMPORT_VERSION));
+  hash.addData(&source);
+  const auto directory =
+    m_cache_directory + '/' + hash.result().toHex().toStdString();
+  QDir().mkpath(QString::fromStdString(directory));
+
+  // Once a scene has been converted its description is cached with its
+  // meshes, so later imports only hash the source rather than reading it
+  ImportedScene imported;
+  if (read_description(directory, i_path, imported))
+  {
+    report.read_ms = elapsed_ms(start);
+    report.cache_hits = imported.meshes.size();
+  }
+  else
+    imported = read(i_path, directory, report);
+
+  report.meshes = imported.meshes.size();
+  report.materials = imported.materials.size();
+  report.nodes = imported.nodes.size();
+  for (const auto& mesh : imported.meshes)
+    report.triangles += mesh.triangles;
+  report.total_ms = elapsed_ms(start);
+
+  std::cout << std::fixed << std::setprecision(2) << "Imported scene "
+            << i_path << " in " << report.total_ms << " ms: " << report.meshes
+            << " meshes (" << report.cache_hits << " cached), "
+            << report.triangles << " triangles, " << report.materials
+            << " materials, " << report.nodes << " nodes" << std::endl;
+  if (o_report)
+    *o_report = report;
+  return imported;
+}
+
+ImportedScene SceneImporter::read(const std::string& i_path,
+                                  const std::string& i_directory,
+                                  SceneImportReport& io_report) const
+{
+  using clock = std::chrono::steady_clock;
+  const auto elapsed_ms = [](clock::time_point i_start) {
+    return std::chrono::duration<double, std::milli>(clock::now() - i_start)
+      .count();
+  };
+  const auto start = clock::now();
+
+  // Keep the node hierarchy, rather than baking it in to the vertices
+  Assimp::Importer importer;
+  const aiScene* scene = importer.ReadFile(
+    i_path,
+    aiProcess_Triangulate | aiProcess_JoinIdenticalVertices |
+      aiProcess_GenSmoothNormals | aiProcess_SortByPType);
+  if (!scene || !scene->mRootNode)
+    throw std::runtime_error("Failed to import " + i_path + ": " +
+                             importer.GetErrorString());
+  io_report.read_ms = elapsed_ms(start);
+
+  ImportedScene imported;
+  imported.source_path = i_path;
+  imported.materials.resize(scene->mNumMaterials);
+  std::vector<std::string> material_names(scene->mNumMaterials);
+  for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
+  {
+    aiString name;
+    scene->mMaterials[i]->Get(AI_MATKEY_NAME, name);
+    material_names[i] = name.C_Str();
+    imported.materials[i].name = material_name(i_path, i, material_names[i]);
+  }
+  // Points and lines are skipped, so keep track of where each mesh went
+  std::vector<int32_t> mesh_indices(scene->mNumMeshes, -1);
+  std::vector<unsigned int> sources;
+  for (unsigned int m = 0; m < scene->mNumMeshes; ++m)
+  {
+    const aiMesh& mesh = *scene->mMeshes[m];
+    if (!(mesh.mPrimitiveTypes & aiPrimitiveType_TRIANGLE))
+      continue;
+    mesh_indices[m] = static_cast<int32_t>(imported.meshes.size());
+    sources.push_back(m);
+    imported.meshes.push_back(
+      {i_directory + '/' + std::to_string(m) + ".filamesh",
+       triangle_count(mesh)});
+  }
+
+  // Convert every mesh and material independently, the body must not throw
+  // so failures are kept until every task has finished
+  const auto convert_start = clock::now();
+  const auto mesh_count = imported.meshes.size();
+  const auto task_count = mesh_count + imported.materials.size();
+  std::vector<std::exception_ptr> errors(task_count);
+  std::vector<uint8_t> cache_hits(mesh_count, 0);
+  std::vector<Surface> surfaces(imported.materials.size());
+  auto& pool = ThreadPool::global();
+  pool.parallel_for(
+    task_count,
+    [&](std::size_t i_begin, std::size_t i_end) {
+      for (auto i = i_begin; i < i_end; ++i)
+      {
+        try
+        {
+          if (i >= mesh_count)
+          {
+            const auto m = i - mesh_count;
+            surfaces[m] = to_surface(*scene->mMaterials[m]);
+            imported.materials[m].parameters = to_parameters(surfaces[m]);
+            continue;
+          }
+          const auto& path = imported.meshes[i].filamesh_path;
+          if (QFile::exists(QString::fromStdString(path)))
+          {
+            cache_hits[i] = 1;
+            continue;
+          }
+          ScopedTimer mesh_timer("convert mesh");
+          auto mesh = MeshImporter::convert(*scene, {sources[i]});
+          if (mesh.parts.empty())
+            throw std::runtime_error(path + " has no triangles");
+          // Each mesh has a single part, named after its scene material
+          mesh.material_names = {
+            imported.materials[scene->mMeshes[sources[i]]->mMaterialIndex]
+              .name};
+          mesh.parts.front().material_id = 0;
+          MeshImporter::optimize(mesh);
+          MeshImporter::generate_lods(mesh);
+          MeshImporter::write_cached(mesh, path);
+        }
+        catch (...)
+        {
+          errors[i] = std::current_exception();
+        }
+      }
+    },
+    1,
+    m_max_threads);
+  for (const auto& error : errors)
+  {
+    if (error)
+      std::rethrow_exception(error);
+  }
+  io_report.convert_ms = elapsed_ms(convert_start);
+  const auto available_threads = pool.size() + 1;
+  io_report.threads = m_max_threads
+                        ? std::min(m_max_threads, available_threads)
+                        : available_threads;
+
+  // Flatten the hierarchy depth first, so parents precede their children
+  std::vector<std::pair<const aiNode*, int32_t>> pending{
+    {scene->mRootNode, -1}};
+  while (!pending.empty())
+  {
+    const auto node = pending.back().first;
+    const auto parent = pending.back().second;
+    pending.pop_back();
+    ImportedScene::Node imported_node;
+    imported_node.name = node->mName.C_Str();
+    imported_node.parent = parent;
+    imported_node.transform = to_mat4f(node->mTransformation);
+    for (unsigned int i = 0; i < node->mNumMeshes; ++i)
+    {
+      const auto index = node->mMeshes[i] < mesh_indices.size()
+                           ? mesh_indices[node->mMeshes[i]]
+                           : -1;
+      if (index >= 0)
+        imported_node.meshes.push_back(static_cast<uint32_t>(index));
+    }
+    const auto index = static_cast<int32_t>(imported.nodes.size());
+    imported.nodes.push_back(std::move(imported_node));
+    for (unsigned int i = node->mNumChildren; i-- > 0;)
+      pending.emplace_back(node->mChildren[i], index);
+  }
+
+  for (const auto hit : cache_hits)
+    io_report.cache_hits += hit;
+  write_description(imported, material_names, surfaces, i_directory);
+  return imported;
+}
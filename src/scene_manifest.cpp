@@ -0,0 +1,189 @@
+#include "scene_manifest.h"
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <math/quat.h>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+filament::math::float3 to_float3(const QJsonArray& i_array,
+                                 const filament::math::float3& i_default)
+{
+  if (i_array.size() != 3)
+    return i_default;
+  return {i_array[0].toDouble(), i_array[1].toDouble(), i_array[2].toDouble()};
+}
+
+// Parameters are scalars, or arrays of three or four components
+MaterialParameters to_parameters(const QJsonObject& i_object)
+{
+  MaterialParameters parameters;
+  for (auto it = i_object.begin(); it != i_object.end(); ++it)
+  {
+    const auto name = it.key().toStdString();
+    if (it.value().isDouble())
+    {
+      parameters.set(name, static_cast<float>(it.value().toDouble()));
+      continue;
+    }
+    const auto array = it.value().toArray();
+    if (array.size() == 3)
+      parameters.set(name, to_float3(array, {}));
+    else if (array.size() == 4)
+      parameters.set(name,
+                     filament::math::float4{array[0].toDouble(),
+                                            array[1].toDouble(),
+                                            array[2].toDouble(),
+                                            array[3].toDouble()});
+    else
+      throw std::runtime_error("Unsupported value for parameter " + name);
+  }
+  return parameters;
+}
+
+// Transforms are either a raw matrix, or a translation, rotation and scale
+filament::math::mat4f to_transform(const QJsonValue& i_value)
+{
+  namespace flm = filament::math;
+  if (i_value.isArray())
+  {
+    const auto array = i_value.toArray();
+    if (array.size() != 16)
+      throw std::runtime_error("Transform matrices require 16 elements");
+    flm::mat4f matrix;
+    for (int i = 0; i < 16; ++i)
+      matrix[i / 4][i % 4] = static_cast<float>(array[i].toDouble());
+    return matrix;
+  }
+
+  const auto object = i_value.toObject();
+  const auto translation =
+    to_float3(object["translation"].toArray(), flm::float3{0.f});
+  const auto scale_value = object["scale"];
+  const auto scale =
+    scale_value.isDouble()
+      ? flm::float3{static_cast<float>(scale_value.toDouble())}
+      : to_float3(scale_value.toArray(), flm::float3{1.f});
+  flm::quatf rotation{1.f, 0.f, 0.f, 0.f};
+  const auto rotation_array = object["rotation"].toArray();
+  if (rotation_array.size() == 4)
+  {
+    // Stored as x, y, z, w
+    rotation = flm::quatf{static_cast<float>(rotation_array[3].toDouble()),
+                          static_cast<float>(rotation_array[0].toDouble()),
+                          static_cast<float>(rotation_array[1].toDouble()),
+                          static_cast<float>(rotation_array[2].toDouble())};
+  }
+  return flm::mat4f::translation(translation) * flm::mat4f(rotation) *
+         flm::mat4f::scaling(scale);
+}
+}  // namespace
+
+SceneManifest SceneManifest::load(const QString& i_path)
+{
+  QFile file(i_path);
+  if (!file.open(QIODevice::ReadOnly))
+    throw std::runtime_error("Failed to open " + i_path.toStdString());
+  QJsonParseError error;
+  const auto document = QJsonDocument::fromJson(file.readAll(), &error);
+  if (document.isNull())
+    throw std::runtime_error("Failed to parse " + i_path.toStdString() + ": " +
+                             error.errorString().toStdString());
+
+  SceneManifest manifest;
+  manifest.environment =
+    document.object()["environment"].toString().toStdString();
+  for (const auto& mesh_value : document.object()["meshes"].toArray())
+  {
+    const auto mesh = mesh_value.toObject();
+    Entry entry;
+    entry.mesh = mesh["mesh"].toString().toStdString();
+    entry.material = mesh["material"].toString().toStdString();
+    entry.parameters = to_parameters(mesh["parameters"].toObject());
+    const auto transforms = mesh["transforms"].toArray();
+    entry.transforms.reserve(transforms.size());
+    for (const auto& transform : transforms)
+      entry.transforms.push_back(to_transform(transform));
+    // A mesh with no transforms is placed once at the origin
+    if (entry.transforms.empty())
+      entry.transforms.emplace_back();
+    manifest.entries.push_back(std::move(entry));
+  }
+  for (const auto& import_value : document.object()["imports"].toArray())
+  {
+    const auto object = import_value.toObject();
+    manifest.imports.push_back({object["path"].toString().toStdString(),
+                                to_transform(object["transform"])});
+  }
+  return manifest;
+}
+
+SceneManifest SceneManifest::default_scene()
+{
+  SceneManifest manifest;
+  manifest.entries.push_back(
+    {"assets/models/suzanne.obj", "", {}, {filament::math::mat4f{}}});
+  return manifest;
+}
+
+SceneManifest SceneManifest::grid(uint32_t i_count, uint32_t i_looks)
+{
+  namespace flm = filament::math;
+  if (!i_count)
+    return {};
+  // Fill a square that fits within the default camera's view
+  constexpr float extent = 3.f;
+  const auto side =
+    static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(i_count))));
+  const float spacing = extent / side;
+  const float scale = spacing * 0.4f;
+  const float origin = (spacing - extent) * 0.5f;
+
+  // One entry per look, a single look uses the mesh's own materials
+  i_looks = std::max(i_looks, 1u);
+  SceneManifest manifest;
+  manifest.entries.resize(i_looks, {"assets/models/suzanne.obj", "", {}, {}});
+  if (i_looks > 1)
+  {
+    for (uint32_t look = 0; look < i_looks; ++look)
+    {
+      // Sweep the hue and roughness so every look is distinct
+      const float t = static_cast<float>(look) / i_looks;
+      auto& entry = manifest.entries[look];
+      entry.material = "aiDefaultMat";
+      const float angle = 6.2832f * t;
+      entry.parameters
+        .set("baseColor",
+             flm::float3{0.5f + 0.5f * std::cos(angle),
+                         0.5f + 0.5f * std::cos(angle + 2.1f),
+                         0.5f + 0.5f * std::cos(angle + 4.2f)})
+        .set("metallic", look % 2 ? 1.0f : 0.0f)
+        .set("roughness", 0.1f + 0.8f * t)
+        .set("reflectance", 0.5f);
+    }
+  }
+  for (auto& entry : manifest.entries)
+    entry.transforms.reserve(i_count / i_looks + 1);
+
+  for (uint32_t i = 0; i < i_count; ++i)
+  {
+    const flm::float3 position{
+      origin + spacing * (i % side), origin + spacing * (i / side), 0.f};
+    manifest.entries[i % i_looks].transforms.push_back(
+      flm::mat4f::translation(position) *
+      flm::mat4f::scaling(flm::float3{scale}));
+  }
+  return manifest;
+}
+
+std::size_t SceneManifest::instance_count() const noexcept
+{
+  std::size_t count = 0;
+  for (const auto& entry : entries)
+    count += entry.transforms.size();
+  return count;
+}
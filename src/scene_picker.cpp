@@ -0,0 +1,167 @@
+#include "scene_picker.h"
+#include "profiler.h"
+#include <math/vec4.h>
+#include <chrono>
+#include <limits>
+
+namespace
+{
+namespace flm = filament::math;
+
+// Bounds of a box after it has been transformed
+bvh::Aabb transform_box(const bvh::Aabb& i_box, const flm::mat4f& i_transform)
+{
+  const auto center = i_box.center();
+  const auto extent = (i_box.max - i_box.min) * 0.5f;
+  const auto world_center = (i_transform * flm::float4(center, 1.f)).xyz;
+  // Each axis of the box contributes the absolute value of its projection
+  const auto world_extent = abs(i_transform[0].xyz) * extent.x +
+                            abs(i_transform[1].xyz) * extent.y +
+                            abs(i_transform[2].xyz) * extent.z;
+  bvh::Aabb box;
+  box.min = world_center - world_extent;
+  box.max = world_center + world_extent;
+  return box;
+}
+}  // namespace
+
+bvh::Ray camera_ray(const filament::Camera& i_camera,
+                    filament::math::float2 i_ndc)
+{
+  // Unproject the point on the near and far planes in double precision, as
+  // the far plane loses accuracy in single precision
+  const auto clip_to_world = flm::mat4(i_camera.getModelMatrix()) *
+                             inverse(i_camera.getProjectionMatrix());
+  const auto unproject = [&](double i_z) {
+    const auto point = clip_to_world * flm::double4(i_ndc.x, i_ndc.y, i_z, 1.0);
+    return flm::float3(point.xyz / point.w);
+  };
+  const auto near = unproject(-1.0);
+  const auto far = unproject(1.0);
+  return {near, normalize(far - near)};
+}
+
+ScenePicker::ScenePicker(ThreadPool& io_pool) : m_pool(&io_pool)
+{
+}
+
+void ScenePicker::add_mesh(const InstancedMesh& i_mesh,
+                           std::shared_ptr<const std::vector<uint8_t>> i_data)
+{
+  // The shared data keeps the file contents alive until the build finishes
+  auto bvh = m_pool->submit([data = std::move(i_data)] {
+    ScopedTimer timer("build mesh bvh");
+    return std::make_shared<const MeshBvh>(
+      filamesh_file::parse(data->data(), data->size()));
+  });
+  m_meshes.push_back({&i_mesh, bvh.share(), nullptr});
+}
+
+PickResult ScenePicker::pick(const bvh::Ray& i_ray,
+                             const TransformStore& i_transforms)
+{
+  ScopedTimer timer("pick");
+  update(i_transforms);
+
+  PickResult result;
+  float t_max = std::numeric_limits<float>::max();
+  const auto test_leaf = [&](uint32_t i_first, uint32_t i_count) {
+    for (auto i = i_first; i < i_first + i_count; ++i)
+    {
+      // The direction isn't normalized in mesh space, so distances along the
+      // ray are the same as in world space
+      const auto& instance = m_instances[m_tree.order[i]];
+      const bvh::Ray ray(
+        (instance.world_to_mesh * flm::float4(i_ray.origin, 1.f)).xyz,
+        (instance.world_to_mesh * flm::float4(i_ray.direction, 0.f)).xyz);
+      MeshBvh::Hit hit;
+      if (!m_meshes[instance.mesh].ready->intersect(ray, t_max, hit))
+        continue;
+      t_max = hit.distance;
+      result.hit = true;
+      result.entity = instance.entity;
+      result.triangle = hit.triangle;
+      result.distance = hit.distance;
+    }
+  };
+  bvh::traverse(m_tree, i_ray, t_max, test_leaf);
+  if (result.hit)
+    result.position = i_ray.origin + i_ray.direction * result.distance;
+  return result;
+}
+
+void ScenePicker::wait() const
+{
+  for (const auto& mesh : m_meshes)
+    mesh.bvh.wait();
+}
+
+std::size_t ScenePicker::triangle_count() const noexcept
+{
+  return m_triangles;
+}
+
+double ScenePicker::build_ms() const
+{
+  double total = 0.0;
+  for (const auto& mesh : m_meshes)
+  {
+    if (mesh.ready)
+      total += mesh.ready->build_ms();
+  }
+  return total;
+}
+
+void ScenePicker::update(const TransformStore& i_transforms)
+{
+  // Pick up any mesh hierarchies which finished building since last time
+  std::size_t ready = 0;
+  std::size_t instance_count = 0;
+  for (auto& mesh : m_meshes)
+  {
+    if (!mesh.ready && mesh.bvh.wait_for(std::chrono::seconds(0)) ==
+                         std::future_status::ready)
+      mesh.ready = mesh.bvh.get();
+    if (mesh.ready)
+    {
+      ++ready;
+      instance_count += mesh.mesh->instances().size();
+    }
+  }
+  const bool same_instances =
+    ready == m_built_meshes && instance_count == m_built_instances;
+  if (same_instances && i_transforms.version() == m_built_version)
+    return;
+
+  // Only the transforms changed, e.g. while animating, so the tree keeps its
+  // structure and is refit around the instances' new bounds
+  ScopedTimer timer(same_instances ? "refit scene bvh" : "build scene bvh");
+  m_instances.clear();
+  m_instances.reserve(instance_count);
+  m_triangles = 0;
+  std::vector<bvh::Aabb> bounds;
+  bounds.reserve(instance_count);
+  for (uint32_t m = 0; m < m_meshes.size(); ++m)
+  {
+    const auto& mesh = m_meshes[m];
+    if (!mesh.ready)
+      continue;
+    const auto& entities = mesh.mesh->instances();
+    const auto& nodes = mesh.mesh->nodes();
+    for (std::size_t i = 0; i < entities.size(); ++i)
+    {
+      const auto& world = i_transforms.world(nodes[i]);
+      m_instances.push_back({entities[i], m, inverse(world)});
+      bounds.push_back(transform_box(mesh.ready->bounds(), world));
+    }
+    m_triangles += entities.size() * mesh.ready->triangle_count();
+  }
+  if (same_instances)
+    bvh::refit(m_tree, bounds);
+  else
+    m_tree = bvh::build(bounds);
+
+  m_built_meshes = ready;
+  m_built_instances = instance_count;
+  m_built_version = i_transforms.version();
+}
@@ -0,0 +1,204 @@
+#include "shared_scene.h"
+#include "asset_loader.h"
+#include "pbr_scene.h"
+#include "profiler.h"
+#include <QTimer>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+// State created, accessed and destroyed only on the render thread
+struct SharedScene::RenderState
+{
+  RenderState(std::shared_ptr<filament::Engine> i_engine,
+              SceneManifest i_manifest);
+  // The materials, meshes and lights every view renders
+  PbrScene scene;
+  // Loads the scene's assets off the render thread
+  AssetLoader loader;
+  // Loaded once the first view is attached
+  SceneManifest manifest;
+  bool loading_started = false;
+  // The startup timeline is printed once everything has loaded
+  bool first_frame_drawn = false;
+  bool timeline_printed = false;
+  // Animation time is measured from when the scene was created
+  std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
+  bool animated = false;
+};
+
+SharedScene::RenderState::RenderState(
+  std::shared_ptr<filament::Engine> i_engine, SceneManifest i_manifest)
+  : scene(std::move(i_engine)), manifest(std::move(i_manifest))
+{
+}
+
+SharedScene::SharedScene(std::shared_ptr<filament::Engine> i_engine,
+                         std::shared_ptr<RenderThread> i_render_thread,
+                         SceneManifest i_manifest)
+  : m_engine(std::move(i_engine)), m_render_thread(std::move(i_render_thread))
+{
+  m_render_thread->run_sync([this, &i_manifest] {
+    m_render_state =
+      std::make_unique<RenderState>(m_engine, std::move(i_manifest));
+  });
+}
+
+SharedScene::~SharedScene()
+{
+  // Every view has been destroyed by now, as they hold a reference to us
+  m_render_thread->run_sync([this] { m_render_state.reset(); });
+}
+
+const std::shared_ptr<filament::Engine>& SharedScene::engine() const noexcept
+{
+  return m_engine;
+}
+
+const std::shared_ptr<RenderThread>& SharedScene::render_thread() const
+  noexcept
+{
+  return m_render_thread;
+}
+
+void SharedScene::attach(filament::View& io_view)
+{
+  auto& state = *m_render_state;
+  state.scene.configure_view(io_view);
+  if (state.loading_started)
+    return;
+  state.loading_started = true;
+  // Begin loading our materials, meshes and lights, we can render the first
+  // frame immediately and each asset will appear once it has loaded
+  ScopedTimer timer("init scene");
+  state.scene.init_async(state.loader, state.manifest);
+}
+
+PickResult SharedScene::pick(const filament::Camera& i_camera,
+                             filament::math::float2 i_ndc)
+{
+  return m_render_state->scene.pick(camera_ray(i_camera, i_ndc));
+}
+
+void SharedScene::set_lods_enabled(bool i_enabled)
+{
+  auto state = m_render_state.get();
+  m_render_thread->post(
+    [state, i_enabled] { state->scene.set_lods_enabled(i_enabled); });
+}
+
+void SharedScene::set_animated(bool i_animated)
+{
+  auto state = m_render_state.get();
+  m_render_thread->post([state, i_animated] {
+    state->animated = i_animated;
+    state->scene.set_animated(i_animated);
+  });
+}
+
+void SharedScene::set_transform_threads(std::size_t i_max_threads)
+{
+  auto state = m_render_state.get();
+  m_render_thread->post([state, i_max_threads] {
+    state->scene.set_transform_threads(i_max_threads);
+  });
+}
+
+void SharedScene::set_upload_budget(std::size_t i_bytes)
+{
+  auto state = m_render_state.get();
+  m_render_thread->post(
+    [state, i_bytes] { state->scene.set_upload_budget(i_bytes); });
+}
+
+void SharedScene::submit(const void* i_key, Target i_target)
+{
+  const auto found = std::find_if(
+    m_pending.begin(),
+    m_pending.end(),
+    [i_key](const std::pair<const void*, Target>& i_pending) {
+      return i_pending.first == i_key;
+    });
+  if (found != m_pending.end())
+    found->second = std::move(i_target);
+  else
+    m_pending.emplace_back(i_key, std::move(i_target));
+
+  // Wait for the rest of this event loop pass, so that views drawn in
+  // response to the same event share a batch
+  if (m_flush_scheduled)
+    return;
+  m_flush_scheduled = true;
+  std::weak_ptr<SharedScene> self = shared_from_this();
+  QTimer::singleShot(0, [self] {
+    if (const auto scene = self.lock())
+      scene->flush();
+  });
+}
+
+void SharedScene::cancel(const void* i_key)
+{
+  m_pending.erase(std::remove_if(
+                    m_pending.begin(),
+                    m_pending.end(),
+                    [i_key](const std::pair<const void*, Target>& i_pending) {
+                      return i_pending.first == i_key;
+                    }),
+                  m_pending.end());
+}
+
+void SharedScene::flush()
+{
+  m_flush_scheduled = false;
+  if (m_pending.empty())
+    return;
+  std::vector<Target> targets;
+  targets.reserve(m_pending.size());
+  for (auto& pending : m_pending)
+    targets.push_back(std::move(pending.second));
+  m_pending.clear();
+  m_render_thread->post(
+    [this, targets = std::move(targets)] { render(targets); });
+}
+
+void SharedScene::render(const std::vector<Target>& i_targets)
+{
+  ScopedTimer timer("batch");
+  auto& state = *m_render_state;
+  {
+    // Add any assets that have finished loading to the scene
+    ScopedTimer pump_timer("pump assets");
+    state.loader.pump();
+  }
+  state.scene.stream_textures();
+  const auto now = std::chrono::steady_clock::now();
+  state.scene.update_transforms(
+    std::chrono::duration<double>(now - state.start).count());
+  // Renderables are shared, so pick detail levels that suit every view
+  std::vector<const filament::View*> views;
+  views.reserve(i_targets.size());
+  for (const auto& target : i_targets)
+    views.push_back(target.view);
+  state.scene.update_lods(views);
+
+  // Keep drawing until all of our assets have been added to the scene, and
+  // their textures have fully streamed in, or forever while animating
+  const bool loading =
+    state.loader.pending() != 0 || state.scene.streaming();
+  for (const auto& target : i_targets)
+    target.draw(loading, state.animated);
+  state.scene.end_frame();
+
+  if (!state.first_frame_drawn)
+  {
+    state.first_frame_drawn = true;
+    state.loader.mark("first frame");
+  }
+  if (state.loading_started && !state.timeline_printed &&
+      !state.loader.pending())
+  {
+    state.timeline_printed = true;
+    print_timeline(std::cout, state.loader.timeline());
+  }
+}
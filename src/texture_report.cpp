@@ -0,0 +1,133 @@
+#include "texture_report.h"
+#include <iomanip>
+
+UploadTimer::UploadTimer(uint32_t i_uploads)
+  : m_start(clock::now()), m_remaining(i_uploads)
+{
+}
+
+void UploadTimer::upload_released() noexcept
+{
+  if (--m_remaining == 0)
+    m_elapsed_ms =
+      std::chrono::duration<double, std::milli>(clock::now() - m_start)
+        .count();
+}
+
+bool UploadTimer::complete() const noexcept
+{
+  return m_remaining == 0;
+}
+
+double UploadTimer::elapsed_ms() const noexcept
+{
+  return m_elapsed_ms;
+}
+
+const char* format_name(filament::Texture::InternalFormat i_format) noexcept
+{
+  using Format = filament::Texture::InternalFormat;
+  switch (i_format)
+  {
+  case Format::RGB8: return "RGB8";
+  case Format::SRGB8: return "SRGB8";
+  case Format::RGBA8: return "RGBA8";
+  case Format::SRGB8_A8: return "SRGB8_A8";
+  case Format::R11F_G11F_B10F: return "R11F_G11F_B10F";
+  case Format::RGB16F: return "RGB16F";
+  case Format::RGBA16F: return "RGBA16F";
+  case Format::ETC2_RGB8: return "ETC2_RGB8";
+  case Format::ETC2_EAC_RGBA8: return "ETC2_EAC_RGBA8";
+  case Format::ETC2_EAC_SRGBA8: return "ETC2_EAC_SRGBA8";
+  case Format::DXT1_RGB: return "DXT1_RGB";
+  case Format::DXT5_RGBA: return "DXT5_RGBA";
+  case Format::DXT5_SRGBA: return "DXT5_SRGBA";
+  case Format::RGBA_ASTC_4x4: return "ASTC_4x4";
+  case Format::SRGB8_ALPHA8_ASTC_4x4: return "SRGB8_ASTC_4x4";
+  default: return "other";
+  }
+}
+
+bool is_compressed(filament::Texture::InternalFormat i_format) noexcept
+{
+  using Format = filament::Texture::InternalFormat;
+  switch (i_format)
+  {
+  case Format::EAC_R11:
+  case Format::EAC_R11_SIGNED:
+  case Format::EAC_RG11:
+  case Format::EAC_RG11_SIGNED:
+  case Format::ETC2_RGB8:
+  case Format::ETC2_SRGB8:
+  case Format::ETC2_RGB8_A1:
+  case Format::ETC2_SRGB8_A1:
+  case Format::ETC2_EAC_RGBA8:
+  case Format::ETC2_EAC_SRGBA8:
+  case Format::DXT1_RGB:
+  case Format::DXT1_RGBA:
+  case Format::DXT3_RGBA:
+  case Format::DXT5_RGBA:
+  case Format::DXT1_SRGB:
+  case Format::DXT1_SRGBA:
+  case Format::DXT3_SRGBA:
+  case Format::DXT5_SRGBA:
+  case Format::RGBA_ASTC_4x4:
+  case Format::RGBA_ASTC_5x4:
+  case Format::RGBA_ASTC_5x5:
+  case Format::RGBA_ASTC_6x5:
+  case Format::RGBA_ASTC_6x6:
+  case Format::RGBA_ASTC_8x5:
+  case Format::RGBA_ASTC_8x6:
+  case Format::RGBA_ASTC_8x8:
+  case Format::RGBA_ASTC_10x5:
+  case Format::RGBA_ASTC_10x6:
+  case Format::RGBA_ASTC_10x8:
+  case Format::RGBA_ASTC_10x10:
+  case Format::RGBA_ASTC_12x10:
+  case Format::RGBA_ASTC_12x12:
+  case Format::SRGB8_ALPHA8_ASTC_4x4:
+  case Format::SRGB8_ALPHA8_ASTC_5x4:
+  case Format::SRGB8_ALPHA8_ASTC_5x5:
+  case Format::SRGB8_ALPHA8_ASTC_6x5:
+  case Format::SRGB8_ALPHA8_ASTC_6x6:
+  case Format::SRGB8_ALPHA8_ASTC_8x5:
+  case Format::SRGB8_ALPHA8_ASTC_8x6:
+  case Format::SRGB8_ALPHA8_ASTC_8x8:
+  case Format::SRGB8_ALPHA8_ASTC_10x5:
+  case Format::SRGB8_ALPHA8_ASTC_10x6:
+  case Format::SRGB8_ALPHA8_ASTC_10x8:
+  case Format::SRGB8_ALPHA8_ASTC_10x10:
+  case Format::SRGB8_ALPHA8_ASTC_12x10:
+  case Format::SRGB8_ALPHA8_ASTC_12x12: return true;
+  default: return false;
+  }
+}
+
+QJsonObject to_json(const TextureReport& i_report)
+{
+  QJsonObject json;
+  json["name"] = QString::fromStdString(i_report.name);
+  json["format"] = QString::fromStdString(i_report.format);
+  json["compressed"] = i_report.compressed;
+  json["width"] = static_cast<int>(i_report.width);
+  json["height"] = static_cast<int>(i_report.height);
+  json["levels"] = static_cast<int>(i_report.levels);
+  json["faces"] = static_cast<int>(i_report.faces);
+  json["gpu_bytes"] = static_cast<double>(i_report.gpu_bytes);
+  json["transcode_ms"] = i_report.transcode_ms;
+  json["upload_ms"] = i_report.upload ? i_report.upload->elapsed_ms() : 0.0;
+  return json;
+}
+
+std::ostream& operator<<(std::ostream& io_os, const TextureReport& i_report)
+{
+  io_os << std::fixed << std::setprecision(2) << i_report.name << ": "
+        << i_report.width << 'x' << i_report.height << 'x' << i_report.faces
+        << ", " << i_report.levels << " levels of " << i_report.format << ", "
+        << i_report.gpu_bytes / 1024 << " KiB";
+  if (i_report.transcode_ms > 0.0)
+    io_os << ", transcoded in " << i_report.transcode_ms << " ms";
+  if (i_report.upload && i_report.upload->complete())
+    io_os << ", uploaded in " << i_report.upload->elapsed_ms() << " ms";
+  return io_os;
+}
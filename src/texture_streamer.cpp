@@ -0,0 +1,136 @@
+#include "texture_streamer.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cstdint>
+
+TextureStreamer::TextureStreamer(std::shared_ptr<filament::Engine> i_engine,
+                                 std::size_t i_budget)
+  : m_engine(std::move(i_engine)), m_budget(i_budget)
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+  for (auto& stream : m_streams)
+  {
+    if (stream.whole)
+      m_engine->destroy(stream.whole);
+  }
+}
+
+void TextureStreamer::set_budget(std::size_t i_budget) noexcept
+{
+  m_budget = i_budget;
+}
+
+void TextureStreamer::stream(std::shared_ptr<KtxMapping> i_ktx,
+                             bool i_srgb,
+                             bool i_rgbm,
+                             Replace i_replace,
+                             TextureReport* o_report,
+                             bool i_progressive)
+{
+  const auto levels = i_ktx->num_mip_levels();
+  Stream stream{
+    std::move(i_ktx), i_srgb, i_rgbm, std::move(i_replace), levels, {}, {}};
+  stream.timer = std::make_shared<UploadTimer>(levels);
+  if (o_report)
+  {
+    stream.ktx->describe(*o_report, i_srgb);
+    o_report->upload = stream.timer;
+  }
+  if (!i_progressive)
+    stream.whole =
+      stream.ktx->create_partial_texture(m_engine.get(), i_srgb, i_rgbm, 0);
+  // Only the smallest level is uploaded up front
+  replace(stream, levels - 1);
+  if (stream.base_level > 0)
+    m_streams.push_back(std::move(stream));
+}
+
+std::size_t TextureStreamer::update()
+{
+  if (m_streams.empty())
+    return 0;
+  ScopedTimer timer("stream textures");
+  std::size_t uploaded = 0;
+  for (auto& stream : m_streams)
+  {
+    // Find the most detailed base level whose levels fit in what remains of
+    // the budget, always making progress on the first texture in a frame
+    const auto remaining =
+      m_budget ? m_budget - std::min(uploaded, m_budget) : SIZE_MAX;
+    auto base_level = stream.base_level;
+    while (base_level > 0 && upload_size(stream, base_level - 1) <= remaining)
+      --base_level;
+    if (base_level == stream.base_level && !uploaded)
+      --base_level;
+    if (base_level != stream.base_level)
+      uploaded += replace(stream, base_level);
+  }
+  m_streams.erase(std::remove_if(m_streams.begin(),
+                                 m_streams.end(),
+                                 [](const Stream& i_stream) {
+                                   return i_stream.base_level == 0;
+                                 }),
+                  m_streams.end());
+  return uploaded;
+}
+
+bool TextureStreamer::streaming() const noexcept
+{
+  return !m_streams.empty();
+}
+
+std::size_t TextureStreamer::replace(Stream& io_stream, uint32_t i_base_level)
+{
+  const auto uploaded = upload_size(io_stream, i_base_level);
+  if (io_stream.whole)
+  {
+    // Every upload goes in to the complete texture, so counts towards its
+    // upload time
+    for (auto level = i_base_level; level < io_stream.base_level; ++level)
+      io_stream.ktx->upload_level(m_engine.get(),
+                                  io_stream.whole,
+                                  level,
+                                  io_stream.rgbm,
+                                  io_stream.timer);
+    io_stream.base_level = i_base_level;
+    if (i_base_level == 0)
+    {
+      io_stream.replace(io_stream.whole);
+      io_stream.whole = nullptr;
+    }
+    return uploaded;
+  }
+
+  auto texture = io_stream.ktx->create_partial_texture(
+    m_engine.get(), io_stream.srgb, io_stream.rgbm, i_base_level);
+  // Only the uploads of the complete texture count towards its upload time
+  const auto timer = i_base_level == 0 ? io_stream.timer : nullptr;
+  for (auto level = i_base_level; level < io_stream.ktx->num_mip_levels();
+       ++level)
+    io_stream.ktx->upload_level(
+      m_engine.get(), texture, level, io_stream.rgbm, timer, i_base_level);
+  io_stream.base_level = i_base_level;
+  io_stream.replace(texture);
+  return uploaded;
+}
+
+std::size_t TextureStreamer::upload_size(const Stream& i_stream,
+                                         uint32_t i_base_level) noexcept
+{
+  // Whole textures only need the new levels, others upload every level again
+  return i_stream.whole ? resident_size(*i_stream.ktx, i_base_level) -
+                            resident_size(*i_stream.ktx, i_stream.base_level)
+                        : resident_size(*i_stream.ktx, i_base_level);
+}
+
+std::size_t TextureStreamer::resident_size(const KtxMapping& i_ktx,
+                                           uint32_t i_base_level) noexcept
+{
+  std::size_t size = 0;
+  for (auto level = i_base_level; level < i_ktx.num_mip_levels(); ++level)
+    size += i_ktx.level_size(level);
+  return size;
+}
@@ -0,0 +1,63 @@
+#include "thread_pool.h"
+#include "profiler.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(std::size_t i_num_threads)
+{
+  // hardware_concurrency may return zero if it can't be determined
+  i_num_threads = std::max(i_num_threads, std::size_t{1});
+  m_workers.reserve(i_num_threads);
+  for (std::size_t i = 0; i < i_num_threads; ++i)
+    m_workers.emplace_back([this] { worker_loop(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_condition.notify_all();
+  for (auto& worker : m_workers)
+    worker.join();
+}
+
+ThreadPool& ThreadPool::global()
+{
+  // Function local statics are initialized exactly once in a thread safe manor
+  static ThreadPool pool;
+  return pool;
+}
+
+std::size_t ThreadPool::size() const noexcept
+{
+  return m_workers.size();
+}
+
+void ThreadPool::enqueue(std::function<void()> i_task)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tasks.push_back(std::move(i_task));
+  }
+  m_condition.notify_one();
+}
+
+void ThreadPool::worker_loop()
+{
+  Profiler::global().set_thread_name("worker");
+  for (;;)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_condition.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+      // Drain the queue before stopping
+      if (m_tasks.empty())
+        return;
+      task = std::move(m_tasks.front());
+      m_tasks.pop_front();
+    }
+    task();
+  }
+}
@@ -0,0 +1,186 @@
+#include "tiff_tile_writer.h"
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+constexpr uint16_t TYPE_SHORT = 3;
+constexpr uint16_t TYPE_LONG = 4;
+constexpr uint16_t TYPE_LONG8 = 16;
+
+struct Entry
+{
+  uint16_t tag;
+  uint16_t type;
+  std::vector<uint64_t> values;
+};
+
+uint64_t type_size(uint16_t i_type)
+{
+  return i_type == TYPE_SHORT ? 2 : i_type == TYPE_LONG ? 4 : 8;
+}
+
+// Append a little endian value of the given number of bytes
+void put(std::vector<char>& io_bytes, uint64_t i_value, uint64_t i_size)
+{
+  for (uint64_t i = 0; i < i_size; ++i)
+    io_bytes.push_back(static_cast<char>((i_value >> (8 * i)) & 0xff));
+}
+
+// The header and image file directory, with values too large to fit in an
+// entry following the directory
+std::vector<char> layout(const std::vector<Entry>& i_entries, bool i_big)
+{
+  const uint64_t offset_size = i_big ? 8 : 4;
+  const uint64_t header_size = i_big ? 16 : 8;
+  const uint64_t entry_size = i_big ? 20 : 12;
+  const uint64_t ifd_size = (i_big ? 8 : 2) +
+                            i_entries.size() * entry_size + offset_size;
+
+  std::vector<char> bytes;
+  std::vector<char> overflow;
+  bytes.push_back('I');
+  bytes.push_back('I');
+  put(bytes, i_big ? 43 : 42, 2);
+  if (i_big)
+  {
+    put(bytes, 8, 2);
+    put(bytes, 0, 2);
+  }
+  put(bytes, header_size, offset_size);
+  put(bytes, i_entries.size(), i_big ? 8 : 2);
+  for (const auto& entry : i_entries)
+  {
+    const uint64_t size = type_size(entry.type);
+    put(bytes, entry.tag, 2);
+    put(bytes, entry.type, 2);
+    put(bytes, entry.values.size(), offset_size);
+    if (entry.values.size() * size <= offset_size)
+    {
+      for (const auto value : entry.values)
+        put(bytes, value, size);
+      put(bytes, 0, offset_size - entry.values.size() * size);
+    }
+    else
+    {
+      put(bytes, header_size + ifd_size + overflow.size(), offset_size);
+      for (const auto value : entry.values)
+        put(overflow, value, size);
+    }
+  }
+  put(bytes, 0, offset_size);
+  bytes.insert(bytes.end(), overflow.begin(), overflow.end());
+  // Start the pixel data on an aligned boundary
+  while (bytes.size() % 16)
+    bytes.push_back(0);
+  return bytes;
+}
+}  // namespace
+
+TiffTileWriter::TiffTileWriter(const std::string& i_path,
+                               uint32_t i_width,
+                               uint32_t i_height,
+                               uint32_t i_tile_width,
+                               uint32_t i_tile_height)
+  : m_file(i_path, std::ios::binary | std::ios::trunc)
+  , m_tile_width(i_tile_width)
+  , m_tile_height(i_tile_height)
+  , m_columns((i_width + i_tile_width - 1) / i_tile_width)
+  , m_rows((i_height + i_tile_height - 1) / i_tile_height)
+{
+  if (!i_width || !i_height || !i_tile_width || !i_tile_height ||
+      i_tile_width % 16 || i_tile_height % 16)
+    throw std::invalid_argument("Invalid TIFF or tile size");
+  if (!m_file)
+    throw std::runtime_error("Failed to create " + i_path);
+
+  const uint64_t tiles = uint64_t(m_columns) * m_rows;
+  const uint64_t tile_bytes = uint64_t(i_tile_width) * i_tile_height * 3;
+  auto entries = [&](uint16_t i_offset_type, uint64_t i_data_offset) {
+    std::vector<uint64_t> offsets(tiles);
+    for (uint64_t i = 0; i < tiles; ++i)
+      offsets[i] = i_data_offset + i * tile_bytes;
+    return std::vector<Entry>{
+      {256, TYPE_LONG, {i_width}},
+      {257, TYPE_LONG, {i_height}},
+      {258, TYPE_SHORT, {8, 8, 8}},
+      {259, TYPE_SHORT, {1}},
+      {262, TYPE_SHORT, {2}},
+      {277, TYPE_SHORT, {3}},
+      {284, TYPE_SHORT, {1}},
+      {322, TYPE_LONG, {i_tile_width}},
+      {323, TYPE_LONG, {i_tile_height}},
+      {324, i_offset_type, std::move(offsets)},
+      {325, i_offset_type, std::vector<uint64_t>(tiles, tile_bytes)}};
+  };
+
+  // Lay out a classic TIFF first, to find whether its offsets would overflow
+  auto header = layout(entries(TYPE_LONG, 0), false);
+  if (header.size() + tiles * tile_bytes > UINT32_MAX)
+  {
+    const auto size = layout(entries(TYPE_LONG8, 0), true).size();
+    header = layout(entries(TYPE_LONG8, size), true);
+  }
+  else
+    header = layout(entries(TYPE_LONG, header.size()), false);
+  m_data_offset = header.size();
+  m_file.write(header.data(), static_cast<std::streamsize>(header.size()));
+  if (!m_file)
+    throw std::runtime_error("Failed to write " + i_path);
+}
+
+uint32_t TiffTileWriter::columns() const noexcept
+{
+  return m_columns;
+}
+
+uint32_t TiffTileWriter::rows() const noexcept
+{
+  return m_rows;
+}
+
+bool TiffTileWriter::write_tile(uint32_t i_column,
+                                uint32_t i_row,
+                                const uint8_t* i_rgba,
+                                uint32_t i_row_pixels)
+{
+  if (i_column >= m_columns || i_row >= m_rows)
+    return false;
+  const uint64_t row_bytes = uint64_t(m_tile_width) * 3;
+  const uint64_t row_pixels = i_row_pixels ? i_row_pixels : m_tile_width;
+  const uint64_t tile_bytes = row_bytes * m_tile_height;
+  const uint64_t offset =
+    m_data_offset + (uint64_t(i_row) * m_columns + i_column) * tile_bytes;
+
+  // Drop the alpha and flip the rows, one row at a time
+  std::vector<char> row(row_bytes);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_file.seekp(static_cast<std::streamoff>(offset));
+  for (uint32_t y = 0; y < m_tile_height && m_file; ++y)
+  {
+    const uint8_t* src =
+      i_rgba + uint64_t(m_tile_height - 1 - y) * row_pixels * 4;
+    for (uint32_t x = 0; x < m_tile_width; ++x)
+      std::memcpy(&row[x * 3], src + x * 4, 3);
+    m_file.write(row.data(), static_cast<std::streamsize>(row_bytes));
+  }
+  if (!m_file)
+  {
+    m_failed = true;
+    m_file.clear();
+    return false;
+  }
+  return true;
+}
+
+bool TiffTileWriter::close()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_file.is_open())
+  {
+    m_file.close();
+    m_failed |= m_file.fail();
+  }
+  return !m_failed;
+}
@@ -125,12 +125,31 @@ void TrackballCamera::act(filament::math::float2 i_mouse_position) noexcept
   };
 }
 
+void TrackballCamera::set_spherical_position(
+  filament::math::float2 i_yaw_pitch) noexcept
+{
+  // Wrap and clamp the same way as orbiting with the mouse
+  m_impl->spherical_position =
+    trackball_coordinate(i_yaw_pitch, filament::math::float2{0.f}, 0.f);
+  m_impl->rotation = fast_trackball_rotation(m_impl->spherical_position);
+}
+
+void TrackballCamera::set_arm_length(float i_arm_length) noexcept
+{
+  m_impl->arm_length = i_arm_length;
+}
+
+void TrackballCamera::set_target(filament::math::float3 i_target) noexcept
+{
+  m_impl->target = std::move(i_target);
+}
+
 filament::math::float3 TrackballCamera::eye() const noexcept
 {
   // Calculate the camera arm
   const auto arm = m_impl->arm_direction * m_impl->arm_length;
-  // Calculate the new position by rotating the camera origin position vector
-  return m_impl->target - (m_impl->rotation * (m_impl->target - arm));
+  // Calculate the new position by rotating the camera arm about the target
+  return m_impl->target + m_impl->rotation * arm;
 }
 
 filament::math::float3 TrackballCamera::target() const noexcept
@@ -0,0 +1,338 @@
+#include "transform_store.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+namespace flm = filament::math;
+
+// Nodes per task, and the fewest nodes worth splitting across threads
+constexpr std::size_t GRAIN = 2048;
+constexpr std::size_t PARALLEL_THRESHOLD = 4 * GRAIN;
+
+// Rotation of a matrix with its scale removed, as a unit quaternion
+flm::quatf to_rotation(const flm::float3& i_x,
+                       const flm::float3& i_y,
+                       const flm::float3& i_z)
+{
+  const float trace = i_x.x + i_y.y + i_z.z;
+  flm::quatf q;
+  if (trace > 0.f)
+  {
+    const float s = 0.5f / std::sqrt(trace + 1.f);
+    q = flm::quatf(0.25f / s,
+                   (i_y.z - i_z.y) * s,
+                   (i_z.x - i_x.z) * s,
+                   (i_x.y - i_y.x) * s);
+  }
+  else if (i_x.x > i_y.y && i_x.x > i_z.z)
+  {
+    const float s = 2.f * std::sqrt(1.f + i_x.x - i_y.y - i_z.z);
+    q = flm::quatf((i_y.z - i_z.y) / s,
+                   0.25f * s,
+                   (i_y.x + i_x.y) / s,
+                   (i_z.x + i_x.z) / s);
+  }
+  else if (i_y.y > i_z.z)
+  {
+    const float s = 2.f * std::sqrt(1.f + i_y.y - i_x.x - i_z.z);
+    q = flm::quatf((i_z.x - i_x.z) / s,
+                   (i_y.x + i_x.y) / s,
+                   0.25f * s,
+                   (i_z.y + i_y.z) / s);
+  }
+  else
+  {
+    const float s = 2.f * std::sqrt(1.f + i_z.z - i_x.x - i_y.y);
+    q = flm::quatf((i_x.y - i_y.x) / s,
+                   (i_z.x + i_x.z) / s,
+                   (i_z.y + i_y.z) / s,
+                   0.25f * s);
+  }
+  return normalize(q);
+}
+
+// Split the upper 3x3 of a matrix in to a rotation and scale, returning false
+// if it has shear or a zero length axis so can't be rebuilt from them
+bool decompose(const flm::mat4f& i_matrix,
+               flm::quatf& o_rotation,
+               flm::float3& o_scale)
+{
+  // Columns shorter than this are treated as collapsed, and ones further than
+  // this from perpendicular as sheared
+  constexpr float EPSILON = 1e-6f;
+  constexpr float SHEAR_TOLERANCE = 1e-3f;
+  flm::float3 x = i_matrix[0].xyz;
+  flm::float3 y = i_matrix[1].xyz;
+  flm::float3 z = i_matrix[2].xyz;
+  o_scale = {length(x), length(y), length(z)};
+  o_rotation = flm::quatf(1.f, 0.f, 0.f, 0.f);
+  if (o_scale.x < EPSILON || o_scale.y < EPSILON || o_scale.z < EPSILON)
+    return false;
+  x /= o_scale.x;
+  y /= o_scale.y;
+  z /= o_scale.z;
+  // A mirrored matrix is a rotation with one axis flipped
+  if (dot(cross(x, y), z) < 0.f)
+  {
+    o_scale.x = -o_scale.x;
+    x = -x;
+  }
+  o_rotation = to_rotation(x, y, z);
+  return std::abs(dot(x, y)) < SHEAR_TOLERANCE &&
+         std::abs(dot(x, z)) < SHEAR_TOLERANCE &&
+         std::abs(dot(y, z)) < SHEAR_TOLERANCE;
+}
+}  // namespace
+
+TransformStore::TransformStore(std::shared_ptr<filament::Engine> i_engine,
+                               ThreadPool& io_pool)
+  : m_engine(std::move(i_engine)), m_pool(&io_pool)
+{
+}
+
+TransformStore::Node
+TransformStore::add(const std::vector<utils::Entity>& i_entities,
+                    const std::vector<filament::math::mat4f>& i_transforms,
+                    Node i_parent)
+{
+  const auto first = static_cast<Node>(size());
+  const auto count = std::min(i_entities.size(), i_transforms.size());
+  const auto total = first + count;
+  for (auto array : {&m_tx, &m_ty, &m_tz, &m_rx, &m_ry, &m_rz, &m_rw})
+    array->reserve(total);
+  for (auto array : {&m_sx, &m_sy, &m_sz})
+    array->reserve(total);
+  m_linear_index.reserve(total);
+  m_world.reserve(total);
+  m_entities.reserve(total);
+
+  const uint32_t depth = i_parent == NONE ? 0 : m_depth[i_parent] + 1;
+  if (depth > m_depths.size())
+    m_depths.resize(depth);
+  auto& transform_manager = m_engine->getTransformManager();
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    // Split the matrix in to translation, rotation and scale, keeping the
+    // upper 3x3 of any that can't be
+    const auto& m = i_transforms[i];
+    flm::quatf rotation;
+    flm::float3 scale;
+    if (decompose(m, rotation, scale))
+      m_linear_index.push_back(NONE);
+    else
+    {
+      m_linear_index.push_back(static_cast<uint32_t>(m_linear.size()));
+      m_linear.emplace_back(m[0].xyz, m[1].xyz, m[2].xyz);
+    }
+    m_tx.push_back(m[3].x);
+    m_ty.push_back(m[3].y);
+    m_tz.push_back(m[3].z);
+    m_rx.push_back(rotation.x);
+    m_ry.push_back(rotation.y);
+    m_rz.push_back(rotation.z);
+    m_rw.push_back(rotation.w);
+    m_sx.push_back(scale.x);
+    m_sy.push_back(scale.y);
+    m_sz.push_back(scale.z);
+    m_parents.push_back(i_parent);
+    m_depth.push_back(depth);
+    m_local_dirty.push_back(1);
+    m_world_dirty.push_back(0);
+    // Nodes are usable straight away, their parents' world matrices are
+    // already known as parents are added first
+    m_world.push_back(i_parent == NONE ? m : m_world[i_parent] * m);
+
+    if (!transform_manager.hasComponent(i_entities[i]))
+      transform_manager.create(i_entities[i]);
+    m_entities.push_back(i_entities[i]);
+    if (depth)
+      m_depths[depth - 1].push_back(static_cast<Node>(first + i));
+  }
+  m_any_dirty = m_any_dirty || count;
+  return first;
+}
+
+std::size_t TransformStore::size() const noexcept
+{
+  return m_parents.size();
+}
+
+filament::math::float3 TransformStore::translation(Node i_node) const noexcept
+{
+  return {m_tx[i_node], m_ty[i_node], m_tz[i_node]};
+}
+
+filament::math::quatf TransformStore::rotation(Node i_node) const noexcept
+{
+  return flm::quatf(m_rw[i_node], m_rx[i_node], m_ry[i_node], m_rz[i_node]);
+}
+
+filament::math::float3 TransformStore::scale(Node i_node) const noexcept
+{
+  return {m_sx[i_node], m_sy[i_node], m_sz[i_node]};
+}
+
+const filament::math::mat4f& TransformStore::world(Node i_node) const noexcept
+{
+  return m_world[i_node];
+}
+
+bool TransformStore::changed(Node i_node) const noexcept
+{
+  return m_world_dirty[i_node];
+}
+
+std::size_t TransformStore::version() const noexcept
+{
+  return m_version;
+}
+
+void TransformStore::set_max_threads(std::size_t i_max_threads) noexcept
+{
+  m_max_threads = i_max_threads;
+}
+
+std::size_t TransformStore::update()
+{
+  // Clear the changes reported by the previous update
+  if (!m_any_dirty)
+  {
+    std::fill(m_world_dirty.begin(), m_world_dirty.end(), 0);
+    return 0;
+  }
+  ScopedTimer timer("update transforms");
+  const auto count = size();
+
+  // Parents always precede their children, so one pass in order propagates
+  // dirtiness down the hierarchy
+  std::size_t dirty = 0;
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    const auto parent = m_parents[i];
+    m_world_dirty[i] =
+      m_local_dirty[i] | (parent != NONE ? m_world_dirty[parent] : 0);
+    dirty += m_world_dirty[i];
+  }
+
+  const std::size_t threads = count < PARALLEL_THRESHOLD ? 1 : m_max_threads;
+  m_pool->parallel_for(
+    count,
+    [this](std::size_t i_begin, std::size_t i_end) {
+      compute_local(i_begin, i_end);
+    },
+    GRAIN,
+    threads);
+
+  // Children hold their local matrices, so apply their parents' world
+  // matrices one depth at a time
+  for (const auto& nodes : m_depths)
+  {
+    m_pool->parallel_for(
+      nodes.size(),
+      [this, &nodes](std::size_t i_begin, std::size_t i_end) {
+        for (auto i = i_begin; i < i_end; ++i)
+        {
+          const auto node = nodes[i];
+          if (m_world_dirty[node])
+            m_world[node] = m_world[m_parents[node]] * m_world[node];
+        }
+      },
+      GRAIN,
+      nodes.size() < PARALLEL_THRESHOLD ? 1 : m_max_threads);
+  }
+
+  {
+    // Only the changed transforms are handed to filament, which defers its
+    // own work until the transaction is committed
+    ScopedTimer commit_timer("commit transforms");
+    auto& transform_manager = m_engine->getTransformManager();
+    transform_manager.openLocalTransformTransaction();
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      if (!m_world_dirty[i])
+        continue;
+      const auto instance = transform_manager.getInstance(m_entities[i]);
+      if (instance)
+        transform_manager.setTransform(instance, m_world[i]);
+    }
+    transform_manager.commitLocalTransformTransaction();
+  }
+
+  std::fill(m_local_dirty.begin(), m_local_dirty.end(), 0);
+  m_any_dirty = false;
+  ++m_version;
+  return dirty;
+}
+
+void TransformStore::compute_local(std::size_t i_begin, std::size_t i_end)
+{
+  if (std::none_of(m_world_dirty.begin() + i_begin,
+                   m_world_dirty.begin() + i_end,
+                   [](uint8_t i_dirty) { return i_dirty; }))
+    return;
+
+  // The rotation and scale are combined in to the upper 3x3 of the matrix,
+  // one array per element, in a branch free loop over the contiguous
+  // components which the compiler vectorizes
+  const auto n = i_end - i_begin;
+  thread_local std::vector<float> elements;
+  elements.resize(9 * n);
+  float* const e[9] = {&elements[0 * n],
+                       &elements[1 * n],
+                       &elements[2 * n],
+                       &elements[3 * n],
+                       &elements[4 * n],
+                       &elements[5 * n],
+                       &elements[6 * n],
+                       &elements[7 * n],
+                       &elements[8 * n]};
+  const float* const rx = m_rx.data() + i_begin;
+  const float* const ry = m_ry.data() + i_begin;
+  const float* const rz = m_rz.data() + i_begin;
+  const float* const rw = m_rw.data() + i_begin;
+  const float* const sx = m_sx.data() + i_begin;
+  const float* const sy = m_sy.data() + i_begin;
+  const float* const sz = m_sz.data() + i_begin;
+  for (std::size_t i = 0; i < n; ++i)
+  {
+    const float xx = rx[i] * rx[i], yy = ry[i] * ry[i], zz = rz[i] * rz[i];
+    const float xy = rx[i] * ry[i], xz = rx[i] * rz[i], yz = ry[i] * rz[i];
+    const float wx = rw[i] * rx[i], wy = rw[i] * ry[i], wz = rw[i] * rz[i];
+    // Column major, each column scaled by its axis
+    e[0][i] = (1.f - 2.f * (yy + zz)) * sx[i];
+    e[1][i] = 2.f * (xy + wz) * sx[i];
+    e[2][i] = 2.f * (xz - wy) * sx[i];
+    e[3][i] = 2.f * (xy - wz) * sy[i];
+    e[4][i] = (1.f - 2.f * (xx + zz)) * sy[i];
+    e[5][i] = 2.f * (yz + wx) * sy[i];
+    e[6][i] = 2.f * (xz + wy) * sz[i];
+    e[7][i] = 2.f * (yz - wx) * sz[i];
+    e[8][i] = (1.f - 2.f * (xx + yy)) * sz[i];
+  }
+
+  // Scatter in to the matrices of the dirty nodes
+  for (std::size_t i = 0; i < n; ++i)
+  {
+    const auto node = i_begin + i;
+    if (!m_world_dirty[node])
+      continue;
+    auto& m = m_world[node];
+    const auto linear = m_linear_index[node];
+    if (linear != NONE)
+    {
+      const auto& l = m_linear[linear];
+      m[0] = {l[0], 0.f};
+      m[1] = {l[1], 0.f};
+      m[2] = {l[2], 0.f};
+    }
+    else
+    {
+      m[0] = {e[0][i], e[1][i], e[2][i], 0.f};
+      m[1] = {e[3][i], e[4][i], e[5][i], 0.f};
+      m[2] = {e[6][i], e[7][i], e[8][i], 0.f};
+    }
+    m[3] = {m_tx[node], m_ty[node], m_tz[node], 1.f};
+  }
+}